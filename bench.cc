@@ -0,0 +1,897 @@
+#include <benchmark/benchmark.h>
+
+#include <sched.h>
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "matrix_async.h"
+#include "matrix_batch.h"
+#include "matrix_decomp.h"
+#include "matrix_fixed.h"
+#include "matrix_generic.h"
+#include "matrix_io.h"
+#include "matrix_numa.h"
+#include "matrix_oop.h"
+#include "matrix_parallel.h"
+#include "matrix_sparse.h"
+#include "matrix_stats.h"
+#include "matrix_strassen.h"
+#include "matrix_structure.h"
+#include "matrix_view.h"
+
+// Every size-parameterized benchmark runs over n x n matrices for n from 2
+// to 4096 and reports GFLOPS and bytes_per_second: the floating point
+// operations of the textbook algorithm and the bytes it has to read and
+// write at least once.
+static void Sizes(benchmark::internal::Benchmark* b) {
+  b->RangeMultiplier(4)->Range(2, 4096);
+}
+
+static void Report(benchmark::State& state, double flops, double bytes) {
+  if (flops > 0)
+    state.counters["GFLOPS"] = benchmark::Counter(
+        flops * state.iterations() / 1e9, benchmark::Counter::kIsRate);
+  if (bytes > 0) state.SetBytesProcessed((int64_t)(bytes * state.iterations()));
+}
+
+static double MatrixBytes(int n) { return (double)n * n * sizeof(double); }
+
+static Matrix FilledMatrix(int rows, int cols) {
+  Matrix m(rows, cols);
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++) m(i, j) = i * 0.5 + j * 0.25;
+  return m;
+}
+
+static Matrix WellConditioned(int n) {
+  Matrix m = FilledMatrix(n, n);
+  for (int i = 0; i < n; i++) m(i, i) += n;
+  return m;
+}
+
+static void BM_Construct(benchmark::State& state) {
+  const int n = state.range(0);
+  for (auto _ : state) {
+    Matrix m(n, n);
+    benchmark::DoNotOptimize(m.GetData());
+  }
+  Report(state, 0, MatrixBytes(n));
+}
+BENCHMARK(BM_Construct)->Apply(Sizes);
+
+static void BM_ConstructList(benchmark::State& state) {
+  std::initializer_list<double> data = {1, 2,  3,  4,  5,  6,  7,  8,
+                                        9, 10, 11, 12, 13, 14, 15, 16};
+  for (auto _ : state) {
+    Matrix m(4, 4, data);
+    benchmark::DoNotOptimize(m.GetData());
+  }
+  Report(state, 0, 2 * MatrixBytes(4));
+}
+BENCHMARK(BM_ConstructList);
+
+static void BM_Copy(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix src = FilledMatrix(n, n);
+  for (auto _ : state) {
+    Matrix m(src);
+    benchmark::DoNotOptimize(m.GetData());
+  }
+  Report(state, 0, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_Copy)->Apply(Sizes);
+
+static void BM_CopyAssign(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix src = FilledMatrix(n, n), dst(n, n);
+  for (auto _ : state) {
+    dst = src;
+    benchmark::DoNotOptimize(dst.GetData());
+  }
+  Report(state, 0, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_CopyAssign)->Apply(Sizes);
+
+static void BM_Move(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n);
+  for (auto _ : state) {
+    Matrix b(std::move(a));
+    a = std::move(b);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+}
+BENCHMARK(BM_Move)->Arg(2)->Arg(4096);
+
+static void BM_ElementWalk(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix m = FilledMatrix(n, n);
+  for (auto _ : state) {
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++) sum += m(i, j);
+    benchmark::DoNotOptimize(sum);
+  }
+  Report(state, (double)n * n, MatrixBytes(n));
+}
+BENCHMARK(BM_ElementWalk)->Apply(Sizes);
+
+static void BM_SetRowsCols(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix m = FilledMatrix(n, n);
+  for (auto _ : state) {
+    m.SetRows(n / 2 + 1);
+    m.SetCols(n / 2 + 1);
+    m.SetRows(n);
+    m.SetCols(n);
+    benchmark::DoNotOptimize(m.GetData());
+  }
+}
+BENCHMARK(BM_SetRowsCols)->Apply(Sizes);
+
+static void BM_EqMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n);
+  for (auto _ : state) benchmark::DoNotOptimize(a.EqMatrix(b));
+  Report(state, 2.0 * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_EqMatrix)->Apply(Sizes);
+
+static void BM_SumMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n);
+  for (auto _ : state) {
+    a.SumMatrix(b);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  Report(state, (double)n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_SumMatrix)->Apply(Sizes);
+
+static void BM_SubMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n);
+  for (auto _ : state) {
+    a.SubMatrix(b);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  Report(state, (double)n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_SubMatrix)->Apply(Sizes);
+
+static void BM_MulNumber(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n);
+  for (auto _ : state) {
+    a.MulNumber(1.0000001);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  Report(state, (double)n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_MulNumber)->Apply(Sizes);
+
+static void BM_MulMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n);
+  for (auto _ : state) {
+    Matrix c(a);
+    c.MulMatrix(b);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_MulMatrix)->Apply(Sizes);
+
+// MulMatrix with Strassen-Winograd above the crossover given as the second
+// argument. GFLOPS counts the classical 2n^3, so it reads as the speedup.
+static void BM_MulMatrixStrassen(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n);
+  SetStrassenCrossover(state.range(1));
+  for (auto _ : state) {
+    Matrix c(a);
+    c.MulMatrix(b);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  SetStrassenCrossover(0);
+  Report(state, 2.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_MulMatrixStrassen)
+    ->ArgsProduct({{1024, 2048, 4096}, {256, 512, 1024}});
+
+// Products into one preallocated destination.
+static void BM_MultiplyInto(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n), c;
+  for (auto _ : state) {
+    Multiply(a, b, c);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_MultiplyInto)->Apply(Sizes);
+
+// The same operations per element type; complex products count the four
+// real multiplies and four real adds of each multiply-add.
+template <typename T>
+static void BM_SumMatrixOf(benchmark::State& state) {
+  const int n = state.range(0);
+  BasicMatrix<T> a = MatrixCast<T>(FilledMatrix(n, n)), b(a);
+  for (auto _ : state) {
+    a.SumMatrix(b);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  Report(state, (double)n * n, 3.0 * n * n * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_SumMatrixOf, float)->Range(2, 4096);
+BENCHMARK_TEMPLATE(BM_SumMatrixOf, double)->Range(2, 4096);
+BENCHMARK_TEMPLATE(BM_SumMatrixOf, std::complex<double>)->Range(2, 4096);
+BENCHMARK_TEMPLATE(BM_SumMatrixOf, int)->Range(2, 4096);
+
+template <typename T>
+static void BM_MulMatrixOf(benchmark::State& state) {
+  const int n = state.range(0);
+  BasicMatrix<T> a = MatrixCast<T>(FilledMatrix(n, n)), b(a);
+  for (auto _ : state) {
+    BasicMatrix<T> c(a);
+    c.MulMatrix(b);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  const double flops = sizeof(T) == sizeof(std::complex<double>) ? 8.0 : 2.0;
+  Report(state, flops * n * n * n, 3.0 * n * n * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_MulMatrixOf, float)->Range(2, 1024);
+BENCHMARK_TEMPLATE(BM_MulMatrixOf, double)->Range(2, 1024);
+BENCHMARK_TEMPLATE(BM_MulMatrixOf, std::complex<double>)->Range(2, 1024);
+BENCHMARK_TEMPLATE(BM_MulMatrixOf, int)->Range(2, 1024);
+
+static void BM_Transpose(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n);
+  for (auto _ : state) {
+    Matrix t = a.Transpose();
+    benchmark::DoNotOptimize(t.GetData());
+  }
+  Report(state, 0, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_Transpose)->Apply(Sizes);
+
+static void BM_TransposeInPlace(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n);
+  for (auto _ : state) {
+    a.TransposeInPlace();
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  Report(state, 0, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_TransposeInPlace)->Apply(Sizes);
+
+// A * B^T through the transposed view, no transposed copy of B.
+static void BM_MulTransposed(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n), c;
+  for (auto _ : state) {
+    c = a * Transposed(b);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_MulTransposed)->Apply(Sizes);
+
+// Structured operands. GFLOPS are counted as for the dense product, so they
+// show the speedup over BM_MulTransposed and BM_MulMatrix directly.
+static Matrix UpperTriangular(int n) {
+  Matrix m = WellConditioned(n);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < i; j++) m(i, j) = 0;
+  return m;
+}
+
+static Matrix Tridiagonal(int n) {
+  Matrix m(n, n);
+  for (int i = 0; i < n; i++) {
+    m(i, i) = 4;
+    if (i > 0) m(i, i - 1) = m(i - 1, i) = -1;
+  }
+  return m;
+}
+
+// A * A^T, SYRK.
+static void BM_MulTransposedSelf(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), c;
+  for (auto _ : state) {
+    c = a * Transposed(a);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_MulTransposedSelf)->Apply(Sizes);
+
+static void BM_MulTriangular(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = UpperTriangular(n), b = FilledMatrix(n, n), c;
+  for (auto _ : state) {
+    c = a * b;
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_MulTriangular)->Apply(Sizes);
+
+static void BM_DeterminantTriangular(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = UpperTriangular(n);
+  for (auto _ : state) benchmark::DoNotOptimize(a.Determinant());
+  Report(state, 2.0 / 3 * n * n * n, MatrixBytes(n));
+}
+BENCHMARK(BM_DeterminantTriangular)->Apply(Sizes);
+
+static void BM_InverseTridiagonal(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = Tridiagonal(n);
+  for (auto _ : state) {
+    Matrix inv = a.InverseMatrix();
+    benchmark::DoNotOptimize(inv.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_InverseTridiagonal)->Apply(Sizes);
+
+// A * B and A^-1 * B for packed symmetric A, B with 16 columns.
+static void BM_PackedMulMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix dense = WellConditioned(n);
+  dense += dense.Transpose();
+  PackedMatrix a(dense, Packing::kSymmetric);
+  Matrix b = FilledMatrix(n, 16);
+  for (auto _ : state) {
+    Matrix c = a * b;
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * n * n * 16, MatrixBytes(n) / 2);
+}
+BENCHMARK(BM_PackedMulMatrix)->RangeMultiplier(4)->Range(2, 4096);
+
+// C11 += A11 * B12 on the n/2 x n/2 quadrants of n x n matrices, through
+// views, against copying the quadrants out and the result back.
+static void BM_MulBlockView(benchmark::State& state) {
+  const int n = state.range(0), h = n / 2;
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n), c = FilledMatrix(n, n);
+  for (auto _ : state) {
+    MatrixView(c).Block(0, 0, h, h) +=
+        MatrixView(a).Block(0, 0, h, h) * MatrixView(b).Block(0, h, h, h);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * h * h * h, 4 * MatrixBytes(h));
+}
+BENCHMARK(BM_MulBlockView)->Apply(Sizes);
+
+static void BM_MulBlockCopy(benchmark::State& state) {
+  const int n = state.range(0), h = n / 2;
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n), c = FilledMatrix(n, n);
+  for (auto _ : state) {
+    Matrix a11(h, h), b12(h, h), c11(h, h);
+    for (int i = 0; i < h; i++)
+      for (int j = 0; j < h; j++) {
+        a11(i, j) = a(i, j);
+        b12(i, j) = b(i, h + j);
+        c11(i, j) = c(i, j);
+      }
+    c11 += a11 * b12;
+    for (int i = 0; i < h; i++)
+      for (int j = 0; j < h; j++) c(i, j) = c11(i, j);
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * h * h * h, 4 * MatrixBytes(h));
+}
+BENCHMARK(BM_MulBlockCopy)->Apply(Sizes);
+
+// A * B + B * A and A * A + B * B: four independent products, one after
+// another and as a MatrixGraph that overlaps them, which pays off while a
+// single product can't keep every thread busy. The graph copies A and B in
+// each iteration.
+static void BM_ProductsSerial(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = WellConditioned(n);
+  for (auto _ : state) {
+    Matrix x = a * b + b * a, y = a * a + b * b;
+    benchmark::DoNotOptimize(x.GetData());
+    benchmark::DoNotOptimize(y.GetData());
+  }
+  Report(state, 8.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_ProductsSerial)->Apply(Sizes)->UseRealTime();
+
+static void BM_ProductsGraph(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = WellConditioned(n);
+  for (auto _ : state) {
+    MatrixGraph graph;
+    const int x = graph.Input(a), y = graph.Input(b);
+    graph.Sum(graph.Mul(x, y), graph.Mul(y, x));
+    graph.Sum(graph.Mul(x, x), graph.Mul(y, y));
+    graph.Run();
+    benchmark::DoNotOptimize(graph.Get(graph.GetSize() - 1).GetData());
+  }
+  Report(state, 8.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_ProductsGraph)->Apply(Sizes)->UseRealTime();
+
+// A + B * 2 - C evaluated as one fused expression, against the eager
+// sequence of whole-matrix passes it replaces.
+static void BM_FusedExpression(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n), c = FilledMatrix(n, n);
+  Matrix r(n, n);
+  for (auto _ : state) {
+    r = a + b * 2.0 - c;
+    benchmark::DoNotOptimize(r.GetData());
+  }
+  Report(state, 3.0 * n * n, 4 * MatrixBytes(n));
+}
+BENCHMARK(BM_FusedExpression)->Apply(Sizes);
+
+static void BM_EagerExpression(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n), c = FilledMatrix(n, n);
+  for (auto _ : state) {
+    Matrix scaled(b);
+    scaled.MulNumber(2.0);
+    Matrix r(a);
+    r.SumMatrix(scaled);
+    r.SubMatrix(c);
+    benchmark::DoNotOptimize(r.GetData());
+  }
+  Report(state, 3.0 * n * n, 4 * MatrixBytes(n));
+}
+BENCHMARK(BM_EagerExpression)->Apply(Sizes);
+
+static void BM_Determinant(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n);
+  for (auto _ : state) benchmark::DoNotOptimize(a.Determinant());
+  Report(state, 2.0 / 3 * n * n * n, MatrixBytes(n));
+}
+BENCHMARK(BM_Determinant)->Apply(Sizes);
+
+static void BM_InverseMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n);
+  for (auto _ : state) {
+    Matrix inv = a.InverseMatrix();
+    benchmark::DoNotOptimize(inv.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_InverseMatrix)->Apply(Sizes);
+
+// Float LU, refined to double accuracy column by column.
+static void BM_InverseMixed(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n);
+  for (auto _ : state) {
+    Matrix inv = a.InverseMatrix(Precision::kMixed);
+    benchmark::DoNotOptimize(inv.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_InverseMixed)->Apply(Sizes);
+
+static void BM_CalcComplements(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n);
+  for (auto _ : state) {
+    Matrix c = a.CalcComplements();
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_CalcComplements)->Apply(Sizes);
+
+// A * x = b for one right-hand side, through the inverse and through each
+// factorization. WellConditioned() isn't symmetric, so Cholesky gets
+// A^T * A + n * I.
+static void BM_SolveInverse(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n), b = FilledMatrix(n, 1);
+  for (auto _ : state) {
+    Matrix x = a.InverseMatrix() * b;
+    benchmark::DoNotOptimize(x.GetData());
+  }
+  Report(state, 2.0 * n * n * n, MatrixBytes(n));
+}
+BENCHMARK(BM_SolveInverse)->Apply(Sizes);
+
+static void BM_SolveLU(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n), b = FilledMatrix(n, 1);
+  for (auto _ : state) {
+    Matrix x = LU(a).Solve(b);
+    benchmark::DoNotOptimize(x.GetData());
+  }
+  Report(state, 2.0 / 3 * n * n * n, MatrixBytes(n));
+}
+BENCHMARK(BM_SolveLU)->Apply(Sizes);
+
+static void BM_SolveCholesky(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n);
+  a = a.Transpose() * a;
+  for (int i = 0; i < n; i++) a(i, i) += n;
+  Matrix b = FilledMatrix(n, 1);
+  for (auto _ : state) {
+    Matrix x = Cholesky(a).Solve(b);
+    benchmark::DoNotOptimize(x.GetData());
+  }
+  Report(state, 1.0 / 3 * n * n * n, MatrixBytes(n));
+}
+BENCHMARK(BM_SolveCholesky)->Apply(Sizes);
+
+// Same flops as BM_SolveLU: the factorization runs in float, the
+// refinement steps add O(n^2) each.
+static void BM_SolveMixed(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n), b = FilledMatrix(n, 1);
+  for (auto _ : state) {
+    Matrix x = Solve(a, b, Precision::kMixed);
+    benchmark::DoNotOptimize(x.GetData());
+  }
+  Report(state, 2.0 / 3 * n * n * n, MatrixBytes(n));
+}
+BENCHMARK(BM_SolveMixed)->Apply(Sizes);
+
+// Least squares for 2n x n. The QR is unblocked, so it stops at 1024.
+static void BM_SolveQR(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(2 * n, n), b = FilledMatrix(2 * n, 1);
+  for (int i = 0; i < n; i++) a(i, i) += n;
+  for (auto _ : state) {
+    Matrix x = QR(a).Solve(b);
+    benchmark::DoNotOptimize(x.GetData());
+  }
+  Report(state, 2.0 * n * n * (2 * n - n / 3.0), 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_SolveQR)->RangeMultiplier(4)->Range(2, 1024);
+
+// Values and vectors. The flop counts are LAPACK's usual estimates: 4/3 n^3
+// for the reduction, 4/3 n^3 to form Q and about 6 n^3 for the rotations.
+static void BM_SymmetricEigen(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n);
+  a += a.Transpose();
+  for (auto _ : state) {
+    SymmetricEigen eigen(a);
+    benchmark::DoNotOptimize(eigen.GetVectors().GetData());
+  }
+  Report(state, 9.0 * n * n * n, 2 * MatrixBytes(n));
+}
+BENCHMARK(BM_SymmetricEigen)->RangeMultiplier(4)->Range(2, 1024);
+
+static void BM_SVD(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = WellConditioned(n);
+  for (auto _ : state) {
+    SVD svd(a);
+    benchmark::DoNotOptimize(svd.GetU().GetData());
+  }
+  Report(state, 21.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_SVD)->RangeMultiplier(4)->Range(2, 1024);
+
+// File I/O through the page cache, so these measure the format's own cost
+// rather than the disk.
+static const char* kBenchFile = "matrix_bench.bin";
+
+static void BM_SaveMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n);
+  for (auto _ : state) SaveMatrix(a, kBenchFile);
+  std::remove(kBenchFile);
+  Report(state, 0, MatrixBytes(n));
+}
+BENCHMARK(BM_SaveMatrix)->Apply(Sizes);
+
+static void BM_LoadMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  SaveMatrix(FilledMatrix(n, n), kBenchFile);
+  for (auto _ : state) {
+    Matrix a = LoadMatrix(kBenchFile);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  std::remove(kBenchFile);
+  Report(state, 0, MatrixBytes(n));
+}
+BENCHMARK(BM_LoadMatrix)->Apply(Sizes);
+
+// Opening alone, which doesn't depend on the size.
+static void BM_MapMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  SaveMatrix(FilledMatrix(n, n), kBenchFile);
+  for (auto _ : state) {
+    Matrix a = MapMatrix(kBenchFile);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  std::remove(kBenchFile);
+}
+BENCHMARK(BM_MapMatrix)->Apply(Sizes);
+
+// Out-of-core product with a budget of a quarter of one operand, so the
+// tiles are 1/5 of n on a side and every operand is read several times.
+static void BM_MultiplyFiles(benchmark::State& state) {
+  const int n = state.range(0);
+  SaveMatrix(FilledMatrix(n, n), "matrix_bench_a.bin");
+  SaveMatrix(WellConditioned(n), "matrix_bench_b.bin");
+  for (auto _ : state)
+    MultiplyFiles("matrix_bench_a.bin", "matrix_bench_b.bin", kBenchFile,
+                  MatrixBytes(n) / 4);
+  for (const char* path : {"matrix_bench_a.bin", "matrix_bench_b.bin",
+                           kBenchFile})
+    std::remove(path);
+  Report(state, 2.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_MultiplyFiles)->RangeMultiplier(4)->Range(256, 4096);
+
+// The text output that used to be the only way to persist a matrix.
+static void BM_WriteText(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n);
+  for (auto _ : state) {
+    std::ofstream out(kBenchFile);
+    out << a;
+  }
+  std::remove(kBenchFile);
+  Report(state, 0, MatrixBytes(n));
+}
+BENCHMARK(BM_WriteText)->RangeMultiplier(4)->Range(2, 1024);
+
+// Shortest round-trip text through SaveMatrixText and back.
+static void BM_SaveText(benchmark::State& state) {
+  const int n = state.range(0);
+  Matrix a = FilledMatrix(n, n);
+  for (auto _ : state) SaveMatrixText(a, kBenchFile);
+  std::remove(kBenchFile);
+  Report(state, 0, MatrixBytes(n));
+}
+BENCHMARK(BM_SaveText)->RangeMultiplier(4)->Range(2, 4096)->UseRealTime();
+
+static void BM_LoadText(benchmark::State& state) {
+  const int n = state.range(0);
+  SaveMatrixText(FilledMatrix(n, n), kBenchFile);
+  for (auto _ : state) {
+    Matrix a = LoadMatrixText(kBenchFile);
+    benchmark::DoNotOptimize(a.GetData());
+  }
+  std::remove(kBenchFile);
+  Report(state, 0, MatrixBytes(n));
+}
+BENCHMARK(BM_LoadText)->RangeMultiplier(4)->Range(2, 4096)->UseRealTime();
+
+// n x n with about 1% of the entries stored.
+static SparseMatrix SparseSample(int n) {
+  std::vector<Triplet> triplets;
+  for (int i = 0; i < n; i++)
+    for (int j = (i * 37) % 100; j < n; j += 100)
+      triplets.push_back({i, j, i * 0.5 + j * 0.25});
+  return SparseMatrix(n, n, triplets);
+}
+
+static double SparseBytes(const SparseMatrix& a) {
+  return a.GetNonZeros() * (sizeof(double) + sizeof(int)) +
+         a.GetRows() * sizeof(long);
+}
+
+static void BM_SparseMulVector(benchmark::State& state) {
+  const int n = state.range(0);
+  SparseMatrix a = SparseSample(n);
+  std::vector<double> x(n, 1.0);
+  for (auto _ : state) benchmark::DoNotOptimize(a.MulVector(x).data());
+  Report(state, 2.0 * a.GetNonZeros(), SparseBytes(a) + 2.0 * n * 8);
+}
+BENCHMARK(BM_SparseMulVector)->Apply(Sizes);
+
+// Sparse n x n times a dense n x 64 block.
+static void BM_SparseMulMatrix(benchmark::State& state) {
+  const int n = state.range(0);
+  SparseMatrix a = SparseSample(n);
+  Matrix b = FilledMatrix(n, 64);
+  for (auto _ : state) {
+    Matrix c = a * b;
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  Report(state, 2.0 * 64 * a.GetNonZeros(), SparseBytes(a) + 2.0 * n * 64 * 8);
+}
+BENCHMARK(BM_SparseMulMatrix)->Apply(Sizes);
+
+static void BM_SparseTranspose(benchmark::State& state) {
+  const int n = state.range(0);
+  SparseMatrix a = SparseSample(n);
+  for (auto _ : state) {
+    SparseMatrix t = a.Transpose();
+    benchmark::DoNotOptimize(t.GetValues().data());
+  }
+  Report(state, 0, 2 * SparseBytes(a));
+}
+BENCHMARK(BM_SparseTranspose)->Apply(Sizes);
+
+static void BM_SparseSum(benchmark::State& state) {
+  const int n = state.range(0);
+  SparseMatrix a = SparseSample(n), b = SparseSample(n).Transpose();
+  for (auto _ : state) {
+    SparseMatrix c = a + b;
+    benchmark::DoNotOptimize(c.GetValues().data());
+  }
+  Report(state, a.GetNonZeros(), 4 * SparseBytes(a));
+}
+BENCHMARK(BM_SparseSum)->Apply(Sizes);
+
+// Batches of 4x4 transforms composed with one another and inverted, the
+// shape that FixedMatrix is meant for.
+static Matrix Transform4x4(int seed) {
+  Matrix m = FilledMatrix(4, 4);
+  for (int i = 0; i < 4; i++) m(i, i) += 4 + seed % 7;
+  return m;
+}
+
+static void BM_Transform4x4Dynamic(benchmark::State& state) {
+  std::vector<Matrix> batch;
+  for (int b = 0; b < state.range(0); b++) batch.push_back(Transform4x4(b));
+  Matrix t = Transform4x4(3);
+  for (auto _ : state)
+    for (const Matrix& m : batch) {
+      Matrix r = m * t;
+      benchmark::DoNotOptimize(r.GetData());
+    }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Transform4x4Dynamic)->Arg(1024);
+
+static void BM_Transform4x4Fixed(benchmark::State& state) {
+  std::vector<FixedMatrix<4, 4>> batch;
+  for (int b = 0; b < state.range(0); b++)
+    batch.emplace_back(Transform4x4(b));
+  FixedMatrix<4, 4> t(Transform4x4(3));
+  for (auto _ : state)
+    for (const FixedMatrix<4, 4>& m : batch) {
+      FixedMatrix<4, 4> r = m * t;
+      benchmark::DoNotOptimize(r);
+    }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Transform4x4Fixed)->Arg(1024);
+
+static void BM_Inverse4x4Dynamic(benchmark::State& state) {
+  std::vector<Matrix> batch;
+  for (int b = 0; b < state.range(0); b++) batch.push_back(Transform4x4(b));
+  for (auto _ : state)
+    for (const Matrix& m : batch) {
+      Matrix r = m.InverseMatrix();
+      benchmark::DoNotOptimize(r.GetData());
+    }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Inverse4x4Dynamic)->Arg(1024);
+
+static void BM_Inverse4x4Fixed(benchmark::State& state) {
+  std::vector<FixedMatrix<4, 4>> batch;
+  for (int b = 0; b < state.range(0); b++)
+    batch.emplace_back(Transform4x4(b));
+  for (auto _ : state)
+    for (const FixedMatrix<4, 4>& m : batch) {
+      FixedMatrix<4, 4> r = m.InverseMatrix();
+      benchmark::DoNotOptimize(r);
+    }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Inverse4x4Fixed)->Arg(1024);
+
+static MatrixBatch Transform4x4Batch(int count) {
+  MatrixBatch batch(count, 4, 4);
+  for (int b = 0; b < count; b++) batch.Set(b, Transform4x4(b));
+  return batch;
+}
+
+static void BM_Transform4x4Batch(benchmark::State& state) {
+  MatrixBatch batch = Transform4x4Batch(state.range(0));
+  MatrixBatch t(state.range(0), 4, 4);
+  for (int b = 0; b < state.range(0); b++) t.Set(b, Transform4x4(3));
+  for (auto _ : state) {
+    MatrixBatch r = batch * t;
+    benchmark::DoNotOptimize(&r(0, 0, 0));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Transform4x4Batch)->Arg(1024)->Arg(1 << 16);
+
+static void BM_Inverse4x4Batch(benchmark::State& state) {
+  MatrixBatch batch = Transform4x4Batch(state.range(0));
+  for (auto _ : state) {
+    MatrixBatch r = batch.InverseMatrix();
+    benchmark::DoNotOptimize(&r(0, 0, 0));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Inverse4x4Batch)->Arg(1024)->Arg(1 << 16);
+
+static void BM_Determinant4x4Batch(benchmark::State& state) {
+  MatrixBatch batch = Transform4x4Batch(state.range(0));
+  for (auto _ : state) {
+    std::vector<double> r = batch.Determinant();
+    benchmark::DoNotOptimize(r.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Determinant4x4Batch)->Arg(1024)->Arg(1 << 16);
+
+// Streaming read of 128 MiB bound to the node of the reading thread (0)
+// or to another one (1), pinned to node 0. With one node there is nothing
+// remote, and the remote run is skipped.
+static void BM_NumaBandwidth(benchmark::State& state) {
+  const bool remote = state.range(0);
+  const int nodes = GetNumaNodes();
+  if (remote && nodes < 2) {
+    state.SkipWithError("one NUMA node, no remote memory");
+    return;
+  }
+  cpu_set_t saved;
+  sched_getaffinity(0, sizeof(saved), &saved);
+  PinCurrentThread(0);
+  const std::size_t count = std::size_t(1) << 24;
+  NumaAllocator numa(NumaPolicy::kBind, remote ? nodes - 1 : 0);
+  double* data = static_cast<double*>(numa.Allocate(count * sizeof(double)));
+  for (std::size_t i = 0; i < count; i++) data[i] = 1;
+  for (auto _ : state) {
+    double sum = 0;
+    for (std::size_t i = 0; i < count; i++) sum += data[i];
+    benchmark::DoNotOptimize(sum);
+  }
+  numa.Deallocate(data, count * sizeof(double));
+  sched_setaffinity(0, sizeof(saved), &saved);
+  state.SetLabel(remote ? "remote" : "local");
+  Report(state, 0, count * sizeof(double));
+}
+BENCHMARK(BM_NumaBandwidth)->Arg(0)->Arg(1)->UseRealTime();
+
+// Product on the pinned pool with its operands and result first touched
+// by the workers (0), interleaved over the nodes (1) or, as before
+// NumaAllocator, first touched by one thread (2).
+static void BM_MulMatrixPlacement(benchmark::State& state) {
+  const int n = 1024, placement = state.range(0);
+  NumaAllocator numa(placement == 1 ? NumaPolicy::kInterleave
+                                    : NumaPolicy::kFirstTouch);
+  SetThreadPinning(true);
+  if (placement < 2) SetMatrixAllocator(&numa);
+  {
+    ThreadLimit serial(placement == 2 ? 1 : 0);
+    Matrix a = FilledMatrix(n, n), b = FilledMatrix(n, n), c(n, n);
+    ThreadLimit all(0);
+    for (auto _ : state) {
+      Multiply(a, b, c);
+      benchmark::DoNotOptimize(c.GetData());
+    }
+  }
+  SetMatrixAllocator(nullptr);
+  SetThreadPinning(false);
+  Report(state, 2.0 * n * n * n, 3 * MatrixBytes(n));
+}
+BENCHMARK(BM_MulMatrixPlacement)->DenseRange(0, 2)->UseRealTime();
+
+// 4x4 construct, copy and multiply with recording off (0) and on (1), the
+// cheapest calls the instrumentation hooks sit on.
+static void BM_StatsOverhead(benchmark::State& state) {
+  Matrix a = FilledMatrix(4, 4);
+  SetStatsEnabled(state.range(0));
+  for (auto _ : state) {
+    Matrix b(a), c(4, 4);
+    c = a * b;
+    benchmark::DoNotOptimize(c.GetData());
+  }
+  SetStatsEnabled(false);
+  ResetStats();
+}
+BENCHMARK(BM_StatsOverhead)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
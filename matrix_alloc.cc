@@ -0,0 +1,81 @@
+#include "matrix_alloc.h"
+
+#include <atomic>
+#include <new>
+
+void* HeapAllocator::Allocate(std::size_t bytes) {
+  return ::operator new(bytes, std::align_val_t(kMatrixAlignment));
+}
+
+void HeapAllocator::Deallocate(void* block, std::size_t) {
+  ::operator delete(block, std::align_val_t(kMatrixAlignment));
+}
+
+PoolAllocator::PoolAllocator(std::size_t max_block) : max_block_(max_block) {}
+
+PoolAllocator::~PoolAllocator() { Release(); }
+
+int PoolAllocator::SizeClass(std::size_t bytes) {
+  int c = 6;
+  while ((std::size_t(1) << c) < bytes) c++;
+  return c;
+}
+
+void* PoolAllocator::Allocate(std::size_t bytes) {
+  if (bytes > max_block_)
+    return ::operator new(bytes, std::align_val_t(kMatrixAlignment));
+  const int c = SizeClass(bytes);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (FreeBlock* block = free_[c]) {
+      free_[c] = block->next;
+      cached_bytes_ -= std::size_t(1) << c;
+      return block;
+    }
+  }
+  return ::operator new(std::size_t(1) << c,
+                        std::align_val_t(kMatrixAlignment));
+}
+
+void PoolAllocator::Deallocate(void* block, std::size_t bytes) {
+  if (bytes > max_block_) {
+    ::operator delete(block, std::align_val_t(kMatrixAlignment));
+    return;
+  }
+  const int c = SizeClass(bytes);
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_[c] = new (block) FreeBlock{free_[c]};
+  cached_bytes_ += std::size_t(1) << c;
+}
+
+void PoolAllocator::Release() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (FreeBlock*& head : free_)
+    while (FreeBlock* block = head) {
+      head = block->next;
+      ::operator delete(block, std::align_val_t(kMatrixAlignment));
+    }
+  cached_bytes_ = 0;
+}
+
+std::size_t PoolAllocator::GetCachedBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cached_bytes_;
+}
+
+static std::atomic<MatrixAllocator*> matrix_allocator{nullptr};
+
+// Never destroyed, so static matrices can still free their storage at exit.
+static MatrixAllocator* DefaultAllocator() {
+  static MatrixAllocator* heap = new HeapAllocator;
+  return heap;
+}
+
+void SetMatrixAllocator(MatrixAllocator* allocator) {
+  matrix_allocator = allocator;
+}
+
+MatrixAllocator* GetMatrixAllocator() {
+  MatrixAllocator* allocator = matrix_allocator;
+  return allocator ? allocator : DefaultAllocator();
+}
@@ -0,0 +1,63 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_ALLOC_H
+#define CPP1__MATRIXPLUS_0__MATRIX_ALLOC_H
+
+#include <cstddef>
+#include <mutex>
+
+// Alignment of every Matrix buffer: one cache line, which is also the
+// widest vector load the kernels use.
+constexpr std::size_t kMatrixAlignment = 64;
+
+// Source of Matrix storage. Blocks are aligned to kMatrixAlignment and are
+// returned with the size they were requested with. An allocator must
+// outlive every Matrix whose storage it provided.
+class MatrixAllocator {
+ public:
+  virtual ~MatrixAllocator() = default;
+  virtual void* Allocate(std::size_t bytes) = 0;
+  virtual void Deallocate(void* block, std::size_t bytes) = 0;
+};
+
+// Aligned operator new and delete, the default.
+class HeapAllocator : public MatrixAllocator {
+ public:
+  void* Allocate(std::size_t bytes) override;
+  void Deallocate(void* block, std::size_t bytes) override;
+};
+
+// Caches freed blocks in power-of-two size classes and hands them out
+// again, so a loop creating same-sized temporaries stops reaching the heap
+// after its first iteration. Blocks above max_block bypass the cache.
+// Thread safe; cached blocks are freed by Release() or the destructor.
+class PoolAllocator : public MatrixAllocator {
+ public:
+  explicit PoolAllocator(std::size_t max_block = std::size_t(1) << 26);
+  ~PoolAllocator() override;
+  PoolAllocator(const PoolAllocator&) = delete;
+  PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+  void* Allocate(std::size_t bytes) override;
+  void Deallocate(void* block, std::size_t bytes) override;
+  void Release();
+  std::size_t GetCachedBytes() const;
+
+ private:
+  static constexpr int kClasses = 48;
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+  static int SizeClass(std::size_t bytes);
+
+  std::size_t max_block_;
+  std::size_t cached_bytes_{0};
+  FreeBlock* free_[kClasses]{};
+  mutable std::mutex mutex_;
+};
+
+// Allocator new Matrix storage is drawn from; nullptr restores the
+// HeapAllocator. Existing matrices keep returning storage to the allocator
+// that provided it.
+void SetMatrixAllocator(MatrixAllocator* allocator);
+MatrixAllocator* GetMatrixAllocator();
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_ALLOC_H
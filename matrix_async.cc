@@ -0,0 +1,270 @@
+#include "matrix_async.h"
+
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix_decomp.h"
+#include "matrix_parallel.h"
+
+// Runs fn on the pool; packaged_task carries its result or exception to
+// the future. std::function needs a copyable task, hence the shared_ptr.
+template <typename Fn>
+static auto Launch(Fn fn) -> std::future<decltype(fn())> {
+  using Result = decltype(fn());
+  auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+  std::future<Result> result = task->get_future();
+  GetThreadPool()->Submit([task] { (*task)(); });
+  return result;
+}
+
+std::future<Matrix> SumMatrixAsync(Matrix a, Matrix b) {
+  return Launch([a = std::move(a), b = std::move(b)]() mutable {
+    a.SumMatrix(b);
+    return std::move(a);
+  });
+}
+
+std::future<Matrix> SubMatrixAsync(Matrix a, Matrix b) {
+  return Launch([a = std::move(a), b = std::move(b)]() mutable {
+    a.SubMatrix(b);
+    return std::move(a);
+  });
+}
+
+std::future<Matrix> MulMatrixAsync(Matrix a, Matrix b) {
+  return Launch([a = std::move(a), b = std::move(b)]() mutable {
+    a.MulMatrix(b);
+    return std::move(a);
+  });
+}
+
+std::future<Matrix> MulNumberAsync(Matrix a, double num) {
+  return Launch([a = std::move(a), num]() mutable {
+    a.MulNumber(num);
+    return std::move(a);
+  });
+}
+
+std::future<Matrix> TransposeAsync(Matrix a) {
+  return Launch([a = std::move(a)] { return a.Transpose(); });
+}
+
+std::future<Matrix> InverseAsync(Matrix a) {
+  return Launch([a = std::move(a)] { return a.InverseMatrix(); });
+}
+
+std::future<double> DeterminantAsync(Matrix a) {
+  return Launch([a = std::move(a)] { return a.Determinant(); });
+}
+
+std::future<Matrix> SolveAsync(Matrix a, Matrix b) {
+  return Launch([a = std::move(a), b = std::move(b)] { return Solve(a, b); });
+}
+
+MatrixGraph::MatrixGraph() {}
+
+const MatrixGraph::Node& MatrixGraph::Operand(int node) const {
+  if (node < 0 || node >= GetSize())
+    throw std::out_of_range("Incorrect input, index is out of range");
+  const Node& operand = nodes_[node];
+  if (operand.done && operand.value.GetRows() == 0)
+    throw std::invalid_argument("Result of the node was released!");
+  return operand;
+}
+
+int MatrixGraph::AddNode(Op op, int a, int b, double num, int rows,
+                         int cols) {
+  const int id = GetSize();
+  nodes_.push_back({op, a, b, num, rows, cols, false, false, 0, 0, {}, {}});
+  // Run() counts the uses of the nodes it runs; a node that has already
+  // run gets its new consumers counted here.
+  for (int operand : {a, b}) {
+    if (operand < 0) continue;
+    nodes_[operand].consumers.push_back(id);
+    if (nodes_[operand].done) nodes_[operand].uses++;
+  }
+  return id;
+}
+
+int MatrixGraph::Input(Matrix m) {
+  const int id = AddNode(Op::kInput, -1, -1, 0, m.GetRows(), m.GetCols());
+  Node& node = nodes_[id];
+  node.value = std::move(m);
+  node.keep = node.done = true;
+  return id;
+}
+
+int MatrixGraph::Sum(int a, int b) {
+  const Node &x = Operand(a), &y = Operand(b);
+  if (x.rows != y.rows || x.cols != y.cols)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  return AddNode(Op::kSum, a, b, 0, x.rows, x.cols);
+}
+
+int MatrixGraph::Sub(int a, int b) {
+  const Node &x = Operand(a), &y = Operand(b);
+  if (x.rows != y.rows || x.cols != y.cols)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  return AddNode(Op::kSub, a, b, 0, x.rows, x.cols);
+}
+
+int MatrixGraph::Mul(int a, int b) {
+  const Node &x = Operand(a), &y = Operand(b);
+  if (x.cols != y.rows)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  return AddNode(Op::kMul, a, b, 0, x.rows, y.cols);
+}
+
+int MatrixGraph::MulNumber(int a, double num) {
+  const Node& x = Operand(a);
+  return AddNode(Op::kMulNumber, a, -1, num, x.rows, x.cols);
+}
+
+int MatrixGraph::Transpose(int a) {
+  const Node& x = Operand(a);
+  return AddNode(Op::kTranspose, a, -1, 0, x.cols, x.rows);
+}
+
+int MatrixGraph::Inverse(int a) {
+  const Node& x = Operand(a);
+  if (x.rows != x.cols)
+    throw std::invalid_argument("This matrix has no inverse matrix!");
+  return AddNode(Op::kInverse, a, -1, 0, x.rows, x.cols);
+}
+
+int MatrixGraph::Solve(int a, int b) {
+  const Node &x = Operand(a), &y = Operand(b);
+  if (x.rows != y.rows)
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix rows number!");
+  return AddNode(Op::kSolve, a, b, 0, x.cols, y.cols);
+}
+
+void MatrixGraph::Keep(int node) {
+  if (node < 0 || node >= GetSize())
+    throw std::out_of_range("Incorrect input, index is out of range");
+  nodes_[node].keep = true;
+}
+
+void MatrixGraph::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  reused_ = 0;
+  error_ = nullptr;
+  std::vector<int> ready;
+  for (int i = 0; i < GetSize(); i++) {
+    Node& node = nodes_[i];
+    if (node.done) continue;
+    if (node.consumers.empty()) node.keep = true;
+    node.uses = (int)node.consumers.size();
+    node.waiting = (node.a >= 0 && !nodes_[node.a].done) +
+                   (node.b >= 0 && !nodes_[node.b].done);
+    if (node.waiting == 0) ready.push_back(i);
+  }
+  for (int i : ready) Start(i);
+  done_.wait(lock, [this] { return running_ == 0; });
+  spares_.clear();
+  if (error_) std::rethrow_exception(error_);
+}
+
+// Called with mutex_ held.
+void MatrixGraph::Start(int node) {
+  running_++;
+  GetThreadPool()->Submit([this, node] { Execute(node); });
+}
+
+// Called with mutex_ held. The smallest spare buffer that fits, so large
+// ones stay for the nodes that need them.
+Matrix MatrixGraph::TakeSpare(const Node& node) {
+  const long needed = (long)node.rows * Matrix::LeadingDimension(node.cols);
+  int best = -1;
+  for (int i = 0; i < (int)spares_.size(); i++) {
+    const long size = (long)spares_[i].GetRows() * spares_[i].GetStride();
+    if (size >= needed &&
+        (best < 0 ||
+         size < (long)spares_[best].GetRows() * spares_[best].GetStride()))
+      best = i;
+  }
+  if (best < 0) return Matrix();
+  Matrix spare = std::move(spares_[best]);
+  spares_.erase(spares_.begin() + best);
+  reused_++;
+  return spare;
+}
+
+// Operands are done and aren't released before this node finishes, so
+// they are read without the lock; only this task writes the node's value.
+void MatrixGraph::Execute(int id) {
+  Node& node = nodes_[id];
+  std::exception_ptr error;
+  try {
+    Matrix out;
+    if (node.op != Op::kInverse && node.op != Op::kSolve) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      out = TakeSpare(node);
+    }
+    const Matrix& a = nodes_[node.a].value;
+    const Matrix& b = nodes_[node.b >= 0 ? node.b : node.a].value;
+    switch (node.op) {
+      case Op::kSum:
+        Add(a, b, out);
+        break;
+      case Op::kSub:
+        Subtract(a, b, out);
+        break;
+      case Op::kMul:
+        Multiply(a, b, out);
+        break;
+      case Op::kMulNumber:
+        out = a * node.num;
+        break;
+      case Op::kTranspose:
+        out = MatrixView(a).Transposed();
+        break;
+      case Op::kInverse:
+        out = a.InverseMatrix();
+        break;
+      case Op::kSolve:
+        out = ::Solve(a, b);
+        break;
+      case Op::kInput:
+        break;
+    }
+    node.value = std::move(out);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  Finish(id, error);
+}
+
+void MatrixGraph::Finish(int id, std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Node& node = nodes_[id];
+  if (error) {
+    // Consumers never become ready, so the rest of the graph drains.
+    if (!error_) error_ = error;
+  } else {
+    node.done = true;
+    for (int operand : {node.a, node.b}) {
+      if (operand < 0) continue;
+      Node& used = nodes_[operand];
+      if (--used.uses == 0 && !used.keep)
+        spares_.push_back(std::move(used.value));
+    }
+    if (!error_)
+      for (int consumer : node.consumers)
+        if (--nodes_[consumer].waiting == 0) Start(consumer);
+  }
+  if (--running_ == 0) done_.notify_all();
+}
+
+const Matrix& MatrixGraph::Get(int node) const {
+  if (node < 0 || node >= GetSize() || !nodes_[node].done ||
+      !nodes_[node].keep)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  return nodes_[node].value;
+}
+
+int MatrixGraph::GetSize() const { return (int)nodes_.size(); }
+
+int MatrixGraph::GetReusedBuffers() const { return reused_; }
@@ -0,0 +1,114 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_ASYNC_H
+#define CPP1__MATRIXPLUS_0__MATRIX_ASYNC_H
+
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include "matrix_oop.h"
+
+// Operations started on the shared thread pool, see matrix_parallel.h.
+// Operands are taken by value, so the caller can't change them while the
+// operation runs; move them in to save the copy. An exception thrown by the
+// operation is rethrown by the future's get(). The operations themselves
+// still split their work across the pool, so independent calls overlap
+// where one alone wouldn't keep every thread busy. Don't wait on one of
+// these futures from a task running on the pool.
+std::future<Matrix> SumMatrixAsync(Matrix a, Matrix b);
+std::future<Matrix> SubMatrixAsync(Matrix a, Matrix b);
+std::future<Matrix> MulMatrixAsync(Matrix a, Matrix b);
+std::future<Matrix> MulNumberAsync(Matrix a, double num);
+std::future<Matrix> TransposeAsync(Matrix a);
+std::future<Matrix> InverseAsync(Matrix a);
+std::future<double> DeterminantAsync(Matrix a);
+// Solve(a, b) of matrix_decomp.h.
+std::future<Matrix> SolveAsync(Matrix a, Matrix b);
+
+// Dependency graph of Matrix operations, run concurrently on the shared
+// thread pool. Each call adds a node and returns its handle; operands are
+// handles of earlier nodes, so the graph is acyclic by construction. Run()
+// starts every node whose operands are ready and each finished node starts
+// the consumers it completes, so independent operations overlap without
+// the caller ordering them.
+//
+// Results of Input() nodes, of nodes nothing consumes and of nodes passed
+// to Keep() are kept; any other result dies once its last consumer is done
+// and its buffer goes to a later node of the same size or smaller, which
+// writes its result there instead of allocating. Shapes are checked as
+// nodes are added, with the messages of the synchronous operations.
+//
+// Not thread safe; build and run a graph from one thread, not from a task
+// on the pool.
+class MatrixGraph {
+ public:
+  MatrixGraph();
+  MatrixGraph(const MatrixGraph&) = delete;
+  MatrixGraph& operator=(const MatrixGraph&) = delete;
+
+  int Input(Matrix m);
+  int Sum(int a, int b);
+  int Sub(int a, int b);
+  int Mul(int a, int b);
+  int MulNumber(int a, double num);
+  int Transpose(int a);
+  int Inverse(int a);
+  // Solve(a, b) of matrix_decomp.h.
+  int Solve(int a, int b);
+  void Keep(int node);
+
+  // Runs the nodes added since the last Run() and waits for them. The
+  // first exception a node throws is rethrown once the nodes already
+  // running are done; the nodes depending on it aren't run.
+  void Run();
+  // Result of a node that has run and was kept; throws std::out_of_range
+  // for any other.
+  const Matrix& Get(int node) const;
+  int GetSize() const;
+  // Buffers of dead intermediates the last Run() handed to other nodes.
+  int GetReusedBuffers() const;
+
+ private:
+  enum class Op {
+    kInput,
+    kSum,
+    kSub,
+    kMul,
+    kMulNumber,
+    kTranspose,
+    kInverse,
+    kSolve,
+  };
+  struct Node {
+    Op op;
+    int a, b;
+    double num;
+    int rows, cols;
+    bool keep, done;
+    // Consumers still to finish; the result is released at zero.
+    int uses;
+    // Operands still to finish; the node is ready at zero.
+    int waiting;
+    std::vector<int> consumers;
+    Matrix value;
+  };
+
+  int AddNode(Op op, int a, int b, double num, int rows, int cols);
+  const Node& Operand(int node) const;
+  void Start(int node);
+  void Execute(int node);
+  void Finish(int node, std::exception_ptr error);
+  // A spare buffer for the result of node, or an empty matrix.
+  Matrix TakeSpare(const Node& node);
+
+  std::vector<Node> nodes_;
+  // Dead intermediates, matrices whose buffers are up for reuse.
+  std::vector<Matrix> spares_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  int running_{0}, reused_{0};
+  std::exception_ptr error_;
+};
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_ASYNC_H
@@ -0,0 +1,273 @@
+#include "matrix_batch.h"
+
+#include <math.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+// The kernels below handle one group: every element is kLanes doubles and
+// the lane loops have that constant trip count, so the compiler turns each
+// of them into a few vector instructions. They're instantiated once per
+// instruction set, like the kernels in matrix_simd.cc.
+
+constexpr int kLanes = MatrixBatch::kLanes;
+
+#define BATCH_INLINE inline __attribute__((always_inline))
+
+// c = a * b for m x k a and k x n b.
+BATCH_INLINE void MulLanes(int m, int k, int n, const double* a,
+                           const double* b, double* c) {
+  for (int i = 0; i < m; i++)
+    for (int j = 0; j < n; j++) {
+      double acc[kLanes] = {};
+      for (int p = 0; p < k; p++) {
+        const double* x = a + (i * k + p) * kLanes;
+        const double* y = b + (p * n + j) * kLanes;
+        for (int l = 0; l < kLanes; l++) acc[l] += x[l] * y[l];
+      }
+      double* z = c + (i * n + j) * kLanes;
+      for (int l = 0; l < kLanes; l++) z[l] = acc[l];
+    }
+}
+
+// Gaussian elimination with partial pivoting on n rows of width elements,
+// multiplying the pivots into det. Lanes pick their pivots independently:
+// a row below the pivot row is swapped with it, by blending, in the lanes
+// where it holds the larger candidate, which leaves the largest one on top.
+// With jordan the rows above the pivot are cleared too and the pivot rows
+// are normalized, turning [A | I] into [I | A^-1]. A zero pivot zeroes its
+// row instead of dividing by it, so singular lanes end with det 0 and never
+// produce inf or NaN.
+BATCH_INLINE void EliminateLanes(int n, int width, bool jordan, double* w,
+                                 double* det) {
+  const long ld = (long)width * kLanes;
+  for (int l = 0; l < kLanes; l++) det[l] = 1;
+  for (int c = 0; c < n; c++) {
+    double* pivot_row = w + c * ld;
+    double* pc = pivot_row + c * kLanes;
+    for (int r = c + 1; r < n; r++) {
+      double* row = w + r * ld;
+      double* rc = row + c * kLanes;
+      double swap[kLanes];
+      for (int l = 0; l < kLanes; l++) swap[l] = fabs(rc[l]) > fabs(pc[l]);
+      for (int e = c * kLanes; e < width * kLanes; e += kLanes) {
+        double x[kLanes], y[kLanes];
+        for (int l = 0; l < kLanes; l++) x[l] = pivot_row[e + l];
+        for (int l = 0; l < kLanes; l++) y[l] = row[e + l];
+        for (int l = 0; l < kLanes; l++)
+          pivot_row[e + l] = swap[l] != 0 ? y[l] : x[l];
+        for (int l = 0; l < kLanes; l++)
+          row[e + l] = swap[l] != 0 ? x[l] : y[l];
+      }
+      for (int l = 0; l < kLanes; l++) det[l] = swap[l] != 0 ? -det[l] : det[l];
+    }
+    double scale[kLanes];
+    for (int l = 0; l < kLanes; l++) {
+      det[l] *= pc[l];
+      scale[l] = pc[l] != 0 ? 1 / pc[l] : 0;
+    }
+    for (int e = c * kLanes; e < width * kLanes; e += kLanes)
+      for (int l = 0; l < kLanes; l++) pivot_row[e + l] *= scale[l];
+    for (int r = jordan ? 0 : c + 1; r < n; r++) {
+      if (r == c) continue;
+      double* row = w + r * ld;
+      double f[kLanes];
+      for (int l = 0; l < kLanes; l++) f[l] = row[c * kLanes + l];
+      for (int e = c * kLanes; e < width * kLanes; e += kLanes) {
+        double x[kLanes];
+        for (int l = 0; l < kLanes; l++) x[l] = pivot_row[e + l];
+        for (int l = 0; l < kLanes; l++) row[e + l] -= f[l] * x[l];
+      }
+    }
+  }
+}
+
+struct BatchKernels {
+  void (*mul)(int m, int k, int n, const double* a, const double* b,
+              double* c);
+  void (*eliminate)(int n, int width, bool jordan, double* w, double* det);
+};
+
+#define BATCH_KERNELS(NAME, ATTRIBUTES)                                     \
+  ATTRIBUTES static void Mul##NAME(int m, int k, int n, const double* a,   \
+                                   const double* b, double* c) {           \
+    MulLanes(m, k, n, a, b, c);                                            \
+  }                                                                        \
+  ATTRIBUTES static void Eliminate##NAME(int n, int width, bool jordan,    \
+                                         double* w, double* det) {         \
+    EliminateLanes(n, width, jordan, w, det);                              \
+  }                                                                        \
+  static const BatchKernels k##NAME##BatchKernels = {Mul##NAME,            \
+                                                     Eliminate##NAME};
+
+BATCH_KERNELS(Scalar, __attribute__((optimize("no-tree-vectorize"))))
+BATCH_KERNELS(Default, )
+#if defined(__x86_64__) || defined(__i386__)
+BATCH_KERNELS(Avx2, __attribute__((target("avx2,fma"))))
+BATCH_KERNELS(Avx512, __attribute__((target("avx512f"))))
+#endif
+
+// Follows the instruction set of the element-wise kernels, so MATRIX_ISA
+// and SetSimdIsa() apply here as well.
+static const BatchKernels& GetBatchKernels() {
+  switch (Kernels().isa) {
+    case SimdIsa::kScalar:
+      return kScalarBatchKernels;
+#if defined(__x86_64__) || defined(__i386__)
+    case SimdIsa::kAvx2:
+      return kAvx2BatchKernels;
+    case SimdIsa::kAvx512:
+      return kAvx512BatchKernels;
+#endif
+    default:
+      return kDefaultBatchKernels;
+  }
+}
+
+MatrixBatch::MatrixBatch() {}
+
+MatrixBatch::MatrixBatch(int count, int rows, int cols)
+    : count_(count), rows_(rows), cols_(cols) {
+  if (count <= 0 || rows <= 0 || cols <= 0)
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+  data_ = Matrix((int)GetBlocks(), rows * cols * kLanes);
+}
+
+int MatrixBatch::GetCount() const { return count_; }
+
+int MatrixBatch::GetRows() const { return rows_; }
+
+int MatrixBatch::GetCols() const { return cols_; }
+
+long MatrixBatch::GetBlocks() const { return (count_ + kLanes - 1) / kLanes; }
+
+double* MatrixBatch::Block(long block) const {
+  return data_.GetData() + block * data_.GetStride();
+}
+
+double& MatrixBatch::operator()(int index, int row, int col) const {
+  if (index >= count_ || row >= rows_ || col >= cols_ || index < 0 ||
+      row < 0 || col < 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  return Block(index / kLanes)[(row * cols_ + col) * kLanes + index % kLanes];
+}
+
+Matrix MatrixBatch::Get(int index) const {
+  (*this)(index, 0, 0);
+  Matrix result(rows_, cols_);
+  const double* src = Block(index / kLanes) + index % kLanes;
+  for (int i = 0; i < rows_; i++)
+    for (int j = 0; j < cols_; j++)
+      result(i, j) = src[(i * cols_ + j) * kLanes];
+  return result;
+}
+
+void MatrixBatch::Set(int index, const Matrix& matrix) {
+  (*this)(index, 0, 0);
+  if (matrix.GetRows() != rows_ || matrix.GetCols() != cols_)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  double* dst = Block(index / kLanes) + index % kLanes;
+  for (int i = 0; i < rows_; i++)
+    for (int j = 0; j < cols_; j++)
+      dst[(i * cols_ + j) * kLanes] = matrix(i, j);
+}
+
+void MatrixBatch::MulMatrix(const MatrixBatch& other) {
+  *this = *this * other;
+}
+
+MatrixBatch MatrixBatch::Transpose() const {
+  if (count_ == 0) return MatrixBatch();
+  MatrixBatch result(count_, cols_, rows_);
+  ParallelFor(0, GetBlocks(), (double)count_ * rows_ * cols_,
+              [&](long lo, long hi) {
+                for (long b = lo; b < hi; b++) {
+                  const double* src = Block(b);
+                  double* dst = result.Block(b);
+                  for (int i = 0; i < rows_; i++)
+                    for (int j = 0; j < cols_; j++)
+                      memcpy(dst + (j * rows_ + i) * kLanes,
+                             src + (i * cols_ + j) * kLanes,
+                             kLanes * sizeof(double));
+                }
+              });
+  return result;
+}
+
+std::vector<double> MatrixBatch::Determinant() const {
+  if (cols_ != rows_)
+    throw std::invalid_argument("Only square matrices have determinant!");
+  std::vector<double> result(count_);
+  const BatchKernels& kernels = GetBatchKernels();
+  const int n = rows_;
+  const double work = 2.0 / 3 * count_ * n * n * n;
+  ParallelFor(0, GetBlocks(), work, [&](long lo, long hi) {
+    std::vector<double> w((std::size_t)n * n * kLanes);
+    double det[kLanes];
+    for (long b = lo; b < hi; b++) {
+      memcpy(w.data(), Block(b), w.size() * sizeof(double));
+      kernels.eliminate(n, n, false, w.data(), det);
+      for (long l = 0; l < kLanes && b * kLanes + l < count_; l++)
+        result[b * kLanes + l] = det[l];
+    }
+  });
+  return result;
+}
+
+MatrixBatch MatrixBatch::InverseMatrix() const {
+  if (cols_ != rows_ || count_ == 0)
+    throw std::invalid_argument("This matrix has no inverse matrix!");
+  MatrixBatch result(count_, rows_, cols_);
+  const BatchKernels& kernels = GetBatchKernels();
+  const int n = rows_;
+  const double work = 2.0 * count_ * n * n * n;
+  std::vector<double> dets(GetBlocks() * kLanes);
+  ParallelFor(0, GetBlocks(), work, [&](long lo, long hi) {
+    // Each lane's rows of [A | I], inverted in place.
+    std::vector<double> w((std::size_t)2 * n * n * kLanes);
+    for (long b = lo; b < hi; b++) {
+      const double* src = Block(b);
+      for (int i = 0; i < n; i++) {
+        double* row = w.data() + (std::size_t)2 * i * n * kLanes;
+        memcpy(row, src + (std::size_t)i * n * kLanes,
+               (std::size_t)n * kLanes * sizeof(double));
+        for (int j = 0; j < n; j++)
+          for (int l = 0; l < kLanes; l++)
+            row[(n + j) * kLanes + l] = i == j;
+      }
+      kernels.eliminate(n, 2 * n, true, w.data(), dets.data() + b * kLanes);
+      double* dst = result.Block(b);
+      for (int i = 0; i < n; i++)
+        memcpy(dst + (std::size_t)i * n * kLanes,
+               w.data() + (std::size_t)(2 * i + 1) * n * kLanes,
+               (std::size_t)n * kLanes * sizeof(double));
+    }
+  });
+  for (int i = 0; i < count_; i++)
+    if (fabs(dets[i]) < EPS)
+      throw std::invalid_argument("This matrix has no inverse matrix!");
+  return result;
+}
+
+MatrixBatch operator*(const MatrixBatch& a, const MatrixBatch& b) {
+  if (a.count_ != b.count_)
+    throw std::invalid_argument("Batch sizes aren't equal!");
+  if (a.cols_ != b.rows_)
+    throw std::invalid_argument(
+        "First matrix columns number isn't equal to second matrix rows number, "
+        "mathematically incorrect!");
+  if (a.count_ == 0) return MatrixBatch();
+  MatrixBatch result(a.count_, a.rows_, b.cols_);
+  const BatchKernels& kernels = GetBatchKernels();
+  const double work = 2.0 * a.count_ * a.rows_ * a.cols_ * b.cols_;
+  ParallelFor(0, a.GetBlocks(), work, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++)
+      kernels.mul(a.rows_, a.cols_, b.cols_, a.Block(i), b.Block(i),
+                  result.Block(i));
+  });
+  return result;
+}
@@ -0,0 +1,51 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_BATCH_H
+#define CPP1__MATRIXPLUS_0__MATRIX_BATCH_H
+
+#include <vector>
+
+#include "matrix_oop.h"
+
+// GetCount() matrices of the same shape stored for lock-step processing.
+// Matrices are grouped kLanes at a time and a group keeps each element of
+// its matrices side by side: element (i, j) of matrix index lives at
+//   block(index / kLanes)[(i * GetCols() + j) * kLanes + index % kLanes],
+// so every kernel works on kLanes matrices per SIMD instruction, and
+// groups are split across the thread pool. Unused lanes of the last group
+// hold zeros and are never reported.
+class MatrixBatch {
+ public:
+  static constexpr int kLanes = 8;
+
+  MatrixBatch();
+  // count matrices of zeros.
+  MatrixBatch(int count, int rows, int cols);
+
+  int GetCount() const;
+  int GetRows() const;
+  int GetCols() const;
+  double& operator()(int index, int row, int col) const;
+  Matrix Get(int index) const;
+  void Set(int index, const Matrix& matrix);
+
+  // Every matrix is multiplied by the matrix with the same index in other.
+  void MulMatrix(const MatrixBatch& other);
+  MatrixBatch Transpose() const;
+  std::vector<double> Determinant() const;
+  // Throws if any of the matrices is singular.
+  MatrixBatch InverseMatrix() const;
+
+  friend MatrixBatch operator*(const MatrixBatch& a, const MatrixBatch& b);
+
+ private:
+  // Start of the group holding matrices [block * kLanes, +kLanes).
+  double* Block(long block) const;
+  long GetBlocks() const;
+
+  int count_{}, rows_{}, cols_{};
+  // One row per group.
+  Matrix data_;
+};
+
+MatrixBatch operator*(const MatrixBatch& a, const MatrixBatch& b);
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_BATCH_H
@@ -0,0 +1,1266 @@
+#include "matrix_decomp.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+// Width of the column panels factored before each GEMM update of the
+// trailing matrix.
+static constexpr int kPanel = 64;
+// Triangular solves with fewer right-hand sides go column by column.
+static constexpr int kNarrow = 4;
+
+// Eight partial sums, so the loop vectorizes and isn't bound by the
+// latency of one chain of additions.
+static double Dot(const double* a, const double* b, long n) {
+  double acc[8] = {};
+  long i = 0;
+  for (; i + 8 <= n; i += 8)
+    for (int l = 0; l < 8; l++) acc[l] += a[i + l] * b[i + l];
+  double sum = 0;
+  for (; i < n; i++) sum += a[i] * b[i];
+  for (int l = 0; l < 8; l++) sum += acc[l];
+  return sum;
+}
+
+// Solves T * Y = X in place of X for the n x n triangular T with element
+// (i, j) at t[i * rs + j * cs], one of rs and cs being 1, so a transposed
+// factor is just swapped strides. A unit T has ones on the diagonal, which
+// isn't read.
+static void SolveTriangular(const double* t, int rs, int cs, int n,
+                            bool upper, bool unit, Matrix& x) {
+  const int m = x.GetCols(), xld = x.GetStride();
+  double* d = x.GetData();
+  const SimdKernels& k = Kernels();
+  auto at = [&](long i, long j) { return t[i * rs + j * cs]; };
+  if (m < kNarrow) {
+    // A column at a time, so the inner loops run along T instead of
+    // calling the kernels on rows of a few elements.
+    std::vector<double> v(n);
+    for (int j = 0; j < m; j++) {
+      for (int i = 0; i < n; i++) v[i] = d[(long)i * xld + j];
+      if (cs == 1) {
+        for (int s = 0; s < n; s++) {
+          const long i = upper ? n - 1 - s : s;
+          const long first = upper ? i + 1 : 0, last = upper ? n : i;
+          v[i] -= Dot(t + i * rs + first, v.data() + first, last - first);
+          if (!unit) v[i] /= at(i, i);
+        }
+      } else {
+        for (int s = 0; s < n; s++) {
+          const long c = upper ? n - 1 - s : s;
+          if (!unit) v[c] /= at(c, c);
+          if (upper)
+            k.axpy(v.data(), -v[c], t + c * cs, c);
+          else
+            k.axpy(v.data() + c + 1, -v[c], t + c * cs + c + 1, n - c - 1);
+        }
+      }
+      for (int i = 0; i < n; i++) d[(long)i * xld + j] = v[i];
+    }
+    return;
+  }
+  if (!upper) {
+    for (int k0 = 0; k0 < n; k0 += kPanel) {
+      const int k1 = std::min(n, k0 + kPanel);
+      ParallelFor(0, m, (double)m * kPanel * kPanel, [&](long lo, long hi) {
+        for (int c = k0; c < k1; c++) {
+          if (!unit) k.scale(d + (long)c * xld + lo, 1 / at(c, c), hi - lo);
+          for (int i = c + 1; i < k1; i++)
+            k.axpy(d + (long)i * xld + lo, -at(i, c), d + (long)c * xld + lo,
+                   hi - lo);
+        }
+      });
+      if (k1 < n)
+        Gemm(n - k1, m, k1 - k0, -1.0, t + (long)k1 * rs + (long)k0 * cs, rs,
+             cs, d + (long)k0 * xld, xld, 1, d + (long)k1 * xld, xld);
+    }
+    return;
+  }
+  for (int k1 = n; k1 > 0;) {
+    const int k0 = std::max(0, k1 - kPanel);
+    ParallelFor(0, m, (double)m * kPanel * kPanel, [&](long lo, long hi) {
+      for (int c = k1 - 1; c >= k0; c--) {
+        if (!unit) k.scale(d + (long)c * xld + lo, 1 / at(c, c), hi - lo);
+        for (int i = k0; i < c; i++)
+          k.axpy(d + (long)i * xld + lo, -at(i, c), d + (long)c * xld + lo,
+                 hi - lo);
+      }
+    });
+    if (k0 > 0)
+      Gemm(k0, m, k1 - k0, -1.0, t + (long)k0 * cs, rs, cs, d + (long)k0 * xld,
+           xld, 1, d, xld);
+    k1 = k0;
+  }
+}
+
+LU::LU() {}
+
+LU::LU(const MatrixArg& a) { Factorize(a); }
+
+void LU::Factorize(const MatrixArg& a) {
+  if (a.GetRows() != a.GetCols())
+    throw std::invalid_argument("Only square matrices have LU decomposition!");
+  lu_ = a;
+  const int n = a.GetRows(), ld = lu_.GetStride();
+  double* d = lu_.GetData();
+  const SimdKernels& k = Kernels();
+  swaps_.resize(n);
+  sign_ = 1;
+  singular_ = false;
+  for (int k0 = 0; k0 < n; k0 += kPanel) {
+    const int k1 = std::min(n, k0 + kPanel);
+    // Unblocked factorization of the panel; rows are swapped across the
+    // full width so the permutation is applied once.
+    for (int c = k0; c < k1; c++) {
+      int p = c;
+      for (int i = c + 1; i < n; i++)
+        if (fabs(d[(long)i * ld + c]) > fabs(d[(long)p * ld + c])) p = i;
+      swaps_[c] = p;
+      if (p != c) {
+        std::swap_ranges(d + (long)c * ld, d + (long)c * ld + n,
+                         d + (long)p * ld);
+        sign_ = -sign_;
+      }
+      const double* row_c = d + (long)c * ld;
+      if (row_c[c] == 0) {
+        singular_ = true;
+        continue;
+      }
+      ParallelFor(c + 1, n, (double)(n - c) * (k1 - c), [&](long lo, long hi) {
+        for (long i = lo; i < hi; i++) {
+          double* row_i = d + i * ld;
+          row_i[c] /= row_c[c];
+          k.axpy(row_i + c + 1, -row_i[c], row_c + c + 1, k1 - c - 1);
+        }
+      });
+    }
+    if (k1 == n) break;
+    // U12 = inverse(L11) * A12, split by columns, then A22 -= L21 * U12.
+    ParallelFor(k1, n, (double)(n - k1) * kPanel * kPanel,
+                [&](long lo, long hi) {
+                  for (int c = k0; c < k1; c++)
+                    for (int i = c + 1; i < k1; i++)
+                      k.axpy(d + (long)i * ld + lo, -d[(long)i * ld + c],
+                             d + (long)c * ld + lo, hi - lo);
+                });
+    Gemm(n - k1, n - k1, k1 - k0, -1.0, d + (long)k1 * ld + k0, ld, 1,
+         d + (long)k0 * ld + k1, ld, 1, d + (long)k1 * ld + k1, ld);
+  }
+  permutation_.resize(n);
+  for (int i = 0; i < n; i++) permutation_[i] = i;
+  for (int i = 0; i < n; i++)
+    std::swap(permutation_[i], permutation_[swaps_[i]]);
+}
+
+bool LU::IsSingular() const { return singular_; }
+
+double LU::Determinant() const {
+  if (singular_) return 0;
+  double result = sign_;
+  for (int i = 0; i < GetSize(); i++) result *= lu_(i, i);
+  return result;
+}
+
+void LU::PermuteRows(Matrix& x) const {
+  const int m = x.GetCols(), ld = x.GetStride();
+  double* d = x.GetData();
+  for (int i = 0; i < GetSize(); i++)
+    if (swaps_[i] != i)
+      std::swap_ranges(d + (long)i * ld, d + (long)i * ld + m,
+                       d + (long)swaps_[i] * ld);
+}
+
+void LU::SolveLower(Matrix& x) const {
+  SolveTriangular(lu_.GetData(), lu_.GetStride(), 1, GetSize(), false, true,
+                  x);
+}
+
+void LU::SolveUpper(Matrix& x) const {
+  SolveTriangular(lu_.GetData(), lu_.GetStride(), 1, GetSize(), true, false,
+                  x);
+}
+
+Matrix LU::Solve(const MatrixArg& b) const {
+  if (b.GetRows() != GetSize())
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix size!");
+  if (singular_) throw std::invalid_argument("Matrix is singular!");
+  Matrix x(b);
+  PermuteRows(x);
+  SolveLower(x);
+  SolveUpper(x);
+  return x;
+}
+
+Matrix LU::Inverse() const {
+  Matrix identity(GetSize(), GetSize());
+  for (int i = 0; i < GetSize(); i++) identity(i, i) = 1;
+  return Solve(identity);
+}
+
+// adj(A) = inverse(W) * C * inverse(L) * P, where U = D * W splits off the
+// pivots and C = det(A) * inverse(D) is formed from products of the other
+// pivots, so a tiny (or zero) last pivot is never divided by.
+Matrix LU::Complements() const {
+  const int n = GetSize();
+  for (int i = 0; i + 1 < n; i++)
+    if (lu_(i, i) == 0)
+      throw std::invalid_argument("Leading pivots of the matrix are zero!");
+  Matrix y(n, n);
+  for (int i = 0; i < n; i++) y(i, i) = 1;
+  PermuteRows(y);
+  SolveLower(y);
+  std::vector<double> suffix(n + 1, 1.0);
+  for (int i = n - 1; i >= 0; i--) suffix[i] = suffix[i + 1] * lu_(i, i);
+  const int ld = lu_.GetStride(), yld = y.GetStride();
+  const double* u = lu_.GetData();
+  double* d = y.GetData();
+  const SimdKernels& k = Kernels();
+  double prefix = sign_;
+  for (int i = 0; i < n; i++) {
+    k.scale(d + (long)i * yld, prefix * suffix[i + 1], n);
+    prefix *= u[(long)i * ld + i];
+  }
+  for (int c = n - 1; c > 0; c--)
+    for (int i = 0; i < c; i++)
+      k.axpy(d + (long)i * yld, -u[(long)i * ld + c] / u[(long)i * ld + i],
+             d + (long)c * yld, n);
+  return y.Transpose();
+}
+
+int LU::GetSize() const { return lu_.GetRows(); }
+
+const Matrix& LU::GetFactors() const { return lu_; }
+
+const std::vector<int>& LU::GetPermutation() const { return permutation_; }
+
+// Refinement steps MixedLU takes at most, as in LAPACK's dsgesv.
+static constexpr int kMaxRefinements = 30;
+
+// Largest absolute row sum.
+static double NormInf(const MatrixView& a) {
+  double norm = 0;
+  const int cs = a.GetColStride();
+  for (int i = 0; i < a.GetRows(); i++) {
+    const double* row = a.GetData() + (long)i * a.GetRowStride();
+    double sum = 0;
+    for (int j = 0; j < a.GetCols(); j++) sum += fabs(row[(long)j * cs]);
+    norm = std::max(norm, sum);
+  }
+  return norm;
+}
+
+// Backward error of x given its residual r = b - a * x and ||a||.
+static double BackwardError(double norm_a, const MatrixView& r,
+                            const MatrixView& x, const MatrixView& b) {
+  const int m = b.GetCols();
+  std::vector<double> r_max(m), x_max(m), b_max(m);
+  for (int i = 0; i < b.GetRows(); i++)
+    for (int j = 0; j < m; j++) {
+      // A solution that isn't finite leaves infinities or NaNs here, which
+      // std::max would drop.
+      if (!std::isfinite(r(i, j))) return INFINITY;
+      r_max[j] = std::max(r_max[j], fabs(r(i, j)));
+      b_max[j] = std::max(b_max[j], fabs(b(i, j)));
+    }
+  for (int i = 0; i < x.GetRows(); i++)
+    for (int j = 0; j < m; j++) x_max[j] = std::max(x_max[j], fabs(x(i, j)));
+  double error = 0;
+  for (int j = 0; j < m; j++) {
+    if (r_max[j] == 0) continue;
+    const double scale = norm_a * x_max[j] + b_max[j];
+    error = std::max(error, scale > 0 ? r_max[j] / scale : INFINITY);
+  }
+  return error;
+}
+
+// b - a * x. With few columns the product is a row of dot products per
+// column, which reads a once instead of packing it for the GEMM.
+static Matrix Residual(const Matrix& a, const Matrix& x, const Matrix& b) {
+  Matrix r(b);
+  const int n = a.GetRows(), m = x.GetCols();
+  if (m >= kNarrow) {
+    r -= a * x;
+    return r;
+  }
+  const int k = x.GetRows(), ld = a.GetStride(), rld = r.GetStride();
+  std::vector<double> column(k);
+  for (int j = 0; j < m; j++) {
+    for (int i = 0; i < k; i++) column[i] = x(i, j);
+    ParallelFor(0, n, (double)n * k, [&](long lo, long hi) {
+      for (long i = lo; i < hi; i++)
+        r.GetData()[i * rld + j] -=
+            Dot(a.GetData() + i * ld, column.data(), k);
+    });
+  }
+  return r;
+}
+
+double BackwardError(const MatrixArg& a, const MatrixArg& x,
+                     const MatrixArg& b) {
+  if (a.GetCols() != x.GetRows() || a.GetRows() != b.GetRows() ||
+      x.GetCols() != b.GetCols())
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  Matrix r(b);
+  r -= MatrixView(a) * MatrixView(x);
+  return BackwardError(NormInf(a), r, x, b);
+}
+
+MixedLU::MixedLU() {}
+
+MixedLU::MixedLU(const MatrixArg& a) { Factorize(a); }
+
+void MixedLU::Factorize(const MatrixArg& a) {
+  a_ = a;
+  norm_ = NormInf(a_);
+  lu_.Factorize(MatrixCast<float>(a_));
+}
+
+// The float factors give the determinant to float accuracy, plenty for
+// telling a singular matrix apart; when they are singular themselves the
+// double factorization decides.
+double MixedLU::Determinant() const {
+  if (lu_.IsSingular()) return LU(a_).Determinant();
+  return lu_.Determinant();
+}
+
+Matrix MixedLU::Solve(const MatrixArg& b, Refinement* refinement) const {
+  if (b.GetRows() != GetSize())
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix size!");
+  const double tolerance =
+      std::sqrt((double)GetSize()) * std::numeric_limits<double>::epsilon();
+  const Matrix rhs(b);
+  Refinement result;
+  Matrix x;
+  if (!lu_.IsSingular()) {
+    x = MatrixCast<double>(lu_.Solve(MatrixCast<float>(rhs)));
+    // Each step has to at least halve the error, so a matrix too badly
+    // conditioned for float gives up early instead of after every step.
+    double previous = INFINITY;
+    for (;;) {
+      const Matrix r = Residual(a_, x, rhs);
+      result.residual = BackwardError(norm_, r, x, rhs);
+      if (result.residual <= tolerance ||
+          !(result.residual < previous / 2) ||
+          result.iterations == kMaxRefinements)
+        break;
+      previous = result.residual;
+      x += MatrixCast<double>(lu_.Solve(MatrixCast<float>(r)));
+      result.iterations++;
+    }
+  }
+  if (lu_.IsSingular() || result.residual > tolerance) {
+    x = LU(a_).Solve(rhs);
+    result.residual = BackwardError(a_, x, rhs);
+    result.fallback = true;
+  }
+  if (refinement) *refinement = result;
+  return x;
+}
+
+Matrix MixedLU::Inverse(Refinement* refinement) const {
+  Matrix identity(GetSize(), GetSize());
+  for (int i = 0; i < GetSize(); i++) identity(i, i) = 1;
+  return Solve(identity, refinement);
+}
+
+int MixedLU::GetSize() const { return a_.GetRows(); }
+
+BandLU::BandLU() {}
+
+BandLU::BandLU(const MatrixArg& a) { Factorize(a, DetectBandwidth(a)); }
+
+BandLU::BandLU(const MatrixArg& a, Bandwidth band) { Factorize(a, band); }
+
+// Row i of band_ holds columns i - lower through i + lower + upper, so the
+// rows a step swaps or updates are contiguous runs and the kernels apply.
+void BandLU::Factorize(const MatrixArg& a, Bandwidth band) {
+  if (a.GetRows() != a.GetCols())
+    throw std::invalid_argument("Only square matrices have LU decomposition!");
+  const int n = a.GetRows();
+  const int kl = std::min(band.lower, n - 1), ku = std::min(band.upper, n - 1);
+  bandwidth_ = {kl, ku};
+  band_ = Matrix(n, 2 * kl + ku + 1);
+  for (int i = 0; i < n; i++)
+    for (int j = std::max(0, i - kl); j <= std::min(n - 1, i + ku); j++)
+      At(i, j) = a(i, j);
+  const SimdKernels& k = Kernels();
+  swaps_.resize(n);
+  sign_ = 1;
+  singular_ = false;
+  for (int c = 0; c < n; c++) {
+    const int last = std::min(n - 1, c + kl);
+    const int right = std::min(n - 1, c + kl + ku);
+    int p = c;
+    for (int i = c + 1; i <= last; i++)
+      if (fabs(At(i, c)) > fabs(At(p, c))) p = i;
+    swaps_[c] = p;
+    if (p != c) {
+      std::swap_ranges(&At(c, c), &At(c, c) + right - c + 1, &At(p, c));
+      sign_ = -sign_;
+    }
+    if (At(c, c) == 0) {
+      singular_ = true;
+      continue;
+    }
+    for (int i = c + 1; i <= last; i++) {
+      At(i, c) /= At(c, c);
+      k.axpy(&At(i, c + 1), -At(i, c), &At(c, c + 1), right - c);
+    }
+  }
+}
+
+bool BandLU::IsSingular() const { return singular_; }
+
+double BandLU::Determinant() const {
+  if (singular_) return 0;
+  double result = sign_;
+  for (int i = 0; i < GetSize(); i++) result *= At(i, i);
+  return result;
+}
+
+// The swaps and eliminations are replayed in the order they were made,
+// then U is substituted; columns of B go to the threads.
+Matrix BandLU::Solve(const MatrixArg& b) const {
+  const int n = GetSize();
+  if (b.GetRows() != n)
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix size!");
+  if (singular_) throw std::invalid_argument("Matrix is singular!");
+  Matrix x(b);
+  const int m = x.GetCols(), kl = bandwidth_.lower;
+  const int width = kl + bandwidth_.upper;
+  const SimdKernels& k = Kernels();
+  auto row = [&](long i) { return x.GetData() + i * x.GetStride(); };
+  ParallelFor(0, m, 2.0 * n * m * (kl + width + 1), [&](long lo, long hi) {
+    for (int c = 0; c < n; c++) {
+      if (swaps_[c] != c)
+        std::swap_ranges(row(c) + lo, row(c) + hi, row(swaps_[c]) + lo);
+      for (int i = c + 1; i <= std::min(n - 1, c + kl); i++)
+        k.axpy(row(i) + lo, -At(i, c), row(c) + lo, hi - lo);
+    }
+    for (int c = n - 1; c >= 0; c--) {
+      k.scale(row(c) + lo, 1 / At(c, c), hi - lo);
+      for (int i = std::max(0, c - width); i < c; i++)
+        k.axpy(row(i) + lo, -At(i, c), row(c) + lo, hi - lo);
+    }
+  });
+  return x;
+}
+
+Matrix BandLU::Inverse() const {
+  Matrix identity(GetSize(), GetSize());
+  for (int i = 0; i < GetSize(); i++) identity(i, i) = 1;
+  return Solve(identity);
+}
+
+int BandLU::GetSize() const { return band_.GetRows(); }
+
+Bandwidth BandLU::GetBandwidth() const { return bandwidth_; }
+
+Cholesky::Cholesky() {}
+
+Cholesky::Cholesky(const MatrixArg& a) { Factorize(a); }
+
+void Cholesky::Factorize(const MatrixArg& a) {
+  if (a.GetRows() != a.GetCols())
+    throw std::invalid_argument(
+        "Only square matrices have Cholesky decomposition!");
+  l_ = a;
+  const int n = a.GetRows(), ld = l_.GetStride();
+  double* d = l_.GetData();
+  positive_ = false;
+  for (int k0 = 0; k0 < n; k0 += kPanel) {
+    const int k1 = std::min(n, k0 + kPanel);
+    // The panel is factored left-looking from the columns before it in the
+    // same panel; earlier panels were already subtracted by the GEMM.
+    for (int c = k0; c < k1; c++) {
+      double* row_c = d + (long)c * ld;
+      const double pivot = row_c[c] - Dot(row_c + k0, row_c + k0, c - k0);
+      if (!(pivot > 0)) return;
+      row_c[c] = sqrt(pivot);
+      ParallelFor(c + 1, n, (double)(n - c) * (c - k0 + 1),
+                  [&](long lo, long hi) {
+                    for (long i = lo; i < hi; i++) {
+                      double* row_i = d + i * ld;
+                      row_i[c] = (row_i[c] - Dot(row_i + k0, row_c + k0,
+                                                 c - k0)) / row_c[c];
+                    }
+                  });
+    }
+    if (k1 == n) break;
+    // A22 -= L21 * L21^T, only the bands of rows on and below the diagonal.
+    for (int i0 = k1; i0 < n; i0 += kPanel) {
+      const int i1 = std::min(n, i0 + kPanel);
+      Gemm(i1 - i0, i1 - k1, k1 - k0, -1.0, d + (long)i0 * ld + k0, ld, 1,
+           d + (long)k1 * ld + k0, 1, ld, d + (long)i0 * ld + k1, ld);
+    }
+  }
+  for (int i = 0; i < n; i++)
+    std::fill(d + (long)i * ld + i + 1, d + (long)i * ld + n, 0.0);
+  positive_ = true;
+}
+
+bool Cholesky::IsPositiveDefinite() const { return positive_; }
+
+double Cholesky::Determinant() const {
+  if (!positive_)
+    throw std::invalid_argument("Matrix isn't positive definite!");
+  double result = 1;
+  for (int i = 0; i < GetSize(); i++) result *= l_(i, i) * l_(i, i);
+  return result;
+}
+
+Matrix Cholesky::Solve(const MatrixArg& b) const {
+  if (b.GetRows() != GetSize())
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix size!");
+  if (!positive_)
+    throw std::invalid_argument("Matrix isn't positive definite!");
+  Matrix x(b);
+  const int n = GetSize(), ld = l_.GetStride();
+  SolveTriangular(l_.GetData(), ld, 1, n, false, false, x);
+  SolveTriangular(l_.GetData(), 1, ld, n, true, false, x);
+  return x;
+}
+
+int Cholesky::GetSize() const { return l_.GetRows(); }
+
+const Matrix& Cholesky::GetFactor() const { return l_; }
+
+QR::QR() {}
+
+QR::QR(const MatrixArg& a) { Factorize(a); }
+
+void QR::Factorize(const MatrixArg& a) {
+  transposed_ = a.GetRows() < a.GetCols();
+  qr_ = transposed_ ? a.Transposed() : MatrixView(a);
+  const int m = qr_.GetRows(), n = qr_.GetCols(), ld = qr_.GetStride();
+  double* d = qr_.GetData();
+  const SimdKernels& k = Kernels();
+  tau_.assign(n, 0);
+  std::vector<double> w(n);
+  for (int c = 0; c < n; c++) {
+    double* row_c = d + (long)c * ld;
+    double tail = 0;
+    for (long i = c + 1; i < m; i++) tail += d[i * ld + c] * d[i * ld + c];
+    if (tail == 0) continue;
+    const double x0 = row_c[c], norm = sqrt(x0 * x0 + tail);
+    const double beta = x0 > 0 ? -norm : norm, tau = (beta - x0) / beta;
+    const double scale = 1 / (x0 - beta);
+    for (long i = c + 1; i < m; i++) d[i * ld + c] *= scale;
+    row_c[c] = beta;
+    tau_[c] = tau;
+    // The trailing columns are split across threads: w = v^T * A over
+    // rows c.., then A -= tau * v * w, both as row axpys.
+    ParallelFor(c + 1, n, 4.0 * (m - c) * (n - c), [&](long lo, long hi) {
+      double* wl = w.data() + lo;
+      std::copy(row_c + lo, row_c + hi, wl);
+      for (long i = c + 1; i < m; i++)
+        k.axpy(wl, d[i * ld + c], d + i * ld + lo, hi - lo);
+      k.axpy(row_c + lo, -tau, wl, hi - lo);
+      for (long i = c + 1; i < m; i++)
+        k.axpy(d + i * ld + lo, -tau * d[i * ld + c], wl, hi - lo);
+    });
+  }
+  double largest = 0;
+  for (int c = 0; c < n; c++) largest = std::max(largest, fabs(qr_(c, c)));
+  const double tolerance =
+      largest * n * std::numeric_limits<double>::epsilon();
+  deficient_ = false;
+  for (int c = 0; c < n; c++)
+    if (fabs(qr_(c, c)) <= tolerance) deficient_ = true;
+}
+
+bool QR::IsRankDeficient() const { return deficient_; }
+
+void QR::ApplyReflectors(Matrix& x, bool transposed) const {
+  const int m = qr_.GetRows(), n = qr_.GetCols(), ld = qr_.GetStride();
+  const int cols = x.GetCols(), xld = x.GetStride();
+  const double* v = qr_.GetData();
+  double* d = x.GetData();
+  const SimdKernels& k = Kernels();
+  std::vector<double> w(cols);
+  ParallelFor(0, cols, 4.0 * m * n * cols, [&](long lo, long hi) {
+    double* wl = w.data() + lo;
+    for (int s = 0; s < n; s++) {
+      const int c = transposed ? s : n - 1 - s;
+      if (tau_[c] == 0) continue;
+      double* row_c = d + (long)c * xld;
+      std::copy(row_c + lo, row_c + hi, wl);
+      for (long i = c + 1; i < m; i++)
+        k.axpy(wl, v[i * ld + c], d + i * xld + lo, hi - lo);
+      k.axpy(row_c + lo, -tau_[c], wl, hi - lo);
+      for (long i = c + 1; i < m; i++)
+        k.axpy(d + i * xld + lo, -tau_[c] * v[i * ld + c], wl, hi - lo);
+    }
+  });
+}
+
+Matrix QR::Solve(const MatrixArg& b) const {
+  if (b.GetRows() != GetRows())
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix rows number!");
+  if (deficient_) throw std::invalid_argument("Matrix is rank deficient!");
+  const int n = qr_.GetCols(), ld = qr_.GetStride();
+  Matrix x(b);
+  if (!transposed_) {
+    // R * X = first n rows of Q^T * B.
+    ApplyReflectors(x, true);
+    x.SetRows(n);
+    SolveTriangular(qr_.GetData(), ld, 1, n, true, false, x);
+  } else {
+    // A = R^T * Q^T, so X = Q * [Z; 0] with R^T * Z = B.
+    SolveTriangular(qr_.GetData(), 1, ld, n, false, false, x);
+    x.SetRows(qr_.GetRows());
+    ApplyReflectors(x, false);
+  }
+  return x;
+}
+
+int QR::GetRows() const {
+  return transposed_ ? qr_.GetCols() : qr_.GetRows();
+}
+
+int QR::GetCols() const {
+  return transposed_ ? qr_.GetRows() : qr_.GetCols();
+}
+
+const Matrix& QR::GetFactors() const { return qr_; }
+
+bool QR::IsTransposed() const { return transposed_; }
+
+// Reflectors accumulated per GEMM update in the tridiagonal and bidiagonal
+// reductions and per block when their products are applied.
+static constexpr int kReflectorBlock = 32;
+
+// Turns (alpha, x) of n elements at stride inc into the reflector I - tau *
+// v * v^T mapping it to (beta, 0): alpha becomes beta, x the tail of v,
+// whose leading 1 is implied. Returns tau, zero when x is already zero.
+static double MakeReflector(double& alpha, double* x, long n, long inc) {
+  double tail = 0;
+  for (long i = 0; i < n; i++) tail += x[i * inc] * x[i * inc];
+  if (tail == 0) return 0;
+  const double norm = sqrt(alpha * alpha + tail);
+  const double beta = alpha > 0 ? -norm : norm, tau = (beta - alpha) / beta;
+  const double scale = 1 / (alpha - beta);
+  for (long i = 0; i < n; i++) x[i * inc] *= scale;
+  alpha = beta;
+  return tau;
+}
+
+// x = H_0 * H_1 * ... * H_(count - 1) * x for H_l = I - tau[l] * v_l *
+// v_l^T, v_l being zero above row l + offset, 1 there and store(r, l) below.
+// Each block of reflectors is applied as I - V * T * V^T, three GEMMs.
+static void ApplyBlockReflectors(const MatrixView& store, int offset,
+                                 const std::vector<double>& tau, int count,
+                                 Matrix& x) {
+  const int rows = x.GetRows(), cols = x.GetCols(), ldx = x.GetStride();
+  for (int b1 = count; b1 > 0;) {
+    const int b0 = std::max(0, b1 - kReflectorBlock), kb = b1 - b0;
+    const int top = b0 + offset, len = rows - top;
+    b1 = b0;
+    if (len <= 0) continue;
+    Matrix v(len, kb), t(kb, kb), w(kb, cols), tw(kb, cols);
+    for (int l = 0; l < kb && l < len; l++) {
+      v(l, l) = 1;
+      for (int r = l + 1; r < len; r++) v(r, l) = store(top + r, b0 + l);
+    }
+    // Forward accumulation: T(0:j, j) = -tau_j * T(0:j, 0:j) * V^T * v_j.
+    std::vector<double> s(kb);
+    for (int j = 0; j < kb; j++) {
+      const double tau_j = tau[b0 + j];
+      t(j, j) = tau_j;
+      for (int i = 0; i < j; i++) {
+        s[i] = 0;
+        for (int r = j; r < len; r++) s[i] += v(r, i) * v(r, j);
+      }
+      for (int i = 0; i < j; i++) {
+        double sum = 0;
+        for (int l = i; l < j; l++) sum += t(i, l) * s[l];
+        t(i, j) = -tau_j * sum;
+      }
+    }
+    double* xd = x.GetData() + (long)top * ldx;
+    Gemm(kb, cols, len, 1.0, v.GetData(), 1, v.GetStride(), xd, ldx, 1,
+         w.GetData(), w.GetStride());
+    Gemm(kb, cols, kb, 1.0, t.GetData(), t.GetStride(), 1, w.GetData(),
+         w.GetStride(), 1, tw.GetData(), tw.GetStride());
+    Gemm(len, cols, kb, -1.0, v.GetData(), v.GetStride(), 1, tw.GetData(),
+         tw.GetStride(), 1, xd, ldx);
+  }
+}
+
+// Plane rotation of rows a and b: (x_a, x_b) becomes (c * x_a + s * x_b,
+// c * x_b - s * x_a).
+struct Rotation {
+  int a, b;
+  double c, s;
+};
+
+// Applies rotations in order to the rows of z. They are recorded a sweep
+// at a time and applied here split by columns, so every thread runs the
+// whole sequence over its own slice of the rows.
+static void ApplyRotations(Matrix& z, const std::vector<Rotation>& rotations) {
+  const int cols = z.GetCols(), ld = z.GetStride();
+  double* d = z.GetData();
+  ParallelFor(0, cols, 6.0 * cols * rotations.size(), [&](long lo, long hi) {
+    for (const Rotation& r : rotations) {
+      double* x = d + (long)r.a * ld;
+      double* y = d + (long)r.b * ld;
+      for (long j = lo; j < hi; j++) {
+        const double xj = x[j], yj = y[j];
+        x[j] = r.c * xj + r.s * yj;
+        y[j] = r.c * yj - r.s * xj;
+      }
+    }
+  });
+}
+
+// Reduces the symmetric a, both triangles filled, to tridiagonal form Q^T
+// * a * Q with diagonal d and subdiagonal e, e[i] = T(i + 1, i). Reflector
+// c, applied to rows and columns c + 1.., is left below the subdiagonal of
+// column c of a with tau[c].
+//
+// Panels of kReflectorBlock columns are reduced against the trailing matrix
+// as it was before the panel, corrected on the fly by A - V * W^T - W * V^T
+// for the panel's reflectors V and their products W, and the trailing
+// matrix is then updated by two GEMMs.
+static void Tridiagonalize(Matrix& a, std::vector<double>& d,
+                           std::vector<double>& e, std::vector<double>& tau) {
+  const int n = a.GetRows(), ld = a.GetStride();
+  double* ad = a.GetData();
+  d.assign(n, 0);
+  e.assign(n, 0);
+  tau.assign(std::max(0, n - 2), 0);
+  std::vector<double> v(n), y(n), z1(kReflectorBlock), z2(kReflectorBlock);
+  Matrix vs(n, kReflectorBlock), ws(n, kReflectorBlock);
+  const int lv = vs.GetStride(), lw = ws.GetStride();
+  double *vd = vs.GetData(), *wd = ws.GetData();
+  for (int k0 = 0; k0 < n - 2; k0 += kReflectorBlock) {
+    const int kb = std::min(kReflectorBlock, n - 2 - k0);
+    for (int j = 0; j < kb; j++) {
+      const int c = k0 + j;
+      // Column c catches up with the panel's earlier reflectors.
+      const double* vc = vd + (long)c * lv;
+      const double* wc = wd + (long)c * lw;
+      for (long i = c; i < n; i++)
+        ad[i * ld + c] -= Dot(vd + i * lv, wc, j) + Dot(wd + i * lw, vc, j);
+      d[c] = ad[(long)c * ld + c];
+      double* x = ad + (long)(c + 1) * ld + c;
+      const double t = MakeReflector(*x, x + ld, n - c - 2, ld);
+      e[c] = *x;
+      tau[c] = t;
+      std::fill(v.begin(), v.end(), 0.0);
+      v[c + 1] = 1;
+      for (long i = c + 2; i < n; i++) v[i] = ad[i * ld + c];
+      // y = tau * (A22 - V * W^T - W * V^T) * v over rows c + 1..
+      ParallelFor(c + 1, n, 2.0 * (n - c) * (n - c), [&](long lo, long hi) {
+        for (long i = lo; i < hi; i++)
+          y[i] = Dot(ad + i * ld + c + 1, v.data() + c + 1, n - c - 1);
+      });
+      for (int l = 0; l < j; l++) {
+        z1[l] = z2[l] = 0;
+        for (long i = c + 1; i < n; i++) {
+          z1[l] += wd[i * lw + l] * v[i];
+          z2[l] += vd[i * lv + l] * v[i];
+        }
+      }
+      double vy = 0;
+      for (long i = c + 1; i < n; i++) {
+        y[i] = t * (y[i] - Dot(vd + i * lv, z1.data(), j) -
+                    Dot(wd + i * lw, z2.data(), j));
+        vy += v[i] * y[i];
+      }
+      // w = y - tau / 2 * (y^T v) * v makes the update A - v w^T - w v^T.
+      const double alpha = -0.5 * t * vy;
+      for (long i = 0; i < n; i++) {
+        vd[i * lv + j] = v[i];
+        wd[i * lw + j] = i > c ? y[i] + alpha * v[i] : 0;
+      }
+    }
+    const int s = k0 + kb;
+    Gemm(n - s, n - s, kb, -1.0, vd + (long)s * lv, lv, 1, wd + (long)s * lw,
+         1, lw, ad + (long)s * ld + s, ld);
+    Gemm(n - s, n - s, kb, -1.0, wd + (long)s * lw, lw, 1, vd + (long)s * lv,
+         1, lv, ad + (long)s * ld + s, ld);
+  }
+  if (n >= 2) {
+    d[n - 2] = a(n - 2, n - 2);
+    e[n - 2] = a(n - 1, n - 2);
+  }
+  d[n - 1] = a(n - 1, n - 1);
+}
+
+// Diagonalizes the symmetric tridiagonal matrix with diagonal d and
+// subdiagonal e (e[n - 1] unused) by implicit QL iteration with Wilkinson
+// shifts, leaving the eigenvalues in d, unordered. Each rotation is also
+// applied to the rows of z when given, so a z starting as the identity
+// ends with the eigenvector of d[i] in row i.
+static void TridiagonalQL(std::vector<double>& d, std::vector<double>& e,
+                          Matrix* z) {
+  const int n = d.size();
+  const double eps = std::numeric_limits<double>::epsilon();
+  std::vector<Rotation> rotations;
+  e[n - 1] = 0;
+  double shift = 0, norm = 0;
+  for (int l = 0; l < n; l++) {
+    norm = std::max(norm, fabs(d[l]) + fabs(e[l]));
+    int m = l;
+    while (m < n - 1 && fabs(e[m]) > eps * norm) m++;
+    while (m > l && fabs(e[l]) > eps * norm) {
+      double g = d[l];
+      double p = (d[l + 1] - g) / (2 * e[l]);
+      double r = hypot(p, 1.0);
+      if (p < 0) r = -r;
+      d[l] = e[l] / (p + r);
+      d[l + 1] = e[l] * (p + r);
+      const double dl1 = d[l + 1];
+      double h = g - d[l];
+      for (int i = l + 2; i < n; i++) d[i] -= h;
+      shift += h;
+      p = d[m];
+      double c = 1, c2 = 1, c3 = 1, s = 0, s2 = 0;
+      const double el1 = e[l + 1];
+      rotations.clear();
+      for (int i = m - 1; i >= l; i--) {
+        c3 = c2;
+        c2 = c;
+        s2 = s;
+        g = c * e[i];
+        h = c * p;
+        r = hypot(p, e[i]);
+        e[i + 1] = s * r;
+        s = e[i] / r;
+        c = p / r;
+        p = c * d[i] - s * g;
+        d[i + 1] = h + s * (c * g + s * d[i]);
+        rotations.push_back({i, i + 1, c, -s});
+      }
+      if (z) ApplyRotations(*z, rotations);
+      p = -s * s2 * c3 * el1 * e[l] / dl1;
+      e[l] = s * p;
+      d[l] = c * p;
+    }
+    d[l] += shift;
+    e[l] = 0;
+  }
+}
+
+static void CheckFinite(const MatrixView& a) {
+  for (int i = 0; i < a.GetRows(); i++)
+    for (int j = 0; j < a.GetCols(); j++)
+      if (!std::isfinite(a(i, j)))
+        throw std::invalid_argument("Matrix elements aren't finite!");
+}
+
+SymmetricEigen::SymmetricEigen() {}
+
+SymmetricEigen::SymmetricEigen(const MatrixArg& a, bool vectors) {
+  Factorize(a, vectors);
+}
+
+void SymmetricEigen::Factorize(const MatrixArg& a, bool vectors) {
+  if (a.GetRows() != a.GetCols())
+    throw std::invalid_argument("Only square matrices have eigenvalues!");
+  const int n = a.GetRows();
+  Matrix t(n, n);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j <= i; j++) t(i, j) = t(j, i) = a(i, j);
+  CheckFinite(t);
+  std::vector<double> e, tau;
+  Tridiagonalize(t, values_, e, tau);
+  if (!vectors) {
+    TridiagonalQL(values_, e, nullptr);
+    std::sort(values_.begin(), values_.end());
+    vectors_ = Matrix();
+    return;
+  }
+  Matrix z(n, n);
+  for (int i = 0; i < n; i++) z(i, i) = 1;
+  TridiagonalQL(values_, e, &z);
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&](int i, int j) { return values_[i] < values_[j]; });
+  // Eigenvector i of the tridiagonal matrix is row order[i] of z; Q takes
+  // them back to A's basis.
+  std::vector<double> sorted(n);
+  vectors_ = Matrix(n, n);
+  for (int i = 0; i < n; i++) {
+    sorted[i] = values_[order[i]];
+    for (int r = 0; r < n; r++) vectors_(r, i) = z(order[i], r);
+  }
+  values_ = sorted;
+  ApplyBlockReflectors(t, 1, tau, n - 2, vectors_);
+}
+
+const std::vector<double>& SymmetricEigen::GetValues() const {
+  return values_;
+}
+
+const Matrix& SymmetricEigen::GetVectors() const { return vectors_; }
+
+int SymmetricEigen::GetSize() const { return values_.size(); }
+
+// Reduces a, m x n with m >= n, to upper bidiagonal form Q^T * a * P with
+// diagonal d and superdiagonal e. Left reflector i, on rows i.., is left
+// below the diagonal of column i with tauq[i]; right reflector i, on
+// columns i + 1.., right of the superdiagonal of row i with taup[i].
+//
+// Panels of kReflectorBlock rows and columns are reduced as in LAPACK's
+// dlabrd: the trailing matrix stays as it was before the panel, corrected
+// on the fly by U * Y^T + X * V^T for the panel's reflectors, and is
+// updated by two GEMMs after it.
+static void Bidiagonalize(Matrix& a, std::vector<double>& d,
+                          std::vector<double>& e, std::vector<double>& tauq,
+                          std::vector<double>& taup) {
+  const int m = a.GetRows(), n = a.GetCols();
+  d.assign(n, 0);
+  e.assign(n, 0);
+  tauq.assign(n, 0);
+  taup.assign(n, 0);
+  std::vector<double> tmp(kReflectorBlock + 1), tmp2(kReflectorBlock);
+  Matrix xs(m, kReflectorBlock), ys(n, kReflectorBlock);
+  for (int k0 = 0; k0 < n; k0 += kReflectorBlock) {
+    const MatrixView b = MatrixView(a).Block(k0, k0, m - k0, n - k0);
+    const int rows = b.GetRows(), cols = b.GetCols(), ld = b.GetRowStride();
+    const int kb = std::min(kReflectorBlock, cols);
+    double* bd = b.GetData();
+    const int lx = xs.GetStride(), ly = ys.GetStride();
+    double *xd = xs.GetData(), *yd = ys.GetData();
+    auto at = [&](long r, long c) -> double& { return bd[r * ld + c]; };
+    for (int i = 0; i < kb; i++) {
+      // Column i catches up: a(i.., i) -= U * Y(i, :)^T + X * V(:, i).
+      for (long r = i; r < rows; r++) {
+        double sum = Dot(bd + r * ld, yd + (long)i * ly, i);
+        for (int l = 0; l < i; l++) sum += xd[r * lx + l] * at(l, i);
+        at(r, i) -= sum;
+      }
+      tauq[k0 + i] =
+          MakeReflector(at(i, i), &at(std::min(i + 1, rows - 1), i),
+                        rows - i - 1, ld);
+      d[k0 + i] = at(i, i);
+      if (i == cols - 1) break;
+      at(i, i) = 1;
+      // y = tauq * (A^T u - Y * U^T u - V^T * X^T u) over columns i + 1..
+      double* y = yd + (long)(i + 1) * ly + i;
+      ParallelFor(i + 1, cols, 2.0 * (rows - i) * (cols - i),
+                  [&](long lo, long hi) {
+                    std::vector<double> acc(hi - lo);
+                    for (long r = i; r < rows; r++)
+                      Kernels().axpy(acc.data(), at(r, i), bd + r * ld + lo,
+                                     hi - lo);
+                    for (long c = lo; c < hi; c++)
+                      y[(c - i - 1) * ly] = acc[c - lo];
+                  });
+      for (int l = 0; l < i; l++) {
+        tmp[l] = tmp2[l] = 0;
+        for (long r = i; r < rows; r++) {
+          tmp[l] += at(r, l) * at(r, i);
+          tmp2[l] += xd[r * lx + l] * at(r, i);
+        }
+      }
+      for (long c = i + 1; c < cols; c++) {
+        double sum = Dot(yd + c * ly, tmp.data(), i);
+        for (int l = 0; l < i; l++) sum += at(l, c) * tmp2[l];
+        y[(c - i - 1) * ly] = tauq[k0 + i] * (y[(c - i - 1) * ly] - sum);
+      }
+      // Row i catches up: a(i, i + 1..) -= Y * U(i, :)^T + V^T * X(i, :)^T.
+      for (long c = i + 1; c < cols; c++) {
+        double sum = Dot(yd + c * ly, bd + (long)i * ld, i + 1);
+        for (int l = 0; l < i; l++) sum += at(l, c) * xd[(long)i * lx + l];
+        at(i, c) -= sum;
+      }
+      taup[k0 + i] = MakeReflector(at(i, i + 1),
+                                   &at(i, std::min(i + 2, cols - 1)),
+                                   cols - i - 2, 1);
+      e[k0 + i] = at(i, i + 1);
+      at(i, i + 1) = 1;
+      // x = taup * (A v - U * Y^T v - X * V v) over rows i + 1..
+      const double* v = bd + (long)i * ld + i + 1;
+      double* x = xd + (long)(i + 1) * lx + i;
+      ParallelFor(i + 1, rows, 2.0 * (rows - i) * (cols - i),
+                  [&](long lo, long hi) {
+                    for (long r = lo; r < hi; r++)
+                      x[(r - i - 1) * lx] =
+                          Dot(bd + r * ld + i + 1, v, cols - i - 1);
+                  });
+      for (int l = 0; l <= i; l++) {
+        tmp[l] = 0;
+        for (long c = i + 1; c < cols; c++)
+          tmp[l] += yd[c * ly + l] * at(i, c);
+      }
+      for (int l = 0; l < i; l++)
+        tmp2[l] = Dot(bd + (long)l * ld + i + 1, v, cols - i - 1);
+      for (long r = i + 1; r < rows; r++) {
+        const double sum = Dot(bd + r * ld, tmp.data(), i + 1) +
+                           Dot(xd + r * lx, tmp2.data(), i);
+        x[(r - i - 1) * lx] = taup[k0 + i] * (x[(r - i - 1) * lx] - sum);
+      }
+    }
+    if (kb < cols && kb < rows) {
+      Gemm(rows - kb, cols - kb, kb, -1.0, bd + (long)kb * ld, ld, 1,
+           yd + (long)kb * ly, 1, ly, bd + (long)kb * ld + kb, ld);
+      Gemm(rows - kb, cols - kb, kb, -1.0, xd + (long)kb * lx, lx, 1,
+           bd + kb, ld, 1, bd + (long)kb * ld + kb, ld);
+    }
+    for (int i = 0; i < kb; i++) {
+      at(i, i) = d[k0 + i];
+      if (i + 1 < cols) at(i, i + 1) = e[k0 + i];
+    }
+  }
+}
+
+static void SwapRows(Matrix& z, int i, int j) {
+  double* row_i = z.GetData() + (long)i * z.GetStride();
+  std::swap_ranges(row_i, row_i + z.GetCols(),
+                   z.GetData() + (long)j * z.GetStride());
+}
+
+// Diagonalizes the upper bidiagonal matrix with diagonal s and
+// superdiagonal e (e[n - 1] unused) by implicit QR iteration, as in
+// LINPACK's dsvdc. The values end up nonnegative and descending in s; the
+// left and right rotations are applied to the rows of ut and vt when given.
+static void BidiagonalQR(std::vector<double>& s, std::vector<double>& e,
+                         Matrix* ut, Matrix* vt) {
+  const int n = s.size();
+  const double eps = std::numeric_limits<double>::epsilon();
+  const double tiny = std::numeric_limits<double>::min() / eps;
+  std::vector<Rotation> left, right;
+  e[n - 1] = 0;
+  auto flush = [&] {
+    if (ut && !left.empty()) ApplyRotations(*ut, left);
+    if (vt && !right.empty()) ApplyRotations(*vt, right);
+    left.clear();
+    right.clear();
+  };
+  for (int p = n; p > 0;) {
+    // e[k] negligible splits off the trailing block k + 1..p - 1.
+    int k = p - 2;
+    for (; k >= 0; k--)
+      if (fabs(e[k]) <= tiny + eps * (fabs(s[k]) + fabs(s[k + 1]))) {
+        e[k] = 0;
+        break;
+      }
+    int kase;
+    if (k == p - 2) {
+      kase = 4;
+    } else {
+      int ks = p - 1;
+      for (; ks > k; ks--) {
+        const double t = (ks != p ? fabs(e[ks]) : 0) +
+                         (ks != k + 1 ? fabs(e[ks - 1]) : 0);
+        if (fabs(s[ks]) <= tiny + eps * t) {
+          s[ks] = 0;
+          break;
+        }
+      }
+      if (ks == k) {
+        kase = 3;
+      } else if (ks == p - 1) {
+        kase = 1;
+      } else {
+        kase = 2;
+        k = ks;
+      }
+    }
+    k++;
+    if (kase == 1) {
+      // s[p - 1] is zero: chase e[p - 2] up out of the last column.
+      double f = e[p - 2];
+      e[p - 2] = 0;
+      for (int j = p - 2; j >= k; j--) {
+        const double t = hypot(s[j], f), cs = s[j] / t, sn = f / t;
+        s[j] = t;
+        if (j != k) {
+          f = -sn * e[j - 1];
+          e[j - 1] *= cs;
+        }
+        right.push_back({j, p - 1, cs, sn});
+      }
+      flush();
+    } else if (kase == 2) {
+      // s[k - 1] is zero: chase e[k - 1] along row k - 1.
+      double f = e[k - 1];
+      e[k - 1] = 0;
+      for (int j = k; j < p; j++) {
+        const double t = hypot(s[j], f), cs = s[j] / t, sn = f / t;
+        s[j] = t;
+        f = -sn * e[j];
+        e[j] *= cs;
+        left.push_back({j, k - 1, cs, sn});
+      }
+      flush();
+    } else if (kase == 3) {
+      // One shifted QR sweep over k..p - 1, the shift being the eigenvalue
+      // of the trailing 2 x 2 of B^T B closer to its last entry.
+      const double scale =
+          std::max({fabs(s[p - 1]), fabs(s[p - 2]), fabs(e[p - 2]),
+                    fabs(s[k]), fabs(e[k])});
+      const double sp = s[p - 1] / scale, spm1 = s[p - 2] / scale;
+      const double epm1 = e[p - 2] / scale, sk = s[k] / scale;
+      const double ek = e[k] / scale;
+      const double b = ((spm1 + sp) * (spm1 - sp) + epm1 * epm1) / 2;
+      const double c = (sp * epm1) * (sp * epm1);
+      double shift = 0;
+      if (b != 0 || c != 0) {
+        shift = sqrt(b * b + c);
+        if (b < 0) shift = -shift;
+        shift = c / (b + shift);
+      }
+      double f = (sk + sp) * (sk - sp) + shift, g = sk * ek;
+      for (int j = k; j < p - 1; j++) {
+        double t = hypot(f, g), cs = f / t, sn = g / t;
+        if (j != k) e[j - 1] = t;
+        f = cs * s[j] + sn * e[j];
+        e[j] = cs * e[j] - sn * s[j];
+        g = sn * s[j + 1];
+        s[j + 1] *= cs;
+        right.push_back({j, j + 1, cs, sn});
+        t = hypot(f, g);
+        cs = f / t;
+        sn = g / t;
+        s[j] = t;
+        f = cs * e[j] + sn * s[j + 1];
+        s[j + 1] = -sn * e[j] + cs * s[j + 1];
+        g = sn * e[j + 1];
+        e[j + 1] *= cs;
+        left.push_back({j, j + 1, cs, sn});
+      }
+      e[p - 2] = f;
+      flush();
+    } else {
+      // s[k] has converged: make it nonnegative and sort it into place.
+      if (s[k] <= 0) {
+        s[k] = s[k] < 0 ? -s[k] : 0;
+        if (vt) Kernels().scale(vt->GetData() + (long)k * vt->GetStride(), -1,
+                                vt->GetCols());
+      }
+      for (; k < n - 1 && s[k] < s[k + 1]; k++) {
+        std::swap(s[k], s[k + 1]);
+        if (ut) SwapRows(*ut, k, k + 1);
+        if (vt) SwapRows(*vt, k, k + 1);
+      }
+      p--;
+    }
+  }
+}
+
+SVD::SVD() {}
+
+SVD::SVD(const MatrixArg& a, bool vectors) { Factorize(a, vectors); }
+
+void SVD::Factorize(const MatrixArg& a, bool vectors) {
+  rows_ = a.GetRows();
+  cols_ = a.GetCols();
+  // Wide matrices are factored transposed, A^T = V * S * U^T.
+  const bool transposed = rows_ < cols_;
+  Matrix b = transposed ? a.Transposed() : MatrixView(a);
+  CheckFinite(b);
+  const int m = b.GetRows(), n = b.GetCols();
+  std::vector<double> e, tauq, taup;
+  Bidiagonalize(b, values_, e, tauq, taup);
+  if (!vectors) {
+    BidiagonalQR(values_, e, nullptr, nullptr);
+    u_ = v_ = Matrix();
+    return;
+  }
+  Matrix ut(n, n), vt(n, n);
+  for (int i = 0; i < n; i++) ut(i, i) = vt(i, i) = 1;
+  BidiagonalQR(values_, e, &ut, &vt);
+  // U = Q * [Ut^T; 0] and V = P * Vt^T.
+  Matrix u(m, n), v(vt.Transpose());
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) u(i, j) = ut(j, i);
+  ApplyBlockReflectors(b, 0, tauq, n, u);
+  ApplyBlockReflectors(MatrixView(b).Block(0, 0, n, n).Transposed(), 1, taup,
+                       n - 1, v);
+  u_ = transposed ? std::move(v) : std::move(u);
+  v_ = transposed ? std::move(u) : std::move(v);
+}
+
+const std::vector<double>& SVD::GetValues() const { return values_; }
+
+const Matrix& SVD::GetU() const { return u_; }
+
+const Matrix& SVD::GetV() const { return v_; }
+
+int SVD::Rank() const {
+  if (values_.empty()) return 0;
+  const double tolerance = std::max(rows_, cols_) * values_[0] *
+                           std::numeric_limits<double>::epsilon();
+  int rank = 0;
+  for (double value : values_)
+    if (value > tolerance) rank++;
+  return rank;
+}
+
+double SVD::Condition() const {
+  if (values_.empty() || values_.back() == 0)
+    return std::numeric_limits<double>::infinity();
+  return values_[0] / values_.back();
+}
+
+// Symmetric with a positive diagonal, so worth trying Cholesky on.
+static bool MaybePositiveDefinite(const MatrixView& a) {
+  for (int i = 0; i < a.GetRows(); i++) {
+    if (!(a(i, i) > 0)) return false;
+    for (int j = 0; j < i; j++)
+      if (a(i, j) != a(j, i)) return false;
+  }
+  return true;
+}
+
+Matrix SolveTriangular(const MatrixArg& t, const MatrixArg& b,
+                       Triangle triangle) {
+  const int n = t.GetRows();
+  if (t.GetCols() != n)
+    throw std::invalid_argument("Only square matrices are triangular!");
+  if (b.GetRows() != n)
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix size!");
+  for (int i = 0; i < n; i++)
+    if (t(i, i) == 0) throw std::invalid_argument("Matrix is singular!");
+  // The solver reads T through one unit stride and one other.
+  Matrix storage;
+  const MatrixView tv = t.GetColStride() == 1 || t.GetRowStride() == 1
+                            ? MatrixView(t)
+                            : MatrixView(storage = t);
+  Matrix x(b);
+  SolveTriangular(tv.GetData(), tv.GetRowStride(), tv.GetColStride(), n,
+                  triangle == Triangle::kUpper, false, x);
+  return x;
+}
+
+Matrix Solve(const MatrixArg& a, const MatrixArg& b) {
+  if (b.GetRows() != a.GetRows())
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix rows number!");
+  if (a.GetRows() != a.GetCols()) return QR(a).Solve(b);
+  if (MaybePositiveDefinite(a)) {
+    Cholesky cholesky(a);
+    if (cholesky.IsPositiveDefinite()) return cholesky.Solve(b);
+  }
+  return LU(a).Solve(b);
+}
+
+Matrix Solve(const MatrixArg& a, const MatrixArg& b, Precision precision,
+             Refinement* refinement) {
+  if (b.GetRows() != a.GetRows())
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix rows number!");
+  if (precision == Precision::kMixed) return MixedLU(a).Solve(b, refinement);
+  Matrix x = Solve(a, b);
+  if (refinement) *refinement = {BackwardError(a, x, b), 0, false};
+  return x;
+}
@@ -0,0 +1,256 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_DECOMP_H
+#define CPP1__MATRIXPLUS_0__MATRIX_DECOMP_H
+
+#include <vector>
+
+#include "matrix_generic.h"
+#include "matrix_oop.h"
+#include "matrix_structure.h"
+
+// Partial-pivoting LU factorization P * A = L * U, stored in place: U on
+// and above the diagonal, the unit lower L below it. A factorization can be
+// kept and reused for any number of solves.
+class LU {
+ public:
+  LU();
+  explicit LU(const MatrixArg& a);
+
+  // Refactors, reusing the storage of the previous factorization when the
+  // size is unchanged.
+  void Factorize(const MatrixArg& a);
+  // True when a pivot came out exactly zero.
+  bool IsSingular() const;
+  double Determinant() const;
+  // Solves A * X = B for every column of B.
+  Matrix Solve(const MatrixArg& b) const;
+  Matrix Inverse() const;
+  // Transposed adjugate, det(A) * inverse(A)^T, without dividing by a
+  // small last pivot. Requires every pivot but the last to be nonzero.
+  Matrix Complements() const;
+  int GetSize() const;
+  const Matrix& GetFactors() const;
+  // Row i of P * A is row GetPermutation()[i] of A.
+  const std::vector<int>& GetPermutation() const;
+
+ private:
+  void PermuteRows(Matrix& x) const;
+  void SolveLower(Matrix& x) const;
+  void SolveUpper(Matrix& x) const;
+  Matrix lu_;
+  std::vector<int> swaps_, permutation_;
+  int sign_{1};
+  bool singular_{false};
+};
+
+// Arithmetic a solve or inverse runs in: kDouble throughout, or kMixed,
+// factoring in float and refining the solution in double.
+enum class Precision { kDouble, kMixed };
+
+// How far a solution X of A * X = B got: its normwise backward error, the
+// largest over the columns of ||B - A * X|| / (||A|| * ||X|| + ||B||) in
+// the infinity norm, and the refinement it took.
+struct Refinement {
+  double residual{};
+  // Correction steps after the first solve.
+  int iterations{};
+  // True when float refinement didn't converge and the solution came from
+  // a double LU instead.
+  bool fallback{};
+};
+
+double BackwardError(const MatrixArg& a, const MatrixArg& x,
+                     const MatrixArg& b);
+
+// LU factorization in float with solutions refined in double. The O(n^3)
+// factorization runs on FloatLU, twice the SIMD lanes and half the memory
+// traffic of LU; each refinement step is a double residual B - A * X and a
+// float correction solve, O(n^2) per column of B. Refinement stops at a
+// backward error of sqrt(n) * epsilon, double accuracy, which takes a step
+// or two while A is well conditioned for float, cond(A) up to about 1e6.
+// Past that, or when A is singular or out of range in float, the solution
+// comes from a double LU instead, so results are as accurate as LU's
+// either way.
+//
+// It pays off for large solves with few right-hand sides, where the
+// factorization is nearly all the work. An inverse is n of them: each
+// refinement step adds a double GEMM and a float solve of n columns, so
+// it takes several times as long as LU's inverse, for the same accuracy.
+class MixedLU {
+ public:
+  MixedLU();
+  explicit MixedLU(const MatrixArg& a);
+
+  // Keeps a double copy of A for the residuals.
+  void Factorize(const MatrixArg& a);
+  double Determinant() const;
+  // Solves A * X = B for every column of B.
+  Matrix Solve(const MatrixArg& b, Refinement* refinement = nullptr) const;
+  Matrix Inverse(Refinement* refinement = nullptr) const;
+  int GetSize() const;
+
+ private:
+  Matrix a_;
+  double norm_{};
+  FloatLU lu_;
+};
+
+// Partial-pivoting LU of a banded matrix, kept in band storage: O(n *
+// lower * (lower + upper)) work and O(n * (2 * lower + upper)) memory
+// instead of O(n^3) and O(n^2). Pivoting widens the upper band of U to
+// lower + upper. Elements outside the band aren't read.
+class BandLU {
+ public:
+  BandLU();
+  // The band of a is detected, see matrix_structure.h.
+  explicit BandLU(const MatrixArg& a);
+  BandLU(const MatrixArg& a, Bandwidth band);
+
+  void Factorize(const MatrixArg& a, Bandwidth band);
+  bool IsSingular() const;
+  double Determinant() const;
+  // Solves A * X = B for every column of B.
+  Matrix Solve(const MatrixArg& b) const;
+  Matrix Inverse() const;
+  int GetSize() const;
+  Bandwidth GetBandwidth() const;
+
+ private:
+  // Element (i, j) of the factors, for j - i in [-lower, lower + upper].
+  double& At(int i, int j) const {
+    return band_(i, j - i + bandwidth_.lower);
+  }
+  Matrix band_;
+  Bandwidth bandwidth_{0, 0};
+  std::vector<int> swaps_;
+  int sign_{1};
+  bool singular_{false};
+};
+
+// Cholesky factorization A = L * L^T of a symmetric positive definite
+// matrix, half the work of LU and stable without pivoting. Only the lower
+// triangle of A is read.
+class Cholesky {
+ public:
+  Cholesky();
+  explicit Cholesky(const MatrixArg& a);
+
+  void Factorize(const MatrixArg& a);
+  // False when a pivot came out nonpositive: A isn't positive definite and
+  // Determinant() and Solve() throw.
+  bool IsPositiveDefinite() const;
+  double Determinant() const;
+  // Solves A * X = B for every column of B.
+  Matrix Solve(const MatrixArg& b) const;
+  int GetSize() const;
+  // L, zero above the diagonal.
+  const Matrix& GetFactor() const;
+
+ private:
+  Matrix l_;
+  bool positive_{false};
+};
+
+// Householder QR factorization A = Q * R. Reflector k is I - tau_k * v_k *
+// v_k^T, with v_k below the diagonal of column k of GetFactors() (its
+// leading 1 implied) and R on and above the diagonal. A matrix with fewer
+// rows than columns is factored transposed.
+class QR {
+ public:
+  QR();
+  explicit QR(const MatrixArg& a);
+
+  void Factorize(const MatrixArg& a);
+  // True when a diagonal entry of R is negligible next to the largest one;
+  // Solve() throws then.
+  bool IsRankDeficient() const;
+  // X minimizing the residual of A * X = B column by column; when A has
+  // fewer rows than columns, the solution of least norm.
+  Matrix Solve(const MatrixArg& b) const;
+  int GetRows() const;
+  int GetCols() const;
+  // Factors of A, or of A^T when IsTransposed().
+  const Matrix& GetFactors() const;
+  bool IsTransposed() const;
+
+ private:
+  // x = Q^T * x or x = Q * x, x having as many rows as the factors.
+  void ApplyReflectors(Matrix& x, bool transposed) const;
+  Matrix qr_;
+  std::vector<double> tau_;
+  bool transposed_{false}, deficient_{false};
+};
+
+// Eigendecomposition A = V * diag(values) * V^T of a symmetric matrix, V
+// orthogonal. A is reduced to tridiagonal form by blocked Householder
+// reflections, whose trailing updates are GEMMs, and the tridiagonal matrix
+// is diagonalized by implicit QL iteration. Only the lower triangle of A is
+// read.
+class SymmetricEigen {
+ public:
+  SymmetricEigen();
+  explicit SymmetricEigen(const MatrixArg& a, bool vectors = true);
+
+  // Without vectors only the values are computed, in O(n^2) after the
+  // reduction instead of O(n^3).
+  void Factorize(const MatrixArg& a, bool vectors = true);
+  // Ascending.
+  const std::vector<double>& GetValues() const;
+  // Column i is the unit eigenvector of GetValues()[i]; empty when factored
+  // without vectors.
+  const Matrix& GetVectors() const;
+  int GetSize() const;
+
+ private:
+  std::vector<double> values_;
+  Matrix vectors_;
+};
+
+// Thin singular value decomposition A = U * diag(values) * V^T of an m x n
+// matrix: for p = min(m, n), U is m x p and V is n x p, both with
+// orthonormal columns. A is reduced to bidiagonal form by blocked
+// Householder reflections and the bidiagonal matrix is diagonalized by
+// implicit QR iteration.
+class SVD {
+ public:
+  SVD();
+  explicit SVD(const MatrixArg& a, bool vectors = true);
+
+  void Factorize(const MatrixArg& a, bool vectors = true);
+  // Descending and nonnegative.
+  const std::vector<double>& GetValues() const;
+  // Empty when factored without vectors.
+  const Matrix& GetU() const;
+  const Matrix& GetV() const;
+  // Singular values above max(m, n) * epsilon * the largest one.
+  int Rank() const;
+  // Largest over smallest singular value, infinite for a singular matrix.
+  double Condition() const;
+
+ private:
+  std::vector<double> values_;
+  Matrix u_, v_;
+  int rows_{0}, cols_{0};
+};
+
+// Which triangle of a matrix is read.
+enum class Triangle { kLower, kUpper };
+
+// X with T * X = B for every column of B, reading only the given triangle
+// of T. Blocked like the LU solves, so it costs n^2 per column of B, most
+// of it in GEMM; a triangular inverse is the solve against the identity.
+Matrix SolveTriangular(const MatrixArg& t, const MatrixArg& b,
+                       Triangle triangle);
+
+// X with A * X = B for every column of B, without forming an inverse:
+// Cholesky for symmetric matrices with a positive diagonal that turn out
+// positive definite, LU for other square matrices and QR least squares for
+// rectangular ones. Keep an LU, Cholesky or QR object to solve repeatedly
+// with the same A.
+Matrix Solve(const MatrixArg& a, const MatrixArg& b);
+// Solve in the given precision; kMixed solves through MixedLU and so
+// requires a square A. The backward error reached goes to refinement when
+// given.
+Matrix Solve(const MatrixArg& a, const MatrixArg& b, Precision precision,
+             Refinement* refinement = nullptr);
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_DECOMP_H
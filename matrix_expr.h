@@ -0,0 +1,341 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_EXPR_H
+#define CPP1__MATRIXPLUS_0__MATRIX_EXPR_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+#include "matrix_oop.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+// Lazy element-wise expressions. A + B * 2.0 - C builds a tree of small
+// nodes that is evaluated in a single pass when it is assigned to a Matrix,
+// one strip of a row at a time through a buffer that stays in L1. Nodes
+// refer to their Matrix operands, so an expression must be consumed within
+// the statement that builds it.
+#define EXPR_STRIP 256
+
+// Every node provides GetRows(), GetCols(), Reads(dst) telling how the
+// elements the expression reads overlap view dst, and
+//   EvalSpan(i, j0, n, out): out[0, n) = row i, columns [j0, j0 + n),
+//   AddSpan(i, j0, n, sign, out): out[0, n) += sign * the same elements.
+template <typename E>
+class MatrixExpr {
+ public:
+  const E& Self() const { return static_cast<const E&>(*this); }
+};
+
+// Leaf referring to a Matrix, or a view of one, that outlives the
+// expression. Views with a column stride are gathered element by element.
+class MatrixRef : public MatrixExpr<MatrixRef> {
+ public:
+  explicit MatrixRef(const MatrixView& v) : v_(v) {}
+  int GetRows() const { return v_.GetRows(); }
+  int GetCols() const { return v_.GetCols(); }
+  Overlap Reads(const MatrixView& dst) const { return v_.OverlapWith(dst); }
+  const double* Span(int i, int j0) const {
+    return v_.GetData() + (long)i * v_.GetRowStride() +
+           (long)j0 * v_.GetColStride();
+  }
+  void EvalSpan(int i, int j0, int n, double* out) const {
+    const double* src = Span(i, j0);
+    const long cs = v_.GetColStride();
+    if (cs == 1) {
+      std::memcpy(out, src, n * sizeof(double));
+      return;
+    }
+    for (int j = 0; j < n; j++) out[j] = src[j * cs];
+  }
+  void AddSpan(int i, int j0, int n, double sign, double* out) const {
+    const double* src = Span(i, j0);
+    const long cs = v_.GetColStride();
+    if (cs != 1) {
+      for (int j = 0; j < n; j++) out[j] += sign * src[j * cs];
+      return;
+    }
+    const SimdKernels& k = Kernels();
+    if (sign == 1)
+      k.add(out, src, n);
+    else if (sign == -1)
+      k.sub(out, src, n);
+    else
+      k.axpy(out, sign, src, n);
+  }
+
+ private:
+  MatrixView v_;
+};
+
+// Leaf owning a Matrix materialized from a product inside an expression.
+class MatrixValue : public MatrixExpr<MatrixValue> {
+ public:
+  explicit MatrixValue(std::shared_ptr<const Matrix> m)
+      : m_(std::move(m)), ref_(*m_) {}
+  int GetRows() const { return ref_.GetRows(); }
+  int GetCols() const { return ref_.GetCols(); }
+  Overlap Reads(const MatrixView&) const { return Overlap::kNone; }
+  void EvalSpan(int i, int j0, int n, double* out) const {
+    ref_.EvalSpan(i, j0, n, out);
+  }
+  void AddSpan(int i, int j0, int n, double sign, double* out) const {
+    ref_.AddSpan(i, j0, n, sign, out);
+  }
+
+ private:
+  std::shared_ptr<const Matrix> m_;
+  MatrixRef ref_;
+};
+
+// L + R when Sign is 1, L - R when it is -1.
+template <typename L, typename R, int Sign>
+class MatrixBinary : public MatrixExpr<MatrixBinary<L, R, Sign>> {
+ public:
+  MatrixBinary(const L& l, const R& r) : l_(l), r_(r) {
+    if (l.GetRows() != r.GetRows() || l.GetCols() != r.GetCols())
+      throw std::invalid_argument("Matrix dimensions aren't equal!");
+  }
+  int GetRows() const { return l_.GetRows(); }
+  int GetCols() const { return l_.GetCols(); }
+  Overlap Reads(const MatrixView& dst) const {
+    return std::max(l_.Reads(dst), r_.Reads(dst));
+  }
+  void EvalSpan(int i, int j0, int n, double* out) const {
+    l_.EvalSpan(i, j0, n, out);
+    r_.AddSpan(i, j0, n, Sign, out);
+  }
+  void AddSpan(int i, int j0, int n, double sign, double* out) const {
+    l_.AddSpan(i, j0, n, sign, out);
+    r_.AddSpan(i, j0, n, sign * Sign, out);
+  }
+
+ private:
+  L l_;
+  R r_;
+};
+
+template <typename E>
+class MatrixScale : public MatrixExpr<MatrixScale<E>> {
+ public:
+  MatrixScale(const E& e, double num) : e_(e), num_(num) {
+    if (isnan(num) || isinf(num))
+      throw std::invalid_argument("Invalid number, inf or nan!");
+  }
+  int GetRows() const { return e_.GetRows(); }
+  int GetCols() const { return e_.GetCols(); }
+  Overlap Reads(const MatrixView& dst) const { return e_.Reads(dst); }
+  void EvalSpan(int i, int j0, int n, double* out) const {
+    e_.EvalSpan(i, j0, n, out);
+    Kernels().scale(out, num_, n);
+  }
+  // Scaled leaves fold into one axpy instead of a copy and a scale.
+  void AddSpan(int i, int j0, int n, double sign, double* out) const {
+    e_.AddSpan(i, j0, n, sign * num_, out);
+  }
+
+ private:
+  E e_;
+  double num_;
+};
+
+// m read as its transpose. Products take it through swapped strides, so
+// A * Transposed(B) never materializes B^T.
+inline MatrixView Transposed(const Matrix& m) {
+  return MatrixView(m).Transposed();
+}
+
+// A read-only argument: a Matrix, a view, or an expression or product,
+// which is evaluated into a matrix the argument keeps alive. Products and
+// the decompositions take their inputs this way, so views are read in
+// place and anything else converts as it did to const Matrix&.
+class MatrixArg : public MatrixView {
+ public:
+  MatrixArg(const Matrix& m) : MatrixView(m) {}
+  MatrixArg(const MatrixView& v) : MatrixView(v) {}
+  template <typename E>
+  MatrixArg(const MatrixExpr<E>& e) : MatrixArg(std::make_shared<Matrix>(e)) {}
+  MatrixArg(const MatrixProduct& p);
+  MatrixArg(const MatrixArg& other) = default;
+  // Would copy elements through MatrixView::operator=.
+  MatrixArg& operator=(const MatrixArg&) = delete;
+
+ private:
+  explicit MatrixArg(std::shared_ptr<const Matrix> m)
+      : MatrixView(*m), owned_(std::move(m)) {}
+  std::shared_ptr<const Matrix> owned_;
+};
+
+// Unevaluated A * B. Assigning it runs GEMM straight into the destination,
+// and C += A * B or C -= A * B accumulate without a product temporary.
+// Operands that are themselves expressions are materialized first; views
+// are read in place through their strides.
+class MatrixProduct {
+ public:
+  MatrixProduct(MatrixArg a, MatrixArg b);
+  int GetRows() const;
+  int GetCols() const;
+  const MatrixView& GetLeft() const;
+  const MatrixView& GetRight() const;
+  // kNone unless an operand shares storage with dst, in which case GEMM
+  // can't write dst directly.
+  Overlap Reads(const MatrixView& dst) const;
+  // c += alpha * A * B; c must not overlap the operands.
+  void AddTo(const MatrixView& c, double alpha) const;
+
+ private:
+  MatrixArg a_, b_;
+};
+
+template <typename T>
+struct ExprNode {
+  using type = T;
+  static const T& Wrap(const T& e) { return e; }
+};
+
+template <>
+struct ExprNode<Matrix> {
+  using type = MatrixRef;
+  static MatrixRef Wrap(const Matrix& m) { return MatrixRef(m); }
+};
+
+template <>
+struct ExprNode<MatrixView> {
+  using type = MatrixRef;
+  static MatrixRef Wrap(const MatrixView& v) { return MatrixRef(v); }
+};
+
+template <>
+struct ExprNode<MatrixProduct> {
+  using type = MatrixValue;
+  static MatrixValue Wrap(const MatrixProduct& p) {
+    return MatrixValue(std::make_shared<const Matrix>(p));
+  }
+};
+
+template <typename T>
+struct IsMatrixOperand
+    : std::integral_constant<bool,
+                             std::is_same<T, Matrix>::value ||
+                                 std::is_same<T, MatrixView>::value ||
+                                 std::is_same<T, MatrixProduct>::value ||
+                                 std::is_base_of<MatrixExpr<T>, T>::value> {};
+
+template <typename L, typename R>
+using EnableBinary = std::enable_if_t<
+    IsMatrixOperand<L>::value && IsMatrixOperand<R>::value, int>;
+
+template <typename L, typename R, EnableBinary<L, R> = 0>
+MatrixBinary<typename ExprNode<L>::type, typename ExprNode<R>::type, 1>
+operator+(const L& l, const R& r) {
+  return {ExprNode<L>::Wrap(l), ExprNode<R>::Wrap(r)};
+}
+
+template <typename L, typename R, EnableBinary<L, R> = 0>
+MatrixBinary<typename ExprNode<L>::type, typename ExprNode<R>::type, -1>
+operator-(const L& l, const R& r) {
+  return {ExprNode<L>::Wrap(l), ExprNode<R>::Wrap(r)};
+}
+
+template <typename E, std::enable_if_t<IsMatrixOperand<E>::value, int> = 0>
+MatrixScale<typename ExprNode<E>::type> operator*(const E& e,
+                                                  const double num) {
+  return {ExprNode<E>::Wrap(e), num};
+}
+
+template <typename E, std::enable_if_t<IsMatrixOperand<E>::value, int> = 0>
+MatrixScale<typename ExprNode<E>::type> operator*(const double num,
+                                                  const E& e) {
+  return {ExprNode<E>::Wrap(e), num};
+}
+
+template <typename L, typename R, EnableBinary<L, R> = 0>
+MatrixProduct operator*(const L& l, const R& r) {
+  return MatrixProduct(l, r);
+}
+
+template <typename E>
+Matrix::BasicMatrix(const MatrixExpr<E>& e) {
+  *this = e;
+}
+
+template <typename E>
+Matrix& Matrix::operator=(const MatrixExpr<E>& expr) {
+  const E& e = expr.Self();
+  // An operand reading this matrix element for element has its shape, so
+  // reshaping never touches storage the expression still reads; any other
+  // overlap, like a view of another part of it, needs a temporary.
+  const Overlap overlap = e.Reads(*this);
+  if (overlap == Overlap::kPartial) return *this = Matrix(e);
+  if (rows_ != e.GetRows() || cols_ != e.GetCols())
+    Reshape(e.GetRows(), e.GetCols());
+  // When the destination is also an operand, each strip is evaluated into
+  // a buffer before it is stored; otherwise straight into the row.
+  const bool aliased = overlap == Overlap::kSame;
+  ParallelFor(0, rows_, (double)rows_ * cols_, [&](long lo, long hi) {
+    double strip[EXPR_STRIP];
+    for (long i = lo; i < hi; i++)
+      for (int j0 = 0; j0 < cols_; j0 += EXPR_STRIP) {
+        int n = std::min(EXPR_STRIP, cols_ - j0);
+        if (!aliased) {
+          e.EvalSpan(i, j0, n, Row(i) + j0);
+          continue;
+        }
+        e.EvalSpan(i, j0, n, strip);
+        std::memcpy(Row(i) + j0, strip, n * sizeof(double));
+      }
+  });
+  return *this;
+}
+
+template <typename E>
+Matrix& Matrix::operator+=(const MatrixExpr<E>& e) {
+  return *this = *this + e.Self();
+}
+
+template <typename E>
+Matrix& Matrix::operator-=(const MatrixExpr<E>& e) {
+  return *this = *this - e.Self();
+}
+
+template <typename E>
+MatrixView& MatrixView::operator=(const MatrixExpr<E>& expr) {
+  const E& e = expr.Self();
+  CheckShape(e.GetRows(), e.GetCols());
+  const Overlap overlap = e.Reads(*this);
+  if (overlap == Overlap::kPartial) {
+    Matrix value(e);
+    return *this = MatrixView(value);
+  }
+  // Strips go straight into rows with unit stride unless the destination
+  // is also an operand, and are scattered otherwise.
+  const bool direct = overlap == Overlap::kNone && col_stride_ == 1;
+  ParallelFor(0, rows_, (double)rows_ * cols_, [&](long lo, long hi) {
+    double strip[EXPR_STRIP];
+    for (long i = lo; i < hi; i++)
+      for (int j0 = 0; j0 < cols_; j0 += EXPR_STRIP) {
+        int n = std::min(EXPR_STRIP, cols_ - j0);
+        double* dst = Ptr(i, j0);
+        if (direct) {
+          e.EvalSpan(i, j0, n, dst);
+          continue;
+        }
+        e.EvalSpan(i, j0, n, strip);
+        for (int j = 0; j < n; j++) dst[(long)j * col_stride_] = strip[j];
+      }
+  });
+  return *this;
+}
+
+template <typename E>
+MatrixView& MatrixView::operator+=(const MatrixExpr<E>& e) {
+  return *this = *this + e.Self();
+}
+
+template <typename E>
+MatrixView& MatrixView::operator-=(const MatrixExpr<E>& e) {
+  return *this = *this - e.Self();
+}
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_EXPR_H
@@ -0,0 +1,288 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_FIXED_H
+#define CPP1__MATRIXPLUS_0__MATRIX_FIXED_H
+
+#include <math.h>
+
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix_oop.h"
+
+// Matrix with compile-time dimensions and inline storage, for the 2x2 to
+// 4x4 transforms where heap storage and runtime checks of Matrix dominate.
+// Mismatched shapes in +, - and * fail to compile; the loops have constant
+// bounds and are unrolled by the compiler.
+template <int R, int C>
+class FixedMatrix {
+  static_assert(R > 0 && C > 0, "Matrix dimensions aren't positive!");
+
+ public:
+  static constexpr int kRows = R;
+  static constexpr int kCols = C;
+
+  constexpr FixedMatrix() : m_{} {}
+  FixedMatrix(std::initializer_list<double> m) : m_{} {
+    if (m.size() != (std::size_t)R * C)
+      throw std::invalid_argument("Incorrect sizes, or initializer list");
+    auto k = m.begin();
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++) m_[i][j] = *k++;
+  }
+  explicit FixedMatrix(const Matrix& other) : m_{} {
+    if (other.GetRows() != R || other.GetCols() != C)
+      throw std::invalid_argument("Matrix dimensions aren't equal!");
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++)
+        m_[i][j] = other.GetData()[(long)i * other.GetStride() + j];
+  }
+
+  static constexpr FixedMatrix Identity() {
+    static_assert(R == C, "Only square matrices have identity!");
+    FixedMatrix result;
+    for (int i = 0; i < R; i++) result.m_[i][i] = 1;
+    return result;
+  }
+
+  Matrix ToMatrix() const {
+    Matrix result(R, C);
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++)
+        result.GetData()[(long)i * result.GetStride() + j] = m_[i][j];
+    return result;
+  }
+
+  constexpr int GetRows() const { return R; }
+  constexpr int GetCols() const { return C; }
+
+  double& operator()(int row, int col) {
+    CheckIndex(row, col);
+    return m_[row][col];
+  }
+  double operator()(int row, int col) const {
+    CheckIndex(row, col);
+    return m_[row][col];
+  }
+
+  bool EqMatrix(const FixedMatrix& other) const {
+    bool equal = true;
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++)
+        equal &= fabs(m_[i][j] - other.m_[i][j]) <= EPS;
+    return equal;
+  }
+  void SumMatrix(const FixedMatrix& other) {
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++) m_[i][j] += other.m_[i][j];
+  }
+  void SubMatrix(const FixedMatrix& other) {
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++) m_[i][j] -= other.m_[i][j];
+  }
+  void MulNumber(const double num) {
+    if (isnan(num) || isinf(num))
+      throw std::invalid_argument("Invalid number, inf or nan!");
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++) m_[i][j] *= num;
+  }
+  void MulMatrix(const FixedMatrix<C, C>& other) { *this = *this * other; }
+
+  FixedMatrix<C, R> Transpose() const {
+    FixedMatrix<C, R> result;
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++) result.At(j, i) = m_[i][j];
+    return result;
+  }
+
+  double Determinant() const {
+    static_assert(R == C, "Only square matrices have determinant!");
+    return DeterminantOf(*this);
+  }
+
+  FixedMatrix CalcComplements() const {
+    static_assert(R == C, "Only square matrices have complements matrix!");
+    if constexpr (R == 4) return Adjugate().Transpose();
+    FixedMatrix result;
+    if (R == 1) {
+      result.m_[0][0] = 1;
+      return result;
+    }
+    for (int i = 0; i < R; i++)
+      for (int j = 0; j < C; j++)
+        result.m_[i][j] = DeterminantOf(Minor(i, j)) * ((i + j) % 2 ? -1 : 1);
+    return result;
+  }
+
+  FixedMatrix InverseMatrix() const {
+    static_assert(R == C, "Only square matrices have inverse matrix!");
+    double det = Determinant();
+    if (fabs(det) < EPS)
+      throw std::invalid_argument("This matrix has no inverse matrix!");
+    FixedMatrix result = Adjugate();
+    result.MulNumber(1 / det);
+    return result;
+  }
+
+  FixedMatrix& operator+=(const FixedMatrix& other) {
+    SumMatrix(other);
+    return *this;
+  }
+  FixedMatrix& operator-=(const FixedMatrix& other) {
+    SubMatrix(other);
+    return *this;
+  }
+  FixedMatrix& operator*=(const FixedMatrix<C, C>& other) {
+    MulMatrix(other);
+    return *this;
+  }
+  FixedMatrix& operator*=(const double num) {
+    MulNumber(num);
+    return *this;
+  }
+
+  // Unchecked element access for the kernels.
+  constexpr double& At(int row, int col) { return m_[row][col]; }
+  constexpr double At(int row, int col) const { return m_[row][col]; }
+
+ private:
+  void CheckIndex(int row, int col) const {
+    if (row >= R || col >= C || col < 0 || row < 0)
+      throw std::out_of_range("Incorrect input, index is out of range");
+  }
+
+  FixedMatrix<(R > 1 ? R - 1 : 1), (C > 1 ? C - 1 : 1)> Minor(int x,
+                                                              int y) const {
+    FixedMatrix<(R > 1 ? R - 1 : 1), (C > 1 ? C - 1 : 1)> result;
+    for (int i = 0, k = 0; i < R; i++) {
+      if (i == x) continue;
+      for (int j = 0, n = 0; j < C; j++)
+        if (j != y) result.At(k, n++) = m_[i][j];
+      k++;
+    }
+    return result;
+  }
+
+  // 2x2 minors of the top rows (s) and of the bottom rows (c) of a 4x4
+  // matrix, indexed by column pair 01, 02, 03, 12, 13, 23; the determinant
+  // and the adjugate are both sums of their products.
+  static void PairMinors(const FixedMatrix<4, 4>& a, double* s, double* c) {
+    static constexpr int kPairs[6][2] = {{0, 1}, {0, 2}, {0, 3},
+                                         {1, 2}, {1, 3}, {2, 3}};
+    for (int p = 0; p < 6; p++) {
+      const int x = kPairs[p][0], y = kPairs[p][1];
+      s[p] = a.At(0, x) * a.At(1, y) - a.At(1, x) * a.At(0, y);
+      c[p] = a.At(2, x) * a.At(3, y) - a.At(3, x) * a.At(2, y);
+    }
+  }
+
+  FixedMatrix Adjugate() const {
+    if constexpr (R == 4) {
+      double s[6], c[6];
+      PairMinors(*this, s, c);
+      // Row i of the adjugate is built from column i of the matrix, the
+      // top-row minors for the bottom rows and vice versa.
+      const auto& a = m_;
+      return {a[1][1] * c[5] - a[1][2] * c[4] + a[1][3] * c[3],
+              -a[0][1] * c[5] + a[0][2] * c[4] - a[0][3] * c[3],
+              a[3][1] * s[5] - a[3][2] * s[4] + a[3][3] * s[3],
+              -a[2][1] * s[5] + a[2][2] * s[4] - a[2][3] * s[3],
+              -a[1][0] * c[5] + a[1][2] * c[2] - a[1][3] * c[1],
+              a[0][0] * c[5] - a[0][2] * c[2] + a[0][3] * c[1],
+              -a[3][0] * s[5] + a[3][2] * s[2] - a[3][3] * s[1],
+              a[2][0] * s[5] - a[2][2] * s[2] + a[2][3] * s[1],
+              a[1][0] * c[4] - a[1][1] * c[2] + a[1][3] * c[0],
+              -a[0][0] * c[4] + a[0][1] * c[2] - a[0][3] * c[0],
+              a[3][0] * s[4] - a[3][1] * s[2] + a[3][3] * s[0],
+              -a[2][0] * s[4] + a[2][1] * s[2] - a[2][3] * s[0],
+              -a[1][0] * c[3] + a[1][1] * c[1] - a[1][2] * c[0],
+              a[0][0] * c[3] - a[0][1] * c[1] + a[0][2] * c[0],
+              -a[3][0] * s[3] + a[3][1] * s[1] - a[3][2] * s[0],
+              a[2][0] * s[3] - a[2][1] * s[1] + a[2][2] * s[0]};
+    } else {
+      return CalcComplements().Transpose();
+    }
+  }
+
+  template <int N>
+  static double DeterminantOf(const FixedMatrix<N, N>& a) {
+    if constexpr (N == 1) {
+      return a.At(0, 0);
+    } else if constexpr (N == 2) {
+      return a.At(0, 0) * a.At(1, 1) - a.At(0, 1) * a.At(1, 0);
+    } else if constexpr (N == 3) {
+      return a.At(0, 0) * (a.At(1, 1) * a.At(2, 2) - a.At(1, 2) * a.At(2, 1)) -
+             a.At(0, 1) * (a.At(1, 0) * a.At(2, 2) - a.At(1, 2) * a.At(2, 0)) +
+             a.At(0, 2) * (a.At(1, 0) * a.At(2, 1) - a.At(1, 1) * a.At(2, 0));
+    } else if constexpr (N == 4) {
+      double s[6], c[6];
+      PairMinors(a, s, c);
+      return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] -
+             s[4] * c[1] + s[5] * c[0];
+    } else {
+      // Larger sizes: Gaussian elimination with partial pivoting in place.
+      FixedMatrix<N, N> lu = a;
+      double det = 1;
+      for (int c = 0; c < N; c++) {
+        int p = c;
+        for (int i = c + 1; i < N; i++)
+          if (fabs(lu.At(i, c)) > fabs(lu.At(p, c))) p = i;
+        if (lu.At(p, c) == 0) return 0;
+        if (p != c) {
+          for (int j = 0; j < N; j++) std::swap(lu.At(p, j), lu.At(c, j));
+          det = -det;
+        }
+        det *= lu.At(c, c);
+        for (int i = c + 1; i < N; i++) {
+          double l = lu.At(i, c) / lu.At(c, c);
+          for (int j = c + 1; j < N; j++) lu.At(i, j) -= l * lu.At(c, j);
+        }
+      }
+      return det;
+    }
+  }
+
+  double m_[R][C];
+};
+
+template <int R, int C>
+bool operator==(const FixedMatrix<R, C>& a, const FixedMatrix<R, C>& b) {
+  return a.EqMatrix(b);
+}
+
+template <int R, int C>
+FixedMatrix<R, C> operator+(FixedMatrix<R, C> a, const FixedMatrix<R, C>& b) {
+  a.SumMatrix(b);
+  return a;
+}
+
+template <int R, int C>
+FixedMatrix<R, C> operator-(FixedMatrix<R, C> a, const FixedMatrix<R, C>& b) {
+  a.SubMatrix(b);
+  return a;
+}
+
+template <int R, int C>
+FixedMatrix<R, C> operator*(FixedMatrix<R, C> a, const double num) {
+  a.MulNumber(num);
+  return a;
+}
+
+template <int R, int C>
+FixedMatrix<R, C> operator*(const double num, FixedMatrix<R, C> a) {
+  a.MulNumber(num);
+  return a;
+}
+
+template <int R, int K, int C>
+FixedMatrix<R, C> operator*(const FixedMatrix<R, K>& a,
+                            const FixedMatrix<K, C>& b) {
+  FixedMatrix<R, C> result;
+  for (int i = 0; i < R; i++)
+    for (int k = 0; k < K; k++) {
+      double aik = a.At(i, k);
+      for (int j = 0; j < C; j++) result.At(i, j) += aik * b.At(k, j);
+    }
+  return result;
+}
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_FIXED_H
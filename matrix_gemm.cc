@@ -0,0 +1,89 @@
+#include "matrix_gemm.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+// Cache blocks of the packed panels: a KC x NR sliver of B stays in L1, an
+// MC x KC block of A in L2 and a KC x NC panel of B in L3. MC and NC are
+// multiples of every micro-kernel's register block (see matrix_simd.cc).
+static constexpr int kMC = 96;
+static constexpr int kKC = 256;
+static constexpr int kNC = 2048;
+// Column chunk of C a single task covers, a multiple of every NR.
+static constexpr int kNChunk = 512;
+
+// Packs alpha times an mc x kc block of A into row panels of mr, stored
+// column by column and zero padded, so the micro-kernel reads it
+// sequentially.
+static void PackA(int mc, int kc, double alpha, const double* a, int rs,
+                  int cs, int mr, double* out) {
+  for (int i = 0; i < mc; i += mr) {
+    int rows = std::min(mr, mc - i);
+    for (int p = 0; p < kc; p++) {
+      const double* src = a + (long)i * rs + (long)p * cs;
+      for (int r = 0; r < rows; r++) out[r] = alpha * src[(long)r * rs];
+      for (int r = rows; r < mr; r++) out[r] = 0;
+      out += mr;
+    }
+  }
+}
+
+// Packs a kc x nc panel of B into column slivers of nr, stored row by row.
+static void PackB(int kc, int nc, const double* b, int rs, int cs, int nr,
+                  double* out) {
+  for (int j = 0; j < nc; j += nr) {
+    int cols = std::min(nr, nc - j);
+    for (int p = 0; p < kc; p++) {
+      const double* src = b + (long)p * rs + (long)j * cs;
+      for (int c = 0; c < cols; c++) out[c] = src[(long)c * cs];
+      for (int c = cols; c < nr; c++) out[c] = 0;
+      out += nr;
+    }
+  }
+}
+
+void Gemm(int m, int n, int k, double alpha, const double* a, int a_rs,
+          int a_cs, const double* b, int b_rs, int b_cs, double* c, int ldc) {
+  const SimdKernels& kernels = Kernels();
+  const int mr = kernels.gemm_mr, nr = kernels.gemm_nr;
+  // Packing buffers are kept per thread and only ever grow. The B panel is
+  // packed by the caller and shared; every task packs its own A block.
+  thread_local std::vector<double> a_pack, b_pack;
+  b_pack.resize((std::size_t)kKC * kNC);
+  for (int jc = 0; jc < n; jc += kNC) {
+    int nc = std::min(kNC, n - jc);
+    for (int pc = 0; pc < k; pc += kKC) {
+      int kc = std::min(kKC, k - pc);
+      PackB(kc, nc, b + (long)pc * b_rs + (long)jc * b_cs, b_rs, b_cs, nr,
+            b_pack.data());
+      const double* b_panel = b_pack.data();
+      // Tasks are MC-row blocks of C, split further into column chunks when
+      // there are too few row blocks to go around.
+      const int m_blocks = (m + kMC - 1) / kMC;
+      const int n_chunks = (nc + kNChunk - 1) / kNChunk;
+      ParallelFor(0, (long)m_blocks * n_chunks, 2.0 * m * nc * kc,
+                  [&](long lo, long hi) {
+                    a_pack.resize((std::size_t)kMC * kKC);
+                    for (long t = lo; t < hi; t++) {
+                      int ic = (int)(t / n_chunks) * kMC;
+                      int j0 = (int)(t % n_chunks) * kNChunk;
+                      int mc = std::min(kMC, m - ic);
+                      int j1 = std::min(nc, j0 + kNChunk);
+                      PackA(mc, kc, alpha,
+                            a + (long)ic * a_rs + (long)pc * a_cs, a_rs, a_cs,
+                            mr, a_pack.data());
+                      for (int jr = j0; jr < j1; jr += nr)
+                        for (int ir = 0; ir < mc; ir += mr)
+                          kernels.gemm(kc, a_pack.data() + (long)ir * kc,
+                                       b_panel + (long)jr * kc,
+                                       c + (long)(ic + ir) * ldc + jc + jr,
+                                       ldc, std::min(mr, mc - ir),
+                                       std::min(nr, j1 - jr));
+                    }
+                  });
+    }
+  }
+}
@@ -0,0 +1,14 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_GEMM_H
+#define CPP1__MATRIXPLUS_0__MATRIX_GEMM_H
+
+// Products with at most this many multiply-adds stay on the naive kernel,
+// where packing would cost more than it saves.
+#define GEMM_NAIVE_LIMIT (12 * 12 * 12)
+
+// C(m x n) += alpha * A(m x k) * B(k x n). Each operand is addressed
+// through a row stride and a column stride, so a transposed operand is just
+// swapped strides and never has to be materialized.
+void Gemm(int m, int n, int k, double alpha, const double* a, int a_rs,
+          int a_cs, const double* b, int b_rs, int b_cs, double* c, int ldc);
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_GEMM_H
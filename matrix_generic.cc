@@ -0,0 +1,1032 @@
+#include "matrix_generic.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+// The kernels work on the real scalars of an element: a complex element is
+// its real and imaginary part, which std::complex guarantees are stored
+// next to each other.
+template <typename T>
+struct ElementTraits {
+  using Real = T;
+  static constexpr int kPlanes = 1;
+};
+
+template <typename R>
+struct ElementTraits<std::complex<R>> {
+  using Real = R;
+  static constexpr int kPlanes = 2;
+};
+
+template <typename T>
+using RealOf = typename ElementTraits<T>::Real;
+template <typename T>
+constexpr int kPlanesOf = ElementTraits<T>::kPlanes;
+
+// Element-wise kernels go a cache line of Reals at a time. The lane loops
+// have that constant trip count, so the compiler turns each of them into a
+// few vector instructions, like the kernels in matrix_batch.cc; operands
+// are loaded into locals first because dst and src may be the same matrix.
+template <typename R>
+constexpr int kBlock = 64 / sizeof(R);
+
+#define GENERIC_INLINE inline __attribute__((always_inline))
+
+// x * y without the inf and NaN recovery of std::complex, which is a
+// library call per product.
+template <typename T>
+GENERIC_INLINE T Mul(T x, T y) {
+  if constexpr (kPlanesOf<T> == 2)
+    return T(x.real() * y.real() - x.imag() * y.imag(),
+             x.real() * y.imag() + x.imag() * y.real());
+  else
+    return x * y;
+}
+
+template <typename T, int Sign>
+GENERIC_INLINE void AddLanes(T* dst, const T* src, long n) {
+  using R = RealOf<T>;
+  constexpr int W = kBlock<R>;
+  R* d = reinterpret_cast<R*>(dst);
+  const R* s = reinterpret_cast<const R*>(src);
+  n *= kPlanesOf<T>;
+  long i = 0;
+  for (; i + W <= n; i += W) {
+    R x[W];
+    for (int l = 0; l < W; l++) x[l] = s[i + l];
+    for (int l = 0; l < W; l++) d[i + l] += Sign * x[l];
+  }
+  for (; i < n; i++) d[i] += Sign * s[i];
+}
+
+// y += a * x.
+template <typename T>
+GENERIC_INLINE void AxpyLanes(T* y, T a, const T* x, long n) {
+  using R = RealOf<T>;
+  constexpr int W = kBlock<R>;
+  if constexpr (kPlanesOf<T> == 2) {
+    // W / 2 elements per block, split into real and imaginary lanes.
+    constexpr int H = W / 2;
+    const R ar = a.real(), ai = a.imag();
+    R* d = reinterpret_cast<R*>(y);
+    const R* s = reinterpret_cast<const R*>(x);
+    long i = 0;
+    for (; i + H <= n; i += H) {
+      R re[H], im[H];
+      for (int l = 0; l < H; l++) re[l] = s[2 * (i + l)];
+      for (int l = 0; l < H; l++) im[l] = s[2 * (i + l) + 1];
+      for (int l = 0; l < H; l++) {
+        d[2 * (i + l)] += ar * re[l] - ai * im[l];
+        d[2 * (i + l) + 1] += ar * im[l] + ai * re[l];
+      }
+    }
+    for (; i < n; i++) y[i] += Mul(a, x[i]);
+  } else {
+    long i = 0;
+    for (; i + W <= n; i += W) {
+      R v[W];
+      for (int l = 0; l < W; l++) v[l] = x[i + l];
+      for (int l = 0; l < W; l++) y[i + l] += a * v[l];
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+  }
+}
+
+template <typename T>
+GENERIC_INLINE void ScaleLanes(T* dst, T num, long n) {
+  using R = RealOf<T>;
+  constexpr int W = kBlock<R>;
+  long i = 0;
+  if constexpr (kPlanesOf<T> == 2) {
+    constexpr int H = W / 2;
+    const R ar = num.real(), ai = num.imag();
+    R* d = reinterpret_cast<R*>(dst);
+    for (; i + H <= n; i += H) {
+      R re[H], im[H];
+      for (int l = 0; l < H; l++) re[l] = d[2 * (i + l)];
+      for (int l = 0; l < H; l++) im[l] = d[2 * (i + l) + 1];
+      for (int l = 0; l < H; l++) {
+        d[2 * (i + l)] = ar * re[l] - ai * im[l];
+        d[2 * (i + l) + 1] = ar * im[l] + ai * re[l];
+      }
+    }
+    for (; i < n; i++) dst[i] = Mul(num, dst[i]);
+  } else {
+    for (; i + W <= n; i += W)
+      for (int l = 0; l < W; l++) dst[i + l] *= num;
+    for (; i < n; i++) dst[i] *= num;
+  }
+}
+
+// Ordered compares, so a NaN pair counts as equal, as in Matrix.
+template <typename T>
+GENERIC_INLINE bool EqLanes(const T* a, const T* b, long n, double eps) {
+  using R = RealOf<T>;
+  constexpr int W = kBlock<R>;
+  const R* x = reinterpret_cast<const R*>(a);
+  const R* y = reinterpret_cast<const R*>(b);
+  const R e = static_cast<R>(eps);
+  n *= kPlanesOf<T>;
+  auto differ = [e](R u, R v) -> int {
+    if constexpr (std::is_integral_v<R>)
+      return u != v;
+    else
+      return (u - v > e) | (v - u > e);
+  };
+  long i = 0;
+  for (; i + W <= n; i += W) {
+    int any = 0;
+    for (int l = 0; l < W; l++) any |= differ(x[i + l], y[i + l]);
+    if (any) return false;
+  }
+  for (; i < n; i++)
+    if (differ(x[i], y[i])) return false;
+  return true;
+}
+
+// C(mr x nr) += A(mr x kc) * packed B sliver. A is read in place, rows lda
+// elements apart; rows past mr repeat the last one and are never stored.
+// Complex slivers hold NR real parts and then NR imaginary parts per row.
+template <typename T, int MR, int NR>
+GENERIC_INLINE void GemmLanes(int kc, const T* a, int lda,
+                              const RealOf<T>* b, T* c, int ldc, int mr,
+                              int nr) {
+  using R = RealOf<T>;
+  constexpr int P = kPlanesOf<T>;
+  const R* rows[MR];
+  for (int r = 0; r < MR; r++)
+    rows[r] = reinterpret_cast<const R*>(a + (long)std::min(r, mr - 1) * lda);
+  R acc[P][MR][NR] = {};
+  for (int p = 0; p < kc; p++, b += P * NR) {
+#pragma GCC unroll 8
+    for (int r = 0; r < MR; r++) {
+      if constexpr (P == 1) {
+        const R ar = rows[r][p];
+        for (int s = 0; s < NR; s++) acc[0][r][s] += ar * b[s];
+      } else {
+        const R ar = rows[r][2 * p], ai = rows[r][2 * p + 1];
+        for (int s = 0; s < NR; s++) {
+          acc[0][r][s] += ar * b[s] - ai * b[NR + s];
+          acc[1][r][s] += ar * b[NR + s] + ai * b[s];
+        }
+      }
+    }
+  }
+  for (int r = 0; r < mr; r++)
+    for (int s = 0; s < nr; s++) {
+      if constexpr (P == 1)
+        c[(long)r * ldc + s] += acc[0][r][s];
+      else
+        c[(long)r * ldc + s] += T(acc[0][r][s], acc[1][r][s]);
+    }
+}
+
+template <typename T>
+struct GenericKernels {
+  void (*add)(T* dst, const T* src, long n);
+  void (*sub)(T* dst, const T* src, long n);
+  void (*scale)(T* dst, T num, long n);
+  void (*axpy)(T* y, T a, const T* x, long n);
+  bool (*eq)(const T* a, const T* b, long n, double eps);
+  void (*gemm)(int kc, const T* a, int lda, const RealOf<T>* b, T* c,
+               int ldc, int mr, int nr);
+  int gemm_mr, gemm_nr;
+};
+
+// Register block for vectors of VectorBytes: each of the MR rows keeps two
+// vectors of accumulators per plane.
+template <typename T, int VectorBytes>
+constexpr int kGemmNr = 2 * VectorBytes / (sizeof(RealOf<T>) * kPlanesOf<T>);
+
+#define GENERIC_KERNELS(NAME, ATTRIBUTES, VECTOR_BYTES, MR)                  \
+  template <typename T>                                                      \
+  ATTRIBUTES static void Add##NAME(T* dst, const T* src, long n) {           \
+    AddLanes<T, 1>(dst, src, n);                                             \
+  }                                                                          \
+  template <typename T>                                                      \
+  ATTRIBUTES static void Sub##NAME(T* dst, const T* src, long n) {           \
+    AddLanes<T, -1>(dst, src, n);                                            \
+  }                                                                          \
+  template <typename T>                                                      \
+  ATTRIBUTES static void Scale##NAME(T* dst, T num, long n) {                \
+    ScaleLanes(dst, num, n);                                                 \
+  }                                                                          \
+  template <typename T>                                                      \
+  ATTRIBUTES static void Axpy##NAME(T* y, T a, const T* x, long n) {         \
+    AxpyLanes(y, a, x, n);                                                   \
+  }                                                                          \
+  template <typename T>                                                      \
+  ATTRIBUTES static bool Eq##NAME(const T* a, const T* b, long n,            \
+                                  double eps) {                              \
+    return EqLanes(a, b, n, eps);                                            \
+  }                                                                          \
+  template <typename T>                                                      \
+  ATTRIBUTES static void Gemm##NAME(int kc, const T* a, int lda,             \
+                                    const RealOf<T>* b, T* c, int ldc,       \
+                                    int mr, int nr) {                        \
+    GemmLanes<T, MR, kGemmNr<T, VECTOR_BYTES>>(kc, a, lda, b, c, ldc, mr,    \
+                                               nr);                          \
+  }                                                                          \
+  template <typename T>                                                      \
+  static const GenericKernels<T> k##NAME##Kernels = {                        \
+      Add##NAME<T>,  Sub##NAME<T>, Scale##NAME<T>,          Axpy##NAME<T>,   \
+      Eq##NAME<T>,   Gemm##NAME<T>, MR, kGemmNr<T, VECTOR_BYTES>};
+
+GENERIC_KERNELS(Scalar, __attribute__((optimize("no-tree-vectorize"))), 16, 4)
+GENERIC_KERNELS(Default, , 16, 4)
+#if defined(__x86_64__) || defined(__i386__)
+GENERIC_KERNELS(Avx2, __attribute__((target("avx2,fma"))), 32, 6)
+GENERIC_KERNELS(Avx512, __attribute__((target("avx512f"))), 64, 8)
+#endif
+
+// Follows the instruction set of the double kernels, so MATRIX_ISA and
+// SetSimdIsa() apply here as well.
+template <typename T>
+static const GenericKernels<T>& GetGenericKernels() {
+  switch (Kernels().isa) {
+    case SimdIsa::kScalar:
+      return kScalarKernels<T>;
+#if defined(__x86_64__) || defined(__i386__)
+    case SimdIsa::kAvx2:
+      return kAvx2Kernels<T>;
+    case SimdIsa::kAvx512:
+      return kAvx512Kernels<T>;
+#endif
+    default:
+      return kDefaultKernels<T>;
+  }
+}
+
+// Cache blocks as in matrix_gemm.cc; kMC and kNChunk are multiples of every
+// register block above.
+static constexpr int kMC = 96;
+static constexpr int kKC = 256;
+static constexpr int kNC = 2048;
+static constexpr int kNChunk = 512;
+
+// Packs a kc x nc panel of B into column slivers of nr, stored row by row.
+template <typename T>
+static void PackB(int kc, int nc, const T* b, int ldb, int nr,
+                  RealOf<T>* out) {
+  constexpr int P = kPlanesOf<T>;
+  for (int j = 0; j < nc; j += nr) {
+    int cols = std::min(nr, nc - j);
+    for (int p = 0; p < kc; p++, out += P * nr) {
+      const T* src = b + (long)p * ldb + j;
+      for (int c = 0; c < nr; c++) {
+        T x = c < cols ? src[c] : T(0);
+        if constexpr (P == 1) {
+          out[c] = x;
+        } else {
+          out[c] = x.real();
+          out[nr + c] = x.imag();
+        }
+      }
+    }
+  }
+}
+
+// C(m x n) += A(m x k) * B(k x n), blocked like Gemm() in matrix_gemm.cc:
+// B panels are packed once and shared by the tasks, which run MC-row
+// blocks of C.
+template <typename T>
+static void GenericGemm(int m, int n, int k, const T* a, int lda, const T* b,
+                        int ldb, T* c, int ldc) {
+  const GenericKernels<T>& kernels = GetGenericKernels<T>();
+  const int mr = kernels.gemm_mr, nr = kernels.gemm_nr;
+  thread_local std::vector<RealOf<T>> b_pack;
+  b_pack.resize((std::size_t)kKC * kNC * kPlanesOf<T>);
+  for (int jc = 0; jc < n; jc += kNC) {
+    int nc = std::min(kNC, n - jc);
+    for (int pc = 0; pc < k; pc += kKC) {
+      int kc = std::min(kKC, k - pc);
+      PackB(kc, nc, b + (long)pc * ldb + jc, ldb, nr, b_pack.data());
+      const RealOf<T>* b_panel = b_pack.data();
+      const int m_blocks = (m + kMC - 1) / kMC;
+      const int n_chunks = (nc + kNChunk - 1) / kNChunk;
+      ParallelFor(0, (long)m_blocks * n_chunks, 2.0 * m * nc * kc,
+                  [&](long lo, long hi) {
+                    for (long t = lo; t < hi; t++) {
+                      int ic = (int)(t / n_chunks) * kMC;
+                      int j0 = (int)(t % n_chunks) * kNChunk;
+                      int mc = std::min(kMC, m - ic);
+                      int j1 = std::min(nc, j0 + kNChunk);
+                      for (int jr = j0; jr < j1; jr += nr)
+                        for (int ir = 0; ir < mc; ir += mr)
+                          kernels.gemm(
+                              kc, a + (long)(ic + ir) * lda + pc, lda,
+                              b_panel + (long)jr * kc * kPlanesOf<T>,
+                              c + (long)(ic + ir) * ldc + jc + jr, ldc,
+                              std::min(mr, mc - ir), std::min(nr, j1 - jr));
+                    }
+                  });
+    }
+  }
+}
+
+// Runs a row kernel over every row pair, or over the whole buffers when
+// neither has padding, as ForEachRow in matrix_oop.cc does.
+template <typename T, typename Kernel>
+static bool ForEachRow(int rows, int cols, T* a, int lda, const T* b, int ldb,
+                       Kernel kernel) {
+  std::atomic<bool> accepted{true};
+  if (lda == cols && ldb == cols) {
+    long size = (long)rows * cols;
+    ParallelFor(0, size, size, [&](long lo, long hi) {
+      if (accepted && !kernel(a + lo, b + lo, hi - lo)) accepted = false;
+    });
+  } else {
+    ParallelFor(0, rows, (double)rows * cols, [&](long lo, long hi) {
+      for (long i = lo; i < hi && accepted; i++)
+        if (!kernel(a + i * lda, b + i * ldb, cols)) accepted = false;
+    });
+  }
+  return accepted;
+}
+
+template <typename T>
+static double Tolerance() {
+  if constexpr (std::is_integral_v<T>)
+    return 0;
+  else if constexpr (std::is_same_v<T, float>)
+    return kFloatEps;
+  else
+    return EPS;
+}
+
+template <typename T>
+static bool IsFinite(T x) {
+  if constexpr (std::is_integral_v<T>)
+    return true;
+  else if constexpr (kPlanesOf<T> == 2)
+    return std::isfinite(x.real()) && std::isfinite(x.imag());
+  else
+    return std::isfinite(x);
+}
+
+// Gaussian elimination with partial pivoting on the first n rows of w,
+// returning the determinant of its leading n x n block, or 0 at the first
+// column without a nonzero pivot. With jordan the rows above the pivot are
+// cleared too and the pivot rows normalized, which turns [A | I] into
+// [I | A^-1].
+template <typename T>
+static T Eliminate(T* w, int ld, int n, int width, bool jordan) {
+  const GenericKernels<T>& k = GetGenericKernels<T>();
+  auto row = [w, ld](int i) { return w + (long)i * ld; };
+  T det = 1;
+  for (int c = 0; c < n; c++) {
+    int pivot = c;
+    for (int r = c + 1; r < n; r++)
+      if (std::abs(row(r)[c]) > std::abs(row(pivot)[c])) pivot = r;
+    if (row(pivot)[c] == T(0)) return 0;
+    if (pivot != c) {
+      std::swap_ranges(row(c) + c, row(c) + width, row(pivot) + c);
+      det = -det;
+    }
+    T* pivot_row = row(c);
+    det *= pivot_row[c];
+    if (jordan) k.scale(pivot_row + c, T(1) / pivot_row[c], width - c);
+    for (int r = jordan ? 0 : c + 1; r < n; r++) {
+      if (r == c || row(r)[c] == T(0)) continue;
+      T f = jordan ? row(r)[c] : row(r)[c] / pivot_row[c];
+      k.axpy(row(r) + c, -f, pivot_row + c, width - c);
+    }
+  }
+  return det;
+}
+
+// Element type of elimination workspaces: integer eliminations form the
+// products of two minors in a type twice as wide as T.
+template <typename T>
+using Wide = std::conditional_t<
+    !std::is_integral_v<T>, T,
+    std::conditional_t<(sizeof(T) < sizeof(long)), long, __int128>>;
+
+// Fraction-free elimination: every division is exact, so the integer
+// determinant comes out without rounding.
+template <typename T>
+static T BareissDeterminant(const T* a, int lda, int n) {
+  using Wide = ::Wide<T>;
+  if (n == 0) return 1;
+  std::vector<Wide> w((std::size_t)n * n);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      w[(std::size_t)i * n + j] = a[(long)i * lda + j];
+  auto at = [&w, n](int i, int j) -> Wide& {
+    return w[(std::size_t)i * n + j];
+  };
+  Wide sign = 1, previous = 1;
+  for (int c = 0; c + 1 < n; c++) {
+    if (at(c, c) == 0) {
+      int r = c + 1;
+      while (r < n && at(r, c) == 0) r++;
+      if (r == n) return 0;
+      for (int j = c; j < n; j++) std::swap(at(c, j), at(r, j));
+      sign = -sign;
+    }
+    for (int i = c + 1; i < n; i++)
+      for (int j = c + 1; j < n; j++)
+        at(i, j) = (at(i, j) * at(c, c) - at(i, c) * at(c, j)) / previous;
+    previous = at(c, c);
+  }
+  return static_cast<T>(sign * at(n - 1, n - 1));
+}
+
+// adj(B) = det(B) * B^-1 of the n x n matrix b, by Gauss-Jordan elimination
+// of [B | I] in w; for integers fraction-free, which keeps every entry a
+// minor of [B | I] and every division exact. Returns det(B), or 0 when B is
+// singular, leaving adj unspecified.
+template <typename T>
+static T Adjugate(const T* b, int ldb, int n, std::vector<Wide<T>>& w,
+                  T* adj, int ldadj) {
+  const int width = 2 * n;
+  w.assign((std::size_t)n * width, Wide<T>(0));
+  auto at = [&w, width](int i, int j) -> Wide<T>& {
+    return w[(std::size_t)i * width + j];
+  };
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) at(i, j) = b[(long)i * ldb + j];
+    at(i, n + i) = 1;
+  }
+  if constexpr (!std::is_integral_v<T>) {
+    T det = Eliminate(w.data(), width, n, width, true);
+    if (det == T(0)) return det;
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++) adj[(long)i * ldadj + j] = det * at(i, n + j);
+    return det;
+  } else {
+    Wide<T> sign = 1, previous = 1;
+    for (int c = 0; c < n; c++) {
+      if (at(c, c) == 0) {
+        int r = c + 1;
+        while (r < n && at(r, c) == 0) r++;
+        if (r == n) return 0;
+        for (int j = 0; j < width; j++) std::swap(at(c, j), at(r, j));
+        sign = -sign;
+      }
+      for (int i = 0; i < n; i++) {
+        if (i == c) continue;
+        for (int j = 0; j < width; j++)
+          if (j != c)
+            at(i, j) = (at(i, j) * at(c, c) - at(i, c) * at(c, j)) / previous;
+        at(i, c) = 0;
+      }
+      previous = at(c, c);
+    }
+    // Now [d * I | d * A^-1] with d = det(P * A) for the row swaps P.
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++)
+        adj[(long)i * ldadj + j] = static_cast<T>(sign * at(i, n + j));
+    return static_cast<T>(sign * previous);
+  }
+}
+
+// Rank of the n x n matrix a by elimination with complete pivoting in w,
+// fraction-free for integers. *p and *q get the row and column left out
+// by the first n - 1 pivots, whose minor is nonzero at rank n - 1.
+template <typename T>
+static int EliminationRank(const T* a, int lda, int n,
+                           std::vector<Wide<T>>& w, int* p, int* q) {
+  w.assign((std::size_t)n * n, Wide<T>(0));
+  auto at = [&w, n](int i, int j) -> Wide<T>& {
+    return w[(std::size_t)i * n + j];
+  };
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) at(i, j) = a[(long)i * lda + j];
+  std::vector<int> rows(n), cols(n);
+  for (int i = 0; i < n; i++) rows[i] = cols[i] = i;
+  Wide<T> previous = 1;
+  int rank = 0;
+  for (; rank < n; rank++) {
+    const int c = rank;
+    int pr = -1, pc = -1;
+    for (int i = c; i < n; i++)
+      for (int j = c; j < n; j++) {
+        if (at(i, j) == Wide<T>(0)) continue;
+        if constexpr (std::is_integral_v<T>) {
+          if (pr >= 0) continue;
+        } else {
+          if (pr >= 0 && std::abs(at(i, j)) <= std::abs(at(pr, pc))) continue;
+        }
+        pr = i;
+        pc = j;
+      }
+    if (pr < 0) break;
+    for (int j = 0; j < n; j++) std::swap(at(c, j), at(pr, j));
+    for (int i = 0; i < n; i++) std::swap(at(i, c), at(i, pc));
+    std::swap(rows[c], rows[pr]);
+    std::swap(cols[c], cols[pc]);
+    for (int i = c + 1; i < n; i++)
+      for (int j = c + 1; j < n; j++) {
+        if constexpr (std::is_integral_v<T>)
+          at(i, j) = (at(i, j) * at(c, c) - at(i, c) * at(c, j)) / previous;
+        else
+          at(i, j) -= at(i, c) / at(c, c) * at(c, j);
+      }
+    previous = at(c, c);
+  }
+  *p = rows[n - 1];
+  *q = cols[n - 1];
+  return rank;
+}
+
+template <typename T>
+int BasicMatrix<T>::LeadingDimension(int cols) {
+  constexpr int kRowAlign = kMatrixAlignment / sizeof(T);
+  if (cols < kRowAlign) return cols;
+  int ld = (cols + kRowAlign - 1) / kRowAlign * kRowAlign;
+  if (ld % (2048 / sizeof(T)) == 0) ld += kRowAlign;
+  return ld;
+}
+
+template <typename T>
+void BasicMatrix<T>::CreateMatrix() {
+  stride_ = LeadingDimension(cols_);
+  capacity_ = (std::size_t)rows_ * stride_ * sizeof(T);
+  allocator_ = GetMatrixAllocator();
+  matrix_ = static_cast<T*>(allocator_->Allocate(capacity_));
+  std::memset(static_cast<void*>(matrix_), 0, capacity_);
+}
+
+template <typename T>
+void BasicMatrix<T>::CopyMatrixVals(const BasicMatrix& other) {
+  int rows = std::min(other.rows_, rows_), cols = std::min(other.cols_, cols_);
+  for (int i = 0; i < rows; i++)
+    std::memcpy(static_cast<void*>(Row(i)), other.Row(i), cols * sizeof(T));
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix() {}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(int rows, int cols) : rows_(rows), cols_(cols) {
+  if (rows <= 0 || cols <= 0)
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+  CreateMatrix();
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(int rows, int cols, std::initializer_list<T> m)
+    : BasicMatrix(rows, cols) {
+  if ((std::size_t)rows * cols != m.size())
+    throw std::invalid_argument("Incorrect sizes, or initializer list");
+  auto k = m.begin();
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++) Row(i)[j] = *k++;
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(const BasicMatrix& other) {
+  *this = other;
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(BasicMatrix&& other) {
+  *this = std::move(other);
+}
+
+template <typename T>
+BasicMatrix<T>::~BasicMatrix() {
+  if (matrix_) {
+    allocator_->Deallocate(matrix_, capacity_);
+    rows_ = cols_ = stride_ = 0;
+    capacity_ = 0;
+    matrix_ = nullptr;
+  }
+}
+
+template <typename T>
+bool BasicMatrix<T>::EqMatrix(const BasicMatrix& other) const {
+  if (other.cols_ != cols_ || other.rows_ != rows_) return false;
+  const GenericKernels<T>& k = GetGenericKernels<T>();
+  const double eps = Tolerance<T>();
+  return ForEachRow(rows_, cols_, matrix_, stride_, other.matrix_,
+                    other.stride_, [&k, eps](T* a, const T* b, long n) {
+                      return k.eq(a, b, n, eps);
+                    });
+}
+
+template <typename T>
+void BasicMatrix<T>::SumMatrix(const BasicMatrix& other) {
+  if (other.cols_ != cols_ || other.rows_ != rows_)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  const GenericKernels<T>& k = GetGenericKernels<T>();
+  ForEachRow(rows_, cols_, matrix_, stride_, other.matrix_, other.stride_,
+             [&k](T* a, const T* b, long n) {
+               k.add(a, b, n);
+               return true;
+             });
+}
+
+template <typename T>
+void BasicMatrix<T>::SubMatrix(const BasicMatrix& other) {
+  if (other.cols_ != cols_ || other.rows_ != rows_)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  const GenericKernels<T>& k = GetGenericKernels<T>();
+  ForEachRow(rows_, cols_, matrix_, stride_, other.matrix_, other.stride_,
+             [&k](T* a, const T* b, long n) {
+               k.sub(a, b, n);
+               return true;
+             });
+}
+
+template <typename T>
+void BasicMatrix<T>::MulNumber(const T num) {
+  if (!IsFinite(num))
+    throw std::invalid_argument("Invalid number, inf or nan!");
+  const GenericKernels<T>& k = GetGenericKernels<T>();
+  ForEachRow(rows_, cols_, matrix_, stride_, matrix_, stride_,
+             [&k, num](T* a, const T*, long n) {
+               k.scale(a, num, n);
+               return true;
+             });
+}
+
+template <typename T>
+void BasicMatrix<T>::MulMatrix(const BasicMatrix& other) {
+  if (cols_ != other.rows_)
+    throw std::invalid_argument(
+        "First matrix columns number isn't equal to second matrix rows number, "
+        "mathematically incorrect!");
+  BasicMatrix result(rows_, other.cols_);
+  const int m = rows_, n = other.cols_, k = cols_;
+  if ((long long)m * n * k > GEMM_NAIVE_LIMIT) {
+    GenericGemm(m, n, k, matrix_, stride_, other.matrix_, other.stride_,
+                result.matrix_, result.stride_);
+  } else {
+    for (int i = 0; i < m; i++) {
+      T* row_c = result.Row(i);
+      for (int x = 0; x < k; x++) {
+        const T aik = Row(i)[x];
+        const T* row_b = other.Row(x);
+        for (int j = 0; j < n; j++) row_c[j] += Mul(aik, row_b[j]);
+      }
+    }
+  }
+  *this = std::move(result);
+}
+
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::Transpose() const {
+  constexpr int kTile = 32;
+  BasicMatrix result(cols_, rows_);
+  const int tiles = (rows_ + kTile - 1) / kTile;
+  ParallelFor(0, tiles, (double)rows_ * cols_, [&](long lo, long hi) {
+    for (long t = lo; t < hi; t++) {
+      const int i0 = t * kTile, i1 = std::min(rows_, i0 + kTile);
+      for (int j0 = 0; j0 < cols_; j0 += kTile) {
+        const int j1 = std::min(cols_, j0 + kTile);
+        for (int i = i0; i < i1; i++)
+          for (int j = j0; j < j1; j++) result.Row(j)[i] = Row(i)[j];
+      }
+    }
+  });
+  return result;
+}
+
+template <typename T>
+void BasicMatrix<T>::TransposeInPlace() {
+  if (rows_ != cols_)
+    throw std::invalid_argument(
+        "Only square matrices can be transposed in place!");
+  for (int i = 0; i < rows_; i++)
+    for (int j = i + 1; j < cols_; j++) std::swap(Row(i)[j], Row(j)[i]);
+}
+
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::CalcComplements() const {
+  if (cols_ != rows_)
+    throw std::invalid_argument(
+        "Only square matrices have complements matrix!");
+  const int n = rows_;
+  BasicMatrix result(n, n);
+  if (n == 1) {
+    result.Row(0)[0] = 1;
+    return result;
+  }
+  // Complements are adj(A)^T, exact for integers.
+  std::vector<Wide<T>> w;
+  BasicMatrix adj(n, n);
+  if (Adjugate(matrix_, stride_, n, w, adj.matrix_, adj.stride_) != T(0)) {
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++) result.Row(i)[j] = adj.Row(j)[i];
+    return result;
+  }
+  // A singular A has adj(A) = 0 below rank n - 1 and adj(A) of rank 1 at
+  // it, which a row and a column of complements determine.
+  int p, q;
+  if (EliminationRank(matrix_, stride_, n, w, &p, &q) < n - 1) return result;
+  // Complements of row p don't depend on row p of A, which can be e_q
+  // instead, and those of column q not on column q, which can be e_p. Either
+  // way the determinant becomes C(p, q), nonzero here.
+  BasicMatrix b(*this);
+  std::fill(b.Row(p), b.Row(p) + n, T(0));
+  b.Row(p)[q] = 1;
+  const T pivot = Adjugate(b.matrix_, b.stride_, n, w, adj.matrix_,
+                           adj.stride_);
+  if (pivot == T(0)) return result;  // Rounding; A is as good as rank n - 2.
+  std::vector<T> row_p(n);
+  for (int j = 0; j < n; j++) row_p[j] = adj.Row(j)[p];
+  std::copy(Row(p), Row(p) + n, b.Row(p));
+  for (int i = 0; i < n; i++) b.Row(i)[q] = T(i == p ? 1 : 0);
+  if (Adjugate(b.matrix_, b.stride_, n, w, adj.matrix_, adj.stride_) ==
+      T(0))
+    return result;
+  for (int i = 0; i < n; i++) {
+    const Wide<T> column_q = adj.Row(q)[i];
+    for (int j = 0; j < n; j++)
+      result.Row(i)[j] = static_cast<T>(column_q * Wide<T>(row_p[j]) / pivot);
+  }
+  return result;
+}
+
+template <typename T>
+T BasicMatrix<T>::Determinant() const {
+  if (cols_ != rows_)
+    throw std::invalid_argument("Only square matrices have determinant!");
+  if constexpr (std::is_integral_v<T>) {
+    return BareissDeterminant(matrix_, stride_, rows_);
+  } else {
+    BasicMatrix w(*this);
+    return Eliminate(w.matrix_, w.stride_, rows_, cols_, false);
+  }
+}
+
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::InverseMatrix() const {
+  if (cols_ != rows_ || !matrix_)
+    throw std::invalid_argument("This matrix has no inverse matrix!");
+  const int n = rows_;
+  if constexpr (std::is_integral_v<T>) {
+    // The inverse of an integer matrix is an integer matrix only for
+    // determinant 1 or -1, and is then the adjugate times it.
+    std::vector<Wide<T>> w;
+    BasicMatrix result(n, n);
+    T det = Adjugate(matrix_, stride_, n, w, result.matrix_, result.stride_);
+    if (det != 1 && det != -1)
+      throw std::invalid_argument("This matrix has no inverse matrix!");
+    result.MulNumber(det);
+    return result;
+  } else {
+    BasicMatrix w(n, 2 * n);
+    for (int i = 0; i < n; i++) {
+      std::copy(Row(i), Row(i) + n, w.Row(i));
+      w.Row(i)[n + i] = 1;
+    }
+    T det = Eliminate(w.matrix_, w.stride_, n, 2 * n, true);
+    if (std::abs(det) < EPS)
+      throw std::invalid_argument("This matrix has no inverse matrix!");
+    BasicMatrix result(n, n);
+    for (int i = 0; i < n; i++)
+      std::copy(w.Row(i) + n, w.Row(i) + 2 * n, result.Row(i));
+    return result;
+  }
+}
+
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(const BasicMatrix& other) {
+  if (this != &other) {
+    if (rows_ != other.rows_ || cols_ != other.cols_) {
+      this->~BasicMatrix();
+      rows_ = other.rows_, cols_ = other.cols_;
+      if (other.matrix_) CreateMatrix();
+    }
+    CopyMatrixVals(other);
+  }
+  return *this;
+}
+
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(BasicMatrix&& other) {
+  if (this != &other) {
+    this->~BasicMatrix();
+    std::swap(matrix_, other.matrix_);
+    std::swap(rows_, other.rows_);
+    std::swap(cols_, other.cols_);
+    std::swap(stride_, other.stride_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(allocator_, other.allocator_);
+  }
+  return *this;
+}
+
+template <typename T>
+T& BasicMatrix<T>::operator()(int row, int col) const {
+  if (row >= rows_ || col >= cols_ || col < 0 || row < 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  return Row(row)[col];
+}
+
+template <typename T>
+int BasicMatrix<T>::GetCols() const {
+  return cols_;
+}
+
+template <typename T>
+int BasicMatrix<T>::GetRows() const {
+  return rows_;
+}
+
+template <typename T>
+T* BasicMatrix<T>::GetData() const {
+  return matrix_;
+}
+
+template <typename T>
+int BasicMatrix<T>::GetStride() const {
+  return stride_;
+}
+
+template <typename T>
+void BasicMatrix<T>::SetCols(int cols) {
+  if (cols <= 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  BasicMatrix temp(rows_, cols);
+  temp.CopyMatrixVals(*this);
+  *this = std::move(temp);
+}
+
+template <typename T>
+void BasicMatrix<T>::SetRows(int rows) {
+  if (rows <= 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  BasicMatrix temp(rows, cols_);
+  temp.CopyMatrixVals(*this);
+  *this = std::move(temp);
+}
+
+// Width of the column panels FloatLU factors and solves before each GEMM
+// update, as in matrix_decomp.cc.
+static constexpr int kLuPanel = 64;
+// Triangular solves with fewer right-hand sides go column by column.
+static constexpr int kNarrowSolve = 4;
+
+// Eight partial sums, so the loop vectorizes.
+static float Dot(const float* a, const float* b, long n) {
+  float acc[8] = {};
+  long i = 0;
+  for (; i + 8 <= n; i += 8)
+    for (int l = 0; l < 8; l++) acc[l] += a[i + l] * b[i + l];
+  float sum = 0;
+  for (; i < n; i++) sum += a[i] * b[i];
+  for (int l = 0; l < 8; l++) sum += acc[l];
+  return sum;
+}
+
+// -t(i, j) for i in [r0, r1), j in [c0, c1), packed by rows: GenericGemm
+// only accumulates, so the subtracted operand is negated on the way in.
+static void NegatedPanel(const float* t, int ld, int r0, int r1, int c0,
+                         int c1, std::vector<float>& panel) {
+  const int w = c1 - c0;
+  panel.resize((std::size_t)(r1 - r0) * w);
+  for (int i = r0; i < r1; i++)
+    for (int j = c0; j < c1; j++)
+      panel[(std::size_t)(i - r0) * w + j - c0] = -t[(long)i * ld + j];
+}
+
+FloatLU::FloatLU() {}
+
+FloatLU::FloatLU(const BasicMatrix<float>& a) { Factorize(a); }
+
+void FloatLU::Factorize(const BasicMatrix<float>& a) {
+  if (a.GetRows() != a.GetCols())
+    throw std::invalid_argument("Only square matrices have LU decomposition!");
+  lu_ = a;
+  const int n = a.GetRows(), ld = lu_.GetStride();
+  float* d = lu_.GetData();
+  const GenericKernels<float>& k = GetGenericKernels<float>();
+  swaps_.resize(n);
+  sign_ = 1;
+  singular_ = false;
+  std::vector<float> panel;
+  for (int k0 = 0; k0 < n; k0 += kLuPanel) {
+    const int k1 = std::min(n, k0 + kLuPanel);
+    for (int c = k0; c < k1; c++) {
+      int p = c;
+      for (int i = c + 1; i < n; i++)
+        if (fabsf(d[(long)i * ld + c]) > fabsf(d[(long)p * ld + c])) p = i;
+      swaps_[c] = p;
+      if (p != c) {
+        std::swap_ranges(d + (long)c * ld, d + (long)c * ld + n,
+                         d + (long)p * ld);
+        sign_ = -sign_;
+      }
+      const float* row_c = d + (long)c * ld;
+      if (row_c[c] == 0) {
+        singular_ = true;
+        continue;
+      }
+      ParallelFor(c + 1, n, (double)(n - c) * (k1 - c), [&](long lo, long hi) {
+        for (long i = lo; i < hi; i++) {
+          float* row_i = d + i * ld;
+          row_i[c] /= row_c[c];
+          k.axpy(row_i + c + 1, -row_i[c], row_c + c + 1, k1 - c - 1);
+        }
+      });
+    }
+    if (k1 == n) break;
+    // U12 = inverse(L11) * A12, split by columns, then A22 -= L21 * U12.
+    ParallelFor(k1, n, (double)(n - k1) * kLuPanel * kLuPanel,
+                [&](long lo, long hi) {
+                  for (int c = k0; c < k1; c++)
+                    for (int i = c + 1; i < k1; i++)
+                      k.axpy(d + (long)i * ld + lo, -d[(long)i * ld + c],
+                             d + (long)c * ld + lo, hi - lo);
+                });
+    NegatedPanel(d, ld, k1, n, k0, k1, panel);
+    GenericGemm(n - k1, n - k1, k1 - k0, panel.data(), k1 - k0,
+                d + (long)k0 * ld + k1, ld, d + (long)k1 * ld + k1, ld);
+  }
+  // Elements past float's range leave infinities or NaNs on the diagonal.
+  for (int i = 0; i < n && !singular_; i++)
+    if (!std::isfinite(d[(long)i * ld + i])) singular_ = true;
+}
+
+bool FloatLU::IsSingular() const { return singular_; }
+
+double FloatLU::Determinant() const {
+  if (singular_) return 0;
+  double result = sign_;
+  for (int i = 0; i < GetSize(); i++) result *= lu_(i, i);
+  return result;
+}
+
+void FloatLU::SolveTriangular(bool upper, BasicMatrix<float>& x) const {
+  const int n = GetSize(), m = x.GetCols();
+  const int ld = lu_.GetStride(), xld = x.GetStride();
+  const float* t = lu_.GetData();
+  float* d = x.GetData();
+  auto at = [&](long i, long j) { return t[i * ld + j]; };
+  if (m < kNarrowSolve) {
+    std::vector<float> v(n);
+    for (int j = 0; j < m; j++) {
+      for (int i = 0; i < n; i++) v[i] = d[(long)i * xld + j];
+      for (int s = 0; s < n; s++) {
+        const int i = upper ? n - 1 - s : s;
+        const int first = upper ? i + 1 : 0, last = upper ? n : i;
+        v[i] -= Dot(t + (long)i * ld + first, v.data() + first, last - first);
+        if (upper) v[i] /= at(i, i);
+      }
+      for (int i = 0; i < n; i++) d[(long)i * xld + j] = v[i];
+    }
+    return;
+  }
+  const GenericKernels<float>& k = GetGenericKernels<float>();
+  std::vector<float> panel;
+  // Diagonal blocks from the top for L, from the bottom for U, each
+  // followed by a GEMM update of the rows still to be solved.
+  for (int s0 = 0; s0 < n; s0 += kLuPanel) {
+    const int k0 = upper ? std::max(0, n - s0 - kLuPanel) : s0;
+    const int k1 = upper ? n - s0 : std::min(n, s0 + kLuPanel);
+    ParallelFor(0, m, (double)m * kLuPanel * kLuPanel, [&](long lo, long hi) {
+      for (int s = 0; s < k1 - k0; s++) {
+        const int c = upper ? k1 - 1 - s : k0 + s;
+        float* xc = d + (long)c * xld + lo;
+        if (upper) k.scale(xc, 1 / at(c, c), hi - lo);
+        for (int i = upper ? k0 : c + 1; i < (upper ? c : k1); i++)
+          k.axpy(d + (long)i * xld + lo, -at(i, c), xc, hi - lo);
+      }
+    });
+    const int r0 = upper ? 0 : k1, r1 = upper ? k0 : n;
+    if (r0 >= r1) continue;
+    NegatedPanel(t, ld, r0, r1, k0, k1, panel);
+    GenericGemm(r1 - r0, m, k1 - k0, panel.data(), k1 - k0,
+                d + (long)k0 * xld, xld, d + (long)r0 * xld, xld);
+  }
+}
+
+BasicMatrix<float> FloatLU::Solve(const BasicMatrix<float>& b) const {
+  if (b.GetRows() != GetSize())
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix size!");
+  if (singular_) throw std::invalid_argument("Matrix is singular!");
+  BasicMatrix<float> x(b);
+  const int m = x.GetCols(), xld = x.GetStride();
+  float* d = x.GetData();
+  for (int i = 0; i < GetSize(); i++)
+    if (swaps_[i] != i)
+      std::swap_ranges(d + (long)i * xld, d + (long)i * xld + m,
+                       d + (long)swaps_[i] * xld);
+  SolveTriangular(false, x);
+  SolveTriangular(true, x);
+  return x;
+}
+
+int FloatLU::GetSize() const { return lu_.GetRows(); }
+
+template class BasicMatrix<float>;
+template class BasicMatrix<std::complex<double>>;
+template class BasicMatrix<int>;
+template class BasicMatrix<long>;
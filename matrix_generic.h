@@ -0,0 +1,163 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_GENERIC_H
+#define CPP1__MATRIXPLUS_0__MATRIX_GENERIC_H
+
+#include <complex>
+#include <cstddef>
+#include <initializer_list>
+#include <iostream>
+#include <vector>
+
+#include "matrix_oop.h"
+
+// Matrices of the element types besides double: float,
+// std::complex<double>, int and long. Storage is laid out like Matrix,
+// rows padded to a cache line, and every type has its own element-wise and
+// GEMM kernels for each instruction set, so a float matrix moves half the
+// bytes of a double one and fills twice the lanes of each vector.
+//
+// Floating point and complex matrices are factored by elimination with
+// partial pivoting. Integer matrices stay exact: Determinant uses
+// fraction-free (Bareiss) elimination, CalcComplements and InverseMatrix
+// its Gauss-Jordan form on [A | I], which need the determinant to fit in
+// T, and only matrices with determinant 1 or -1 have an inverse.
+//
+// EqMatrix allows a difference of EPS per element, per component for
+// complex ones, except for float, which allows kFloatEps, and integers,
+// which must match exactly.
+constexpr float kFloatEps = 1E-5f;
+
+template <typename T>
+class BasicMatrix {
+ public:
+  using value_type = T;
+
+  BasicMatrix();
+  BasicMatrix(int rows, int cols);
+  BasicMatrix(int rows, int cols, std::initializer_list<T> m);
+  BasicMatrix(const BasicMatrix& other);
+  BasicMatrix(BasicMatrix&& other);
+  ~BasicMatrix();
+
+  bool EqMatrix(const BasicMatrix& other) const;
+  void SumMatrix(const BasicMatrix& other);
+  void SubMatrix(const BasicMatrix& other);
+  void MulNumber(const T num);
+  void MulMatrix(const BasicMatrix& other);
+  BasicMatrix Transpose() const;
+  void TransposeInPlace();
+  BasicMatrix CalcComplements() const;
+  T Determinant() const;
+  BasicMatrix InverseMatrix() const;
+
+  BasicMatrix& operator=(const BasicMatrix& other);
+  BasicMatrix& operator=(BasicMatrix&& other);
+  T& operator()(int row, int col) const;
+  BasicMatrix& operator+=(const BasicMatrix& other) {
+    SumMatrix(other);
+    return *this;
+  }
+  BasicMatrix& operator-=(const BasicMatrix& other) {
+    SubMatrix(other);
+    return *this;
+  }
+  BasicMatrix& operator*=(const BasicMatrix& other) {
+    MulMatrix(other);
+    return *this;
+  }
+  BasicMatrix& operator*=(const T other) {
+    MulNumber(other);
+    return *this;
+  }
+  friend BasicMatrix operator+(BasicMatrix a, const BasicMatrix& b) {
+    return a += b;
+  }
+  friend BasicMatrix operator-(BasicMatrix a, const BasicMatrix& b) {
+    return a -= b;
+  }
+  friend BasicMatrix operator*(BasicMatrix a, const BasicMatrix& b) {
+    return a *= b;
+  }
+  friend BasicMatrix operator*(BasicMatrix a, const T num) {
+    return a *= num;
+  }
+  friend BasicMatrix operator*(const T num, BasicMatrix a) {
+    return a *= num;
+  }
+  friend bool operator==(const BasicMatrix& a, const BasicMatrix& b) {
+    return a.EqMatrix(b);
+  }
+  friend std::ostream& operator<<(std::ostream& os, const BasicMatrix& a) {
+    for (int i = 0; i < a.rows_; i++) {
+      for (int j = 0; j < a.cols_; j++) os << a.Row(i)[j] << " ";
+      os << '\n';
+    }
+    return os << '\n';
+  }
+
+  int GetCols() const;
+  int GetRows() const;
+  void SetCols(int x);
+  void SetRows(int x);
+  // Row i starts at GetData() + i * GetStride(), as in Matrix.
+  T* GetData() const;
+  int GetStride() const;
+  static int LeadingDimension(int cols);
+
+ private:
+  void CreateMatrix();
+  void CopyMatrixVals(const BasicMatrix& other);
+  T* Row(int i) const { return matrix_ + (std::size_t)i * stride_; }
+  T* matrix_{nullptr};
+  int rows_{}, cols_{}, stride_{};
+  std::size_t capacity_{};
+  MatrixAllocator* allocator_{nullptr};
+};
+
+extern template class BasicMatrix<float>;
+extern template class BasicMatrix<std::complex<double>>;
+extern template class BasicMatrix<int>;
+extern template class BasicMatrix<long>;
+
+// Partial-pivoting LU factorization P * A = L * U of a float matrix,
+// blocked like LU in matrix_decomp.h: panels are factored on the float row
+// kernels and the trailing matrix is updated by the float GEMM, so it runs
+// at twice the lanes and half the memory traffic of the double one. It is
+// the factorization MixedLU refines from.
+class FloatLU {
+ public:
+  FloatLU();
+  explicit FloatLU(const BasicMatrix<float>& a);
+
+  void Factorize(const BasicMatrix<float>& a);
+  // True when a pivot came out zero or the factors aren't finite.
+  bool IsSingular() const;
+  // Accumulated in double, where float's range would overflow.
+  double Determinant() const;
+  // Solves A * X = B for every column of B.
+  BasicMatrix<float> Solve(const BasicMatrix<float>& b) const;
+  int GetSize() const;
+
+ private:
+  // Solves T * Y = X in place of X for the unit lower or the upper factor.
+  void SolveTriangular(bool upper, BasicMatrix<float>& x) const;
+  BasicMatrix<float> lu_;
+  std::vector<int> swaps_;
+  int sign_{1};
+  bool singular_{false};
+};
+
+// Element-wise conversion between element types, e.g. MatrixCast<float>(m)
+// for a Matrix m.
+template <typename To, typename From>
+BasicMatrix<To> MatrixCast(const BasicMatrix<From>& m) {
+  if (m.GetRows() == 0) return BasicMatrix<To>();
+  BasicMatrix<To> result(m.GetRows(), m.GetCols());
+  for (int i = 0; i < m.GetRows(); i++) {
+    const From* src = m.GetData() + (std::size_t)i * m.GetStride();
+    To* dst = result.GetData() + (std::size_t)i * result.GetStride();
+    for (int j = 0; j < m.GetCols(); j++) dst[j] = static_cast<To>(src[j]);
+  }
+  return result;
+}
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_GENERIC_H
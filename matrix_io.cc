@@ -0,0 +1,703 @@
+#include "matrix_io.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+
+static constexpr char kMagic[8] = {'M', 'A', 'T', 'R', 'I', 'X', 'B', '\0'};
+static constexpr std::uint32_t kVersion = 1;
+static constexpr std::uint32_t kDataOffset = 4096;
+static constexpr std::uint32_t kByteOrder = 0x01020304;
+// Save copies rows through a buffer of at least this many bytes.
+static constexpr std::size_t kStagingBytes = std::size_t(1) << 20;
+// Text is read and written this many bytes at a time, give or take a line.
+static constexpr std::size_t kTextChunk = std::size_t(1) << 22;
+// Longest shortest-round-trip double, "-2.2250738585072014e-308", and its
+// delimiter.
+static constexpr int kMaxElementText = 25;
+// Rough cost of formatting or parsing one element in the element
+// operations ParallelFor's threshold counts.
+static constexpr double kTextWork = 32;
+
+static_assert(sizeof(MatrixFileHeader) == 64, "the header is 64 bytes");
+
+static constexpr std::uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+static constexpr std::uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+static std::uint64_t Rotl(std::uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// Running MatrixChecksum over pieces of the data, each a multiple of 8
+// bytes. Word i goes to lane i % 4, so the lanes are independent chains.
+class Checksum {
+ public:
+  void Update(const void* data, std::size_t bytes) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const std::size_t words = bytes / 8;
+    std::size_t i = 0;
+    for (; i < words && words_ % 4 != 0; i++) Word(p + i * 8);
+    for (; i + 4 <= words; i += 4)
+      for (int l = 0; l < 4; l++)
+        lanes_[l] = Round(lanes_[l], Load(p + (i + l) * 8));
+    for (; i < words; i++) Word(p + i * 8);
+    bytes_ += bytes;
+  }
+
+  std::uint64_t Digest() const {
+    std::uint64_t h = Rotl(lanes_[0], 1) + Rotl(lanes_[1], 7) +
+                      Rotl(lanes_[2], 12) + Rotl(lanes_[3], 18);
+    h ^= bytes_;
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime1;
+    return h ^ (h >> 32);
+  }
+
+ private:
+  static std::uint64_t Load(const unsigned char* p) {
+    std::uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+  }
+  static std::uint64_t Round(std::uint64_t acc, std::uint64_t word) {
+    return Rotl(acc + word * kPrime2, 31) * kPrime1;
+  }
+  void Word(const unsigned char* p) {
+    lanes_[words_ % 4] = Round(lanes_[words_ % 4], Load(p));
+    words_++;
+  }
+
+  std::uint64_t lanes_[4] = {kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1};
+  // Only words_ % 4 matters: the four-word loop leaves it unchanged.
+  std::uint64_t bytes_{0}, words_{0};
+};
+
+std::uint64_t MatrixChecksum(const void* data, std::size_t bytes) {
+  Checksum checksum;
+  checksum.Update(data, bytes);
+  return checksum.Digest();
+}
+
+// Closes the descriptor on every path out of the I/O functions.
+class File {
+ public:
+  File(const std::string& path, int flags) : path_(path) {
+    fd_ = open(path.c_str(), flags, 0644);
+    if (fd_ < 0) Fail("Can't open ");
+  }
+  ~File() {
+    if (fd_ >= 0) close(fd_);
+  }
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+
+  int Get() const { return fd_; }
+  [[noreturn]] void Fail(const char* what) const {
+    throw std::runtime_error(what + path_ + ": " + strerror(errno));
+  }
+  void WriteAt(const void* data, std::size_t bytes, off_t offset) const {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+      ssize_t n = pwrite(fd_, p, bytes, offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) Fail("Can't write ");
+      p += n, bytes -= n, offset += n;
+    }
+  }
+  void ReadAt(void* data, std::size_t bytes, off_t offset) const {
+    char* p = static_cast<char*>(data);
+    while (bytes > 0) {
+      ssize_t n = pread(fd_, p, bytes, offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) Fail("Can't read ");
+      if (n == 0)
+        throw std::invalid_argument("Matrix file is truncated or corrupt!");
+      p += n, bytes -= n, offset += n;
+    }
+  }
+  void Close() {
+    int fd = fd_;
+    fd_ = -1;
+    if (close(fd) != 0) Fail("Can't write ");
+  }
+
+ private:
+  std::string path_;
+  int fd_;
+};
+
+// True when both descriptors are open on one file, whatever the paths
+// they were opened with.
+static bool SameFile(const File& x, const File& y) {
+  struct stat x_info, y_info;
+  if (fstat(x.Get(), &x_info) != 0) x.Fail("Can't read ");
+  if (fstat(y.Get(), &y_info) != 0) y.Fail("Can't read ");
+  return x_info.st_dev == y_info.st_dev && x_info.st_ino == y_info.st_ino;
+}
+
+static std::size_t DataBytes(const MatrixFileHeader& header) {
+  return (std::size_t)header.rows * header.stride * sizeof(double);
+}
+
+static MatrixFileHeader ReadHeader(const File& file) {
+  struct stat info;
+  if (fstat(file.Get(), &info) != 0) file.Fail("Can't read ");
+  MatrixFileHeader header;
+  if ((std::size_t)info.st_size < sizeof(header))
+    throw std::invalid_argument("Not a matrix file!");
+  file.ReadAt(&header, sizeof(header), 0);
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+    throw std::invalid_argument("Not a matrix file!");
+  if (header.version != kVersion || header.byte_order != kByteOrder ||
+      header.dtype != MatrixDtype::kFloat64 ||
+      header.layout != MatrixLayout::kRowMajor)
+    throw std::invalid_argument("Unsupported matrix file format!");
+  if (header.rows <= 0 || header.cols <= 0 || header.rows > INT_MAX ||
+      header.cols > INT_MAX || header.stride < header.cols ||
+      header.stride > INT_MAX || header.data_offset < sizeof(header) ||
+      header.data_offset % kMatrixAlignment != 0 ||
+      (std::size_t)info.st_size < header.data_offset + DataBytes(header))
+    throw std::invalid_argument("Matrix file is truncated or corrupt!");
+  return header;
+}
+
+static void CheckSum(const MatrixFileHeader& header, std::uint64_t checksum) {
+  if (checksum != header.checksum)
+    throw std::invalid_argument("Matrix file checksum mismatch!");
+}
+
+void SaveMatrix(const Matrix& m, const std::string& path) {
+  if (m.GetRows() == 0)
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+  MatrixFileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.data_offset = kDataOffset;
+  header.dtype = MatrixDtype::kFloat64;
+  header.layout = MatrixLayout::kRowMajor;
+  header.byte_order = kByteOrder;
+  header.rows = m.GetRows();
+  header.cols = m.GetCols();
+  header.stride = m.GetStride();
+  File file(path, O_WRONLY | O_CREAT | O_TRUNC);
+  // Rows are copied into a staging buffer so the padding written is zero
+  // whatever the matrix holds there, then checksummed and written.
+  const int cols = m.GetCols(), stride = m.GetStride();
+  const std::size_t rows_per_chunk =
+      std::max<std::size_t>(1, kStagingBytes / (stride * sizeof(double)));
+  std::vector<double> staging(rows_per_chunk * stride);
+  Checksum checksum;
+  off_t offset = kDataOffset;
+  for (int i0 = 0; i0 < m.GetRows(); i0 += rows_per_chunk) {
+    const int i1 = std::min<long>(m.GetRows(), i0 + rows_per_chunk);
+    for (int i = i0; i < i1; i++) {
+      double* row = staging.data() + (std::size_t)(i - i0) * stride;
+      std::memcpy(row, m.GetData() + (std::size_t)i * stride,
+                  cols * sizeof(double));
+      std::fill(row + cols, row + stride, 0.0);
+    }
+    const std::size_t bytes = (std::size_t)(i1 - i0) * stride * sizeof(double);
+    checksum.Update(staging.data(), bytes);
+    file.WriteAt(staging.data(), bytes, offset);
+    offset += bytes;
+  }
+  header.checksum = checksum.Digest();
+  std::vector<char> block(kDataOffset, 0);
+  std::memcpy(block.data(), &header, sizeof(header));
+  file.WriteAt(block.data(), block.size(), 0);
+  file.Close();
+}
+
+MatrixFileHeader ReadMatrixHeader(const std::string& path) {
+  return ReadHeader(File(path, O_RDONLY));
+}
+
+Matrix LoadMatrix(const std::string& path) {
+  File file(path, O_RDONLY);
+  const MatrixFileHeader header = ReadHeader(file);
+  const int rows = header.rows, cols = header.cols;
+  const int stride = Matrix::LeadingDimension(cols);
+  const std::size_t capacity = (std::size_t)rows * stride * sizeof(double);
+  MatrixAllocator* allocator = GetMatrixAllocator();
+  Matrix result(static_cast<double*>(allocator->Allocate(capacity)), rows,
+                cols, stride, capacity, allocator);
+  double* d = result.GetData();
+  if (header.stride == stride) {
+    file.ReadAt(d, capacity, header.data_offset);
+    CheckSum(header, MatrixChecksum(d, capacity));
+    return result;
+  }
+  // Written with another stride: read the rows one by one and repack them.
+  std::vector<double> row(header.stride);
+  const std::size_t row_bytes = row.size() * sizeof(double);
+  Checksum checksum;
+  for (int i = 0; i < rows; i++) {
+    file.ReadAt(row.data(), row_bytes, header.data_offset + i * row_bytes);
+    checksum.Update(row.data(), row_bytes);
+    std::copy(row.begin(), row.begin() + cols, d + (std::size_t)i * stride);
+    std::fill(d + (std::size_t)i * stride + cols,
+              d + (std::size_t)(i + 1) * stride, 0.0);
+  }
+  CheckSum(header, checksum.Digest());
+  return result;
+}
+
+// Storage of one mapped matrix, unmapped when the matrix releases it.
+// Matrices only allocate from GetMatrixAllocator(), never from this.
+class MappedStorage : public MatrixAllocator {
+ public:
+  MappedStorage(void* base, std::size_t length)
+      : base_(base), length_(length) {}
+  void* Allocate(std::size_t) override { throw std::bad_alloc(); }
+  void Deallocate(void*, std::size_t) override {
+    munmap(base_, length_);
+    delete this;
+  }
+
+ private:
+  void* base_;
+  std::size_t length_;
+};
+
+Matrix MapMatrix(const std::string& path, bool verify) {
+  File file(path, O_RDONLY);
+  const MatrixFileHeader header = ReadHeader(file);
+  // The map starts at the top of the file, so the elements need only the
+  // alignment ReadHeader checks; the matrix takes the file's stride.
+  const std::size_t capacity = DataBytes(header);
+  const std::size_t length = header.data_offset + capacity;
+  void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    file.Get(), 0);
+  if (base == MAP_FAILED) file.Fail("Can't map ");
+  double* data = reinterpret_cast<double*>(static_cast<char*>(base) +
+                                           header.data_offset);
+  Matrix result(data, header.rows, header.cols, header.stride, capacity,
+                new MappedStorage(base, length));
+  if (verify) CheckSum(header, MatrixChecksum(data, capacity));
+  return result;
+}
+
+// Spaces, tabs and the '\r' of CRLF line ends.
+static bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static bool IsBlankLine(const char* p, const char* end) {
+  while (p < end && IsBlank(*p)) p++;
+  return p == end;
+}
+
+static void CheckDelimiter(char delimiter) {
+  if (std::isalnum((unsigned char)delimiter) || delimiter == '\n' ||
+      delimiter == '\r' || delimiter == '\0' ||
+      std::strchr(".+-", delimiter))
+    throw std::invalid_argument("Invalid delimiter!");
+}
+
+// Parses the elements of the line [p, end), storing the first cols of them
+// in row, and returns how many there are.
+static int ParseLine(const char* p, const char* end, char delimiter,
+                     double* row, int cols) {
+  const bool blank_separated = IsBlank(delimiter);
+  int count = 0;
+  for (;;) {
+    while (p < end && IsBlank(*p)) p++;
+    // A delimiter has to be followed by an element.
+    if (p == end && (count == 0 || blank_separated)) return count;
+    double value;
+    const std::from_chars_result parsed = std::from_chars(p, end, value);
+    if (parsed.ec != std::errc())
+      throw std::invalid_argument("Matrix text is malformed!");
+    if (count < cols) row[count] = value;
+    count++;
+    const char* next = parsed.ptr;
+    while (next < end && IsBlank(*next)) next++;
+    if (next == end) return count;
+    if (blank_separated ? next == parsed.ptr : *next != delimiter)
+      throw std::invalid_argument("Matrix text is malformed!");
+    p = blank_separated ? next : next + 1;
+  }
+}
+
+static void ParseRow(const char* p, const char* end, char delimiter,
+                     double* row, int cols) {
+  if (ParseLine(p, end, delimiter, row, cols) != cols)
+    throw std::invalid_argument("Matrix text rows have different lengths!");
+}
+
+// Calls fn(begin, end) on consecutive pieces of the file, each about
+// kTextChunk bytes and made of whole lines; a line longer than that is
+// one piece.
+template <typename Fn>
+static void ForEachTextChunk(const File& file, Fn fn) {
+  struct stat info;
+  if (fstat(file.Get(), &info) != 0) file.Fail("Can't read ");
+  const std::size_t size = info.st_size;
+  std::vector<char> buffer;
+  // Bytes at the front of buffer left over from the last piece.
+  std::size_t carry = 0;
+  for (std::size_t offset = 0; offset < size;) {
+    const std::size_t bytes = std::min(kTextChunk, size - offset);
+    buffer.resize(carry + bytes);
+    file.ReadAt(buffer.data() + carry, bytes, offset);
+    offset += bytes;
+    const char* begin = buffer.data();
+    const char* end = begin + buffer.size();
+    const char* last = end;
+    if (offset < size) {
+      while (last > begin && last[-1] != '\n') last--;
+      if (last == begin) {
+        carry = buffer.size();
+        continue;
+      }
+    }
+    fn(begin, last);
+    carry = end - last;
+    std::memmove(buffer.data(), last, carry);
+  }
+}
+
+using TextLine = std::pair<const char*, const char*>;
+
+// The lines of [p, end) that aren't blank.
+static void SplitLines(const char* p, const char* end,
+                       std::vector<TextLine>& lines) {
+  lines.clear();
+  while (p < end) {
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (!eol) eol = end;
+    if (!IsBlankLine(p, eol)) lines.emplace_back(p, eol);
+    p = eol + 1;
+  }
+}
+
+// Formats rows [i0, i1) of m into text and returns its length. Rows are
+// formatted in parallel, each into a slot of text wide enough for any row,
+// and the slots are closed up after.
+static std::size_t FormatRows(const Matrix& m, int i0, int i1,
+                              char delimiter, std::vector<char>& text,
+                              std::vector<std::size_t>& lengths) {
+  const int cols = m.GetCols();
+  const std::size_t slot = (std::size_t)cols * kMaxElementText + 1;
+  if (text.size() < (i1 - i0) * slot) text.resize((i1 - i0) * slot);
+  lengths.resize(i1 - i0);
+  ParallelFor(i0, i1, (double)(i1 - i0) * cols * kTextWork,
+              [&](long lo, long hi) {
+                for (long i = lo; i < hi; i++) {
+                  char* begin = text.data() + (i - i0) * slot;
+                  char *p = begin, *end = begin + slot;
+                  const double* row = m.GetData() + i * m.GetStride();
+                  for (int j = 0; j < cols; j++) {
+                    if (j) *p++ = delimiter;
+                    p = std::to_chars(p, end, row[j]).ptr;
+                  }
+                  *p++ = '\n';
+                  lengths[i - i0] = p - begin;
+                }
+              });
+  std::size_t size = 0;
+  for (int r = 0; r < i1 - i0; r++) {
+    std::memmove(text.data() + size, text.data() + r * slot, lengths[r]);
+    size += lengths[r];
+  }
+  return size;
+}
+
+// Calls fn(text, bytes) on the text of consecutive blocks of about
+// kTextChunk bytes of rows.
+template <typename Fn>
+static void ForEachTextBlock(const Matrix& m, char delimiter, Fn fn) {
+  const int rows_per_block = (int)std::max<std::size_t>(
+      1, kTextChunk / ((std::size_t)m.GetCols() * kMaxElementText));
+  std::vector<char> text;
+  std::vector<std::size_t> lengths;
+  for (int i0 = 0; i0 < m.GetRows(); i0 += rows_per_block) {
+    const int i1 = std::min<long>(m.GetRows(), (long)i0 + rows_per_block);
+    fn(text.data(), FormatRows(m, i0, i1, delimiter, text, lengths));
+  }
+}
+
+static void CheckTextOutput(const Matrix& m, char delimiter) {
+  CheckDelimiter(delimiter);
+  if (m.GetRows() == 0)
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+}
+
+void SaveMatrixText(const Matrix& m, const std::string& path, char delimiter) {
+  CheckTextOutput(m, delimiter);
+  File file(path, O_WRONLY | O_CREAT | O_TRUNC);
+  off_t offset = 0;
+  ForEachTextBlock(m, delimiter, [&](const char* text, std::size_t bytes) {
+    file.WriteAt(text, bytes, offset);
+    offset += bytes;
+  });
+  file.Close();
+}
+
+void WriteMatrixText(std::ostream& os, const Matrix& m, char delimiter) {
+  CheckTextOutput(m, delimiter);
+  ForEachTextBlock(m, delimiter, [&](const char* text, std::size_t bytes) {
+    os.write(text, bytes);
+  });
+}
+
+// The first pass counts the rows and the columns of the first one, so the
+// second parses every chunk straight into its rows of the matrix.
+Matrix LoadMatrixText(const std::string& path, char delimiter) {
+  CheckDelimiter(delimiter);
+  File file(path, O_RDONLY);
+  long rows = 0;
+  int cols = 0;
+  std::vector<TextLine> lines;
+  ForEachTextChunk(file, [&](const char* begin, const char* end) {
+    SplitLines(begin, end, lines);
+    if (rows == 0 && !lines.empty())
+      cols = ParseLine(lines[0].first, lines[0].second, delimiter, nullptr, 0);
+    rows += lines.size();
+  });
+  if (rows == 0 || rows > INT_MAX)
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+  Matrix result(rows, cols);
+  const int stride = result.GetStride();
+  long row = 0;
+  ForEachTextChunk(file, [&](const char* begin, const char* end) {
+    SplitLines(begin, end, lines);
+    // The file changed between the passes.
+    if (row + (long)lines.size() > rows)
+      throw std::invalid_argument("Matrix text is malformed!");
+    ParallelFor(0, lines.size(), (double)lines.size() * cols * kTextWork,
+                [&](long lo, long hi) {
+                  for (long i = lo; i < hi; i++)
+                    ParseRow(lines[i].first, lines[i].second, delimiter,
+                             result.GetData() + (row + i) * stride, cols);
+                });
+    row += lines.size();
+  });
+  if (row != rows) throw std::invalid_argument("Matrix text is malformed!");
+  return result;
+}
+
+// A stream can't be read twice, so rows are collected as parsed and copied
+// into the matrix at the end.
+Matrix ReadMatrixText(std::istream& is, char delimiter) {
+  CheckDelimiter(delimiter);
+  std::vector<double> values;
+  std::string line;
+  int rows = 0, cols = 0;
+  while (std::getline(is, line)) {
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    if (IsBlankLine(begin, end)) {
+      if (rows > 0) break;
+      continue;
+    }
+    if (rows == 0) cols = ParseLine(begin, end, delimiter, nullptr, 0);
+    values.resize(values.size() + cols);
+    ParseRow(begin, end, delimiter, values.data() + values.size() - cols,
+             cols);
+    rows++;
+  }
+  if (rows == 0)
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+  Matrix result(rows, cols);
+  for (int i = 0; i < rows; i++)
+    std::copy(values.begin() + (std::size_t)i * cols,
+              values.begin() + (std::size_t)(i + 1) * cols,
+              result.GetData() + (std::size_t)i * result.GetStride());
+  return result;
+}
+
+// Rows [r0, r1) and columns [c0, c1) of a file matrix to or from the top
+// left of tile.
+static void ReadTile(const File& file, const MatrixFileHeader& header,
+                     int r0, int r1, int c0, int c1, Matrix& tile) {
+  for (int r = r0; r < r1; r++)
+    file.ReadAt(tile.GetData() + (std::size_t)(r - r0) * tile.GetStride(),
+                (c1 - c0) * sizeof(double),
+                header.data_offset +
+                    ((std::size_t)r * header.stride + c0) * sizeof(double));
+}
+
+static void WriteTile(const File& file, const MatrixFileHeader& header,
+                      int r0, int r1, int c0, int c1, const Matrix& tile) {
+  for (int r = r0; r < r1; r++)
+    file.WriteAt(tile.GetData() + (std::size_t)(r - r0) * tile.GetStride(),
+                 (c1 - c0) * sizeof(double),
+                 header.data_offset +
+                     ((std::size_t)r * header.stride + c0) * sizeof(double));
+}
+
+// One thread running I/O tasks in the order they're posted, so a product
+// reads and writes its tiles without starting a thread per tile. Tasks
+// still queued when it is destroyed are dropped; a running one finishes
+// first.
+class IoThread {
+ public:
+  IoThread() : thread_(&IoThread::Run, this) {}
+  ~IoThread() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      tasks_.clear();
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+  IoThread(const IoThread&) = delete;
+  IoThread& operator=(const IoThread&) = delete;
+
+  template <typename Fn>
+  std::future<void> Post(Fn fn) {
+    std::packaged_task<void()> task(std::move(fn));
+    std::future<void> done = task.get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    wake_.notify_one();
+    return done;
+  }
+
+ private:
+  void Run() {
+    for (;;) {
+      std::packaged_task<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::packaged_task<void()>> tasks_;
+  bool stop_{false};
+  // Last, so the thread starts once the rest is constructed.
+  std::thread thread_;
+};
+
+void MultiplyFiles(const std::string& a, const std::string& b,
+                   const std::string& c, std::size_t memory_budget) {
+  File a_file(a, O_RDONLY), b_file(b, O_RDONLY);
+  const MatrixFileHeader a_header = ReadHeader(a_file);
+  const MatrixFileHeader b_header = ReadHeader(b_file);
+  if (a_header.cols != b_header.rows)
+    throw std::invalid_argument(
+        "First matrix columns number isn't equal to second matrix rows number, "
+        "mathematically incorrect!");
+  const int m = a_header.rows, n = b_header.cols, k = a_header.cols;
+  // Six t x t tiles of doubles, t a multiple of the row alignment when it
+  // can be.
+  int t = (int)std::min<double>(sqrt(memory_budget / (6.0 * sizeof(double))),
+                                std::max({m, n, k}));
+  if (t < 1) throw std::invalid_argument("Memory budget is too small!");
+  if (t > 8) t -= t % 8;
+
+  MatrixFileHeader c_header = a_header;
+  c_header.rows = m;
+  c_header.cols = n;
+  c_header.stride = Matrix::LeadingDimension(n);
+  c_header.data_offset = kDataOffset;
+  // Truncated only once it is known not to be an operand under another
+  // name.
+  File c_file(c, O_RDWR | O_CREAT);
+  if (SameFile(c_file, a_file) || SameFile(c_file, b_file))
+    throw std::invalid_argument("The product can't overwrite an operand!");
+  if (ftruncate(c_file.Get(), 0) != 0 ||
+      ftruncate(c_file.Get(), kDataOffset + DataBytes(c_header)) != 0)
+    c_file.Fail("Can't write ");
+
+  struct Step {
+    int i0, i1, j0, j1, p0, p1;
+  };
+  std::vector<Step> steps;
+  for (int i0 = 0; i0 < m; i0 += t)
+    for (int j0 = 0; j0 < n; j0 += t)
+      for (int p0 = 0; p0 < k; p0 += t)
+        steps.push_back({i0, std::min(m, i0 + t), j0, std::min(n, j0 + t), p0,
+                         std::min(k, p0 + t)});
+  const int rows = std::min(m, t), inner = std::min(k, t);
+  const int cols = std::min(n, t);
+  Matrix a_tiles[2] = {Matrix(rows, inner), Matrix(rows, inner)};
+  Matrix b_tiles[2] = {Matrix(inner, cols), Matrix(inner, cols)};
+  Matrix c_tiles[2] = {Matrix(rows, cols), Matrix(rows, cols)};
+  auto load = [&](const Step& s, int slot) {
+    ReadTile(a_file, a_header, s.i0, s.i1, s.p0, s.p1, a_tiles[slot]);
+    ReadTile(b_file, b_header, s.p0, s.p1, s.j0, s.j1, b_tiles[slot]);
+  };
+  // Declared after the buffers, so it is stopped before the buffers go
+  // away on an exception. Loads are posted before the write of the step
+  // ahead of them, so waiting for a load never waits for a write.
+  IoThread io;
+  std::future<void> loading = io.Post([&] { load(steps[0], 0); });
+  std::future<void> writing[2];
+  int c_slot = 1;
+  for (std::size_t i = 0; i < steps.size(); i++) {
+    const Step& s = steps[i];
+    const int slot = i % 2;
+    loading.get();
+    if (i + 1 < steps.size())
+      loading =
+          io.Post([&, next = steps[i + 1], slot] { load(next, 1 - slot); });
+    if (s.p0 == 0) {
+      c_slot = 1 - c_slot;
+      if (writing[c_slot].valid()) writing[c_slot].get();
+      Matrix& tile = c_tiles[c_slot];
+      for (int r = 0; r < s.i1 - s.i0; r++)
+        std::fill(tile.GetData() + (std::size_t)r * tile.GetStride(),
+                  tile.GetData() + (std::size_t)r * tile.GetStride() +
+                      (s.j1 - s.j0),
+                  0.0);
+    }
+    Gemm(s.i1 - s.i0, s.j1 - s.j0, s.p1 - s.p0, 1.0, a_tiles[slot].GetData(),
+         a_tiles[slot].GetStride(), 1, b_tiles[slot].GetData(),
+         b_tiles[slot].GetStride(), 1, c_tiles[c_slot].GetData(),
+         c_tiles[c_slot].GetStride());
+    if (s.p1 == k)
+      writing[c_slot] = io.Post([&, s, c_slot] {
+        WriteTile(c_file, c_header, s.i0, s.i1, s.j0, s.j1, c_tiles[c_slot]);
+      });
+  }
+  for (std::future<void>& w : writing)
+    if (w.valid()) w.get();
+
+  // The rows were written out of order, so the checksum is one more pass.
+  std::vector<double> chunk(kStagingBytes / sizeof(double));
+  Checksum checksum;
+  for (std::size_t done = 0; done < DataBytes(c_header);) {
+    const std::size_t bytes =
+        std::min(chunk.size() * sizeof(double), DataBytes(c_header) - done);
+    c_file.ReadAt(chunk.data(), bytes, kDataOffset + done);
+    checksum.Update(chunk.data(), bytes);
+    done += bytes;
+  }
+  c_header.checksum = checksum.Digest();
+  c_file.WriteAt(&c_header, sizeof(c_header), 0);
+  c_file.Close();
+}
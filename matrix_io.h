@@ -0,0 +1,97 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_IO_H
+#define CPP1__MATRIXPLUS_0__MATRIX_IO_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include "matrix_oop.h"
+
+// Binary matrix file, version 1, in the byte order of the host that wrote
+// it, which readers check through byte_order:
+//
+//   offset  size  field
+//        0     8  magic "MATRIXB\0"
+//        8     4  version, 1
+//       12     4  data_offset, offset of the first element: 4096
+//       16     4  dtype, MatrixDtype
+//       20     4  layout, MatrixLayout
+//       24     4  byte_order, 0x01020304 as written by the host
+//       28     4  reserved, 0
+//       32     8  rows
+//       40     8  cols
+//       48     8  stride, elements from the start of one row to the next
+//       56     8  checksum of the data_offset.. region, see MatrixChecksum
+//     4096        rows * stride elements; the stride - cols after each row
+//                 are zero
+//
+// The elements are page aligned and laid out the way Matrix keeps them in
+// memory, so a file is mapped as-is and Save is one pass over the matrix.
+enum class MatrixDtype : std::uint32_t { kFloat64 = 1 };
+enum class MatrixLayout : std::uint32_t { kRowMajor = 0 };
+
+struct MatrixFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t data_offset;
+  MatrixDtype dtype;
+  MatrixLayout layout;
+  std::uint32_t byte_order;
+  std::uint32_t reserved;
+  std::int64_t rows, cols, stride;
+  std::uint64_t checksum;
+};
+
+// 64-bit hash of bytes (a multiple of 8) in four interleaved
+// multiply-rotate lanes, fast enough to be checked on every load.
+std::uint64_t MatrixChecksum(const void* data, std::size_t bytes);
+
+// I/O failures throw std::runtime_error, files that aren't valid matrix
+// files std::invalid_argument.
+void SaveMatrix(const Matrix& m, const std::string& path);
+MatrixFileHeader ReadMatrixHeader(const std::string& path);
+// Reads the whole file and checks its checksum.
+Matrix LoadMatrix(const std::string& path);
+// Maps the file instead of reading it: opening takes constant time and
+// pages are read on first touch. The file is never written; changes to
+// the matrix are private copy-on-write pages. With verify the checksum is
+// checked, which reads every page up front. A file written with another
+// stride or data offset than SaveMatrix uses is mapped as well, the matrix
+// keeping the file's stride.
+Matrix MapMatrix(const std::string& path, bool verify = false);
+
+// Text matrices: one row per line, elements separated by delimiter. A
+// blank delimiter, ' ' or '\t', separates by any run of spaces and tabs;
+// any other, like ',' for CSV, by exactly one delimiter with optional
+// blanks around it. Blank lines and the '\r' of CRLF line ends are
+// ignored. Elements are written as the shortest text that reads back as
+// the same double (std::to_chars), so a save and load round trip is exact,
+// and read by std::from_chars, which also takes inf and nan.
+//
+// Text is handled a few megabytes at a time, formatted and parsed by rows
+// across the thread pool: a file is never held in memory as text, and
+// loading scans it once for the row count before parsing straight into the
+// matrix. Malformed text throws std::invalid_argument, I/O failures
+// std::runtime_error.
+void SaveMatrixText(const Matrix& m, const std::string& path,
+                    char delimiter = ' ');
+Matrix LoadMatrixText(const std::string& path, char delimiter = ' ');
+// The same for streams. Reading stops after the rows at the first blank
+// line, so operator<< output, or matrices written one after another with a
+// blank line between them, read back one matrix per call.
+void WriteMatrixText(std::ostream& os, const Matrix& m, char delimiter = ' ');
+Matrix ReadMatrixText(std::istream& is, char delimiter = ' ');
+
+// c = a * b for matrix files that needn't fit in memory together. The
+// product runs in square tiles, sized so the tiles in memory at once (two
+// of a, two of b, two of c) stay within memory_budget bytes. The next
+// tiles of a and b are read and finished tiles of c written on one I/O
+// thread, started once per call, while the current ones are multiplied. Operand checksums aren't
+// checked, which would take an extra pass over each. c must not be a or b
+// under any name, e.g. through a link; that throws std::invalid_argument
+// and leaves the operand as it was.
+void MultiplyFiles(const std::string& a, const std::string& b,
+                   const std::string& c,
+                   std::size_t memory_budget = std::size_t(1) << 30);
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_IO_H
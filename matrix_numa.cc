@@ -0,0 +1,161 @@
+#include "matrix_numa.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+struct Topology {
+  // Kernel ids of the online nodes, ascending; node i of this file is
+  // kernel node ids[i].
+  std::vector<int> ids;
+  std::vector<std::vector<int>> cpus;
+};
+
+// Parses a sysfs list like "0-3,8,10-11"; empty when it doesn't parse.
+static std::vector<int> ParseList(const std::string& list) {
+  std::vector<int> values;
+  std::size_t pos = 0;
+  while (pos < list.size()) {
+    std::size_t end = list.find(',', pos);
+    if (end == std::string::npos) end = list.size();
+    const std::string range = list.substr(pos, end - pos);
+    int lo, hi;
+    const int read = std::sscanf(range.c_str(), "%d-%d", &lo, &hi);
+    if (read < 1) return {};
+    if (read == 1) hi = lo;
+    for (int v = lo; v <= hi; v++) values.push_back(v);
+    pos = end + 1;
+  }
+  return values;
+}
+
+static std::vector<int> ReadList(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  if (!std::getline(file, line)) return {};
+  return ParseList(line);
+}
+
+static const Topology& GetTopology() {
+  static const Topology topology = [] {
+    Topology t;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool masked = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    auto usable = [&](int cpu) {
+      return !masked || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed));
+    };
+    const std::string root = "/sys/devices/system/node/";
+    for (int id : ReadList(root + "online")) {
+      std::vector<int> cpus;
+      for (int cpu : ReadList(root + "node" + std::to_string(id) + "/cpulist"))
+        if (usable(cpu)) cpus.push_back(cpu);
+      t.ids.push_back(id);
+      t.cpus.push_back(std::move(cpus));
+    }
+    if (t.ids.empty()) {
+      std::vector<int> cpus;
+      const long online = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+      for (int cpu = 0; cpu < online; cpu++)
+        if (usable(cpu)) cpus.push_back(cpu);
+      t.ids.push_back(0);
+      t.cpus.push_back(std::move(cpus));
+    }
+    return t;
+  }();
+  return topology;
+}
+
+static void CheckNode(int node) {
+  if (node < 0 || node >= GetNumaNodes())
+    throw std::invalid_argument("NUMA node doesn't exist!");
+}
+
+int GetNumaNodes() { return (int)GetTopology().ids.size(); }
+
+const std::vector<int>& GetNodeCpus(int node) {
+  CheckNode(node);
+  return GetTopology().cpus[node];
+}
+
+int GetPageNode(const void* address) {
+  // move_pages without target nodes only reports where each page is, and
+  // a negative status for a page that isn't there yet.
+  const long page = sysconf(_SC_PAGESIZE);
+  void* pages[1] = {
+      reinterpret_cast<void*>((std::uintptr_t)address & ~(page - 1))};
+  int status = -1;
+  if (syscall(SYS_move_pages, 0, 1, pages, nullptr, &status, 0) != 0 ||
+      status < 0)
+    return -1;
+  const std::vector<int>& ids = GetTopology().ids;
+  auto it = std::lower_bound(ids.begin(), ids.end(), status);
+  return it != ids.end() && *it == status ? (int)(it - ids.begin()) : -1;
+}
+
+bool PinCurrentThread(int node) {
+  const std::vector<int>& cpus = GetNodeCpus(node);
+  if (cpus.empty()) return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus)
+    if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+NumaAllocator::NumaAllocator(NumaPolicy policy, int node)
+    : policy_(policy), node_(node) {
+  if (policy == NumaPolicy::kBind) CheckNode(node);
+}
+
+// Sets the policy of the pages of [block, block + bytes), which nothing
+// has touched yet. A refusal leaves the default, first-touch placement.
+static void Place(void* block, std::size_t bytes, NumaPolicy policy,
+                  int node) {
+  const Topology& t = GetTopology();
+  const int bits = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> mask(t.ids.back() / bits + 1);
+  int mode = MPOL_LOCAL;
+  if (policy == NumaPolicy::kInterleave) {
+    mode = MPOL_INTERLEAVE;
+    for (int id : t.ids) mask[id / bits] |= 1UL << (id % bits);
+  } else if (policy == NumaPolicy::kBind) {
+    mode = MPOL_BIND;
+    mask[t.ids[node] / bits] |= 1UL << (t.ids[node] % bits);
+  }
+  // The kernel reads one bit fewer than maxnode says.
+  syscall(SYS_mbind, block, bytes, mode,
+          mode == MPOL_LOCAL ? nullptr : mask.data(), mask.size() * bits + 1,
+          0);
+}
+
+void* NumaAllocator::Allocate(std::size_t bytes) {
+  if (bytes < kNumaMinBlock)
+    return ::operator new(bytes, std::align_val_t(kMatrixAlignment));
+  void* block = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (block == MAP_FAILED) throw std::bad_alloc();
+  // With one node every policy is the default placement.
+  if (GetNumaNodes() > 1) Place(block, bytes, policy_, node_);
+  return block;
+}
+
+void NumaAllocator::Deallocate(void* block, std::size_t bytes) {
+  if (bytes < kNumaMinBlock)
+    ::operator delete(block, std::align_val_t(kMatrixAlignment));
+  else
+    munmap(block, bytes);
+}
+
+NumaPolicy NumaAllocator::GetPolicy() const { return policy_; }
@@ -0,0 +1,55 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_NUMA_H
+#define CPP1__MATRIXPLUS_0__MATRIX_NUMA_H
+
+#include <cstddef>
+#include <vector>
+
+#include "matrix_alloc.h"
+
+// NUMA topology as /sys/devices/system/node reports it, read once. A
+// machine without NUMA support, or without sysfs, is one node holding
+// every CPU, and everything below degrades to the default placement there.
+int GetNumaNodes();
+// CPUs of node this process may run on, ascending.
+const std::vector<int>& GetNodeCpus(int node);
+// Node holding the page at address, or -1 when the kernel doesn't say,
+// e.g. for a page not touched yet.
+int GetPageNode(const void* address);
+// Restricts the calling thread to the CPUs of node. Returns false, leaving
+// the thread as it was, when the system doesn't allow it.
+bool PinCurrentThread(int node);
+
+// Where a NumaAllocator puts the pages of a matrix:
+// - kFirstTouch: on the node of the thread that first writes each page.
+//   Matrix zero-fills large new storage in parallel on the thread pool
+//   (rows in chunks, as the kernels split them), so with pinned workers
+//   (SetThreadPinning in matrix_parallel.h) rows land next to the threads
+//   that work on them rather than all next to the allocating thread.
+// - kInterleave: round robin over the nodes, page by page, for data every
+//   thread reads, like the B operand of a product.
+// - kBind: all on one node.
+enum class NumaPolicy { kFirstTouch, kInterleave, kBind };
+
+// Matrix storage placed by a NumaPolicy, see matrix_alloc.h. Blocks of at
+// least kNumaMinBlock bytes are mapped straight from the kernel, so none
+// of their pages is touched before the matrix writes them; smaller ones
+// come from the heap with default placement. Placement is a request: a
+// kernel without NUMA support or a policy it refuses leaves the default.
+class NumaAllocator : public MatrixAllocator {
+ public:
+  static constexpr std::size_t kNumaMinBlock = std::size_t(1) << 20;
+
+  // node is only used by kBind; throws std::invalid_argument if it doesn't
+  // exist.
+  explicit NumaAllocator(NumaPolicy policy, int node = 0);
+
+  void* Allocate(std::size_t bytes) override;
+  void Deallocate(void* block, std::size_t bytes) override;
+  NumaPolicy GetPolicy() const;
+
+ private:
+  NumaPolicy policy_;
+  int node_;
+};
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_NUMA_H
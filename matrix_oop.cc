@@ -1,26 +1,120 @@
 #include "matrix_oop.h"
 
-void Matrix::CreateMatrix() {
-  matrix_ = new double*[rows_];
-  for (int i = 0; i < rows_; i++) matrix_[i] = new double[cols_]();
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "matrix_alloc.h"
+#include "matrix_decomp.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+#include "matrix_stats.h"
+#include "matrix_strassen.h"
+#include "matrix_structure.h"
+
+// Row starts are padded to a cache line so kernels see aligned rows.
+static constexpr int kRowAlign = kMatrixAlignment / sizeof(double);
+// Side of the square tiles Transpose copies at a time.
+static constexpr int kTransposeTile = 32;
+
+#if MATRIX_STATS
+// Largest dimension and classical flop count of a product, for
+// matrix_stats.h.
+static int ProductSize(const MatrixProduct& p) {
+  return std::max(std::max(p.GetRows(), p.GetCols()), p.GetLeft().GetCols());
+}
+
+static double ProductFlops(const MatrixProduct& p) {
+  return 2.0 * p.GetRows() * p.GetCols() * p.GetLeft().GetCols();
+}
+#endif
+
+int Matrix::LeadingDimension(int cols) {
+  if (cols < kRowAlign) return cols;
+  int ld = (cols + kRowAlign - 1) / kRowAlign * kRowAlign;
+  // A stride that is a multiple of 2 KiB maps a whole column onto one or two
+  // cache sets, so such strides get one extra line.
+  if (ld % (2048 / sizeof(double)) == 0) ld += kRowAlign;
+  return ld;
+}
+
+void Matrix::CreateMatrix(bool zero_fill) {
+  stride_ = LeadingDimension(cols_);
+  capacity_ = (std::size_t)rows_ * stride_ * sizeof(double);
+  allocator_ = GetMatrixAllocator();
+  matrix_ = static_cast<double*>(allocator_->Allocate(capacity_));
+  MATRIX_STATS_ALLOCATED(capacity_);
+  // Rows are cleared in parallel chunks, like the kernels split them, so
+  // fresh pages are first touched by the pool workers, see NumaPolicy in
+  // matrix_numa.h.
+  if (zero_fill)
+    ParallelFor(0, rows_, (double)rows_ * stride_, [this](long lo, long hi) {
+      std::memset(Row(lo), 0, (hi - lo) * stride_ * sizeof(double));
+    });
+}
+
+void Matrix::Reshape(int rows, int cols) {
+  int stride = LeadingDimension(cols);
+  if (matrix_ && (std::size_t)rows * stride * sizeof(double) <= capacity_) {
+    rows_ = rows, cols_ = cols, stride_ = stride;
+    return;
+  }
+  this->~Matrix();
+  rows_ = rows, cols_ = cols;
+  CreateMatrix(false);
 }
 
 void Matrix::CopyMatrixVals(const Matrix& other) {
-  for (int i = 0; i < std::min(other.rows_, rows_); i++)
-    for (int j = 0; j < std::min(other.cols_, cols_); j++)
-      matrix_[i][j] = other.matrix_[i][j];
+  int rows = std::min(other.rows_, rows_), cols = std::min(other.cols_, cols_);
+  // In parallel chunks of rows for the same first touch as CreateMatrix.
+  const bool whole =
+      stride_ == other.stride_ && cols == cols_ && cols == other.cols_;
+  ParallelFor(0, rows, (double)rows * cols, [&](long lo, long hi) {
+    if (whole) {
+      std::memcpy(Row(lo), other.Row(lo), (hi - lo) * stride_ * sizeof(double));
+      return;
+    }
+    for (long i = lo; i < hi; i++)
+      std::memcpy(Row(i), other.Row(i), cols * sizeof(double));
+  });
 }
 
-Matrix::Matrix() {}
+// Runs a row kernel over every row pair, or over the whole buffers when
+// neither has padding, split across the thread pool for large matrices.
+// Stops at the first span the kernel rejects.
+template <typename Kernel>
+static bool ForEachRow(int rows, int cols, double* a, int lda, const double* b,
+                       int ldb, Kernel kernel) {
+  std::atomic<bool> accepted{true};
+  if (lda == cols && ldb == cols) {
+    long size = (long)rows * cols;
+    ParallelFor(0, size, size, [&](long lo, long hi) {
+      if (accepted && !kernel(a + lo, b + lo, hi - lo)) accepted = false;
+    });
+  } else {
+    ParallelFor(0, rows, (double)rows * cols, [&](long lo, long hi) {
+      for (long i = lo; i < hi && accepted; i++)
+        if (!kernel(a + i * lda, b + i * ldb, cols)) accepted = false;
+    });
+  }
+  return accepted;
+}
+
+Matrix::BasicMatrix() {}
 
-Matrix::Matrix(int rows, int cols) : cols_(cols), rows_(rows) {
+Matrix::BasicMatrix(int rows, int cols) : cols_(cols), rows_(rows) {
+  MATRIX_STATS_SCOPE(StatsOp::kConstruct, std::max(rows, cols), 0);
   if (rows <= 0 || cols <= 0)
     throw std::invalid_argument("Matrix dimensions aren't positive!");
   CreateMatrix();
 }
 
-Matrix::Matrix(int rows, int cols, std::initializer_list<double>& m)
+Matrix::BasicMatrix(int rows, int cols, std::initializer_list<double>& m)
     : cols_(cols), rows_(rows) {
+  MATRIX_STATS_SCOPE(StatsOp::kConstruct, std::max(rows, cols), 0);
   if (rows * cols != (m.size()))
     throw std::invalid_argument("Incorrect sizes, or initializer list");
   CreateMatrix();
@@ -28,175 +122,359 @@ Matrix::Matrix(int rows, int cols, std::initializer_list<double>& m)
   for (auto k = m.begin(); k != m.end(); k++,
             i = (j + 1) == GetCols() ? (i + 1) : i,
             j = (j + 1) == GetCols() ? 0 : (j + 1)) {
-    matrix_[i][j] = *k;
+    Row(i)[j] = *k;
   }
 }
 
-Matrix::Matrix(const Matrix& other) { *this = other; }
+Matrix::BasicMatrix(double* data, int rows, int cols, int stride,
+                    std::size_t capacity, MatrixAllocator* allocator)
+    : matrix_(data),
+      rows_(rows),
+      cols_(cols),
+      stride_(stride),
+      capacity_(capacity),
+      allocator_(allocator) {}
+
+Matrix::BasicMatrix(const Matrix& other) { *this = other; }
 
-Matrix::Matrix(Matrix&& other) { *this = std::move(other); }
+Matrix::BasicMatrix(const MatrixView& v) { *this = v; }
+
+Matrix::BasicMatrix(Matrix&& other) { *this = std::move(other); }
+
+Matrix::BasicMatrix(const MatrixProduct& p) { *this = p; }
 
 Matrix::~Matrix() {
   if (matrix_) {
-    for (int i = 0; i < rows_; i++) delete[] matrix_[i];
-    delete[] matrix_;
+    allocator_->Deallocate(matrix_, capacity_);
     cols_ = 0;
     rows_ = 0;
+    stride_ = 0;
+    capacity_ = 0;
     matrix_ = nullptr;
   }
 }
 
 bool Matrix::EqMatrix(const Matrix& other) const {
   if (other.cols_ != cols_ || other.rows_ != rows_) return false;
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < cols_; j++)
-      if (fabs(matrix_[i][j] - other.matrix_[i][j]) > EPS) return false;
-  return true;
+  const SimdKernels& k = Kernels();
+  return ForEachRow(rows_, cols_, matrix_, stride_, other.matrix_,
+                    other.stride_, [&k](double* a, const double* b, long n) {
+                      return k.eq(a, b, n, EPS);
+                    });
 }
 
 void Matrix::SumMatrix(const Matrix& other) {
   if (other.cols_ != cols_ || other.rows_ != rows_)
     throw std::invalid_argument("Matrix dimensions aren't equal!");
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < cols_; j++) matrix_[i][j] += other.matrix_[i][j];
+  const SimdKernels& k = Kernels();
+  ForEachRow(rows_, cols_, matrix_, stride_, other.matrix_, other.stride_,
+             [&k](double* a, const double* b, long n) {
+               k.add(a, b, n);
+               return true;
+             });
 }
 
 void Matrix::SubMatrix(const Matrix& other) {
   if (other.cols_ != cols_ || other.rows_ != rows_)
     throw std::invalid_argument("Matrix dimensions aren't equal!");
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < cols_; j++) matrix_[i][j] -= other.matrix_[i][j];
+  const SimdKernels& k = Kernels();
+  ForEachRow(rows_, cols_, matrix_, stride_, other.matrix_, other.stride_,
+             [&k](double* a, const double* b, long n) {
+               k.sub(a, b, n);
+               return true;
+             });
 }
 
 void Matrix::MulNumber(const double num) {
   if (isnan(num) || isinf(num))
     throw std::invalid_argument("Invalid number, inf or nan!");
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < cols_; j++) matrix_[i][j] *= num;
+  const SimdKernels& k = Kernels();
+  ForEachRow(rows_, cols_, matrix_, stride_, matrix_, stride_,
+             [&k, num](double* a, const double*, long n) {
+               k.scale(a, num, n);
+               return true;
+             });
 }
 
 void Matrix::MulMatrix(const Matrix& other) {
-  if (cols_ != other.rows_)
-    throw std::invalid_argument(
-        "First matrix columns number isn't equal to second matrix rows number, "
-        "mathematically incorrect!");
-  Matrix other_trans(other.Transpose());
+  MATRIX_STATS_SCOPE(StatsOp::kMulMatrix,
+                     std::max(std::max(rows_, cols_), other.cols_),
+                     2.0 * rows_ * cols_ * other.cols_);
+  MatrixProduct p(*this, other);
   Matrix result(rows_, other.cols_);
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < other_trans.rows_; j++)
-      for (int k = 0; k < other_trans.cols_; k++)
-        result.matrix_[i][j] += matrix_[i][k] * other_trans.matrix_[j][k];
+  p.AddTo(result, 1.0);
   *this = std::move(result);
 }
 
+// dst(j, i) = src(i, j) over a rows x cols block.
+static void TransposeTile(const double* src, int lds, double* dst, int ldd,
+                          int rows, int cols) {
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      dst[(long)j * ldd + i] = src[(long)i * lds + j];
+}
+
+// Tiles are copied whole, so the column-order writes of one tile touch
+// only kTransposeTile lines and pages; a source and a destination tile fit
+// in L1 together.
 Matrix Matrix::Transpose() const {
   Matrix result(cols_, rows_);
-  for (int i = 0; i < rows_; i++)
-    for (int j = 0; j < cols_; j++) result.matrix_[j][i] = matrix_[i][j];
+  const int tiles = (rows_ + kTransposeTile - 1) / kTransposeTile;
+  ParallelFor(0, tiles, (double)rows_ * cols_, [&](long lo, long hi) {
+    for (long t = lo; t < hi; t++) {
+      const int i0 = t * kTransposeTile;
+      const int rows = std::min(kTransposeTile, rows_ - i0);
+      for (int j0 = 0; j0 < cols_; j0 += kTransposeTile)
+        TransposeTile(Row(i0) + j0, stride_, result.Row(j0) + i0,
+                      result.stride_, rows,
+                      std::min(kTransposeTile, cols_ - j0));
+    }
+  });
   return result;
 }
 
-double Matrix::CalcMinor(const int x, const int y) const {
-  if (cols_ == 1) return matrix_[0][0];
-  Matrix temp(rows_ - 1, cols_ - 1);
-  for (int i = 0, k = 0; i < rows_; i++) {
-    for (int j = 0, n = 0; j < cols_; j++) {
-      if (i == x || j == y) continue;
-      temp.matrix_[k][n] = matrix_[i][j];
-      n++;
+// Tile (I, J) above the diagonal is swapped with tile (J, I) below it, each
+// pair by the task owning row tile I.
+void Matrix::TransposeInPlace() {
+  if (rows_ != cols_)
+    throw std::invalid_argument(
+        "Only square matrices can be transposed in place!");
+  const int tiles = (rows_ + kTransposeTile - 1) / kTransposeTile;
+  ParallelFor(0, tiles, (double)rows_ * cols_, [&](long lo, long hi) {
+    for (long t = lo; t < hi; t++) {
+      const int i0 = t * kTransposeTile;
+      const int i1 = std::min(rows_, i0 + kTransposeTile);
+      for (int i = i0; i < i1; i++)
+        for (int j = i + 1; j < i1; j++) std::swap(Row(i)[j], Row(j)[i]);
+      for (int j0 = i1; j0 < cols_; j0 += kTransposeTile) {
+        const int j1 = std::min(cols_, j0 + kTransposeTile);
+        for (int i = i0; i < i1; i++)
+          for (int j = j0; j < j1; j++) std::swap(Row(i)[j], Row(j)[i]);
+      }
+    }
+  });
+}
+
+// Cofactors of an exactly singular matrix from one Gaussian elimination
+// with complete pivoting, P * A * Q = L * U. It leaves the zero pivots
+// last, so the nonzero ones count the rank r. The adjugate of A is
+// det(P) * det(Q) * Q * adj(U) * L^-1 * P, where adj(U) is zero for
+// r < n - 1, det(U1) * v * e_n^T for r = n - 1 (U1 the leading block, U * v
+// = 0 and v_n = 1) and det(U) * U^-1 when rounding left every pivot
+// nonzero. One O(n^3) factorization either way.
+static Matrix SingularComplements(const Matrix& a) {
+  const int n = a.GetRows();
+  Matrix f(a), result(n, n);
+  double* d = f.GetData();
+  const int ld = f.GetStride();
+  auto at = [d, ld](int i, int j) -> double& { return d[(long)i * ld + j]; };
+  // Row k of P * A * Q is row rows[k] of A, column k column cols[k].
+  std::vector<int> rows(n), cols(n);
+  for (int i = 0; i < n; i++) rows[i] = cols[i] = i;
+  double sign = 1;
+  int rank = 0;
+  for (; rank < n; rank++) {
+    const int k = rank;
+    int pi = k, pj = k;
+    for (int i = k; i < n; i++)
+      for (int j = k; j < n; j++)
+        if (fabs(at(i, j)) > fabs(at(pi, pj))) pi = i, pj = j;
+    if (at(pi, pj) == 0) break;
+    if (pi != k) {
+      for (int j = 0; j < n; j++) std::swap(at(k, j), at(pi, j));
+      std::swap(rows[k], rows[pi]);
+      sign = -sign;
+    }
+    if (pj != k) {
+      for (int i = 0; i < n; i++) std::swap(at(i, k), at(i, pj));
+      std::swap(cols[k], cols[pj]);
+      sign = -sign;
+    }
+    for (int i = k + 1; i < n; i++) {
+      const double l = at(i, k) /= at(k, k);
+      for (int j = k + 1; j < n; j++) at(i, j) -= l * at(k, j);
     }
-    if (i == x) continue;
-    k++;
   }
-  return temp.Determinant();
+  if (rank < n - 1) return result;
+  for (int i = 0; i < rank; i++) sign *= at(i, i);
+  // b = adj(U) * L^-1, without the det(U1) or det(U) in sign.
+  Matrix b(n, n);
+  if (rank == n - 1) {
+    // v from U1 * v = -u, w from L^T * w = e_n; b = v * w^T.
+    std::vector<double> v(n), w(n);
+    v[n - 1] = w[n - 1] = 1;
+    for (int i = n - 2; i >= 0; i--) {
+      double sum = -at(i, n - 1);
+      for (int j = i + 1; j < n - 1; j++) sum -= at(i, j) * v[j];
+      v[i] = sum / at(i, i);
+      double t = 0;
+      for (int j = i + 1; j < n; j++) t -= at(j, i) * w[j];
+      w[i] = t;
+    }
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++) b(i, j) = v[i] * w[j];
+  } else {
+    // U^-1 * L^-1, column by column of L^-1 = the solve of L against I.
+    for (int c = 0; c < n; c++) {
+      for (int i = c; i < n; i++) {
+        double sum = i == c ? 1 : 0;
+        for (int j = c; j < i; j++) sum -= at(i, j) * b(j, c);
+        b(i, c) = sum;
+      }
+      for (int i = n - 1; i >= 0; i--) {
+        double sum = b(i, c);
+        for (int j = i + 1; j < n; j++) sum -= at(i, j) * b(j, c);
+        b(i, c) = sum / at(i, i);
+      }
+    }
+  }
+  // adj(A)(cols[i], rows[j]) = sign * b(i, j); complements are adj(A)^T.
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) result(rows[j], cols[i]) = sign * b(i, j);
+  return result;
 }
 
 Matrix Matrix::CalcComplements() const {
   if (cols_ != rows_)
     throw std::invalid_argument(
         "Only square matrices have complements matrix!");
-  Matrix result(rows_, cols_);
   if (cols_ == 1) {
-    result.matrix_[0][0] = 1;
-  } else {
-    for (int i = 0; i < rows_; i++)
-      for (int j = 0; j < cols_; j++)
-        result.matrix_[i][j] = CalcMinor(i, j) * ((i + j) % 2 == 0 ? 1 : -1);
+    Matrix result(1, 1);
+    result.Row(0)[0] = 1;
+    return result;
   }
-  return result;
+  LU lu(*this);
+  const Matrix& factors = lu.GetFactors();
+  bool leading_pivots = true;
+  for (int i = 0; i + 1 < rows_; i++)
+    if (factors(i, i) == 0) leading_pivots = false;
+  if (leading_pivots) return lu.Complements();
+  // An exactly singular matrix with a zero pivot before the last one.
+  return SingularComplements(*this);
 }
 
 double Matrix::Determinant() const {
+  MATRIX_STATS_SCOPE(StatsOp::kDeterminant, rows_,
+                     2.0 / 3 * rows_ * rows_ * rows_);
   if (cols_ != rows_)
     throw std::invalid_argument("Only square matrices have determinant!");
-  double result = 0;
-  if (cols_ == 2) {
-    result = matrix_[0][0] * matrix_[1][1] - matrix_[0][1] * matrix_[1][0];
-  } else if (cols_ == 1) {
-    result = matrix_[0][0];
-  } else {
-    for (int j = 0; j < cols_; j++)
-      result += matrix_[0][j] * CalcMinor(0, j) * ((j % 2) == 0 ? 1 : -1);
+  if (cols_ == 1) return Row(0)[0];
+  if (cols_ == 2)
+    return Row(0)[0] * Row(1)[1] - Row(0)[1] * Row(1)[0];
+  const Bandwidth band = DetectBandwidth(*this);
+  if (band.IsTriangular()) {
+    double result = 1;
+    for (int i = 0; i < rows_; i++) result *= Row(i)[i];
+    return result;
   }
-  return result;
+  if (band.IsNarrow(rows_)) return BandLU(*this, band).Determinant();
+  // Cholesky is half the work of LU when it goes through.
+  if (IsSymmetric(*this) && Row(0)[0] > 0) {
+    Cholesky cholesky(*this);
+    if (cholesky.IsPositiveDefinite()) return cholesky.Determinant();
+  }
+  return LU(*this).Determinant();
 }
 
 Matrix Matrix::InverseMatrix() const {
-  double det = Determinant();
-  if (cols_ != rows_ || fabs(det) < EPS)
+  MATRIX_STATS_SCOPE(StatsOp::kInverseMatrix, rows_,
+                     2.0 * rows_ * rows_ * rows_);
+  if (cols_ != rows_)
     throw std::invalid_argument("This matrix has no inverse matrix!");
-  Matrix temp = CalcComplements().Transpose();
-  temp.MulNumber(1 / det);
-  return temp;
+  const Bandwidth band = DetectBandwidth(*this);
+  if (band.IsTriangular()) {
+    if (fabs(Determinant()) < EPS)
+      throw std::invalid_argument("This matrix has no inverse matrix!");
+    Matrix result(rows_, cols_);
+    if (band.IsDiagonal()) {
+      for (int i = 0; i < rows_; i++) result.Row(i)[i] = 1 / Row(i)[i];
+      return result;
+    }
+    for (int i = 0; i < rows_; i++) result.Row(i)[i] = 1;
+    return SolveTriangular(
+        *this, result, band.lower == 0 ? Triangle::kUpper : Triangle::kLower);
+  }
+  if (band.IsNarrow(rows_)) {
+    BandLU lu(*this, band);
+    if (fabs(lu.Determinant()) < EPS)
+      throw std::invalid_argument("This matrix has no inverse matrix!");
+    return lu.Inverse();
+  }
+  LU lu(*this);
+  if (fabs(lu.Determinant()) < EPS)
+    throw std::invalid_argument("This matrix has no inverse matrix!");
+  return lu.Inverse();
+}
+
+Matrix Matrix::InverseMatrix(Precision precision,
+                             Refinement* refinement) const {
+  if (precision == Precision::kDouble) {
+    Matrix result = InverseMatrix();
+    if (refinement) {
+      Matrix identity(rows_, cols_);
+      for (int i = 0; i < rows_; i++) identity.Row(i)[i] = 1;
+      *refinement = {BackwardError(*this, result, identity), 0, false};
+    }
+    return result;
+  }
+  MATRIX_STATS_SCOPE(StatsOp::kInverseMatrix, rows_,
+                     2.0 * rows_ * rows_ * rows_);
+  if (cols_ != rows_)
+    throw std::invalid_argument("This matrix has no inverse matrix!");
+  MixedLU lu(*this);
+  if (fabs(lu.Determinant()) < EPS)
+    throw std::invalid_argument("This matrix has no inverse matrix!");
+  return lu.Inverse(refinement);
 }
 
 Matrix& Matrix::operator=(const Matrix& other) {
+  MATRIX_STATS_SCOPE(StatsOp::kCopy, std::max(other.rows_, other.cols_), 0);
   if (this != &other) {
-    if (rows_ != other.rows_ || cols_ != other.cols_) {
-      this->~Matrix();
-      rows_ = other.rows_, cols_ = other.cols_;
-      CreateMatrix();
-    }
+    if (rows_ != other.rows_ || cols_ != other.cols_)
+      Reshape(other.rows_, other.cols_);
     CopyMatrixVals(other);
   }
   return *this;
 }
 
+Matrix& Matrix::operator=(const MatrixView& v) {
+  const Overlap overlap = v.OverlapWith(*this);
+  if (overlap == Overlap::kSame) return *this;
+  if (overlap == Overlap::kPartial) return *this = Matrix(v);
+  if (!v.GetData()) {
+    this->~Matrix();
+    return *this;
+  }
+  if (rows_ != v.GetRows() || cols_ != v.GetCols())
+    Reshape(v.GetRows(), v.GetCols());
+  MatrixView dst(*this);
+  dst = v;
+  return *this;
+}
+
 Matrix& Matrix::operator=(Matrix&& other) {
+  MATRIX_STATS_SCOPE(StatsOp::kMove, std::max(other.rows_, other.cols_), 0);
   if (this != &other) {
     this->~Matrix();
     matrix_ = other.matrix_;
     rows_ = other.rows_;
     cols_ = other.cols_;
+    stride_ = other.stride_;
+    capacity_ = other.capacity_;
+    allocator_ = other.allocator_;
     other.matrix_ = nullptr;
     other.cols_ = 0;
     other.rows_ = 0;
+    other.stride_ = 0;
+    other.capacity_ = 0;
   }
   return *this;
 }
 
-Matrix Matrix::operator+(const Matrix& A) const {
-  Matrix result(*this);
-  result.SumMatrix(A);
-  return result;
-}
-
-Matrix Matrix::operator-(const Matrix& A) const {
-  Matrix result(*this);
-  result.SubMatrix(A);
-  return result;
-}
-
-Matrix Matrix::operator*(const Matrix& A) const {
-  Matrix result(*this);
-  result.MulMatrix(A);
-  return result;
-}
-
 double& Matrix::operator()(int row, int col) const {
   if (row >= rows_ || col >= cols_ || col < 0 || row < 0)
     throw std::out_of_range("Incorrect input, index is out of range");
-  return matrix_[row][col];
+  return Row(row)[col];
 }
 
 Matrix& Matrix::operator+=(const Matrix& other) {
@@ -209,36 +487,131 @@ Matrix& Matrix::operator-=(const Matrix& other) {
   return *this;
 }
 
-Matrix& Matrix::operator*=(const Matrix& other) {
-  MulMatrix(other);
+Matrix& Matrix::operator=(const MatrixProduct& p) {
+  MATRIX_STATS_SCOPE(StatsOp::kMulMatrix, ProductSize(p), ProductFlops(p));
+  if (p.Reads(*this) != Overlap::kNone) return *this = Matrix(p);
+  if (rows_ != p.GetRows() || cols_ != p.GetCols())
+    Reshape(p.GetRows(), p.GetCols());
+  std::memset(matrix_, 0, (std::size_t)rows_ * stride_ * sizeof(double));
+  p.AddTo(*this, 1.0);
   return *this;
 }
 
-Matrix& Matrix::operator*=(const double other) {
-  MulNumber(other);
+Matrix& Matrix::operator+=(const MatrixProduct& p) {
+  MATRIX_STATS_SCOPE(StatsOp::kMulMatrix, ProductSize(p), ProductFlops(p));
+  if (rows_ != p.GetRows() || cols_ != p.GetCols())
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  if (p.Reads(*this) != Overlap::kNone) return *this += Matrix(p);
+  p.AddTo(*this, 1.0);
   return *this;
 }
 
-bool Matrix::operator==(const Matrix& A) const { return EqMatrix(A); }
+Matrix& Matrix::operator-=(const MatrixProduct& p) {
+  MATRIX_STATS_SCOPE(StatsOp::kMulMatrix, ProductSize(p), ProductFlops(p));
+  if (rows_ != p.GetRows() || cols_ != p.GetCols())
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  if (p.Reads(*this) != Overlap::kNone) return *this -= Matrix(p);
+  p.AddTo(*this, -1.0);
+  return *this;
+}
 
-Matrix operator*(const Matrix& A, const double B) {
-  Matrix result(A);
-  result.MulNumber(B);
-  return result;
+MatrixArg::MatrixArg(const MatrixProduct& p)
+    : MatrixArg(std::make_shared<Matrix>(p)) {}
+
+MatrixProduct::MatrixProduct(MatrixArg a, MatrixArg b)
+    : a_(std::move(a)), b_(std::move(b)) {
+  if (a_.GetCols() != b_.GetRows())
+    throw std::invalid_argument(
+        "First matrix columns number isn't equal to second matrix rows number, "
+        "mathematically incorrect!");
 }
 
-Matrix operator*(const double B, const Matrix& A) {
-  Matrix result(A);
-  result.MulNumber(B);
-  return result;
+int MatrixProduct::GetRows() const { return a_.GetRows(); }
+
+int MatrixProduct::GetCols() const { return b_.GetCols(); }
+
+const MatrixView& MatrixProduct::GetLeft() const { return a_; }
+
+const MatrixView& MatrixProduct::GetRight() const { return b_; }
+
+Overlap MatrixProduct::Reads(const MatrixView& dst) const {
+  return std::max(a_.OverlapWith(dst), b_.OverlapWith(dst));
 }
 
+void MatrixProduct::AddTo(const MatrixView& c, double alpha) const {
+  MATRIX_STATS_SCOPE(StatsOp::kMulMatrix, ProductSize(*this),
+                     ProductFlops(*this));
+  const MatrixView &a = a_, &b = b_;
+  const int m = GetRows(), n = GetCols(), k = a.GetCols();
+  if (c.GetRows() != m || c.GetCols() != n)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  // GEMM stores along unit-stride rows of C. A destination laid out by
+  // columns takes C^T += B^T * A^T instead, anything else a temporary.
+  if (c.GetColStride() != 1 && n > 1) {
+    if (c.GetRowStride() == 1 || m == 1) {
+      MatrixProduct(b.Transposed(), a.Transposed())
+          .AddTo(c.Transposed(), alpha);
+      return;
+    }
+    Matrix t(m, n);
+    AddTo(t, alpha);
+    MatrixView dst(c);
+    dst += t;
+    return;
+  }
+  // Operands are read through both strides, so transposed views and
+  // blocks cost nothing extra.
+  const int a_rs = a.GetRowStride(), a_cs = a.GetColStride();
+  const int b_rs = b.GetRowStride(), b_cs = b.GetColStride();
+  const int ldc = c.GetRowStride();
+  if ((long long)m * n * k > GEMM_NAIVE_LIMIT &&
+      StructuredProduct(a, b, c, alpha))
+    return;
+  if (UseStrassen(m, n, k)) {
+    StrassenGemm(a, b, c, alpha, GetStrassenCrossover());
+    return;
+  }
+  if ((long long)m * n * k > GEMM_NAIVE_LIMIT) {
+    Gemm(m, n, k, alpha, a.GetData(), a_rs, a_cs, b.GetData(), b_rs, b_cs,
+         c.GetData(), ldc);
+    return;
+  }
+  // Small products: row i of c gathers the rows of b scaled by row i of a,
+  // which walks c and an untransposed b along their rows.
+  for (int i = 0; i < m; i++) {
+    double* row_c = c.GetData() + (long)i * ldc;
+    for (int x = 0; x < k; x++) {
+      const double aik =
+          alpha * a.GetData()[(long)i * a_rs + (long)x * a_cs];
+      const double* row_b = b.GetData() + (long)x * b_rs;
+      if (b_cs == 1)
+        for (int j = 0; j < n; j++) row_c[j] += aik * row_b[j];
+      else
+        for (int j = 0; j < n; j++) row_c[j] += aik * row_b[(long)j * b_cs];
+    }
+  }
+}
+
+Matrix& Matrix::operator*=(const Matrix& other) {
+  MulMatrix(other);
+  return *this;
+}
+
+Matrix& Matrix::operator*=(const double other) {
+  MulNumber(other);
+  return *this;
+}
+
+bool operator==(const Matrix& A, const Matrix& B) { return A.EqMatrix(B); }
+
+// '\n' rather than std::endl, which flushed the stream once per row; see
+// SaveMatrixText in matrix_io.h for text files.
 std::ostream& operator<<(std::ostream& os, const Matrix& A) {
   for (int i = 0; i < A.rows_; i++) {
-    for (int j = 0; j < A.cols_; j++) os << A.matrix_[i][j] << " ";
-    os << std::endl;
+    for (int j = 0; j < A.cols_; j++) os << A.Row(i)[j] << ' ';
+    os << '\n';
   }
-  os << std::endl;
+  os << '\n';
   return os;
 }
 
@@ -246,9 +619,21 @@ int Matrix::GetCols() const { return cols_; }
 
 int Matrix::GetRows() const { return rows_; }
 
+double* Matrix::GetData() const { return matrix_; }
+
+int Matrix::GetStride() const { return stride_; }
+
+// Shrinking only changes the shape, and growing stays in place while the
+// buffer has room: the old stride is kept, new elements are zeroed.
 void Matrix::SetCols(int cols) {
   if (cols <= 0)
     throw std::out_of_range("Incorrect input, index is out of range");
+  if (cols <= stride_) {
+    for (int i = 0; i < rows_ && cols > cols_; i++)
+      std::memset(Row(i) + cols_, 0, (cols - cols_) * sizeof(double));
+    cols_ = cols;
+    return;
+  }
   Matrix temp(rows_, cols);
   temp.CopyMatrixVals(*this);
   *this = std::move(temp);
@@ -257,7 +642,20 @@ void Matrix::SetCols(int cols) {
 void Matrix::SetRows(int rows) {
   if (rows <= 0)
     throw std::out_of_range("Incorrect input, index is out of range");
+  if (matrix_ && (std::size_t)rows * stride_ * sizeof(double) <= capacity_) {
+    if (rows > rows_)
+      std::memset(Row(rows_), 0,
+                  (std::size_t)(rows - rows_) * stride_ * sizeof(double));
+    rows_ = rows;
+    return;
+  }
   Matrix temp(rows, cols_);
   temp.CopyMatrixVals(*this);
   *this = std::move(temp);
 }
+
+void Add(const Matrix& a, const Matrix& b, Matrix& out) { out = a + b; }
+
+void Subtract(const Matrix& a, const Matrix& b, Matrix& out) { out = a - b; }
+
+void Multiply(const Matrix& a, const Matrix& b, Matrix& out) { out = a * b; }
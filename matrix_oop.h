@@ -2,17 +2,44 @@
 #define CPP1__MATRIXPLUS_0__MATRIX_OOP_H
 #include <math.h>
 
+#include <cstddef>
 #include <iostream>
+#include <string>
+
+#include "matrix_view.h"
 #define EPS 1E-7
 
-class Matrix {
+class MatrixAllocator;
+enum class Precision;
+struct Refinement;
+class MatrixProduct;
+template <typename E>
+class MatrixExpr;
+
+// Dense matrix of T. Matrix, the double specialization below, is the one
+// the decompositions, expressions, files and batches are written against;
+// the float, complex and integer matrices are in matrix_generic.h.
+template <typename T>
+class BasicMatrix;
+using Matrix = BasicMatrix<double>;
+
+template <>
+class BasicMatrix<double> {
  public:
-  Matrix();
-  Matrix(int rows, int cols);
-  Matrix(const Matrix& other);
-  Matrix(Matrix&& other);
-  Matrix(int rows, int cols, std::initializer_list<double>& m);
-  ~Matrix();
+  using value_type = double;
+
+  BasicMatrix();
+  BasicMatrix(int rows, int cols);
+  BasicMatrix(const Matrix& other);
+  BasicMatrix(Matrix&& other);
+  BasicMatrix(int rows, int cols, std::initializer_list<double>& m);
+  // Copies the viewed elements.
+  BasicMatrix(const MatrixView& v);
+  // Evaluates a lazy expression, see matrix_expr.h.
+  template <typename E>
+  BasicMatrix(const MatrixExpr<E>& e);
+  BasicMatrix(const MatrixProduct& p);
+  ~BasicMatrix();
 
   bool EqMatrix(const Matrix& other) const;
   void SumMatrix(const Matrix& other);
@@ -20,35 +47,81 @@ class Matrix {
   void MulNumber(const double num);
   void MulMatrix(const Matrix& other);
   Matrix Transpose() const;
+  void TransposeInPlace();
   Matrix CalcComplements() const;
   double Determinant() const;
   Matrix InverseMatrix() const;
+  // With Precision::kMixed, factored in float and refined in double; see
+  // MixedLU in matrix_decomp.h for when that pays off. The backward error
+  // reached goes to refinement when given.
+  Matrix InverseMatrix(Precision precision,
+                       Refinement* refinement = nullptr) const;
 
   Matrix& operator=(const Matrix& other);
   Matrix& operator=(Matrix&& other);
+  Matrix& operator=(const MatrixView& v);
+  template <typename E>
+  Matrix& operator=(const MatrixExpr<E>& e);
+  Matrix& operator=(const MatrixProduct& p);
   double& operator()(int row, int col) const;
   Matrix& operator+=(const Matrix& other);
   Matrix& operator-=(const Matrix& other);
+  template <typename E>
+  Matrix& operator+=(const MatrixExpr<E>& e);
+  template <typename E>
+  Matrix& operator-=(const MatrixExpr<E>& e);
+  // GEMM-accumulate into this matrix, no product temporary.
+  Matrix& operator+=(const MatrixProduct& p);
+  Matrix& operator-=(const MatrixProduct& p);
   Matrix& operator*=(const Matrix& other);
   Matrix& operator*=(const double other);
-  bool operator==(const Matrix& A) const;
-  Matrix operator+(const Matrix& A) const;
-  Matrix operator-(const Matrix& A) const;
-  Matrix operator*(const Matrix& A) const;
-  friend Matrix operator*(const Matrix& A, const double B);
-  friend Matrix operator*(const double B, const Matrix& A);
   friend std::ostream& operator<<(std::ostream& os, const Matrix& A);
   int GetCols() const;
   int GetRows() const;
   void SetCols(int x);
   void SetRows(int x);
+  // Elements live in one aligned row-major buffer; row i starts at
+  // GetData() + i * GetStride().
+  double* GetData() const;
+  int GetStride() const;
+  // Stride of a new matrix with cols columns.
+  static int LeadingDimension(int cols);
+
+  // matrix_io.h; they hand file data to the matrix without a copy.
+  friend Matrix LoadMatrix(const std::string& path);
+  friend Matrix MapMatrix(const std::string& path, bool verify);
 
  private:
+  // Takes over capacity bytes at data, which allocator releases when the
+  // matrix is done with them.
+  BasicMatrix(double* data, int rows, int cols, int stride,
+              std::size_t capacity, MatrixAllocator* allocator);
   void CopyMatrixVals(const Matrix& other);
-  void CreateMatrix();
-  double CalcMinor(const int x, const int y) const;
-  double** matrix_{nullptr};
-  int rows_{}, cols_{};
+  void CreateMatrix(bool zero_fill = true);
+  // Gives the matrix a new shape with unspecified contents, keeping the
+  // buffer when it is large enough.
+  void Reshape(int rows, int cols);
+  double* Row(int i) const { return matrix_ + (std::size_t)i * stride_; }
+  double* matrix_{nullptr};
+  int rows_{}, cols_{}, stride_{};
+  // Bytes of the buffer and the allocator it came from, see matrix_alloc.h.
+  std::size_t capacity_{};
+  MatrixAllocator* allocator_{nullptr};
 };
 
+bool operator==(const Matrix& A, const Matrix& B);
+
+// out = a + b, a - b and a * b. The destination is reshaped as needed and
+// keeps its storage when it is large enough, so a serial loop over operands
+// of one shape never allocates after its first iteration. Calls split
+// across the thread pool still allocate their job record and tasks; keep
+// them on the caller with ThreadLimit where that matters. out may be an
+// operand; for Multiply that costs a temporary.
+void Add(const Matrix& a, const Matrix& b, Matrix& out);
+void Subtract(const Matrix& a, const Matrix& b, Matrix& out);
+void Multiply(const Matrix& a, const Matrix& b, Matrix& out);
+
+// +, - and scalar * build lazy expressions; matrix * matrix a MatrixProduct.
+#include "matrix_expr.h"
+
 #endif  // CPP1__MATRIXPLUS_0__MATRIX_OOP_H
@@ -0,0 +1,228 @@
+#include "matrix_parallel.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include "matrix_numa.h"
+
+// Pool the current thread works for, so nested submissions go to the
+// worker's own deque.
+static thread_local ThreadPool* current_pool = nullptr;
+static thread_local int current_worker = -1;
+static thread_local int thread_limit = 0;
+
+ThreadPool::ThreadPool(int threads, bool pinned) : pinned_(pinned) {
+  threads = std::max(1, threads);
+  for (int i = 0; i < threads; i++)
+    queues_.push_back(std::make_unique<WorkQueue>());
+  for (int i = 0; i < threads; i++)
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_) worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  int index = current_pool == this ? current_worker
+                                   : (int)(next_queue_++ % queues_.size());
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_++;
+  }
+  wake_.notify_one();
+}
+
+int ThreadPool::GetThreads() const { return (int)workers_.size(); }
+
+bool ThreadPool::Pop(int index, std::function<void()>& task) {
+  WorkQueue& queue = *queues_[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) return false;
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::Steal(int index, std::function<void()>& task) {
+  for (std::size_t i = 1; i < queues_.size(); i++) {
+    WorkQueue& queue = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+// Worker i goes to node i % nodes, the CPUs of each node taken in turn.
+// Nodes without a CPU the process may use are skipped.
+static void PinWorker(int index) {
+  std::vector<const std::vector<int>*> nodes;
+  for (int node = 0; node < GetNumaNodes(); node++)
+    if (!GetNodeCpus(node).empty()) nodes.push_back(&GetNodeCpus(node));
+  if (nodes.empty()) return;
+  const std::vector<int>& cpus = *nodes[index % nodes.size()];
+  const int cpu = cpus[index / nodes.size() % cpus.size()];
+  if (cpu >= CPU_SETSIZE) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void ThreadPool::WorkerLoop(int index) {
+  if (pinned_) PinWorker(index);
+  current_pool = this;
+  current_worker = index;
+  for (;;) {
+    std::function<void()> task;
+    if (Pop(index, task) || Steal(index, task)) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_--;
+      }
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [this] { return stop_ || pending_ > 0; });
+    if (stop_ && pending_ == 0) return;
+  }
+}
+
+static std::mutex pool_mutex;
+static std::shared_ptr<ThreadPool> pool;
+static int num_threads = 0;
+static bool pin_threads = false;
+static std::atomic<long> parallel_threshold{1 << 16};
+
+static int HardwareThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Deleter of the shared pool. The last reference to a replaced pool can
+// be dropped by one of its own workers, in the middle of a task, and a
+// thread can't join itself: a thread of its own joins the workers then.
+static void RetirePool(ThreadPool* retired) {
+  if (current_pool == retired)
+    std::thread([retired] { delete retired; }).detach();
+  else
+    delete retired;
+}
+
+std::shared_ptr<ThreadPool> GetThreadPool() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (!pool)
+    pool = std::shared_ptr<ThreadPool>(
+        new ThreadPool(num_threads > 0 ? num_threads : HardwareThreads(),
+                       pin_threads),
+        RetirePool);
+  return pool;
+}
+
+void SetNumThreads(int threads) {
+  std::shared_ptr<ThreadPool> old;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    num_threads = threads;
+    old = std::move(pool);
+  }
+}
+
+int GetNumThreads() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  return num_threads > 0 ? num_threads : HardwareThreads();
+}
+
+void SetThreadPinning(bool pinned) {
+  std::shared_ptr<ThreadPool> old;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pin_threads = pinned;
+    old = std::move(pool);
+  }
+}
+
+bool GetThreadPinning() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  return pin_threads;
+}
+
+void SetParallelThreshold(long work) { parallel_threshold = work; }
+
+long GetParallelThreshold() { return parallel_threshold; }
+
+ThreadLimit::ThreadLimit(int threads) : saved_(thread_limit) {
+  thread_limit = threads;
+}
+
+ThreadLimit::~ThreadLimit() { thread_limit = saved_; }
+
+int ParallelThreads(long items, double work) {
+  long threshold = std::max(1L, parallel_threshold.load());
+  if (items < 2 || work < threshold) return 1;
+  long threads = thread_limit > 0 ? thread_limit : GetNumThreads();
+  threads = std::min<long>(threads, items);
+  threads = std::min<long>(threads, (long)(work / threshold));
+  return (int)std::max(1L, threads);
+}
+
+void RunParallel(long begin, long end, int threads,
+                 const std::function<void(long, long)>& fn) {
+  // A few chunks per thread even out uneven chunk costs; helpers that find
+  // nothing left just return, so the caller never waits on a queued task.
+  struct Job {
+    std::atomic<long> next{0};
+    long chunks, chunk, begin, end;
+    std::atomic<long> remaining;
+    const std::function<void(long, long)>* fn;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+  };
+  auto job = std::make_shared<Job>();
+  job->begin = begin;
+  job->end = end;
+  job->chunks = std::min<long>(end - begin, (long)threads * 4);
+  job->chunk = (end - begin + job->chunks - 1) / job->chunks;
+  job->chunks = (end - begin + job->chunk - 1) / job->chunk;
+  job->remaining = job->chunks;
+  job->fn = &fn;
+  auto run = [job] {
+    for (long c; (c = job->next++) < job->chunks;) {
+      long lo = job->begin + c * job->chunk;
+      long hi = std::min(job->end, lo + job->chunk);
+      try {
+        (*job->fn)(lo, hi);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (!job->error) job->error = std::current_exception();
+      }
+      if (--job->remaining == 0) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done.notify_all();
+      }
+    }
+  };
+  std::shared_ptr<ThreadPool> workers = GetThreadPool();
+  for (int t = 1; t < threads; t++) workers->Submit(run);
+  run();
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->done.wait(lock, [&job] { return job->remaining == 0; });
+  if (job->error) std::rethrow_exception(job->error);
+}
@@ -0,0 +1,95 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_PARALLEL_H
+#define CPP1__MATRIXPLUS_0__MATRIX_PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool the Matrix kernels split their work across. Every
+// worker owns a deque: it pushes and pops its own tasks at the back and,
+// when idle, steals from the front of the others. Pinned workers each stay
+// on one CPU, see SetThreadPinning.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int threads, bool pinned = false);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void Submit(std::function<void()> task);
+  int GetThreads() const;
+
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+  bool Pop(int index, std::function<void()>& task);
+  bool Steal(int index, std::function<void()>& task);
+  void WorkerLoop(int index);
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  long pending_{0};
+  std::atomic<unsigned> next_queue_{0};
+  bool stop_{false};
+  bool pinned_;
+};
+
+// Pool shared by the library, created on first use with
+// GetNumThreads() workers.
+std::shared_ptr<ThreadPool> GetThreadPool();
+// Global thread count; zero or less means one per hardware thread. Resizing
+// replaces the pool; operations already running finish on the old one,
+// which is destroyed after the last of them.
+void SetNumThreads(int threads);
+int GetNumThreads();
+// Pins every worker of the pool to one CPU, consecutive workers on
+// consecutive NUMA nodes (see matrix_numa.h), so a few threads already use
+// the memory bandwidth of every node and the pages a worker first touches
+// stay local to it. Off by default; changing it replaces the pool like
+// SetNumThreads. A worker the system won't pin runs unpinned.
+void SetThreadPinning(bool pinned);
+bool GetThreadPinning();
+// Estimated work (roughly element operations or flops) below which a call
+// stays on the calling thread; each extra thread also gets at least this
+// much.
+void SetParallelThreshold(long work);
+long GetParallelThreshold();
+
+// Caps the threads used by Matrix calls made on this thread while the
+// guard is alive, e.g. ThreadLimit serial(1); for one serial call.
+class ThreadLimit {
+ public:
+  explicit ThreadLimit(int threads);
+  ~ThreadLimit();
+
+ private:
+  int saved_;
+};
+
+// Threads a loop over items elements with the given total work should use.
+int ParallelThreads(long items, double work);
+void RunParallel(long begin, long end, int threads,
+                 const std::function<void(long, long)>& fn);
+
+// Calls fn(lo, hi) over disjoint chunks covering [begin, end), in parallel
+// when the work is large enough and serially on the caller otherwise.
+template <typename Fn>
+void ParallelFor(long begin, long end, double work, Fn&& fn) {
+  int threads = ParallelThreads(end - begin, work);
+  if (threads <= 1) {
+    if (begin < end) fn(begin, end);
+    return;
+  }
+  RunParallel(begin, end, threads, std::ref(fn));
+}
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_PARALLEL_H
@@ -0,0 +1,447 @@
+#include "matrix_simd.h"
+
+#include <math.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_X86 1
+#endif
+
+#define SCALAR_KERNEL __attribute__((optimize("no-tree-vectorize")))
+#define AVX2_KERNEL __attribute__((target("avx2,fma")))
+#define AVX512_KERNEL __attribute__((target("avx512f")))
+
+// Scalar reference kernels. Vectorization is disabled so they stay an
+// independent check on the SIMD paths.
+
+SCALAR_KERNEL static void AddScalar(double* dst, const double* src, long n) {
+  for (long i = 0; i < n; i++) dst[i] += src[i];
+}
+
+SCALAR_KERNEL static void SubScalar(double* dst, const double* src, long n) {
+  for (long i = 0; i < n; i++) dst[i] -= src[i];
+}
+
+SCALAR_KERNEL static void ScaleScalar(double* dst, double num, long n) {
+  for (long i = 0; i < n; i++) dst[i] *= num;
+}
+
+SCALAR_KERNEL static bool EqScalar(const double* a, const double* b, long n,
+                                   double eps) {
+  for (long i = 0; i < n; i++)
+    if (fabs(a[i] - b[i]) > eps) return false;
+  return true;
+}
+
+SCALAR_KERNEL static void AxpyScalar(double* y, double a, const double* x,
+                                    long n) {
+  for (long i = 0; i < n; i++) y[i] += a * x[i];
+}
+
+template <int MR, int NR>
+SCALAR_KERNEL static void GemmScalar(int kc, const double* a, const double* b,
+                                     double* c, int ldc, int mr, int nr) {
+  double acc[MR][NR] = {};
+  for (int p = 0; p < kc; p++, a += MR, b += NR)
+    for (int r = 0; r < MR; r++)
+      for (int s = 0; s < NR; s++) acc[r][s] += a[r] * b[s];
+  for (int r = 0; r < mr; r++)
+    for (int s = 0; s < nr; s++) c[(long)r * ldc + s] += acc[r][s];
+}
+
+// Adds a register tile spilled to tmp into the mr x nr corner of C.
+static void AddTile(const double* tmp, int tmp_ld, double* c, int ldc, int mr,
+                    int nr) {
+  for (int r = 0; r < mr; r++)
+    for (int s = 0; s < nr; s++) c[(long)r * ldc + s] += tmp[r * tmp_ld + s];
+}
+
+#ifdef MATRIX_X86
+
+// SSE2 is part of x86-64, so these need no target attribute.
+
+static void AddSse2(double* dst, const double* src, long n) {
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(dst + i),
+                                      _mm_loadu_pd(src + i)));
+    _mm_storeu_pd(dst + i + 2, _mm_add_pd(_mm_loadu_pd(dst + i + 2),
+                                          _mm_loadu_pd(src + i + 2)));
+  }
+  for (; i < n; i++) dst[i] += src[i];
+}
+
+static void SubSse2(double* dst, const double* src, long n) {
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(dst + i, _mm_sub_pd(_mm_loadu_pd(dst + i),
+                                      _mm_loadu_pd(src + i)));
+    _mm_storeu_pd(dst + i + 2, _mm_sub_pd(_mm_loadu_pd(dst + i + 2),
+                                          _mm_loadu_pd(src + i + 2)));
+  }
+  for (; i < n; i++) dst[i] -= src[i];
+}
+
+static void ScaleSse2(double* dst, double num, long n) {
+  __m128d s = _mm_set1_pd(num);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(dst + i), s));
+    _mm_storeu_pd(dst + i + 2, _mm_mul_pd(_mm_loadu_pd(dst + i + 2), s));
+  }
+  for (; i < n; i++) dst[i] *= num;
+}
+
+// |a - b| > eps is tested with an ordered compare, so NaN pairs count as
+// equal exactly like the scalar fabs() check does.
+static bool EqSse2(const double* a, const double* b, long n, double eps) {
+  const __m128d abs_mask =
+      _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffff));
+  const __m128d e = _mm_set1_pd(eps);
+  long i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d d = _mm_and_pd(
+        _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)), abs_mask);
+    if (_mm_movemask_pd(_mm_cmpgt_pd(d, e))) return false;
+  }
+  for (; i < n; i++)
+    if (fabs(a[i] - b[i]) > eps) return false;
+  return true;
+}
+
+static void AxpySse2(double* y, double a, const double* x, long n) {
+  __m128d s = _mm_set1_pd(a);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i),
+                                    _mm_mul_pd(s, _mm_loadu_pd(x + i))));
+    _mm_storeu_pd(y + i + 2,
+                  _mm_add_pd(_mm_loadu_pd(y + i + 2),
+                             _mm_mul_pd(s, _mm_loadu_pd(x + i + 2))));
+  }
+  for (; i < n; i++) y[i] += a * x[i];
+}
+
+static void GemmSse2(int kc, const double* a, const double* b, double* c,
+                     int ldc, int mr, int nr) {
+  __m128d acc[4][2];
+  for (int r = 0; r < 4; r++) acc[r][0] = acc[r][1] = _mm_setzero_pd();
+  for (int p = 0; p < kc; p++, a += 4, b += 4) {
+    __m128d b0 = _mm_loadu_pd(b), b1 = _mm_loadu_pd(b + 2);
+#pragma GCC unroll 4
+    for (int r = 0; r < 4; r++) {
+      __m128d ar = _mm_set1_pd(a[r]);
+      acc[r][0] = _mm_add_pd(acc[r][0], _mm_mul_pd(ar, b0));
+      acc[r][1] = _mm_add_pd(acc[r][1], _mm_mul_pd(ar, b1));
+    }
+  }
+  if (mr == 4 && nr == 4) {
+    for (int r = 0; r < 4; r++) {
+      double* cr = c + (long)r * ldc;
+      _mm_storeu_pd(cr, _mm_add_pd(_mm_loadu_pd(cr), acc[r][0]));
+      _mm_storeu_pd(cr + 2, _mm_add_pd(_mm_loadu_pd(cr + 2), acc[r][1]));
+    }
+    return;
+  }
+  double tmp[4 * 4];
+  for (int r = 0; r < 4; r++) {
+    _mm_storeu_pd(tmp + r * 4, acc[r][0]);
+    _mm_storeu_pd(tmp + r * 4 + 2, acc[r][1]);
+  }
+  AddTile(tmp, 4, c, ldc, mr, nr);
+}
+
+AVX2_KERNEL static void AddAvx2(double* dst, const double* src, long n) {
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i),
+                                            _mm256_loadu_pd(src + i)));
+    _mm256_storeu_pd(dst + i + 4, _mm256_add_pd(_mm256_loadu_pd(dst + i + 4),
+                                                _mm256_loadu_pd(src + i + 4)));
+  }
+  for (; i < n; i++) dst[i] += src[i];
+}
+
+AVX2_KERNEL static void SubAvx2(double* dst, const double* src, long n) {
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(dst + i, _mm256_sub_pd(_mm256_loadu_pd(dst + i),
+                                            _mm256_loadu_pd(src + i)));
+    _mm256_storeu_pd(dst + i + 4, _mm256_sub_pd(_mm256_loadu_pd(dst + i + 4),
+                                                _mm256_loadu_pd(src + i + 4)));
+  }
+  for (; i < n; i++) dst[i] -= src[i];
+}
+
+AVX2_KERNEL static void ScaleAvx2(double* dst, double num, long n) {
+  __m256d s = _mm256_set1_pd(num);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(dst + i), s));
+    _mm256_storeu_pd(dst + i + 4,
+                     _mm256_mul_pd(_mm256_loadu_pd(dst + i + 4), s));
+  }
+  for (; i < n; i++) dst[i] *= num;
+}
+
+AVX2_KERNEL static bool EqAvx2(const double* a, const double* b, long n,
+                               double eps) {
+  const __m256d abs_mask =
+      _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffff));
+  const __m256d e = _mm256_set1_pd(eps);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256d d0 = _mm256_and_pd(
+        _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)),
+        abs_mask);
+    __m256d d1 = _mm256_and_pd(
+        _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)),
+        abs_mask);
+    __m256d gt = _mm256_or_pd(_mm256_cmp_pd(d0, e, _CMP_GT_OQ),
+                              _mm256_cmp_pd(d1, e, _CMP_GT_OQ));
+    if (_mm256_movemask_pd(gt)) return false;
+  }
+  for (; i < n; i++)
+    if (fabs(a[i] - b[i]) > eps) return false;
+  return true;
+}
+
+AVX2_KERNEL static void AxpyAvx2(double* y, double a, const double* x,
+                                 long n) {
+  __m256d s = _mm256_set1_pd(a);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(y + i, _mm256_fmadd_pd(s, _mm256_loadu_pd(x + i),
+                                            _mm256_loadu_pd(y + i)));
+    _mm256_storeu_pd(y + i + 4, _mm256_fmadd_pd(s, _mm256_loadu_pd(x + i + 4),
+                                                _mm256_loadu_pd(y + i + 4)));
+  }
+  for (; i < n; i++) y[i] += a * x[i];
+}
+
+// 6x8 tile: twelve ymm accumulators, two B loads and one broadcast.
+AVX2_KERNEL static void GemmAvx2(int kc, const double* a, const double* b,
+                                 double* c, int ldc, int mr, int nr) {
+  __m256d acc[6][2];
+  for (int r = 0; r < 6; r++) acc[r][0] = acc[r][1] = _mm256_setzero_pd();
+  for (int p = 0; p < kc; p++, a += 6, b += 8) {
+    __m256d b0 = _mm256_loadu_pd(b), b1 = _mm256_loadu_pd(b + 4);
+#pragma GCC unroll 6
+    for (int r = 0; r < 6; r++) {
+      __m256d ar = _mm256_broadcast_sd(a + r);
+      acc[r][0] = _mm256_fmadd_pd(ar, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_pd(ar, b1, acc[r][1]);
+    }
+  }
+  if (mr == 6 && nr == 8) {
+    for (int r = 0; r < 6; r++) {
+      double* cr = c + (long)r * ldc;
+      _mm256_storeu_pd(cr, _mm256_add_pd(_mm256_loadu_pd(cr), acc[r][0]));
+      _mm256_storeu_pd(cr + 4,
+                       _mm256_add_pd(_mm256_loadu_pd(cr + 4), acc[r][1]));
+    }
+    return;
+  }
+  double tmp[6 * 8];
+  for (int r = 0; r < 6; r++) {
+    _mm256_storeu_pd(tmp + r * 8, acc[r][0]);
+    _mm256_storeu_pd(tmp + r * 8 + 4, acc[r][1]);
+  }
+  AddTile(tmp, 8, c, ldc, mr, nr);
+}
+
+AVX512_KERNEL static void AddAvx512(double* dst, const double* src, long n) {
+  long i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_add_pd(_mm512_loadu_pd(dst + i),
+                                            _mm512_loadu_pd(src + i)));
+  if (i < n) {
+    __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+    _mm512_mask_storeu_pd(dst + i, m,
+                          _mm512_add_pd(_mm512_maskz_loadu_pd(m, dst + i),
+                                        _mm512_maskz_loadu_pd(m, src + i)));
+  }
+}
+
+AVX512_KERNEL static void SubAvx512(double* dst, const double* src, long n) {
+  long i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_sub_pd(_mm512_loadu_pd(dst + i),
+                                            _mm512_loadu_pd(src + i)));
+  if (i < n) {
+    __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+    _mm512_mask_storeu_pd(dst + i, m,
+                          _mm512_sub_pd(_mm512_maskz_loadu_pd(m, dst + i),
+                                        _mm512_maskz_loadu_pd(m, src + i)));
+  }
+}
+
+AVX512_KERNEL static void ScaleAvx512(double* dst, double num, long n) {
+  __m512d s = _mm512_set1_pd(num);
+  long i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_mul_pd(_mm512_loadu_pd(dst + i), s));
+  if (i < n) {
+    __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+    _mm512_mask_storeu_pd(dst + i, m,
+                          _mm512_mul_pd(_mm512_maskz_loadu_pd(m, dst + i), s));
+  }
+}
+
+AVX512_KERNEL static bool EqAvx512(const double* a, const double* b, long n,
+                                   double eps) {
+  const __m512d e = _mm512_set1_pd(eps);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d d = _mm512_abs_pd(
+        _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    if (_mm512_cmp_pd_mask(d, e, _CMP_GT_OQ)) return false;
+  }
+  if (i < n) {
+    __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+    __m512d d = _mm512_abs_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(m, a + i),
+                                            _mm512_maskz_loadu_pd(m, b + i)));
+    if (_mm512_mask_cmp_pd_mask(m, d, e, _CMP_GT_OQ)) return false;
+  }
+  return true;
+}
+
+AVX512_KERNEL static void AxpyAvx512(double* y, double a, const double* x,
+                                     long n) {
+  __m512d s = _mm512_set1_pd(a);
+  long i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(y + i, _mm512_fmadd_pd(s, _mm512_loadu_pd(x + i),
+                                            _mm512_loadu_pd(y + i)));
+  if (i < n) {
+    __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+    _mm512_mask_storeu_pd(y + i, m,
+                          _mm512_fmadd_pd(s, _mm512_maskz_loadu_pd(m, x + i),
+                                          _mm512_maskz_loadu_pd(m, y + i)));
+  }
+}
+
+// 8x16 tile: sixteen zmm accumulators out of the 32 registers.
+AVX512_KERNEL static void GemmAvx512(int kc, const double* a, const double* b,
+                                     double* c, int ldc, int mr, int nr) {
+  __m512d acc[8][2];
+  for (int r = 0; r < 8; r++) acc[r][0] = acc[r][1] = _mm512_setzero_pd();
+  for (int p = 0; p < kc; p++, a += 8, b += 16) {
+    __m512d b0 = _mm512_loadu_pd(b), b1 = _mm512_loadu_pd(b + 8);
+#pragma GCC unroll 8
+    for (int r = 0; r < 8; r++) {
+      __m512d ar = _mm512_set1_pd(a[r]);
+      acc[r][0] = _mm512_fmadd_pd(ar, b0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_pd(ar, b1, acc[r][1]);
+    }
+  }
+  if (mr == 8 && nr == 16) {
+    for (int r = 0; r < 8; r++) {
+      double* cr = c + (long)r * ldc;
+      _mm512_storeu_pd(cr, _mm512_add_pd(_mm512_loadu_pd(cr), acc[r][0]));
+      _mm512_storeu_pd(cr + 8,
+                       _mm512_add_pd(_mm512_loadu_pd(cr + 8), acc[r][1]));
+    }
+    return;
+  }
+  double tmp[8 * 16];
+  for (int r = 0; r < 8; r++) {
+    _mm512_storeu_pd(tmp + r * 16, acc[r][0]);
+    _mm512_storeu_pd(tmp + r * 16 + 8, acc[r][1]);
+  }
+  AddTile(tmp, 16, c, ldc, mr, nr);
+}
+
+#endif  // MATRIX_X86
+
+static const SimdKernels kScalarKernels = {
+    SimdIsa::kScalar, AddScalar,        SubScalar, ScaleScalar, EqScalar,
+    AxpyScalar,       GemmScalar<4, 8>, 4,         8};
+
+#ifdef MATRIX_X86
+static const SimdKernels kSse2Kernels = {
+    SimdIsa::kSse2, AddSse2, SubSse2, ScaleSse2, EqSse2,
+    AxpySse2,       GemmSse2, 4,      4};
+static const SimdKernels kAvx2Kernels = {
+    SimdIsa::kAvx2, AddAvx2, SubAvx2, ScaleAvx2, EqAvx2,
+    AxpyAvx2,       GemmAvx2, 6,      8};
+static const SimdKernels kAvx512Kernels = {
+    SimdIsa::kAvx512, AddAvx512,  SubAvx512, ScaleAvx512, EqAvx512,
+    AxpyAvx512,       GemmAvx512, 8,         16};
+#endif
+
+static const SimdKernels* KernelsFor(SimdIsa isa) {
+#ifdef MATRIX_X86
+  switch (isa) {
+    case SimdIsa::kSse2:
+      return &kSse2Kernels;
+    case SimdIsa::kAvx2:
+      return &kAvx2Kernels;
+    case SimdIsa::kAvx512:
+      return &kAvx512Kernels;
+    default:
+      break;
+  }
+#else
+  (void)isa;
+#endif
+  return &kScalarKernels;
+}
+
+bool SimdIsaSupported(SimdIsa isa) {
+  switch (isa) {
+    case SimdIsa::kScalar:
+      return true;
+#ifdef MATRIX_X86
+    case SimdIsa::kSse2:
+      return __builtin_cpu_supports("sse2");
+    case SimdIsa::kAvx2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SimdIsa::kAvx512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+static SimdIsa BestSimdIsa() {
+  if (const char* forced = std::getenv("MATRIX_ISA")) {
+    static const struct {
+      const char* name;
+      SimdIsa isa;
+    } kNames[] = {{"scalar", SimdIsa::kScalar},
+                  {"sse2", SimdIsa::kSse2},
+                  {"avx2", SimdIsa::kAvx2},
+                  {"avx512", SimdIsa::kAvx512}};
+    for (const auto& n : kNames)
+      if (!strcmp(forced, n.name) && SimdIsaSupported(n.isa)) return n.isa;
+  }
+  for (SimdIsa isa : {SimdIsa::kAvx512, SimdIsa::kAvx2, SimdIsa::kSse2})
+    if (SimdIsaSupported(isa)) return isa;
+  return SimdIsa::kScalar;
+}
+
+static std::atomic<const SimdKernels*> active_kernels{nullptr};
+
+const SimdKernels& Kernels() {
+  const SimdKernels* k = active_kernels.load(std::memory_order_acquire);
+  if (!k) {
+    k = KernelsFor(BestSimdIsa());
+    active_kernels.store(k, std::memory_order_release);
+  }
+  return *k;
+}
+
+SimdIsa GetSimdIsa() { return Kernels().isa; }
+
+void SetSimdIsa(SimdIsa isa) {
+  if (!SimdIsaSupported(isa))
+    throw std::invalid_argument("Instruction set isn't supported by this CPU!");
+  active_kernels.store(KernelsFor(isa), std::memory_order_release);
+}
@@ -0,0 +1,30 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_SIMD_H
+#define CPP1__MATRIXPLUS_0__MATRIX_SIMD_H
+
+// Instruction sets the element-wise and GEMM kernels are built for. The
+// best one the CPU supports is picked on first use; MATRIX_ISA=scalar|sse2|
+// avx2|avx512 in the environment or SetSimdIsa() can force another one.
+enum class SimdIsa { kScalar, kSse2, kAvx2, kAvx512 };
+
+struct SimdKernels {
+  SimdIsa isa;
+  void (*add)(double* dst, const double* src, long n);
+  void (*sub)(double* dst, const double* src, long n);
+  void (*scale)(double* dst, double num, long n);
+  // True when no pair differs by more than eps.
+  bool (*eq)(const double* a, const double* b, long n, double eps);
+  // y += a * x.
+  void (*axpy)(double* y, double a, const double* x, long n);
+  // C(mr x nr) += packed A sliver * packed B sliver, see matrix_gemm.cc.
+  void (*gemm)(int kc, const double* a, const double* b, double* c, int ldc,
+               int mr, int nr);
+  int gemm_mr, gemm_nr;
+};
+
+bool SimdIsaSupported(SimdIsa isa);
+SimdIsa GetSimdIsa();
+// Throws std::invalid_argument if the CPU can't run the requested kernels.
+void SetSimdIsa(SimdIsa isa);
+const SimdKernels& Kernels();
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_SIMD_H
@@ -0,0 +1,298 @@
+#include "matrix_sparse.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+SparseMatrix::SparseMatrix() {}
+
+SparseMatrix::SparseMatrix(int rows, int cols)
+    : rows_(rows), cols_(cols), offsets_(rows + 1, 0) {
+  if (rows <= 0 || cols <= 0)
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+}
+
+SparseMatrix::SparseMatrix(const Matrix& dense, double tolerance)
+    : SparseMatrix(dense.GetRows(), dense.GetCols()) {
+  const double* d = dense.GetData();
+  const int ld = dense.GetStride();
+  auto stored = [&](long i, int j) {
+    return fabs(d[i * ld + j]) > tolerance;
+  };
+  // Count the entries of every row, then fill each row at its offset.
+  ParallelFor(0, rows_, (double)rows_ * cols_, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++) {
+      long n = 0;
+      for (int j = 0; j < cols_; j++) n += stored(i, j);
+      offsets_[i + 1] = n;
+    }
+  });
+  std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+  columns_.resize(offsets_[rows_]);
+  values_.resize(offsets_[rows_]);
+  ParallelFor(0, rows_, (double)rows_ * cols_, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++)
+      for (long j = 0, k = offsets_[i]; j < cols_; j++)
+        if (stored(i, j)) {
+          columns_[k] = j;
+          values_[k++] = d[i * ld + j];
+        }
+  });
+}
+
+SparseMatrix::SparseMatrix(int rows, int cols,
+                           const std::vector<Triplet>& triplets)
+    : SparseMatrix(rows, cols) {
+  for (const Triplet& t : triplets) {
+    if (t.row >= rows || t.col >= cols || t.row < 0 || t.col < 0)
+      throw std::out_of_range("Incorrect input, index is out of range");
+    offsets_[t.row + 1]++;
+  }
+  std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+  std::vector<long> next(offsets_.begin(), offsets_.end() - 1);
+  std::vector<std::pair<int, double>> entries(triplets.size());
+  for (const Triplet& t : triplets) entries[next[t.row]++] = {t.col, t.value};
+  // Rows are sorted and their duplicates summed independently; the
+  // compaction that closes the gaps left by duplicates is a serial copy.
+  std::vector<long> sizes(rows_);
+  ParallelFor(0, rows_, (double)triplets.size() * 8, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++) {
+      auto first = entries.begin() + offsets_[i];
+      auto last = entries.begin() + offsets_[i + 1];
+      std::sort(first, last, [](const std::pair<int, double>& a,
+                                const std::pair<int, double>& b) {
+        return a.first < b.first;
+      });
+      auto out = first;
+      for (auto e = first; e != last; e++) {
+        if (out != first && (out - 1)->first == e->first)
+          (out - 1)->second += e->second;
+        else
+          *out++ = *e;
+      }
+      sizes[i] = out - first;
+    }
+  });
+  columns_.reserve(triplets.size());
+  values_.reserve(triplets.size());
+  long k = 0;
+  for (int i = 0; i < rows_; i++) {
+    const long start = offsets_[i];
+    offsets_[i] = k;
+    for (long e = start; e < start + sizes[i]; e++, k++) {
+      columns_.push_back(entries[e].first);
+      values_.push_back(entries[e].second);
+    }
+  }
+  offsets_[rows_] = k;
+}
+
+int SparseMatrix::GetRows() const { return rows_; }
+
+int SparseMatrix::GetCols() const { return cols_; }
+
+long SparseMatrix::GetNonZeros() const { return offsets_.back(); }
+
+const std::vector<long>& SparseMatrix::GetOffsets() const { return offsets_; }
+
+const std::vector<int>& SparseMatrix::GetColumns() const { return columns_; }
+
+const std::vector<double>& SparseMatrix::GetValues() const { return values_; }
+
+double SparseMatrix::operator()(int row, int col) const {
+  if (row >= rows_ || col >= cols_ || col < 0 || row < 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  auto first = columns_.begin() + offsets_[row];
+  auto last = columns_.begin() + offsets_[row + 1];
+  auto it = std::lower_bound(first, last, col);
+  return it != last && *it == col ? values_[it - columns_.begin()] : 0;
+}
+
+template <typename Fn>
+void SparseMatrix::ForEachRowRange(double work_per_entry, Fn&& fn) const {
+  const long nnz = GetNonZeros();
+  // Splits the entries, not the rows, so one dense row doesn't leave the
+  // other threads idle. A row belongs to the range holding its first entry.
+  ParallelFor(0, nnz, nnz * work_per_entry, [&](long lo, long hi) {
+    auto rows_end = offsets_.end() - 1;
+    auto first = std::lower_bound(offsets_.begin(), rows_end, lo);
+    auto last = std::lower_bound(first, rows_end, hi);
+    if (first < last)
+      fn((int)(first - offsets_.begin()), (int)(last - offsets_.begin()));
+  });
+}
+
+Matrix SparseMatrix::ToDense() const {
+  if (rows_ == 0) return Matrix();
+  Matrix result(rows_, cols_);
+  double* d = result.GetData();
+  const int ld = result.GetStride();
+  ForEachRowRange(1, [&](int first, int last) {
+    for (long i = first; i < last; i++)
+      for (long k = offsets_[i]; k < offsets_[i + 1]; k++)
+        d[i * ld + columns_[k]] = values_[k];
+  });
+  return result;
+}
+
+SparseMatrix SparseMatrix::Transpose() const {
+  if (rows_ == 0) return SparseMatrix();
+  SparseMatrix result(cols_, rows_);
+  const long nnz = GetNonZeros();
+  result.columns_.resize(nnz);
+  result.values_.resize(nnz);
+  // Blocks of rows count their entries per column, which tells each block
+  // where its entries go in every output row, so the scatter needs no
+  // synchronization. Blocks are in row order, keeping output rows sorted.
+  const int blocks = ParallelThreads(rows_, (double)nnz);
+  std::vector<long> next((std::size_t)blocks * cols_, 0);
+  auto block_rows = [&](long b) {
+    return std::make_pair((int)(rows_ * b / blocks),
+                          (int)(rows_ * (b + 1) / blocks));
+  };
+  ParallelFor(0, blocks, (double)nnz, [&](long lo, long hi) {
+    for (long b = lo; b < hi; b++) {
+      auto rows = block_rows(b);
+      for (long k = offsets_[rows.first]; k < offsets_[rows.second]; k++)
+        next[b * cols_ + columns_[k]]++;
+    }
+  });
+  long sum = 0;
+  for (int c = 0; c < cols_; c++) {
+    result.offsets_[c] = sum;
+    for (long b = 0; b < blocks; b++) {
+      long n = next[b * cols_ + c];
+      next[b * cols_ + c] = sum;
+      sum += n;
+    }
+  }
+  result.offsets_[cols_] = sum;
+  ParallelFor(0, blocks, (double)nnz, [&](long lo, long hi) {
+    for (long b = lo; b < hi; b++) {
+      auto rows = block_rows(b);
+      for (int i = rows.first; i < rows.second; i++)
+        for (long k = offsets_[i]; k < offsets_[i + 1]; k++) {
+          long pos = next[b * cols_ + columns_[k]]++;
+          result.columns_[pos] = i;
+          result.values_[pos] = values_[k];
+        }
+    }
+  });
+  return result;
+}
+
+// Merges row i of a and b, both sorted by column, into columns and values
+// when they are given; returns the length of the merged row.
+static long MergeRows(const SparseMatrix& a, const SparseMatrix& b, int i,
+                      int* columns, double* values) {
+  const std::vector<int> &ac = a.GetColumns(), &bc = b.GetColumns();
+  const std::vector<double> &av = a.GetValues(), &bv = b.GetValues();
+  long p = a.GetOffsets()[i], pe = a.GetOffsets()[i + 1];
+  long q = b.GetOffsets()[i], qe = b.GetOffsets()[i + 1];
+  long n = 0;
+  while (p < pe || q < qe) {
+    int c;
+    double v;
+    if (q == qe || (p < pe && ac[p] < bc[q])) {
+      c = ac[p], v = av[p++];
+    } else if (p == pe || bc[q] < ac[p]) {
+      c = bc[q], v = bv[q++];
+    } else {
+      c = ac[p], v = av[p++] + bv[q++];
+    }
+    if (columns) columns[n] = c, values[n] = v;
+    n++;
+  }
+  return n;
+}
+
+void SparseMatrix::SumMatrix(const SparseMatrix& other) {
+  if (other.cols_ != cols_ || other.rows_ != rows_)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  if (rows_ == 0) return;
+  SparseMatrix result(rows_, cols_);
+  const double work = GetNonZeros() + other.GetNonZeros() + rows_;
+  ParallelFor(0, rows_, work, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++)
+      result.offsets_[i + 1] = MergeRows(*this, other, i, nullptr, nullptr);
+  });
+  std::partial_sum(result.offsets_.begin(), result.offsets_.end(),
+                   result.offsets_.begin());
+  result.columns_.resize(result.offsets_[rows_]);
+  result.values_.resize(result.offsets_[rows_]);
+  ParallelFor(0, rows_, work, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++)
+      MergeRows(*this, other, i, result.columns_.data() + result.offsets_[i],
+                result.values_.data() + result.offsets_[i]);
+  });
+  *this = std::move(result);
+}
+
+void SparseMatrix::MulNumber(const double num) {
+  if (isnan(num) || isinf(num))
+    throw std::invalid_argument("Invalid number, inf or nan!");
+  const SimdKernels& k = Kernels();
+  ParallelFor(0, GetNonZeros(), GetNonZeros(), [&](long lo, long hi) {
+    k.scale(values_.data() + lo, num, hi - lo);
+  });
+}
+
+std::vector<double> SparseMatrix::MulVector(
+    const std::vector<double>& x) const {
+  if ((long)x.size() != cols_)
+    throw std::invalid_argument(
+        "Vector size isn't equal to matrix columns number!");
+  std::vector<double> y(rows_, 0.0);
+  ForEachRowRange(2, [&](int first, int last) {
+    for (int i = first; i < last; i++) {
+      double sum = 0;
+      for (long k = offsets_[i]; k < offsets_[i + 1]; k++)
+        sum += values_[k] * x[columns_[k]];
+      y[i] = sum;
+    }
+  });
+  return y;
+}
+
+Matrix SparseMatrix::MulMatrix(const Matrix& b) const {
+  if (cols_ != b.GetRows())
+    throw std::invalid_argument(
+        "First matrix columns number isn't equal to second matrix rows number, "
+        "mathematically incorrect!");
+  Matrix result(rows_, b.GetCols());
+  const int n = b.GetCols(), ldb = b.GetStride(), ldc = result.GetStride();
+  const double* bd = b.GetData();
+  double* cd = result.GetData();
+  const SimdKernels& kernels = Kernels();
+  // Row i of the result gathers the rows of b named by row i of a.
+  ForEachRowRange(2.0 * n, [&](int first, int last) {
+    for (long i = first; i < last; i++)
+      for (long k = offsets_[i]; k < offsets_[i + 1]; k++)
+        kernels.axpy(cd + i * ldc, values_[k], bd + (long)columns_[k] * ldb,
+                     n);
+  });
+  return result;
+}
+
+SparseMatrix& SparseMatrix::operator+=(const SparseMatrix& other) {
+  SumMatrix(other);
+  return *this;
+}
+
+SparseMatrix operator+(const SparseMatrix& a, const SparseMatrix& b) {
+  SparseMatrix result(a);
+  result.SumMatrix(b);
+  return result;
+}
+
+Matrix operator*(const SparseMatrix& a, const Matrix& b) {
+  return a.MulMatrix(b);
+}
+
+std::vector<double> operator*(const SparseMatrix& a,
+                              const std::vector<double>& x) {
+  return a.MulVector(x);
+}
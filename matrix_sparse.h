@@ -0,0 +1,66 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_SPARSE_H
+#define CPP1__MATRIXPLUS_0__MATRIX_SPARSE_H
+
+#include <vector>
+
+#include "matrix_oop.h"
+
+// One entry of a matrix given in coordinate form.
+struct Triplet {
+  int row, col;
+  double value;
+};
+
+// Matrix in compressed sparse row form: the entries of row i are
+// GetValues()[k] in columns GetColumns()[k] for k in [GetOffsets()[i],
+// GetOffsets()[i + 1]), columns ascending. Memory and the cost of every
+// operation scale with the number of stored entries. The CSR arrays of
+// Transpose() are the compressed sparse column arrays of the matrix.
+class SparseMatrix {
+ public:
+  SparseMatrix();
+  // All zeros.
+  SparseMatrix(int rows, int cols);
+  // Stores the entries with magnitude above tolerance.
+  explicit SparseMatrix(const Matrix& dense, double tolerance = 0);
+  // Entries may come in any order; duplicates are summed.
+  SparseMatrix(int rows, int cols, const std::vector<Triplet>& triplets);
+
+  int GetRows() const;
+  int GetCols() const;
+  long GetNonZeros() const;
+  const std::vector<long>& GetOffsets() const;
+  const std::vector<int>& GetColumns() const;
+  const std::vector<double>& GetValues() const;
+  double operator()(int row, int col) const;
+
+  Matrix ToDense() const;
+  SparseMatrix Transpose() const;
+  // Entries present in either operand are stored, even when they cancel.
+  void SumMatrix(const SparseMatrix& other);
+  void MulNumber(const double num);
+  // y = A * x for a vector of GetCols() values.
+  std::vector<double> MulVector(const std::vector<double>& x) const;
+  // A * B for a dense B, returned dense.
+  Matrix MulMatrix(const Matrix& b) const;
+
+  SparseMatrix& operator+=(const SparseMatrix& other);
+
+ private:
+  // Calls fn(first, last) over row ranges holding about equal numbers of
+  // entries, in parallel when there are enough of them.
+  template <typename Fn>
+  void ForEachRowRange(double work_per_entry, Fn&& fn) const;
+
+  int rows_{}, cols_{};
+  std::vector<long> offsets_{0};
+  std::vector<int> columns_;
+  std::vector<double> values_;
+};
+
+SparseMatrix operator+(const SparseMatrix& a, const SparseMatrix& b);
+Matrix operator*(const SparseMatrix& a, const Matrix& b);
+std::vector<double> operator*(const SparseMatrix& a,
+                              const std::vector<double>& x);
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_SPARSE_H
@@ -0,0 +1,127 @@
+#include "matrix_stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+struct Counters {
+  std::atomic<long> calls;
+  std::atomic<long> sizes[kStatsBuckets];
+  std::atomic<long> nanoseconds;
+  std::atomic<long> flops;
+  std::atomic<long> bytes_allocated;
+};
+
+}  // namespace
+
+static Counters counters[kStatsOps];
+
+static bool EnabledFromEnvironment() {
+  const char* value = std::getenv("MATRIX_STATS");
+  return value && std::strcmp(value, "0") != 0;
+}
+
+std::atomic<bool> stats_enabled{EnabledFromEnvironment()};
+
+// The operation of the StatsScope open on this thread, if any.
+static thread_local StatsOp* current_op = nullptr;
+
+static long Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static int Bucket(int size) {
+  int bucket = 0;
+  while (bucket + 1 < kStatsBuckets && (size >> (bucket + 1)) > 0) bucket++;
+  return bucket;
+}
+
+bool StatsCompiled() { return MATRIX_STATS != 0; }
+
+void SetStatsEnabled(bool enabled) { stats_enabled = enabled; }
+
+bool GetStatsEnabled() { return stats_enabled; }
+
+void ResetStats() {
+  for (Counters& c : counters) {
+    c.calls = 0;
+    for (auto& size : c.sizes) size = 0;
+    c.nanoseconds = 0;
+    c.flops = 0;
+    c.bytes_allocated = 0;
+  }
+}
+
+OpStats GetStats(StatsOp op) {
+  const Counters& c = counters[(int)op];
+  OpStats stats{};
+  stats.calls = c.calls;
+  for (int b = 0; b < kStatsBuckets; b++) stats.sizes[b] = c.sizes[b];
+  stats.seconds = c.nanoseconds * 1e-9;
+  stats.flops = c.flops;
+  stats.bytes_allocated = c.bytes_allocated;
+  return stats;
+}
+
+const char* StatsOpName(StatsOp op) {
+  static const char* const kNames[kStatsOps] = {
+      "MulMatrix", "Determinant", "InverseMatrix", "Construct",
+      "Copy",      "Move",        "Other"};
+  return kNames[(int)op];
+}
+
+std::string StatsJson() {
+  std::ostringstream out;
+  out.precision(17);
+  out << "{\"compiled\": " << (StatsCompiled() ? "true" : "false")
+      << ", \"enabled\": " << (GetStatsEnabled() ? "true" : "false")
+      << ", \"operations\": {";
+  for (int i = 0; i < kStatsOps; i++) {
+    const OpStats s = GetStats((StatsOp)i);
+    out << (i ? ", " : "") << '"' << StatsOpName((StatsOp)i)
+        << "\": {\"calls\": " << s.calls << ", \"seconds\": " << s.seconds
+        << ", \"flops\": " << s.flops << ", \"gflops\": "
+        << (s.seconds > 0 ? s.flops / s.seconds / 1e9 : 0)
+        << ", \"bytes_allocated\": " << s.bytes_allocated
+        << ", \"sizes\": {";
+    bool first = true;
+    for (int b = 0; b < kStatsBuckets; b++) {
+      if (!s.sizes[b]) continue;
+      out << (first ? "" : ", ") << "\"" << (1L << b) << "\": " << s.sizes[b];
+      first = false;
+    }
+    out << "}}";
+  }
+  out << "}}";
+  return out.str();
+}
+
+void StatsScope::Begin(StatsOp op, int size, double flops) {
+  if (current_op) return;
+  op_ = op;
+  active_ = true;
+  current_op = &op_;
+  Counters& c = counters[(int)op];
+  c.calls.fetch_add(1, std::memory_order_relaxed);
+  c.sizes[Bucket(size)].fetch_add(1, std::memory_order_relaxed);
+  c.flops.fetch_add((long)flops, std::memory_order_relaxed);
+  start_ = Now();
+}
+
+void StatsScope::End() {
+  counters[(int)op_].nanoseconds.fetch_add(Now() - start_,
+                                           std::memory_order_relaxed);
+  current_op = nullptr;
+}
+
+void StatsAllocated(std::size_t bytes) {
+  const StatsOp op = current_op ? *current_op : StatsOp::kOther;
+  counters[(int)op].bytes_allocated.fetch_add(bytes,
+                                              std::memory_order_relaxed);
+}
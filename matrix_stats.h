@@ -0,0 +1,106 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_STATS_H
+#define CPP1__MATRIXPLUS_0__MATRIX_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+// Per-operation counters for the Matrix hot paths: calls, a histogram of
+// sizes, wall time, floating point operations and bytes of storage
+// allocated. Only the outermost instrumented call on a thread is counted;
+// the time and allocations of what it calls internally are charged to it,
+// so InverseMatrix includes its LU and the matrices it creates. Storage
+// allocated outside any instrumented call is charged to kOther.
+//
+// Recording is off until SetStatsEnabled(true), or from the start when
+// MATRIX_STATS=1 is in the environment. While it's off an instrumented call
+// costs one relaxed load. Building the library with -DMATRIX_STATS=0
+// (make STATS=0) compiles the hooks out altogether; the functions below
+// then report nothing.
+#ifndef MATRIX_STATS
+#define MATRIX_STATS 1
+#endif
+
+enum class StatsOp {
+  // Every product: MulMatrix, *=, and assigning or accumulating A * B.
+  kMulMatrix,
+  kDeterminant,
+  kInverseMatrix,
+  // Matrix(rows, cols) and the initializer list constructor.
+  kConstruct,
+  // Copy construction and copy assignment.
+  kCopy,
+  kMove,
+  kOther,
+};
+constexpr int kStatsOps = 7;
+// Sizes are bucketed by their largest dimension n: bucket b counts
+// 2^b <= n < 2^(b + 1).
+constexpr int kStatsBuckets = 32;
+
+struct OpStats {
+  long calls;
+  long sizes[kStatsBuckets];
+  double seconds;
+  double flops;
+  long bytes_allocated;
+};
+
+// False when the hooks were compiled out.
+bool StatsCompiled();
+void SetStatsEnabled(bool enabled);
+bool GetStatsEnabled();
+void ResetStats();
+OpStats GetStats(StatsOp op);
+const char* StatsOpName(StatsOp op);
+// Every operation's counters as one JSON object, keyed by StatsOpName,
+// with "gflops" derived from flops and seconds and "sizes" keyed by the
+// lower bound of each nonempty bucket.
+std::string StatsJson();
+
+// Set by SetStatsEnabled, read inline so a hook costs one load while
+// recording is off.
+extern std::atomic<bool> stats_enabled;
+
+// Counts one call of op on the current thread while alive, unless
+// recording is off or another StatsScope is already open.
+class StatsScope {
+ public:
+  StatsScope(StatsOp op, int size, double flops) {
+    if (stats_enabled.load(std::memory_order_relaxed)) Begin(op, size, flops);
+  }
+  ~StatsScope() {
+    if (active_) End();
+  }
+  StatsScope(const StatsScope&) = delete;
+  StatsScope& operator=(const StatsScope&) = delete;
+
+ private:
+  void Begin(StatsOp op, int size, double flops);
+  void End();
+
+  StatsOp op_{};
+  bool active_{false};
+  long start_{0};
+};
+
+// Charges bytes of new storage to the open StatsScope, or to kOther.
+void StatsAllocated(std::size_t bytes);
+
+// Hooks for the library's own translation units.
+#if MATRIX_STATS
+#define MATRIX_STATS_CONCAT_(a, b) a##b
+#define MATRIX_STATS_NAME_(line) MATRIX_STATS_CONCAT_(stats_scope_, line)
+#define MATRIX_STATS_SCOPE(op, size, flops) \
+  StatsScope MATRIX_STATS_NAME_(__LINE__)(op, size, flops)
+#define MATRIX_STATS_ALLOCATED(bytes)                   \
+  do {                                                  \
+    if (stats_enabled.load(std::memory_order_relaxed)) \
+      StatsAllocated(bytes);                            \
+  } while (0)
+#else
+#define MATRIX_STATS_SCOPE(op, size, flops) ((void)0)
+#define MATRIX_STATS_ALLOCATED(bytes) ((void)0)
+#endif
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_STATS_H
@@ -0,0 +1,228 @@
+#include "matrix_strassen.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+static std::atomic<int> strassen_crossover{0};
+
+void SetStrassenCrossover(int n) { strassen_crossover = std::max(0, n); }
+
+int GetStrassenCrossover() { return strassen_crossover; }
+
+bool UseStrassen(int m, int n, int k) {
+  const int crossover = strassen_crossover;
+  return crossover > 0 && std::min(m, std::min(n, k)) >= crossover;
+}
+
+// Halvings until the smallest dimension drops below the crossover.
+static int Levels(int m, int n, int k, int crossover) {
+  int levels = 0;
+  for (int s = std::min(m, std::min(n, k)); s >= crossover; s = (s + 1) / 2)
+    levels++;
+  return levels;
+}
+
+static int RoundUp(int x, int levels) {
+  const int unit = 1 << levels;
+  return (x + unit - 1) / unit * unit;
+}
+
+// Doubles the serial schedule needs below an m x k by k x n product: X
+// holds a sum of A blocks and then P1, Y a sum of B blocks.
+static long SerialWorkspace(long m, long n, long k, int levels) {
+  if (levels == 0) return 0;
+  m /= 2, n /= 2, k /= 2;
+  return m * std::max(k, n) + k * n + SerialWorkspace(m, n, k, levels - 1);
+}
+
+// The parallel first level keeps all eight sums, P1, P2 and P4 at once,
+// and gives every product a serial workspace of its own.
+static long ParallelWorkspace(long m, long n, long k, int levels) {
+  const long half_m = m / 2, half_n = n / 2, half_k = k / 2;
+  return 4 * half_m * half_k + 4 * half_k * half_n + 3 * half_m * half_n +
+         7 * SerialWorkspace(half_m, half_n, half_k, levels - 1);
+}
+
+// A rows x cols temporary carved off the front of work.
+static MatrixView Carve(double*& work, int rows, int cols) {
+  MatrixView v(work, rows, cols, cols);
+  work += (long)rows * cols;
+  return v;
+}
+
+// dst = x + sign * y over views with unit column stride. dst may be x or y
+// itself, element for element.
+static void Combine(const MatrixView& dst, const MatrixView& x,
+                    const MatrixView& y, double sign) {
+  const SimdKernels& k = Kernels();
+  const int rows = dst.GetRows(), cols = dst.GetCols();
+  ParallelFor(0, rows, (double)rows * cols, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++) {
+      double* d = dst.GetData() + i * dst.GetRowStride();
+      const double* xi = x.GetData() + i * x.GetRowStride();
+      const double* yi = y.GetData() + i * y.GetRowStride();
+      if (d == yi && d != xi) {
+        if (sign < 0) k.scale(d, -1.0, cols);
+        k.add(d, xi, cols);
+        continue;
+      }
+      if (d != xi) std::memcpy(d, xi, cols * sizeof(double));
+      if (sign < 0)
+        k.sub(d, yi, cols);
+      else
+        k.add(d, yi, cols);
+    }
+  });
+}
+
+// c = a * b on the classical kernel.
+static void Classical(const MatrixView& a, const MatrixView& b,
+                      const MatrixView& c) {
+  const int m = c.GetRows(), n = c.GetCols();
+  for (int i = 0; i < m; i++)
+    std::memset(c.GetData() + (long)i * c.GetRowStride(), 0,
+                n * sizeof(double));
+  Gemm(m, n, a.GetCols(), 1.0, a.GetData(), a.GetRowStride(), 1,
+       b.GetData(), b.GetRowStride(), 1, c.GetData(), c.GetRowStride());
+}
+
+// c = a * b with two temporaries per level, the Winograd schedule of
+// Douglas et al.: the products land in the quadrants of c and are combined
+// there.
+static void Multiply(const MatrixView& a, const MatrixView& b,
+                     const MatrixView& c, int levels, double* work) {
+  if (levels == 0) {
+    Classical(a, b, c);
+    return;
+  }
+  const int m = a.GetRows() / 2, k = a.GetCols() / 2, n = b.GetCols() / 2;
+  const MatrixView a11 = a.Block(0, 0, m, k), a12 = a.Block(0, k, m, k);
+  const MatrixView a21 = a.Block(m, 0, m, k), a22 = a.Block(m, k, m, k);
+  const MatrixView b11 = b.Block(0, 0, k, n), b12 = b.Block(0, n, k, n);
+  const MatrixView b21 = b.Block(k, 0, k, n), b22 = b.Block(k, n, k, n);
+  const MatrixView c11 = c.Block(0, 0, m, n), c12 = c.Block(0, n, m, n);
+  const MatrixView c21 = c.Block(m, 0, m, n), c22 = c.Block(m, n, m, n);
+  const MatrixView xs(work, m, k, k), xp(work, m, n, n);
+  work += (long)m * std::max(k, n);
+  const MatrixView y = Carve(work, k, n);
+  --levels;
+  Combine(xs, a11, a21, -1);              // S3
+  Combine(y, b22, b12, -1);               // T3
+  Multiply(xs, y, c21, levels, work);     // P7
+  Combine(xs, a21, a22, 1);               // S1
+  Combine(y, b12, b11, -1);               // T1
+  Multiply(xs, y, c22, levels, work);     // P5
+  Combine(y, b22, y, -1);                 // T2
+  Combine(xs, xs, a11, -1);               // S2
+  Multiply(xs, y, c12, levels, work);     // P6
+  Combine(xs, a12, xs, -1);               // S4
+  Multiply(xs, b22, c11, levels, work);   // P3
+  Multiply(a11, b11, xp, levels, work);   // P1
+  Combine(c12, xp, c12, 1);               // U2 = P1 + P6
+  Combine(c21, c12, c21, 1);              // U3 = U2 + P7
+  Combine(c12, c12, c22, 1);              // U4 = U2 + P5
+  Combine(c22, c21, c22, 1);              // U7 = U3 + P5, C22
+  Combine(c12, c12, c11, 1);              // U5 = U4 + P3, C12
+  Combine(y, y, b21, -1);                 // T4
+  Multiply(a22, y, c11, levels, work);    // P4
+  Combine(c21, c21, c11, -1);             // U6 = U3 - P4, C21
+  Multiply(a12, b21, c11, levels, work);  // P2
+  Combine(c11, xp, c11, 1);               // U1 = P1 + P2, C11
+}
+
+// The first level with its seven products run side by side, each on the
+// serial schedule. Their own GEMMs split further across the pool.
+static void MultiplyParallel(const MatrixView& a, const MatrixView& b,
+                             const MatrixView& c, int levels, double* work) {
+  const int m = a.GetRows() / 2, k = a.GetCols() / 2, n = b.GetCols() / 2;
+  const MatrixView a11 = a.Block(0, 0, m, k), a12 = a.Block(0, k, m, k);
+  const MatrixView a21 = a.Block(m, 0, m, k), a22 = a.Block(m, k, m, k);
+  const MatrixView b11 = b.Block(0, 0, k, n), b12 = b.Block(0, n, k, n);
+  const MatrixView b21 = b.Block(k, 0, k, n), b22 = b.Block(k, n, k, n);
+  const MatrixView c11 = c.Block(0, 0, m, n), c12 = c.Block(0, n, m, n);
+  const MatrixView c21 = c.Block(m, 0, m, n), c22 = c.Block(m, n, m, n);
+  const MatrixView s1 = Carve(work, m, k), s2 = Carve(work, m, k);
+  const MatrixView s3 = Carve(work, m, k), s4 = Carve(work, m, k);
+  const MatrixView t1 = Carve(work, k, n), t2 = Carve(work, k, n);
+  const MatrixView t3 = Carve(work, k, n), t4 = Carve(work, k, n);
+  const MatrixView p1 = Carve(work, m, n), p2 = Carve(work, m, n);
+  const MatrixView p4 = Carve(work, m, n);
+  Combine(s1, a21, a22, 1);
+  Combine(s2, s1, a11, -1);
+  Combine(s3, a11, a21, -1);
+  Combine(s4, a12, s2, -1);
+  Combine(t1, b12, b11, -1);
+  Combine(t2, b22, t1, -1);
+  Combine(t3, b22, b12, -1);
+  Combine(t4, t2, b21, -1);
+  // P3, P5, P6 and P7 go straight to the quadrants they are combined in.
+  const MatrixView products[7][3] = {
+      {a11, b11, p1}, {a12, b21, p2}, {s4, b22, c11}, {a22, t4, p4},
+      {s1, t1, c22},  {s2, t2, c12},  {s3, t3, c21}};
+  const long serial = SerialWorkspace(m, n, k, levels - 1);
+  ParallelFor(0, 7, 14.0 * m * n * k, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++)
+      Multiply(products[i][0], products[i][1], products[i][2], levels - 1,
+               work + i * serial);
+  });
+  Combine(c12, p1, c12, 1);   // U2 = P1 + P6
+  Combine(c21, c12, c21, 1);  // U3 = U2 + P7
+  Combine(c12, c12, c22, 1);  // U4 = U2 + P5
+  Combine(c22, c21, c22, 1);  // U7 = U3 + P5, C22
+  Combine(c12, c12, c11, 1);  // U5 = U4 + P3, C12
+  Combine(c21, c21, p4, -1);  // U6 = U3 - P4, C21
+  Combine(c11, p1, p2, 1);    // U1 = P1 + P2, C11
+}
+
+// v, or a zero padded rows x cols copy of it in storage when v doesn't
+// fill that shape or isn't stored by rows.
+static MatrixView Padded(const MatrixView& v, int rows, int cols,
+                         Matrix& storage) {
+  if (v.GetRows() == rows && v.GetCols() == cols && v.GetColStride() == 1)
+    return v;
+  storage = Matrix(rows, cols);
+  MatrixView padded(storage);
+  padded.Block(0, 0, v.GetRows(), v.GetCols()) = v;
+  return padded;
+}
+
+void StrassenGemm(const MatrixView& a, const MatrixView& b,
+                  const MatrixView& c, double alpha, int crossover) {
+  const int m = a.GetRows(), n = b.GetCols(), k = a.GetCols();
+  if (b.GetRows() != k || c.GetRows() != m || c.GetCols() != n)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  const int levels = Levels(m, n, k, std::max(2, crossover));
+  if (levels == 0) {
+    Gemm(m, n, k, alpha, a.GetData(), a.GetRowStride(), a.GetColStride(),
+         b.GetData(), b.GetRowStride(), b.GetColStride(), c.GetData(),
+         c.GetRowStride());
+    return;
+  }
+  const int pm = RoundUp(m, levels), pn = RoundUp(n, levels);
+  const int pk = RoundUp(k, levels);
+  Matrix a_storage, b_storage;
+  const MatrixView pa = Padded(a, pm, pk, a_storage);
+  const MatrixView pb = Padded(b, pk, pn, b_storage);
+  Matrix product(pm, pn);
+  const bool parallel = ParallelThreads(7, 2.0 * pm * pn * pk) > 1;
+  const long size = parallel ? ParallelWorkspace(pm, pn, pk, levels)
+                             : SerialWorkspace(pm, pn, pk, levels);
+  std::unique_ptr<double[]> work(new double[size]);
+  if (parallel)
+    MultiplyParallel(pa, pb, product, levels, work.get());
+  else
+    Multiply(pa, pb, product, levels, work.get());
+  const SimdKernels& kernels = Kernels();
+  ParallelFor(0, m, (double)m * n, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++)
+      kernels.axpy(c.GetData() + i * c.GetRowStride(), alpha,
+                   product.GetData() + i * product.GetStride(), n);
+  });
+}
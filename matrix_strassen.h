@@ -0,0 +1,33 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_STRASSEN_H
+#define CPP1__MATRIXPLUS_0__MATRIX_STRASSEN_H
+
+#include "matrix_oop.h"
+
+// Strassen-Winograd multiplication: 7 half-size products and 15 additions
+// per level instead of 8 products, about n^2.81 flops in all. Products
+// whose every dimension is at least the crossover are split in halves
+// until one drops below it; the pieces left go to the classical GEMM.
+//
+// It is off by default. Once enabled, MulMatrix, operator* and C += A * B
+// take it automatically for products that large. Results differ from the
+// classical ones by rounding: the error bound grows like n^(log2 18) rather
+// than n, so it suits well-scaled operands.
+//
+// Zero or less disables it; the smallest crossover used is 2.
+void SetStrassenCrossover(int n);
+int GetStrassenCrossover();
+// True when an m x k by k x n product goes through StrassenGemm.
+bool UseStrassen(int m, int n, int k);
+
+// c += alpha * a * b by Strassen-Winograd with the given crossover,
+// whether or not the mode is enabled. c must have unit column stride and
+// not overlap a or b.
+//
+// Dimensions that don't halve evenly down to the leaves are zero padded
+// once, at the top. Every level's temporaries come out of one workspace
+// allocated per call, and the seven products of the first level run in
+// parallel when there are threads for them.
+void StrassenGemm(const MatrixView& a, const MatrixView& b,
+                  const MatrixView& c, double alpha, int crossover);
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_STRASSEN_H
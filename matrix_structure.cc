@@ -0,0 +1,399 @@
+#include "matrix_structure.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "matrix_decomp.h"
+#include "matrix_gemm.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+
+// Syrk multiplies tiles of a sixteenth of the matrix on a side, which skips
+// 47% of the work, and at least this large so the GEMMs run at full speed.
+static constexpr int kSyrkTile = 64;
+// Rows or columns of a banded operand taken per GEMM.
+static constexpr int kBandPanel = 128;
+// Structured products run when they do at most this fraction of the dense
+// work; below it the band's GEMMs are too thin to pay off.
+static constexpr double kBandGain = 0.75;
+// Side of the tiles IsSymmetric compares, so the column walk stays in L1.
+static constexpr int kSymmetryTile = 32;
+
+Bandwidth DetectBandwidth(const MatrixView& a) {
+  const int rows = a.GetRows(), cols = a.GetCols();
+  const int rs = a.GetRowStride(), cs = a.GetColStride();
+  const double* d = a.GetData();
+  auto at = [&](long i, long j) { return d[i * rs + j * cs]; };
+  Bandwidth band{0, 0};
+  // Row i can't raise upper past cols - 1 - i or lower past i, so each scan
+  // stops once no row left could.
+  for (int i = 0; i < rows && band.upper < cols - 1 - i; i++)
+    for (int j = cols - 1; j - i > band.upper; j--)
+      if (at(i, j) != 0) {
+        band.upper = j - i;
+        break;
+      }
+  for (int i = rows - 1; i >= 0 && band.lower < i; i--)
+    for (int j = 0; j < cols && i - j > band.lower; j++)
+      if (at(i, j) != 0) {
+        band.lower = i - j;
+        break;
+      }
+  return band;
+}
+
+bool IsSymmetric(const MatrixView& a) {
+  const int n = a.GetRows();
+  if (a.GetCols() != n) return false;
+  const int rs = a.GetRowStride(), cs = a.GetColStride();
+  const double* d = a.GetData();
+  auto at = [&](long i, long j) { return d[i * rs + j * cs]; };
+  for (int i0 = 0; i0 < n; i0 += kSymmetryTile)
+    for (int j0 = 0; j0 <= i0; j0 += kSymmetryTile)
+      for (int i = i0; i < std::min(n, i0 + kSymmetryTile); i++)
+        for (int j = j0; j < std::min(i, j0 + kSymmetryTile); j++)
+          if (at(i, j) != at(j, i)) return false;
+  return true;
+}
+
+void Syrk(const MatrixView& a, const MatrixView& c, double alpha) {
+  const int m = a.GetRows(), k = a.GetCols();
+  if (c.GetRows() != m || c.GetCols() != m)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+  const int rs = a.GetRowStride(), cs = a.GetColStride();
+  const int ldc = c.GetRowStride();
+  const int side = std::min(m, std::max(kSyrkTile, m / 16));
+  Matrix tile(side, side);
+  const MatrixView product(tile);
+  for (int i0 = 0; i0 < m; i0 += side) {
+    const int rows = std::min(side, m - i0);
+    const double* ai = a.GetData() + (long)i0 * rs;
+    // Diagonal tiles whole; their upper halves are the only work repeated.
+    Gemm(rows, rows, k, alpha, ai, rs, cs, ai, cs, rs,
+         c.GetData() + (long)i0 * ldc + i0, ldc);
+    // Every tile left of the diagonal is full, side on a side.
+    for (int j0 = 0; j0 < i0; j0 += side) {
+      const double* aj = a.GetData() + (long)j0 * rs;
+      for (int i = 0; i < rows; i++)
+        std::memset(tile.GetData() + (long)i * tile.GetStride(), 0,
+                    side * sizeof(double));
+      Gemm(rows, side, k, alpha, ai, rs, cs, aj, cs, rs, tile.GetData(),
+           tile.GetStride());
+      const MatrixView p = product.Block(0, 0, rows, side);
+      c.Block(i0, j0, rows, side) += p;
+      c.Block(j0, i0, side, rows) += p.Transposed();
+    }
+  }
+}
+
+// Elements of a rows x cols matrix inside the band.
+static double BandArea(int rows, int cols, Bandwidth band) {
+  double area = 0;
+  for (int i = 0; i < rows; i++)
+    area += std::max(0, std::min(cols - 1, i + band.upper) -
+                            std::max(0, i - band.lower) + 1);
+  return area;
+}
+
+// c += alpha * a * b for a diagonal a: row i of b scaled into row i of c.
+static void LeftDiagonal(const MatrixView& a, const MatrixView& b,
+                         const MatrixView& c, double alpha) {
+  const int n = b.GetCols();
+  const SimdKernels& k = Kernels();
+  const long diagonal = std::min(a.GetRows(), a.GetCols());
+  ParallelFor(0, diagonal, 2.0 * diagonal * n, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++) {
+      double* ci = c.GetData() + i * c.GetRowStride();
+      const double* bi = b.GetData() + i * b.GetRowStride();
+      const double s = alpha * a(i, i);
+      if (b.GetColStride() == 1)
+        k.axpy(ci, s, bi, n);
+      else
+        for (int j = 0; j < n; j++) ci[j] += s * bi[(long)j * b.GetColStride()];
+    }
+  });
+}
+
+// c += alpha * a * b for a diagonal b: column j of a scaled into column j
+// of c.
+static void RightDiagonal(const MatrixView& a, const MatrixView& b,
+                          const MatrixView& c, double alpha) {
+  const int m = a.GetRows();
+  const int diagonal = std::min(b.GetRows(), b.GetCols());
+  std::vector<double> scale(diagonal);
+  for (int j = 0; j < diagonal; j++) scale[j] = alpha * b(j, j);
+  ParallelFor(0, m, 2.0 * m * diagonal, [&](long lo, long hi) {
+    for (long i = lo; i < hi; i++) {
+      double* ci = c.GetData() + i * c.GetRowStride();
+      const double* ai = a.GetData() + i * a.GetRowStride();
+      for (int j = 0; j < diagonal; j++)
+        ci[j] += scale[j] * ai[(long)j * a.GetColStride()];
+    }
+  });
+}
+
+// c += alpha * a * b for a banded a, kBandPanel rows of it at a time
+// against the rows of b its band reaches.
+static void LeftBand(const MatrixView& a, const MatrixView& b,
+                     const MatrixView& c, double alpha, Bandwidth band) {
+  const int m = a.GetRows(), k = a.GetCols(), n = b.GetCols();
+  const int a_rs = a.GetRowStride(), a_cs = a.GetColStride();
+  const int b_rs = b.GetRowStride(), b_cs = b.GetColStride();
+  for (int i0 = 0; i0 < m; i0 += kBandPanel) {
+    const int rows = std::min(kBandPanel, m - i0);
+    const int first = std::max(0, i0 - band.lower);
+    const int last = std::min(k, i0 + rows + band.upper);
+    if (first >= last) continue;
+    Gemm(rows, n, last - first, alpha,
+         a.GetData() + (long)i0 * a_rs + (long)first * a_cs, a_rs, a_cs,
+         b.GetData() + (long)first * b_rs, b_rs, b_cs,
+         c.GetData() + (long)i0 * c.GetRowStride(), c.GetRowStride());
+  }
+}
+
+// c += alpha * a * b for a banded b, kBandPanel columns of it at a time
+// against the columns of a its band reaches.
+static void RightBand(const MatrixView& a, const MatrixView& b,
+                      const MatrixView& c, double alpha, Bandwidth band) {
+  const int m = a.GetRows(), k = a.GetCols(), n = b.GetCols();
+  const int a_rs = a.GetRowStride(), a_cs = a.GetColStride();
+  const int b_rs = b.GetRowStride(), b_cs = b.GetColStride();
+  for (int j0 = 0; j0 < n; j0 += kBandPanel) {
+    const int cols = std::min(kBandPanel, n - j0);
+    const int first = std::max(0, j0 - band.upper);
+    const int last = std::min(k, j0 + cols + band.lower);
+    if (first >= last) continue;
+    Gemm(m, cols, last - first, alpha, a.GetData() + (long)first * a_cs,
+         a_rs, a_cs,
+         b.GetData() + (long)first * b_rs + (long)j0 * b_cs, b_rs, b_cs,
+         c.GetData() + j0, c.GetRowStride());
+  }
+}
+
+bool StructuredProduct(const MatrixView& a, const MatrixView& b,
+                       const MatrixView& c, double alpha) {
+  const int m = a.GetRows(), k = a.GetCols(), n = b.GetCols();
+  // b is a^T only when it also has as many columns as a has rows; two
+  // blocks of one matrix share the start and the strides too.
+  if (m >= 2 * kSyrkTile && n == m && a.GetData() == b.GetData() &&
+      a.GetRowStride() == b.GetColStride() &&
+      a.GetColStride() == b.GetRowStride()) {
+    Syrk(a, c, alpha);
+    return true;
+  }
+  const Bandwidth left = DetectBandwidth(a);
+  if (left.IsDiagonal()) {
+    LeftDiagonal(a, b, c, alpha);
+    return true;
+  }
+  if (BandArea(m, k, left) <= kBandGain * m * k) {
+    LeftBand(a, b, c, alpha, left);
+    return true;
+  }
+  const Bandwidth right = DetectBandwidth(b);
+  if (right.IsDiagonal()) {
+    RightDiagonal(a, b, c, alpha);
+    return true;
+  }
+  if (BandArea(k, n, right) <= kBandGain * k * n) {
+    RightBand(a, b, c, alpha, right);
+    return true;
+  }
+  return false;
+}
+
+// Packed rows of the lower triangle start at i * (i + 1) / 2.
+static long LowerRow(int i) { return (long)i * (i + 1) / 2; }
+
+// y += a * x, through the kernel unless there are only a few elements.
+static void Axpy(double* y, double a, const double* x, long n,
+                 const SimdKernels& k) {
+  if (n >= 8) {
+    k.axpy(y, a, x, n);
+    return;
+  }
+  for (long i = 0; i < n; i++) y[i] += a * x[i];
+}
+
+// Cholesky factor of the symmetric matrix packed in a, packed the same
+// way. False when a pivot comes out nonpositive.
+static bool PackedCholesky(int n, const std::vector<double>& a,
+                           std::vector<double>& l) {
+  l.resize(a.size());
+  for (int i = 0; i < n; i++) {
+    const double* li = l.data() + LowerRow(i);
+    for (int j = 0; j <= i; j++) {
+      const double* lj = l.data() + LowerRow(j);
+      double s = a[LowerRow(i) + j];
+      for (int x = 0; x < j; x++) s -= li[x] * lj[x];
+      if (j < i) {
+        l[LowerRow(i) + j] = s / lj[j];
+      } else {
+        if (!(s > 0)) return false;
+        l[LowerRow(i) + i] = sqrt(s);
+      }
+    }
+  }
+  return true;
+}
+
+// v, or a copy of it in storage when its rows aren't contiguous.
+static MatrixView RowMajor(const MatrixView& v, Matrix& storage) {
+  if (v.GetColStride() == 1) return v;
+  storage = Matrix(v);
+  return storage;
+}
+
+PackedMatrix::PackedMatrix() {}
+
+PackedMatrix::PackedMatrix(int n, Packing packing)
+    : n_(n), packing_(packing) {
+  if (n <= 0) throw std::invalid_argument("Matrix dimensions aren't positive!");
+  values_.assign((long)n * (n + 1) / 2, 0.0);
+}
+
+PackedMatrix::PackedMatrix(const MatrixArg& dense, Packing packing)
+    : PackedMatrix(dense.GetRows(), packing) {
+  if (dense.GetCols() != n_)
+    throw std::invalid_argument("Only square matrices can be packed!");
+  const bool upper = packing_ == Packing::kUpper;
+  for (int i = 0; i < n_; i++)
+    for (int j = upper ? i : 0; j < (upper ? n_ : i + 1); j++)
+      values_[Index(i, j)] = dense(i, j);
+}
+
+int PackedMatrix::GetSize() const { return n_; }
+
+Packing PackedMatrix::GetPacking() const { return packing_; }
+
+const std::vector<double>& PackedMatrix::GetValues() const { return values_; }
+
+long PackedMatrix::Index(int row, int col) const {
+  if (packing_ == Packing::kUpper)
+    return (long)row * n_ - (long)row * (row - 1) / 2 + col - row;
+  return LowerRow(row) + col;
+}
+
+double PackedMatrix::operator()(int row, int col) const {
+  if (row >= n_ || col >= n_ || col < 0 || row < 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  if (packing_ == Packing::kSymmetric && col > row) std::swap(row, col);
+  if (packing_ == Packing::kUpper ? col < row : col > row) return 0;
+  return values_[Index(row, col)];
+}
+
+double& PackedMatrix::At(int row, int col) {
+  if (row >= n_ || col >= n_ || col < 0 || row < 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  if (packing_ == Packing::kSymmetric && col > row) std::swap(row, col);
+  if (packing_ == Packing::kUpper ? col < row : col > row)
+    throw std::out_of_range("Incorrect input, element isn't stored");
+  return values_[Index(row, col)];
+}
+
+Matrix PackedMatrix::ToDense() const {
+  Matrix result(n_, n_);
+  for (int i = 0; i < n_; i++)
+    for (int j = 0; j < n_; j++) result(i, j) = (*this)(i, j);
+  return result;
+}
+
+double PackedMatrix::Determinant() const {
+  double result = 1;
+  if (packing_ != Packing::kSymmetric) {
+    for (int i = 0; i < n_; i++) result *= values_[Index(i, i)];
+    return result;
+  }
+  std::vector<double> l;
+  if (!PackedCholesky(n_, values_, l)) return ToDense().Determinant();
+  for (int i = 0; i < n_; i++) result *= l[LowerRow(i) + i];
+  return result * result;
+}
+
+// Columns of B go to the threads, so the symmetric case can update the
+// rows of both triangles without contention.
+Matrix PackedMatrix::MulMatrix(const MatrixArg& b) const {
+  if (b.GetRows() != n_)
+    throw std::invalid_argument(
+        "First matrix columns number isn't equal to second matrix rows number, "
+        "mathematically incorrect!");
+  Matrix storage;
+  const MatrixView x = RowMajor(b, storage);
+  const int m = x.GetCols();
+  Matrix result(n_, m);
+  const SimdKernels& k = Kernels();
+  auto xr = [&](long i) { return x.GetData() + i * x.GetRowStride(); };
+  auto cr = [&](long i) { return result.GetData() + i * result.GetStride(); };
+  ParallelFor(0, m, (double)n_ * n_ * m, [&](long lo, long hi) {
+    const long w = hi - lo;
+    for (int i = 0; i < n_; i++) {
+      if (packing_ == Packing::kUpper) {
+        const double* ai = values_.data() + Index(i, i);
+        for (int j = i; j < n_; j++)
+          Axpy(cr(i) + lo, ai[j - i], xr(j) + lo, w, k);
+        continue;
+      }
+      const double* ai = values_.data() + LowerRow(i);
+      for (int j = 0; j < i; j++) {
+        Axpy(cr(i) + lo, ai[j], xr(j) + lo, w, k);
+        if (packing_ == Packing::kSymmetric)
+          Axpy(cr(j) + lo, ai[j], xr(i) + lo, w, k);
+      }
+      Axpy(cr(i) + lo, ai[i], xr(i) + lo, w, k);
+    }
+  });
+  return result;
+}
+
+Matrix PackedMatrix::Solve(const MatrixArg& b) const {
+  if (b.GetRows() != n_)
+    throw std::invalid_argument(
+        "Right-hand side rows number isn't equal to matrix size!");
+  std::vector<double> cholesky;
+  const std::vector<double>* lower = &values_;
+  if (packing_ == Packing::kSymmetric) {
+    if (!PackedCholesky(n_, values_, cholesky)) return ::Solve(ToDense(), b);
+    lower = &cholesky;
+  } else {
+    for (int i = 0; i < n_; i++)
+      if (values_[Index(i, i)] == 0)
+        throw std::invalid_argument("Matrix is singular!");
+  }
+  Matrix x(b);
+  const int m = x.GetCols();
+  const SimdKernels& k = Kernels();
+  auto xr = [&](long i) { return x.GetData() + i * x.GetStride(); };
+  ParallelFor(0, m, (double)n_ * n_ * m, [&](long lo, long hi) {
+    const long w = hi - lo;
+    if (packing_ == Packing::kUpper) {
+      for (int i = n_ - 1; i >= 0; i--) {
+        const double* ui = values_.data() + Index(i, i);
+        for (int j = i + 1; j < n_; j++)
+          Axpy(xr(i) + lo, -ui[j - i], xr(j) + lo, w, k);
+        for (long c = lo; c < hi; c++) xr(i)[c] /= ui[0];
+      }
+      return;
+    }
+    const double* l = lower->data();
+    for (int i = 0; i < n_; i++) {
+      for (int j = 0; j < i; j++)
+        Axpy(xr(i) + lo, -l[LowerRow(i) + j], xr(j) + lo, w, k);
+      for (long c = lo; c < hi; c++) xr(i)[c] /= l[LowerRow(i) + i];
+    }
+    if (packing_ == Packing::kLower) return;
+    // L^T a column at a time, which is a row of the packed L.
+    for (int j = n_ - 1; j >= 0; j--) {
+      for (long c = lo; c < hi; c++) xr(j)[c] /= l[LowerRow(j) + j];
+      for (int i = 0; i < j; i++)
+        Axpy(xr(i) + lo, -l[LowerRow(j) + i], xr(j) + lo, w, k);
+    }
+  });
+  return x;
+}
+
+Matrix operator*(const PackedMatrix& a, const Matrix& b) {
+  return a.MulMatrix(b);
+}
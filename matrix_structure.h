@@ -0,0 +1,90 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_STRUCTURE_H
+#define CPP1__MATRIXPLUS_0__MATRIX_STRUCTURE_H
+
+#include <vector>
+
+#include "matrix_oop.h"
+
+// Nonzero pattern of a matrix: element (i, j) is exactly zero unless
+// -lower <= j - i <= upper. Diagonal, triangular and banded matrices are
+// the cases where one or both bandwidths are small.
+struct Bandwidth {
+  int lower, upper;
+
+  bool IsDiagonal() const { return lower == 0 && upper == 0; }
+  bool IsTriangular() const { return lower == 0 || upper == 0; }
+  // Narrow enough for the band algorithms to beat the dense ones on an
+  // n x n matrix by a wide margin.
+  bool IsNarrow(int n) const { return 4 * (lower + upper) < n; }
+};
+
+// Structure is found by looking, not declared: Determinant, InverseMatrix
+// and the products check their operands and take these fast paths on their
+// own. The scans stop as soon as the answer is known, which for a general
+// dense matrix is after a handful of elements; a matrix that does have the
+// structure is read once, O(n^2) next to the O(n^3) it saves.
+Bandwidth DetectBandwidth(const MatrixView& a);
+// Square and equal to its transpose, element for element.
+bool IsSymmetric(const MatrixView& a);
+
+// c += alpha * a * a^T, SYRK style: the tiles on and below the diagonal are
+// multiplied and mirrored, about half the work of the GEMM. c must be
+// square with unit column stride and not overlap a.
+void Syrk(const MatrixView& a, const MatrixView& c, double alpha);
+
+// c += alpha * a * b when a structure of the operands makes it cheaper than
+// the dense GEMM: b being a^T (SYRK), a diagonal operand (a scaling) or a
+// triangular or banded one (GEMMs over the band only). Returns false,
+// leaving c alone, when there is nothing to gain. c must have unit column
+// stride and not overlap a or b.
+bool StructuredProduct(const MatrixView& a, const MatrixView& b,
+                       const MatrixView& c, double alpha);
+
+// Which triangle a PackedMatrix stores: the lower one of a symmetric matrix,
+// which the upper one mirrors, or the nonzero one of a triangular matrix.
+enum class Packing { kSymmetric, kLower, kUpper };
+
+// Square symmetric or triangular matrix with one triangle stored by rows in
+// n * (n + 1) / 2 doubles, half the memory of a Matrix. Products read every
+// stored element once, SYMM and TRMM style, and Solve substitutes in the
+// packed storage directly, for a symmetric matrix after a packed Cholesky
+// factorization.
+class PackedMatrix {
+ public:
+  PackedMatrix();
+  // n x n zeros.
+  PackedMatrix(int n, Packing packing);
+  // Packs the stored triangle of dense, the lower one for kSymmetric; the
+  // other triangle isn't read.
+  PackedMatrix(const MatrixArg& dense, Packing packing);
+
+  int GetSize() const;
+  Packing GetPacking() const;
+  const std::vector<double>& GetValues() const;
+  // Element of the full matrix: mirrored for kSymmetric, zero outside the
+  // triangle of a triangular matrix.
+  double operator()(int row, int col) const;
+  // The stored element for (row, col), either order for kSymmetric. Throws
+  // std::out_of_range outside the triangle of a triangular matrix.
+  double& At(int row, int col);
+
+  Matrix ToDense() const;
+  double Determinant() const;
+  // A * B for a dense B.
+  Matrix MulMatrix(const MatrixArg& b) const;
+  // Solves A * X = B for every column of B. A symmetric matrix that isn't
+  // positive definite is solved dense, through LU.
+  Matrix Solve(const MatrixArg& b) const;
+
+ private:
+  // Position of stored element (row, col) in values_.
+  long Index(int row, int col) const;
+
+  int n_{};
+  Packing packing_{Packing::kSymmetric};
+  std::vector<double> values_;
+};
+
+Matrix operator*(const PackedMatrix& a, const Matrix& b);
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_STRUCTURE_H
@@ -0,0 +1,151 @@
+#include "matrix_view.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "matrix_parallel.h"
+
+// Side of the square tiles a strided copy moves at a time, as in
+// Matrix::Transpose().
+static constexpr int kCopyTile = 32;
+
+MatrixView::MatrixView(double* data, int rows, int cols, int row_stride,
+                       int col_stride)
+    : data_(data),
+      rows_(rows),
+      cols_(cols),
+      row_stride_(row_stride),
+      col_stride_(col_stride) {
+  if (data && (rows <= 0 || cols <= 0))
+    throw std::invalid_argument("Matrix dimensions aren't positive!");
+}
+
+MatrixView::MatrixView(const Matrix& m)
+    : data_(m.GetData()),
+      rows_(m.GetRows()),
+      cols_(m.GetCols()),
+      row_stride_(m.GetStride()),
+      col_stride_(1) {}
+
+double& MatrixView::operator()(int row, int col) const {
+  if (row >= rows_ || col >= cols_ || col < 0 || row < 0)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  return *Ptr(row, col);
+}
+
+MatrixView MatrixView::Block(int row, int col, int rows, int cols) const {
+  if (row < 0 || col < 0 || rows <= 0 || cols <= 0 || row + rows > rows_ ||
+      col + cols > cols_)
+    throw std::out_of_range("Incorrect input, index is out of range");
+  return MatrixView(Ptr(row, col), rows, cols, row_stride_, col_stride_);
+}
+
+MatrixView MatrixView::Row(int row) const { return Block(row, 0, 1, cols_); }
+
+MatrixView MatrixView::Col(int col) const { return Block(0, col, rows_, 1); }
+
+MatrixView MatrixView::Diagonal() const {
+  if (!data_) throw std::out_of_range("Incorrect input, index is out of range");
+  return MatrixView(data_, std::min(rows_, cols_), 1,
+                    row_stride_ + col_stride_);
+}
+
+MatrixView MatrixView::Transposed() const {
+  return MatrixView(data_, cols_, rows_, col_stride_, row_stride_);
+}
+
+Overlap MatrixView::OverlapWith(const MatrixView& other) const {
+  if (!data_ || !other.data_) return Overlap::kNone;
+  const double* last = Ptr(rows_ - 1, cols_ - 1);
+  const double* other_last = other.Ptr(other.rows_ - 1, other.cols_ - 1);
+  if (last < other.data_ || other_last < data_) return Overlap::kNone;
+  // A stride along a dimension of one element is never used.
+  if (data_ == other.data_ && rows_ == other.rows_ && cols_ == other.cols_ &&
+      (rows_ == 1 || row_stride_ == other.row_stride_) &&
+      (cols_ == 1 || col_stride_ == other.col_stride_))
+    return Overlap::kSame;
+  return Overlap::kPartial;
+}
+
+void MatrixView::CheckShape(int rows, int cols) const {
+  if (rows != rows_ || cols != cols_)
+    throw std::invalid_argument("Matrix dimensions aren't equal!");
+}
+
+// Rows are copied whole when both sides have unit column stride, and in
+// tiles otherwise, so that reading a transposed view walks kCopyTile lines
+// at a time instead of a column of the whole matrix.
+MatrixView& MatrixView::operator=(const MatrixView& other) {
+  if (this == &other) return *this;
+  CheckShape(other.rows_, other.cols_);
+  const Overlap overlap = other.OverlapWith(*this);
+  if (overlap == Overlap::kSame) return *this;
+  if (overlap == Overlap::kPartial) {
+    Matrix copy(other);
+    return *this = MatrixView(copy);
+  }
+  if (col_stride_ == 1 && other.col_stride_ == 1) {
+    ParallelFor(0, rows_, (double)rows_ * cols_, [&](long lo, long hi) {
+      for (long i = lo; i < hi; i++)
+        std::memcpy(Ptr(i, 0), other.Ptr(i, 0), cols_ * sizeof(double));
+    });
+    return *this;
+  }
+  const int tiles = (rows_ + kCopyTile - 1) / kCopyTile;
+  ParallelFor(0, tiles, (double)rows_ * cols_, [&](long lo, long hi) {
+    for (long t = lo; t < hi; t++) {
+      const int i0 = t * kCopyTile, i1 = std::min(rows_, i0 + kCopyTile);
+      for (int j0 = 0; j0 < cols_; j0 += kCopyTile) {
+        const int j1 = std::min(cols_, j0 + kCopyTile);
+        for (int i = i0; i < i1; i++)
+          for (int j = j0; j < j1; j++) *Ptr(i, j) = *other.Ptr(i, j);
+      }
+    }
+  });
+  return *this;
+}
+
+MatrixView& MatrixView::operator=(const MatrixProduct& p) {
+  CheckShape(p.GetRows(), p.GetCols());
+  if (p.Reads(*this) != Overlap::kNone) {
+    Matrix value(p);
+    return *this = MatrixView(value);
+  }
+  for (int i = 0; i < rows_; i++)
+    for (int j = 0; j < cols_; j++) *Ptr(i, j) = 0;
+  p.AddTo(*this, 1.0);
+  return *this;
+}
+
+MatrixView& MatrixView::operator+=(const MatrixView& other) {
+  return *this = *this + other;
+}
+
+MatrixView& MatrixView::operator-=(const MatrixView& other) {
+  return *this = *this - other;
+}
+
+MatrixView& MatrixView::operator+=(const MatrixProduct& p) {
+  CheckShape(p.GetRows(), p.GetCols());
+  if (p.Reads(*this) != Overlap::kNone) {
+    Matrix value(p);
+    return *this += MatrixView(value);
+  }
+  p.AddTo(*this, 1.0);
+  return *this;
+}
+
+MatrixView& MatrixView::operator-=(const MatrixProduct& p) {
+  CheckShape(p.GetRows(), p.GetCols());
+  if (p.Reads(*this) != Overlap::kNone) {
+    Matrix value(p);
+    return *this -= MatrixView(value);
+  }
+  p.AddTo(*this, -1.0);
+  return *this;
+}
+
+MatrixView& MatrixView::operator*=(const double num) {
+  return *this = *this * num;
+}
@@ -0,0 +1,81 @@
+#ifndef CPP1__MATRIXPLUS_0__MATRIX_VIEW_H
+#define CPP1__MATRIXPLUS_0__MATRIX_VIEW_H
+
+template <typename T>
+class BasicMatrix;
+using Matrix = BasicMatrix<double>;
+class MatrixProduct;
+template <typename E>
+class MatrixExpr;
+
+// How the elements two views refer to relate: kSame when they are the same
+// elements in the same positions, kPartial when their storage overlaps in
+// any other way. Footprints are compared as address ranges, so views of
+// disjoint columns of one matrix conservatively count as kPartial.
+enum class Overlap { kNone, kSame, kPartial };
+
+// Non-owning window onto elements of a Matrix: element (i, j) lives at
+// GetData()[i * GetRowStride() + j * GetColStride()]. Blocks, rows,
+// columns, the diagonal and the transpose are all views of this form, so
+// they are made in constant time and never copy. A view is valid while
+// the matrix it came from keeps its storage; reshaping or destroying the
+// matrix invalidates it.
+//
+// Views are accepted wherever a Matrix is read: in expressions, in
+// products, which pass their strides straight to GEMM, and by the
+// decompositions. Assigning to a view writes the parent's elements and
+// requires equal shapes. Operands that overlap the destination other than
+// element for element are evaluated into a temporary first.
+class MatrixView {
+ public:
+  MatrixView(double* data, int rows, int cols, int row_stride,
+             int col_stride = 1);
+  // All of m.
+  MatrixView(const Matrix& m);
+  MatrixView(const MatrixView& other) = default;
+
+  int GetRows() const { return rows_; }
+  int GetCols() const { return cols_; }
+  double* GetData() const { return data_; }
+  int GetRowStride() const { return row_stride_; }
+  int GetColStride() const { return col_stride_; }
+  double& operator()(int row, int col) const;
+
+  MatrixView Block(int row, int col, int rows, int cols) const;
+  MatrixView Row(int row) const;
+  MatrixView Col(int col) const;
+  // The main diagonal, as a column.
+  MatrixView Diagonal() const;
+  MatrixView Transposed() const;
+
+  Overlap OverlapWith(const MatrixView& other) const;
+
+  // Element-wise copy into the viewed elements, not a rebinding.
+  MatrixView& operator=(const MatrixView& other);
+  template <typename E>
+  MatrixView& operator=(const MatrixExpr<E>& e);
+  MatrixView& operator=(const MatrixProduct& p);
+  MatrixView& operator+=(const MatrixView& other);
+  MatrixView& operator-=(const MatrixView& other);
+  template <typename E>
+  MatrixView& operator+=(const MatrixExpr<E>& e);
+  template <typename E>
+  MatrixView& operator-=(const MatrixExpr<E>& e);
+  // GEMM-accumulate into the viewed elements.
+  MatrixView& operator+=(const MatrixProduct& p);
+  MatrixView& operator-=(const MatrixProduct& p);
+  MatrixView& operator*=(const double num);
+
+ private:
+  double* Ptr(int row, int col) const {
+    return data_ + (long)row * row_stride_ + (long)col * col_stride_;
+  }
+  void CheckShape(int rows, int cols) const;
+
+  double* data_;
+  int rows_, cols_, row_stride_, col_stride_;
+};
+
+#include "matrix_oop.h"
+
+#endif  // CPP1__MATRIXPLUS_0__MATRIX_VIEW_H
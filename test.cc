@@ -1,6 +1,58 @@
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#include "matrix_alloc.h"
+#include "matrix_async.h"
+#include "matrix_batch.h"
+#include "matrix_decomp.h"
+#include "matrix_fixed.h"
+#include "matrix_generic.h"
+#include "matrix_io.h"
+#include "matrix_numa.h"
 #include "matrix_oop.h"
+#include "matrix_parallel.h"
+#include "matrix_simd.h"
+#include "matrix_sparse.h"
+#include "matrix_stats.h"
+#include "matrix_strassen.h"
+#include "matrix_structure.h"
+#include "matrix_view.h"
+
+// Every heap allocation made by the test binary, so tests can assert that a
+// loop doesn't allocate.
+static std::atomic<long> heap_allocations{0};
+
+void* operator new(std::size_t bytes) {
+  heap_allocations++;
+  if (void* p = std::malloc(bytes ? bytes : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t bytes, std::align_val_t align) {
+  heap_allocations++;
+  std::size_t a = static_cast<std::size_t>(align);
+  if (void* p = std::aligned_alloc(a, (bytes + a - 1) / a * a)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
 
 TEST(default_constructor_test, test1) {
   Matrix arr;
@@ -404,6 +456,1674 @@ TEST(Setters, test1) {
   ASSERT_DOUBLE_EQ(m2.GetCols(), 4);
 }
 
+TEST(Storage, test1) {
+  Matrix m1(3, 20);
+  ASSERT_GE(m1.GetStride(), m1.GetCols());
+  ASSERT_EQ(reinterpret_cast<std::uintptr_t>(m1.GetData()) % 64, 0u);
+  for (int i = 0; i < m1.GetRows(); i++)
+    for (int j = 0; j < m1.GetCols(); j++) m1(i, j) = i * 100 + j;
+  for (int i = 0; i < m1.GetRows(); i++)
+    for (int j = 0; j < m1.GetCols(); j++)
+      ASSERT_DOUBLE_EQ(m1.GetData()[i * m1.GetStride() + j], i * 100 + j);
+}
+
+TEST(Storage, test2) {
+  std::initializer_list<double> data = {1, 2, 3, 4, 5, 6};
+  Matrix m1(2, 3, data);
+  m1.SetCols(10);
+  m1.SetRows(3);
+  ASSERT_DOUBLE_EQ(m1(1, 2), 6);
+  ASSERT_DOUBLE_EQ(m1(1, 9), 0);
+  ASSERT_DOUBLE_EQ(m1(2, 0), 0);
+  m1.SetCols(2);
+  ASSERT_DOUBLE_EQ(m1(1, 1), 5);
+  Matrix m2(m1);
+  ASSERT_TRUE(m2 == m1);
+}
+
+static Matrix SampleMatrix(int rows, int cols, int seed) {
+  Matrix m(rows, cols);
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      m(i, j) = ((i * 31 + j * 17 + seed * 7) % 23) / 7.0 - 1.5;
+  return m;
+}
+
+static Matrix NaiveProduct(const Matrix& a, const Matrix& b) {
+  Matrix result(a.GetRows(), b.GetCols());
+  for (int i = 0; i < a.GetRows(); i++)
+    for (int j = 0; j < b.GetCols(); j++)
+      for (int k = 0; k < a.GetCols(); k++) result(i, j) += a(i, k) * b(k, j);
+  return result;
+}
+
+TEST(BlockedMulMatrix, test1) {
+  Matrix m1 = SampleMatrix(131, 300, 1), m2 = SampleMatrix(300, 77, 2);
+  Matrix expected = NaiveProduct(m1, m2);
+  m1.MulMatrix(m2);
+  ASSERT_EQ(m1.GetRows(), 131);
+  ASSERT_EQ(m1.GetCols(), 77);
+  ASSERT_TRUE(m1 == expected);
+}
+
+TEST(BlockedMulMatrix, test2) {
+  Matrix m1 = SampleMatrix(203, 517, 3), m2 = SampleMatrix(517, 2100, 4);
+  Matrix m3 = m1 * m2;
+  Matrix expected = NaiveProduct(m1, m2);
+  ASSERT_TRUE(m3 == expected);
+}
+
+// Runs the kernels on every instruction set this CPU supports and checks
+// them against the scalar reference.
+TEST(SimdKernels, test1) {
+  SimdIsa saved = GetSimdIsa();
+  Matrix a = SampleMatrix(37, 45, 5), b = SampleMatrix(37, 45, 6);
+  Matrix f = SampleMatrix(45, 150, 7), g = SampleMatrix(150, 61, 8);
+  SetSimdIsa(SimdIsa::kScalar);
+  Matrix sum = a + b, diff = a - b, scaled = a * 1.75, prod = f * g;
+  for (SimdIsa isa : {SimdIsa::kSse2, SimdIsa::kAvx2, SimdIsa::kAvx512}) {
+    if (!SimdIsaSupported(isa)) continue;
+    SetSimdIsa(isa);
+    ASSERT_EQ(GetSimdIsa(), isa);
+    Matrix s = a + b, d = a - b, m = a * 1.75, p = f * g;
+    for (int i = 0; i < a.GetRows(); i++)
+      for (int j = 0; j < a.GetCols(); j++) {
+        ASSERT_EQ(s(i, j), sum(i, j));
+        ASSERT_EQ(d(i, j), diff(i, j));
+        ASSERT_EQ(m(i, j), scaled(i, j));
+      }
+    ASSERT_TRUE(p == prod);
+    ASSERT_TRUE(s == sum);
+    s(36, 44) += 1e-3;
+    ASSERT_FALSE(s == sum);
+  }
+  SetSimdIsa(saved);
+}
+
+TEST(Determinant, test2) {
+  std::initializer_list<double> data1 = {2, -3, 1, 2, 0, -1, 1, 4, 5};
+  Matrix m1(3, 3, data1);
+  ASSERT_NEAR(m1.Determinant(), 49, EPS);
+}
+
+TEST(Determinant, test3) {
+  Matrix m1(150, 150);
+  double expected = -1;
+  for (int i = 0; i < 150; i++) {
+    for (int j = i; j < 150; j++) m1(i, j) = (i + j) % 5 - 2;
+    m1(i, i) = 1 + (i % 3) * 0.5;
+    expected *= m1(i, i);
+  }
+  for (int j = 0; j < 150; j++) std::swap(m1(3, j), m1(120, j));
+  ASSERT_NEAR(m1.Determinant() / expected, 1, 1e-9);
+}
+
+TEST(InverseMatrix, test2) {
+  Matrix m1 = SampleMatrix(150, 150, 9);
+  for (int i = 0; i < 150; i++) m1(i, i) += 10;
+  Matrix product = m1 * m1.InverseMatrix();
+  Matrix identity(150, 150);
+  for (int i = 0; i < 150; i++) identity(i, i) = 1;
+  ASSERT_TRUE(product == identity);
+}
+
+TEST(InverseMatrix, test3) {
+  std::initializer_list<double> data1 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  Matrix m1(3, 3, data1);
+  EXPECT_THROW(m1.InverseMatrix(), std::invalid_argument);
+  Matrix m2(2, 3);
+  EXPECT_THROW(m2.InverseMatrix(), std::invalid_argument);
+}
+
+TEST(CalcComplements, test2) {
+  std::initializer_list<double> data1 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::initializer_list<double> data = {-3, 6, -3, 6, -12, 6, -3, 6, -3};
+  Matrix m1(3, 3, data1), m2(3, 3, data);
+  ASSERT_TRUE(m1.CalcComplements() == m2);
+}
+
+TEST(CalcComplements, test3) {
+  std::initializer_list<double> data1 = {0, 1, 2, 0, 3, 4, 0, 5, 6};
+  std::initializer_list<double> data = {-2, 0, 0, 4, 0, 0, -2, 0, 0};
+  Matrix m1(3, 3, data1), m2(3, 3, data);
+  ASSERT_TRUE(m1.CalcComplements() == m2);
+}
+
+TEST(CalcComplements, test4) {
+  Matrix m1 = SampleMatrix(40, 40, 10);
+  for (int i = 0; i < 40; i++) m1(i, i) += 5;
+  Matrix expected = m1.InverseMatrix().Transpose() * m1.Determinant();
+  Matrix complements = m1.CalcComplements();
+  for (int i = 0; i < 40; i++)
+    for (int j = 0; j < 40; j++)
+      ASSERT_NEAR(complements(i, j) / expected(i, j), 1, 1e-9);
+}
+
+// Zero pivots before the last one: complements from the rank, checked
+// against cofactors of the minors.
+TEST(CalcComplements, test5) {
+  const int n = 150;
+  Matrix zero(n, n);
+  ASSERT_TRUE(zero.CalcComplements() == zero);
+  // Rank n - 2: every minor is singular.
+  Matrix low = SampleMatrix(n, n, 11);
+  for (int i = 0; i < n; i++) low(i, 0) = 0, low(i, 1) = 2 * low(i, 2);
+  ASSERT_TRUE(low.CalcComplements() == zero);
+  // Rank n - 1 with a zero first column: only cofactors of column 0 are
+  // nonzero, and A times the transposed complements is det(A) * I = 0.
+  Matrix deficient = SampleMatrix(n, n, 12);
+  for (int i = 0; i < n; i++) deficient(i, i) += 4, deficient(i, 0) = 0;
+  Matrix complements = deficient.CalcComplements();
+  Matrix minor(n - 1, n - 1);
+  for (int i : {0, 1, 77, n - 1}) {
+    for (int r = 0, k = 0; r < n; r++) {
+      if (r == i) continue;
+      for (int c = 1; c < n; c++) minor(k, c - 1) = deficient(r, c);
+      k++;
+    }
+    const double cofactor = minor.Determinant() * (i % 2 == 0 ? 1 : -1);
+    ASSERT_NEAR(complements(i, 0) / cofactor, 1, 1e-9);
+    ASSERT_DOUBLE_EQ(complements(i, 1), 0);
+  }
+  Matrix product = deficient * complements.Transpose();
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      ASSERT_NEAR(product(i, j), 0, 1e-9 * fabs(complements(0, 0)));
+  // Two zero pivots under partial pivoting, yet rank 1.
+  std::initializer_list<double> data = {0, 1, 0, 0}, expected = {0, 0, -1, 0};
+  ASSERT_TRUE(Matrix(2, 2, data).CalcComplements() == Matrix(2, 2, expected));
+}
+
+TEST(LUDecomposition, test1) {
+  std::initializer_list<double> data1 = {2, 1, 1, 4, -6, 0, -2, 7, 2};
+  std::initializer_list<double> rhs = {5, -2, 9, 1, 0, 3};
+  Matrix a(3, 3, data1), b(3, 2, rhs);
+  LU lu(a);
+  ASSERT_FALSE(lu.IsSingular());
+  ASSERT_NEAR(lu.Determinant(), a.Determinant(), EPS);
+  Matrix x = lu.Solve(b);
+  ASSERT_TRUE(a * x == b);
+  Matrix y = lu.Solve(x);
+  ASSERT_TRUE(a * y == x);
+  EXPECT_THROW(lu.Solve(Matrix(2, 1)), std::invalid_argument);
+}
+
+TEST(LUDecomposition, test2) {
+  Matrix a = SampleMatrix(5, 5, 11);
+  LU lu(a);
+  const Matrix& f = lu.GetFactors();
+  const std::vector<int>& p = lu.GetPermutation();
+  for (int i = 0; i < 5; i++)
+    for (int j = 0; j < 5; j++) {
+      double sum = 0;
+      for (int k = 0; k <= std::min(i, j); k++)
+        sum += (k == i ? 1 : f(i, k)) * f(k, j);
+      ASSERT_NEAR(sum, a(p[i], j), EPS);
+    }
+  EXPECT_THROW(LU(Matrix(2, 3)), std::invalid_argument);
+}
+
+// B^T * B + n * I, symmetric positive definite.
+static Matrix SpdSample(int n, int seed) {
+  Matrix b = SampleMatrix(n, n, seed);
+  Matrix a = b.Transpose() * b;
+  for (int i = 0; i < n; i++) a(i, i) += n;
+  return a;
+}
+
+TEST(Cholesky, test1) {
+  for (int n : {3, 150}) {
+    Matrix a = SpdSample(n, 12), b = SampleMatrix(n, 3, 13);
+    Cholesky cholesky(a);
+    ASSERT_TRUE(cholesky.IsPositiveDefinite());
+    const Matrix& l = cholesky.GetFactor();
+    ASSERT_EQ(l(0, n - 1), 0);
+    ASSERT_TRUE(l * l.Transpose() == a);
+    if (n < 10) {
+      ASSERT_NEAR(cholesky.Determinant() / LU(a).Determinant(), 1, 1e-9);
+    }
+    Matrix x = cholesky.Solve(b);
+    ASSERT_TRUE(a * x == b);
+    ASSERT_TRUE(a * cholesky.Solve(x) == x);
+  }
+  std::initializer_list<double> data = {1, 2, 2, 1};
+  Cholesky indefinite(Matrix(2, 2, data));
+  ASSERT_FALSE(indefinite.IsPositiveDefinite());
+  EXPECT_THROW(indefinite.Solve(Matrix(2, 1)), std::invalid_argument);
+  EXPECT_THROW(Cholesky(Matrix(2, 3)), std::invalid_argument);
+}
+
+TEST(QR, test1) {
+  for (int rows : {6, 200}) {
+    const int cols = rows / 2;
+    Matrix a = SampleMatrix(rows, cols, 14), b = SampleMatrix(rows, 2, 15);
+    for (int i = 0; i < cols; i++) a(i, i) += 5;
+    QR qr(a);
+    ASSERT_FALSE(qr.IsTransposed());
+    ASSERT_FALSE(qr.IsRankDeficient());
+    Matrix x = qr.Solve(b);
+    ASSERT_EQ(x.GetRows(), cols);
+    // The residual of a least squares solution is orthogonal to range(A).
+    Matrix normal = a.Transpose() * (a * x - b);
+    for (int i = 0; i < cols; i++)
+      for (int j = 0; j < 2; j++) ASSERT_NEAR(normal(i, j), 0, 1e-8);
+    // Fewer rows than columns: the least norm solution A^T (A A^T)^-1 B.
+    Matrix wide = a.Transpose(), c = SampleMatrix(cols, 2, 16);
+    QR qr_wide(wide);
+    ASSERT_TRUE(qr_wide.IsTransposed());
+    Matrix y = qr_wide.Solve(c);
+    ASSERT_EQ(y.GetRows(), rows);
+    ASSERT_TRUE(wide * y == c);
+    ASSERT_TRUE(y == a * LU(wide * a).Solve(c));
+  }
+  Matrix deficient(4, 2);
+  for (int i = 0; i < 4; i++) deficient(i, 0) = deficient(i, 1) = i + 1;
+  ASSERT_TRUE(QR(deficient).IsRankDeficient());
+  EXPECT_THROW(QR(deficient).Solve(Matrix(4, 1)), std::invalid_argument);
+  EXPECT_THROW(QR(Matrix(4, 2)).Solve(Matrix(2, 1)), std::invalid_argument);
+}
+
+TEST(Solve, test1) {
+  Matrix spd = SpdSample(90, 17), general = SampleMatrix(90, 90, 18);
+  for (int i = 0; i < 90; i++) general(i, i) += 10;
+  Matrix tall = SampleMatrix(120, 90, 19);
+  for (int i = 0; i < 90; i++) tall(i, i) += 5;
+  Matrix b = SampleMatrix(90, 4, 20), c = SampleMatrix(120, 4, 21);
+  ASSERT_TRUE(Solve(spd, b) == Cholesky(spd).Solve(b));
+  ASSERT_TRUE(spd * Solve(spd, b) == b);
+  ASSERT_TRUE(Solve(general, b) == LU(general).Solve(b));
+  ASSERT_TRUE(general * Solve(general, b) == b);
+  ASSERT_TRUE(Solve(tall, c) == QR(tall).Solve(c));
+  // Symmetric but indefinite falls back to LU.
+  Matrix symmetric = general + general.Transpose();
+  symmetric(0, 0) = 1;
+  ASSERT_TRUE(symmetric * Solve(symmetric, b) == b);
+  EXPECT_THROW(Solve(spd, c), std::invalid_argument);
+}
+
+// Forces every kernel onto four threads and checks it against a serial run.
+TEST(Parallel, test1) {
+  Matrix a = SampleMatrix(300, 310, 12), b = SampleMatrix(310, 290, 13);
+  Matrix c = SampleMatrix(300, 310, 14), sq = SampleMatrix(200, 200, 15);
+  for (int i = 0; i < 200; i++) sq(i, i) += 8;
+  Matrix prod, sum, scaled, trans, inv;
+  double det;
+  {
+    ThreadLimit serial(1);
+    prod = a * b, sum = a + c, scaled = a * 0.5, trans = a.Transpose();
+    inv = sq.InverseMatrix(), det = sq.Determinant();
+  }
+  long saved_threshold = GetParallelThreshold();
+  SetNumThreads(4);
+  SetParallelThreshold(1);
+  ASSERT_EQ(GetNumThreads(), 4);
+  ASSERT_TRUE(a * b == prod);
+  ASSERT_TRUE(a + c == sum);
+  ASSERT_TRUE(a * 0.5 == scaled);
+  ASSERT_TRUE(a.Transpose() == trans);
+  ASSERT_TRUE(sq.InverseMatrix() == inv);
+  ASSERT_NEAR(sq.Determinant() / det, 1, 1e-12);
+  ASSERT_FALSE(a == c);
+  SetParallelThreshold(saved_threshold);
+  SetNumThreads(0);
+}
+
+TEST(Parallel, test2) {
+  std::atomic<int> sum{0};
+  {
+    ThreadPool pool(3);
+    ASSERT_EQ(pool.GetThreads(), 3);
+    for (int i = 1; i <= 100; i++) pool.Submit([&sum, i] { sum += i; });
+  }
+  ASSERT_EQ(sum, 5050);
+  long saved_threshold = GetParallelThreshold();
+  SetParallelThreshold(10);
+  ASSERT_EQ(ParallelThreads(1000, 5), 1);
+  {
+    ThreadLimit limit(2);
+    ASSERT_EQ(ParallelThreads(1000, 1e9), 2);
+  }
+  std::vector<int> hits(1000);
+  ParallelFor(0, 1000, 1e9, [&hits](long lo, long hi) {
+    for (long i = lo; i < hi; i++) hits[i]++;
+  });
+  for (int h : hits) ASSERT_EQ(h, 1);
+  SetParallelThreshold(saved_threshold);
+}
+
+TEST(Expressions, test1) {
+  Matrix a = SampleMatrix(70, 600, 16), b = SampleMatrix(70, 600, 17);
+  Matrix d = SampleMatrix(70, 600, 18);
+  Matrix expected(a);
+  expected.SumMatrix(b * 2.0);
+  expected.SubMatrix(d);
+  Matrix fused = a + b * 2.0 - d;
+  ASSERT_TRUE(fused == expected);
+  Matrix nested = 0.5 * (a - (d - b) * 3) + a;
+  for (int i = 0; i < 70; i++)
+    for (int j = 0; j < 600; j++)
+      ASSERT_NEAR(nested(i, j), 1.5 * a(i, j) - 1.5 * d(i, j) + 1.5 * b(i, j),
+                  1e-12);
+}
+
+TEST(Expressions, test2) {
+  std::initializer_list<double> data = {1, 2, 3, 4};
+  Matrix a(2, 2, data), b(a);
+  a = a + a * 2 - b;
+  ASSERT_DOUBLE_EQ(a(1, 1), 8);
+  a += b - b * 3;
+  ASSERT_DOUBLE_EQ(a(1, 1), 0);
+  a -= b + b;
+  ASSERT_DOUBLE_EQ(a(0, 1), -4);
+  Matrix c(3, 2);
+  EXPECT_THROW(a + c, std::invalid_argument);
+  EXPECT_THROW(a - c * 2, std::invalid_argument);
+  EXPECT_THROW(a * NAN, std::invalid_argument);
+  EXPECT_THROW(c * a * c, std::invalid_argument);
+}
+
+TEST(Expressions, test3) {
+  Matrix a = SampleMatrix(90, 70, 19), b = SampleMatrix(70, 80, 20);
+  Matrix c = SampleMatrix(90, 80, 21);
+  Matrix expected = NaiveProduct(a, b);
+  expected += c;
+  c += a * b;
+  ASSERT_TRUE(c == expected);
+  c -= a * b;
+  c -= a * b;
+  ASSERT_TRUE(c + NaiveProduct(a, b) * 2 == expected);
+}
+
+TEST(Expressions, test4) {
+  std::initializer_list<double> data = {1, 2, 3, 4};
+  std::initializer_list<double> squared = {7, 10, 15, 22};
+  Matrix a(2, 2, data), b(2, 2, squared);
+  a = a * a;
+  ASSERT_TRUE(a == b);
+  Matrix c(2, 2, data);
+  c += c * c;
+  ASSERT_TRUE(c == b + Matrix(2, 2, data));
+  Matrix d(2, 2, data);
+  Matrix e = (d + d) * d - d * 2 * d;
+  ASSERT_TRUE(e == Matrix(2, 2));
+  ASSERT_EQ(e.GetRows(), 2);
+}
+
+template <typename A, typename B, typename = void>
+struct CanMultiply : std::false_type {};
+
+template <typename A, typename B>
+struct CanMultiply<A, B,
+                   std::void_t<decltype(std::declval<A>() * std::declval<B>())>>
+    : std::true_type {};
+
+TEST(FixedMatrix, test1) {
+  static_assert(CanMultiply<FixedMatrix<2, 3>, FixedMatrix<3, 4>>::value);
+  static_assert(!CanMultiply<FixedMatrix<2, 3>, FixedMatrix<2, 3>>::value);
+  FixedMatrix<2, 3> a = {1, 2, 3, 4, 5, 6};
+  FixedMatrix<3, 2> b = a.Transpose();
+  FixedMatrix<2, 2> c = a * b;
+  ASSERT_TRUE(c == (FixedMatrix<2, 2>{14, 32, 32, 77}));
+  ASSERT_DOUBLE_EQ(c.Determinant(), 54);
+  c += FixedMatrix<2, 2>::Identity() * 2;
+  ASSERT_DOUBLE_EQ(c(1, 1), 79);
+  EXPECT_THROW(c(2, 0), std::out_of_range);
+  EXPECT_THROW((FixedMatrix<2, 2>{1, 2, 3}), std::invalid_argument);
+  EXPECT_THROW(c * NAN, std::invalid_argument);
+}
+
+TEST(FixedMatrix, test2) {
+  Matrix a = SampleMatrix(4, 4, 22);
+  FixedMatrix<4, 4> f(a);
+  ASSERT_NEAR(f.Determinant(), a.Determinant(), 1e-9);
+  ASSERT_TRUE(f.InverseMatrix().ToMatrix() == a.InverseMatrix());
+  ASSERT_TRUE(f.CalcComplements().ToMatrix() == a.CalcComplements());
+  ASSERT_TRUE((f * f).ToMatrix() == NaiveProduct(a, a));
+  ASSERT_TRUE(f * f.InverseMatrix() == (FixedMatrix<4, 4>::Identity()));
+  EXPECT_THROW((FixedMatrix<3, 4>(a)), std::invalid_argument);
+  EXPECT_THROW((FixedMatrix<4, 4>().InverseMatrix()), std::invalid_argument);
+}
+
+TEST(FixedMatrix, test3) {
+  for (int seed = 23; seed < 26; seed++) {
+    Matrix a3 = SampleMatrix(3, 3, seed), a6 = SampleMatrix(6, 6, seed);
+    for (int i = 0; i < 6; i++) a6(i, i) += 3;
+    a3(0, 0) += 3;
+    FixedMatrix<3, 3> f3(a3);
+    FixedMatrix<6, 6> f6(a6);
+    ASSERT_NEAR(f3.Determinant(), a3.Determinant(), 1e-9);
+    ASSERT_NEAR(f6.Determinant(), a6.Determinant(), 1e-9);
+    ASSERT_TRUE(f3.InverseMatrix().ToMatrix() == a3.InverseMatrix());
+    ASSERT_TRUE(f6.InverseMatrix().ToMatrix() == a6.InverseMatrix());
+  }
+  FixedMatrix<1, 1> one = {5};
+  ASSERT_DOUBLE_EQ(one.InverseMatrix()(0, 0), 0.2);
+}
+
+// Installs allocator for the rest of the scope and puts the previous one
+// back on every way out of it, a failed ASSERT's return included.
+class AllocatorScope {
+ public:
+  explicit AllocatorScope(MatrixAllocator* allocator)
+      : saved_(GetMatrixAllocator()) {
+    SetMatrixAllocator(allocator);
+  }
+  ~AllocatorScope() { SetMatrixAllocator(saved_); }
+
+ private:
+  MatrixAllocator* saved_;
+};
+
+TEST(Allocation, test1) {
+  // Serial, since handing work to the pool allocates a job record.
+  ThreadLimit serial(1);
+  Matrix a = SampleMatrix(150, 90, 26), b = SampleMatrix(90, 120, 27);
+  Matrix c = SampleMatrix(150, 120, 28), s1 = SampleMatrix(5, 6, 29);
+  Matrix s2 = SampleMatrix(6, 4, 30);
+  Matrix out, sum, small;
+  for (int warm = 0; warm < 2; warm++) {
+    long before = heap_allocations;
+    for (int i = 0; i < 10; i++) {
+      Multiply(a, b, out);
+      Add(out, c, sum);
+      Subtract(sum, out, sum);
+      sum = out + c * 2.0;
+      sum += a * b;
+      Multiply(s1, s2, small);
+    }
+    if (warm) {
+      ASSERT_EQ(heap_allocations - before, 0);
+    }
+  }
+}
+
+TEST(Allocation, test2) {
+  PoolAllocator pool;
+  {
+    AllocatorScope scope(&pool);
+    Matrix a = SampleMatrix(64, 48, 31);
+    for (int warm = 0; warm < 2; warm++) {
+      long before = heap_allocations;
+      for (int i = 0; i < 10; i++) {
+        Matrix t = a.Transpose();
+        Matrix u(t);
+        ASSERT_DOUBLE_EQ(u(5, 7), a(7, 5));
+      }
+      if (warm) {
+        ASSERT_EQ(heap_allocations - before, 0);
+      }
+    }
+  }
+  ASSERT_GT(pool.GetCachedBytes(), 0u);
+  pool.Release();
+  ASSERT_EQ(pool.GetCachedBytes(), 0u);
+}
+
+TEST(Allocation, test3) {
+  Matrix a = SampleMatrix(40, 30, 32), b(a);
+  const double* data = a.GetData();
+  long before = heap_allocations;
+  a.SetRows(10);
+  a.SetCols(7);
+  ASSERT_DOUBLE_EQ(a(9, 6), b(9, 6));
+  a.SetRows(40);
+  a.SetCols(30);
+  ASSERT_EQ(heap_allocations - before, 0);
+  ASSERT_EQ(a.GetData(), data);
+  ASSERT_DOUBLE_EQ(a(9, 6), b(9, 6));
+  ASSERT_DOUBLE_EQ(a(9, 7), 0);
+  ASSERT_DOUBLE_EQ(a(39, 0), 0);
+  Matrix c = SampleMatrix(20, 25, 33);
+  a = c;
+  ASSERT_EQ(a.GetData(), data);
+  a.SetCols(200);
+  ASSERT_DOUBLE_EQ(a(19, 24), c(19, 24));
+  ASSERT_DOUBLE_EQ(a(19, 199), 0);
+}
+
+TEST(Transpose, test2) {
+  Matrix a = SampleMatrix(301, 517, 34);
+  Matrix t = a.Transpose();
+  ASSERT_EQ(t.GetRows(), 517);
+  ASSERT_EQ(t.GetCols(), 301);
+  for (int i = 0; i < 301; i++)
+    for (int j = 0; j < 517; j++) ASSERT_DOUBLE_EQ(t(j, i), a(i, j));
+  Matrix s = SampleMatrix(131, 131, 35), expected = s.Transpose();
+  s.TransposeInPlace();
+  ASSERT_TRUE(s == expected);
+  Matrix one = SampleMatrix(1, 1, 36), copy(one);
+  one.TransposeInPlace();
+  ASSERT_TRUE(one == copy);
+  EXPECT_THROW(a.TransposeInPlace(), std::invalid_argument);
+}
+
+TEST(Transpose, test3) {
+  Matrix a = SampleMatrix(90, 70, 37), b = SampleMatrix(80, 70, 38);
+  Matrix c = a * Transposed(b);
+  ASSERT_TRUE(c == NaiveProduct(a, b.Transpose()));
+  Matrix bt = b.Transpose();
+  Matrix d = Transposed(bt) * Transposed(a);
+  ASSERT_TRUE(d == c.Transpose());
+  Matrix small = SampleMatrix(3, 5, 39);
+  Matrix gram = Transposed(small) * small;
+  ASSERT_TRUE(gram == NaiveProduct(small.Transpose(), small));
+  gram -= Transposed(small) * small;
+  ASSERT_TRUE(gram == Matrix(5, 5));
+  EXPECT_THROW(a * Transposed(a.Transpose()), std::invalid_argument);
+}
+
+// Dense matrix with about one entry in density stored, the rest zeros.
+static Matrix SparseSample(int rows, int cols, int density, int seed) {
+  Matrix m = SampleMatrix(rows, cols, seed);
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      if ((i * 131 + j * 71 + seed * 17) % density != 0) m(i, j) = 0;
+  return m;
+}
+
+TEST(SparseMatrix, test1) {
+  std::initializer_list<double> data = {0, 2, 0, 0, 0, 0, 3, 0, 4};
+  Matrix dense(3, 3, data);
+  SparseMatrix s(dense);
+  ASSERT_EQ(s.GetNonZeros(), 3);
+  ASSERT_DOUBLE_EQ(s(2, 2), 4);
+  ASSERT_DOUBLE_EQ(s(1, 1), 0);
+  ASSERT_TRUE(s.ToDense() == dense);
+  ASSERT_EQ(SparseMatrix(dense, 2.5).GetNonZeros(), 2);
+  SparseMatrix t(3, 3, {{2, 2, 1}, {0, 1, 2}, {2, 0, 3}, {2, 2, 3}});
+  ASSERT_TRUE(t.ToDense() == dense);
+  ASSERT_EQ(t.GetColumns(), s.GetColumns());
+  ASSERT_EQ(t.GetOffsets(), s.GetOffsets());
+  EXPECT_THROW(s(3, 0), std::out_of_range);
+  EXPECT_THROW(SparseMatrix(2, 2, {{2, 0, 1}}), std::out_of_range);
+  EXPECT_THROW(SparseMatrix(0, 2), std::invalid_argument);
+}
+
+TEST(SparseMatrix, test2) {
+  Matrix a = SparseSample(300, 200, 29, 1), b = SparseSample(300, 200, 31, 2);
+  Matrix dense = SampleMatrix(200, 70, 40);
+  std::vector<double> x(200);
+  for (int i = 0; i < 200; i++) x[i] = dense(i, 3);
+  SparseMatrix sa(a), sb(b);
+  Matrix product = NaiveProduct(a, dense);
+  ASSERT_LT(sa.GetNonZeros(), 300 * 200 / 20);
+  long saved_threshold = GetParallelThreshold();
+  for (int threads : {1, 4}) {
+    SetNumThreads(threads);
+    SetParallelThreshold(threads == 1 ? saved_threshold : 1);
+    ASSERT_TRUE(sa * dense == product);
+    std::vector<double> y = sa * x;
+    for (int i = 0; i < 300; i++)
+      ASSERT_NEAR(y[i], product(i, 3), 1e-12);
+    ASSERT_TRUE((sa + sb).ToDense() == a + b);
+    ASSERT_TRUE(sa.Transpose().ToDense() == a.Transpose());
+    ASSERT_TRUE(SparseMatrix(a).ToDense() == a);
+  }
+  SetParallelThreshold(saved_threshold);
+  SetNumThreads(0);
+  sa += sb;
+  sa.MulNumber(2);
+  ASSERT_TRUE(sa.ToDense() == (a + b) * 2);
+  EXPECT_THROW(sa * SampleMatrix(300, 2, 41), std::invalid_argument);
+  EXPECT_THROW(sa * std::vector<double>(3), std::invalid_argument);
+  EXPECT_THROW(sa + SparseMatrix(dense), std::invalid_argument);
+}
+
+static Matrix BatchSample(int rows, int cols, int seed) {
+  Matrix m = SampleMatrix(rows, cols, seed);
+  for (int i = 0; i < rows && i < cols; i++) m(i, i) += 3 + seed % 5;
+  return m;
+}
+
+TEST(MatrixBatch, test1) {
+  const int count = 21;
+  MatrixBatch a(count, 3, 5), b(count, 5, 4);
+  for (int i = 0; i < count; i++) {
+    a.Set(i, BatchSample(3, 5, i));
+    b.Set(i, BatchSample(5, 4, i + 50));
+  }
+  ASSERT_EQ(a(4, 2, 1), BatchSample(3, 5, 4)(2, 1));
+  SimdIsa saved = GetSimdIsa();
+  for (SimdIsa isa : {SimdIsa::kScalar, SimdIsa::kSse2, SimdIsa::kAvx2,
+                      SimdIsa::kAvx512}) {
+    if (!SimdIsaSupported(isa)) continue;
+    SetSimdIsa(isa);
+    MatrixBatch p = a * b, t = a.Transpose();
+    ASSERT_EQ(p.GetRows(), 3);
+    ASSERT_EQ(p.GetCols(), 4);
+    ASSERT_EQ(t.GetRows(), 5);
+    for (int i = 0; i < count; i++) {
+      ASSERT_TRUE(p.Get(i) == a.Get(i) * b.Get(i));
+      ASSERT_TRUE(t.Get(i) == a.Get(i).Transpose());
+    }
+  }
+  SetSimdIsa(saved);
+  EXPECT_THROW(a.MulMatrix(a), std::invalid_argument);
+  EXPECT_THROW(a.MulMatrix(MatrixBatch(count + 1, 5, 4)),
+               std::invalid_argument);
+  EXPECT_THROW(a.Set(0, Matrix(5, 3)), std::invalid_argument);
+  EXPECT_THROW(a(count, 0, 0), std::out_of_range);
+  EXPECT_THROW(MatrixBatch(0, 2, 2), std::invalid_argument);
+}
+
+TEST(MatrixBatch, test2) {
+  long saved_threshold = GetParallelThreshold();
+  for (int n : {1, 3, 4, 6}) {
+    const int count = 35;
+    MatrixBatch batch(count, n, n);
+    for (int i = 0; i < count; i++) batch.Set(i, BatchSample(n, n, i));
+    for (int threads : {1, 4}) {
+      SetNumThreads(threads);
+      SetParallelThreshold(threads == 1 ? saved_threshold : 1);
+      std::vector<double> det = batch.Determinant();
+      MatrixBatch inverse = batch.InverseMatrix();
+      ASSERT_EQ((int)det.size(), count);
+      for (int i = 0; i < count; i++) {
+        Matrix m = batch.Get(i);
+        ASSERT_NEAR(det[i], m.Determinant(), 1e-9 * fabs(m.Determinant()));
+        ASSERT_TRUE(inverse.Get(i) == m.InverseMatrix());
+      }
+    }
+  }
+  SetParallelThreshold(saved_threshold);
+  SetNumThreads(0);
+  std::initializer_list<double> data = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  MatrixBatch singular(10, 3, 3);
+  for (int i = 0; i < 10; i++) singular.Set(i, BatchSample(3, 3, i));
+  singular.Set(7, Matrix(3, 3, data));
+  ASSERT_NEAR(singular.Determinant()[7], 0, 1e-12);
+  ASSERT_NE(singular.Determinant()[6], 0);
+  EXPECT_THROW(singular.InverseMatrix(), std::invalid_argument);
+  EXPECT_THROW(MatrixBatch(2, 2, 3).Determinant(), std::invalid_argument);
+}
+
+TEST(MatrixFile, test1) {
+  const std::string path = testing::TempDir() + "matrix_file_test1.bin";
+  for (Matrix m : {SampleMatrix(3, 5, 22), SampleMatrix(37, 45, 23)}) {
+    SaveMatrix(m, path);
+    MatrixFileHeader header = ReadMatrixHeader(path);
+    ASSERT_EQ(header.rows, m.GetRows());
+    ASSERT_EQ(header.cols, m.GetCols());
+    ASSERT_EQ(header.dtype, MatrixDtype::kFloat64);
+    ASSERT_EQ(header.layout, MatrixLayout::kRowMajor);
+    Matrix loaded = LoadMatrix(path), mapped = MapMatrix(path, true);
+    ASSERT_TRUE(loaded == m);
+    ASSERT_TRUE(mapped == m);
+    ASSERT_EQ((std::uintptr_t)mapped.GetData() % kMatrixAlignment, 0u);
+    // Writes stay in the process, and the mapping outlives the file.
+    mapped(1, 2) = 100;
+    mapped += m;
+    ASSERT_TRUE(LoadMatrix(path) == m);
+    std::remove(path.c_str());
+    ASSERT_EQ(mapped(0, 0), 2 * m(0, 0));
+    mapped.SetRows(60);
+    ASSERT_EQ(mapped(59, 0), 0);
+  }
+}
+
+TEST(MatrixFile, test2) {
+  const std::string path = testing::TempDir() + "matrix_file_test2.bin";
+  Matrix m = SampleMatrix(20, 30, 24);
+  SaveMatrix(m, path);
+  {
+    std::FILE* f = std::fopen(path.c_str(), "r+b");
+    std::fseek(f, 4096 + 8 * 100, SEEK_SET);
+    std::fputc(0x55, f);
+    std::fclose(f);
+  }
+  EXPECT_THROW(LoadMatrix(path), std::invalid_argument);
+  EXPECT_THROW(MapMatrix(path, true), std::invalid_argument);
+  ASSERT_EQ(MapMatrix(path).GetRows(), 20);
+  ASSERT_EQ(truncate(path.c_str(), 4096 + 100), 0);
+  EXPECT_THROW(MapMatrix(path), std::invalid_argument);
+  {
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    std::fputs("1 2 3\n", f);
+    std::fclose(f);
+  }
+  EXPECT_THROW(LoadMatrix(path), std::invalid_argument);
+  std::remove(path.c_str());
+  EXPECT_THROW(LoadMatrix(path), std::runtime_error);
+  EXPECT_THROW(SaveMatrix(m, testing::TempDir() + "missing/dir.bin"),
+               std::runtime_error);
+  ASSERT_EQ(MatrixChecksum(m.GetData(), 64), MatrixChecksum(m.GetData(), 64));
+  ASSERT_NE(MatrixChecksum(m.GetData(), 64), MatrixChecksum(m.GetData(), 72));
+}
+
+TEST(MatrixFile, test3) {
+  const std::string dir = testing::TempDir();
+  const std::string a_path = dir + "matrix_file_a.bin",
+                    b_path = dir + "matrix_file_b.bin",
+                    c_path = dir + "matrix_file_c.bin";
+  Matrix a = SampleMatrix(70, 50, 25), b = SampleMatrix(50, 90, 26);
+  SaveMatrix(a, a_path);
+  SaveMatrix(b, b_path);
+  // 16 x 16 tiles leave partial ones on every edge; the large budget runs
+  // the whole product as one tile.
+  for (std::size_t budget : {6 * 8 * 16 * 16, 1 << 30}) {
+    MultiplyFiles(a_path, b_path, c_path, budget);
+    ASSERT_TRUE(LoadMatrix(c_path) == NaiveProduct(a, b));
+  }
+  EXPECT_THROW(MultiplyFiles(b_path, b_path, c_path), std::invalid_argument);
+  EXPECT_THROW(MultiplyFiles(a_path, b_path, c_path, 10),
+               std::invalid_argument);
+  EXPECT_THROW(MultiplyFiles(a_path, b_path, a_path), std::invalid_argument);
+  // Other names for an operand are caught before it is truncated.
+  const std::string link_path = dir + "matrix_file_link.bin";
+  std::remove(link_path.c_str());
+  ASSERT_EQ(symlink(b_path.c_str(), link_path.c_str()), 0);
+  EXPECT_THROW(MultiplyFiles(a_path, b_path, dir + "./matrix_file_a.bin"),
+               std::invalid_argument);
+  EXPECT_THROW(MultiplyFiles(a_path, b_path, link_path),
+               std::invalid_argument);
+  ASSERT_TRUE(LoadMatrix(a_path) == a);
+  ASSERT_TRUE(LoadMatrix(b_path) == b);
+  for (const std::string& path : {a_path, b_path, c_path, link_path})
+    std::remove(path.c_str());
+}
+
+static bool SameBits(const Matrix& a, const Matrix& b) {
+  if (a.GetRows() != b.GetRows() || a.GetCols() != b.GetCols()) return false;
+  for (int i = 0; i < a.GetRows(); i++)
+    if (std::memcmp(a.GetData() + (std::size_t)i * a.GetStride(),
+                    b.GetData() + (std::size_t)i * b.GetStride(),
+                    a.GetCols() * sizeof(double)) != 0)
+      return false;
+  return true;
+}
+
+TEST(MatrixFile, test4) {
+  const std::string path = testing::TempDir() + "matrix_file_test4.txt";
+  // Enough rows for the text to span several read chunks, and values with
+  // long or unusual shortest forms.
+  Matrix m = SampleMatrix(700, 400, 27);
+  m(0, 0) = 0.1;
+  m(0, 1) = -1e-300;
+  m(0, 2) = 4.9e-324;
+  m(0, 3) = DBL_MAX;
+  m(1, 0) = INFINITY;
+  m(1, 1) = -0.0;
+  for (char delimiter : {' ', '\t', ','}) {
+    SaveMatrixText(m, path, delimiter);
+    ASSERT_TRUE(SameBits(LoadMatrixText(path, delimiter), m));
+  }
+  std::ostringstream out;
+  WriteMatrixText(out, m, ',');
+  std::ifstream file(path);
+  std::stringstream saved;
+  saved << file.rdbuf();
+  ASSERT_EQ(out.str(), saved.str());
+  std::istringstream in(out.str());
+  ASSERT_TRUE(SameBits(ReadMatrixText(in, ','), m));
+  std::remove(path.c_str());
+}
+
+TEST(MatrixFile, test5) {
+  // Blank lines, CRLF and tabs; a blank line ends a matrix in a stream.
+  std::istringstream in("\n  1 2\t3 \r\n4 5 6\n\n7 8 9\n");
+  Matrix first = ReadMatrixText(in), second = ReadMatrixText(in);
+  ASSERT_EQ(first.GetRows(), 2);
+  ASSERT_EQ(first(1, 2), 6);
+  ASSERT_EQ(second.GetRows(), 1);
+  ASSERT_EQ(second(0, 0), 7);
+  EXPECT_THROW(ReadMatrixText(in), std::invalid_argument);
+  // operator<< output reads back one matrix per call.
+  Matrix a(3, 4), b(2, 2);
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 4; j++) a(i, j) = i * 4 - j;
+  b(1, 0) = 9;
+  std::stringstream printed;
+  printed << a << b;
+  ASSERT_TRUE(ReadMatrixText(printed) == a);
+  ASSERT_TRUE(ReadMatrixText(printed) == b);
+  std::istringstream csv("1, 2,3\n-4.5e1 ,inf,nan\n");
+  Matrix c = ReadMatrixText(csv, ',');
+  ASSERT_EQ(c(1, 0), -45);
+  ASSERT_TRUE(std::isinf(c(1, 1)));
+  ASSERT_TRUE(std::isnan(c(1, 2)));
+  for (const char* bad : {"1 2\n3\n", "1 2x\n", "1 ,2\n", "+1\n"}) {
+    std::istringstream text(bad);
+    EXPECT_THROW(ReadMatrixText(text), std::invalid_argument);
+  }
+  for (const char* bad : {"1,,2\n", "1,2,\n", "1 2\n", "1,2\n3\n"}) {
+    std::istringstream text(bad);
+    EXPECT_THROW(ReadMatrixText(text, ','), std::invalid_argument);
+  }
+  const std::string path = testing::TempDir() + "matrix_file_test5.txt";
+  {
+    std::ofstream file(path);
+    file << "1 2\n3 4 5\n";
+  }
+  EXPECT_THROW(LoadMatrixText(path), std::invalid_argument);
+  {
+    std::ofstream file(path);
+    file << "\n \n";
+  }
+  EXPECT_THROW(LoadMatrixText(path), std::invalid_argument);
+  EXPECT_THROW(LoadMatrixText(path, '.'), std::invalid_argument);
+  std::remove(path.c_str());
+  EXPECT_THROW(LoadMatrixText(path), std::runtime_error);
+  EXPECT_THROW(SaveMatrixText(a, testing::TempDir() + "missing/dir.txt"),
+               std::runtime_error);
+}
+
+// Another writer's layout: a wider stride and the data right after the
+// header, still mapped rather than read.
+TEST(MatrixFile, test6) {
+  const std::string path = testing::TempDir() + "matrix_file_test6.bin";
+  Matrix m = SampleMatrix(7, 10, 40);
+  SaveMatrix(m, path);
+  MatrixFileHeader header = ReadMatrixHeader(path);
+  const int stride = 13;
+  std::vector<double> data(7 * stride);
+  for (int i = 0; i < 7; i++)
+    for (int j = 0; j < 10; j++) data[i * stride + j] = m(i, j);
+  header.stride = stride;
+  header.data_offset = 128;
+  header.checksum = MatrixChecksum(data.data(), data.size() * sizeof(double));
+  {
+    std::vector<char> top(header.data_offset);
+    std::memcpy(top.data(), &header, sizeof(header));
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    std::fwrite(top.data(), 1, top.size(), f);
+    std::fwrite(data.data(), sizeof(double), data.size(), f);
+    std::fclose(f);
+  }
+  Matrix mapped = MapMatrix(path, true);
+  ASSERT_EQ(mapped.GetStride(), stride);
+  ASSERT_TRUE(mapped == m);
+  ASSERT_TRUE(LoadMatrix(path) == m);
+  ASSERT_TRUE(mapped * 2.0 == m * 2.0);
+  ASSERT_TRUE(mapped.Transpose() == m.Transpose());
+  mapped.SetCols(12);
+  ASSERT_EQ(mapped(6, 11), 0);
+  ASSERT_EQ(mapped(6, 9), m(6, 9));
+  std::remove(path.c_str());
+}
+
+// Small integers, exact in every element type.
+template <typename T>
+static BasicMatrix<T> IntegerSample(int rows, int cols, int seed) {
+  BasicMatrix<T> m(rows, cols);
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      m(i, j) = (i * 31 + j * 17 + seed * 7) % 23 - 11;
+  return m;
+}
+
+TEST(BasicMatrix, test1) {
+  Matrix a = SampleMatrix(70, 130, 27), b = SampleMatrix(130, 90, 28);
+  Matrix expected = NaiveProduct(a, b);
+  BasicMatrix<float> fa = MatrixCast<float>(a), fb = MatrixCast<float>(b);
+  BasicMatrix<int> ia = IntegerSample<int>(70, 130, 29),
+                   ib = IntegerSample<int>(130, 90, 30);
+  BasicMatrix<long> la = MatrixCast<long>(ia), lb = MatrixCast<long>(ib);
+  Matrix expected_int =
+      NaiveProduct(MatrixCast<double>(ia), MatrixCast<double>(ib));
+  SimdIsa saved = GetSimdIsa();
+  for (SimdIsa isa : {SimdIsa::kScalar, SimdIsa::kSse2, SimdIsa::kAvx2,
+                      SimdIsa::kAvx512}) {
+    if (!SimdIsaSupported(isa)) continue;
+    SetSimdIsa(isa);
+    Matrix product = MatrixCast<double>(fa * fb);
+    for (int i = 0; i < 70; i++)
+      for (int j = 0; j < 90; j++)
+        ASSERT_NEAR(product(i, j), expected(i, j), 1e-3);
+    ASSERT_TRUE(MatrixCast<double>(ia * ib) == expected_int);
+    ASSERT_TRUE(MatrixCast<double>(la * lb) == expected_int);
+    ASSERT_TRUE(fa * 2 == fa + fa);
+    ASSERT_TRUE(fa - fa == BasicMatrix<float>(70, 130));
+    ASSERT_TRUE(ia * 3 - ia == ia + ia);
+    ASSERT_FALSE(ia + ia == ia);
+    ASSERT_TRUE(fa.Transpose().Transpose() == fa);
+  }
+  SetSimdIsa(saved);
+  ASSERT_EQ(fa.GetStride() % 16, 0);
+  EXPECT_THROW(fa.MulMatrix(fa), std::invalid_argument);
+  EXPECT_THROW(ia.SumMatrix(ib), std::invalid_argument);
+  EXPECT_THROW(fa.MulNumber(NAN), std::invalid_argument);
+  EXPECT_THROW(ia(70, 0), std::out_of_range);
+}
+
+TEST(BasicMatrix, test2) {
+  using Complex = std::complex<double>;
+  Matrix ar = SampleMatrix(40, 50, 31), ai = SampleMatrix(40, 50, 32);
+  Matrix br = SampleMatrix(50, 30, 33), bi = SampleMatrix(50, 30, 34);
+  BasicMatrix<Complex> a(40, 50), b(50, 30);
+  for (int i = 0; i < 40; i++)
+    for (int j = 0; j < 50; j++) a(i, j) = Complex(ar(i, j), ai(i, j));
+  for (int i = 0; i < 50; i++)
+    for (int j = 0; j < 30; j++) b(i, j) = Complex(br(i, j), bi(i, j));
+  Matrix re = NaiveProduct(ar, br) - NaiveProduct(ai, bi);
+  Matrix im = NaiveProduct(ar, bi) + NaiveProduct(ai, br);
+  SimdIsa saved = GetSimdIsa();
+  for (SimdIsa isa : {SimdIsa::kScalar, SimdIsa::kSse2, SimdIsa::kAvx2,
+                      SimdIsa::kAvx512}) {
+    if (!SimdIsaSupported(isa)) continue;
+    SetSimdIsa(isa);
+    BasicMatrix<Complex> c = a * b;
+    for (int i = 0; i < 40; i++)
+      for (int j = 0; j < 30; j++) {
+        ASSERT_NEAR(c(i, j).real(), re(i, j), 1e-9);
+        ASSERT_NEAR(c(i, j).imag(), im(i, j), 1e-9);
+      }
+    BasicMatrix<Complex> twice = a * Complex(0, 2);
+    ASSERT_TRUE(twice * Complex(0, 0.5) == a * Complex(-1, 0));
+  }
+  SetSimdIsa(saved);
+  BasicMatrix<Complex> rotation(2, 2, {1, Complex(0, 1), Complex(0, 1), 1});
+  ASSERT_NEAR(std::abs(rotation.Determinant() - 2.0), 0, 1e-12);
+  BasicMatrix<Complex> square(30, 30);
+  for (int i = 0; i < 30; i++)
+    for (int j = 0; j < 30; j++) square(i, j) = a(i, j) + (i == j ? 5.0 : 0);
+  BasicMatrix<Complex> identity(30, 30);
+  for (int i = 0; i < 30; i++) identity(i, i) = 1;
+  ASSERT_TRUE(square * square.InverseMatrix() == identity);
+  BasicMatrix<float> f = MatrixCast<float>(SampleMatrix(12, 12, 35));
+  for (int i = 0; i < 12; i++) f(i, i) += 5;
+  BasicMatrix<float> f_identity(12, 12);
+  for (int i = 0; i < 12; i++) f_identity(i, i) = 1;
+  ASSERT_TRUE(f * f.InverseMatrix() == f_identity);
+  ASSERT_NEAR(f.Determinant(), MatrixCast<double>(f).Determinant(),
+              1e-5 * fabs(f.Determinant()));
+}
+
+TEST(BasicMatrix, test3) {
+  BasicMatrix<int> m(3, 3, {2, 0, 1, 1, 3, 2, 1, 1, 2});
+  ASSERT_EQ(m.Determinant(), 6);
+  BasicMatrix<int> complements(3, 3, {4, 0, -2, 1, 3, -2, -3, -3, 6});
+  ASSERT_TRUE(m.CalcComplements() == complements);
+  EXPECT_THROW(m.InverseMatrix(), std::invalid_argument);
+  // Determinant 1, so the inverse is an integer matrix.
+  BasicMatrix<int> unimodular(3, 3, {2, 3, 1, 1, 2, 1, 1, 1, 1});
+  ASSERT_EQ(unimodular.Determinant(), 1);
+  BasicMatrix<int> identity(3, 3, {1, 0, 0, 0, 1, 0, 0, 0, 1});
+  ASSERT_TRUE(unimodular * unimodular.InverseMatrix() == identity);
+  // Exact where double elimination rounds.
+  for (int n : {1, 2, 7, 12}) {
+    BasicMatrix<long> big = IntegerSample<long>(n, n, n);
+    double det = MatrixCast<double>(big).Determinant();
+    ASSERT_NEAR((double)big.Determinant(), det, 1e-9 * fabs(det) + 1e-6);
+  }
+  BasicMatrix<int> singular(3, 3, {1, 2, 3, 4, 5, 6, 7, 8, 9});
+  ASSERT_EQ(singular.Determinant(), 0);
+  EXPECT_THROW(BasicMatrix<int>(2, 3).Determinant(), std::invalid_argument);
+  m.SetCols(4);
+  ASSERT_EQ(m(2, 3), 0);
+  ASSERT_EQ(m(2, 2), 2);
+}
+
+// Complements and inverses from one elimination, singular ones from the
+// rank.
+TEST(BasicMatrix, test4) {
+  // Unimodular, with a row swap at every step: the inverse stays exact.
+  const int n = 160;
+  BasicMatrix<long> u(n, n), identity(n, n);
+  for (int i = 0; i < n; i++) {
+    u(n - 1 - i, i) = 1;
+    if (i + 1 < n) u(n - 1 - i, i + 1) = 1;
+    identity(i, i) = 1;
+  }
+  ASSERT_TRUE(u * u.InverseMatrix() == identity);
+  // A times its transposed complements is det(A) * I, exactly.
+  BasicMatrix<long> a = IntegerSample<long>(8, 8, 3);
+  for (int i = 0; i < 8; i++) a(i, i) += 20;
+  const long det = a.Determinant();
+  ASSERT_NE(det, 0);
+  BasicMatrix<long> scaled(8, 8);
+  for (int i = 0; i < 8; i++) scaled(i, i) = det;
+  ASSERT_TRUE(a * a.CalcComplements().Transpose() == scaled);
+  // Rank n - 1.
+  BasicMatrix<int> singular(3, 3, {1, 2, 3, 4, 5, 6, 7, 8, 9});
+  BasicMatrix<int> complements(3, 3, {-3, 6, -3, 6, -12, 6, -3, 6, -3});
+  ASSERT_TRUE(singular.CalcComplements() == complements);
+  ASSERT_TRUE(MatrixCast<std::complex<double>>(singular).CalcComplements() ==
+              MatrixCast<std::complex<double>>(complements));
+  ASSERT_TRUE(MatrixCast<float>(singular).CalcComplements() ==
+              MatrixCast<float>(complements));
+  BasicMatrix<long> deficient = IntegerSample<long>(9, 9, 4);
+  for (int i = 0; i < 9; i++) deficient(i, i) += 20;
+  for (int j = 0; j < 9; j++)
+    deficient(8, j) = deficient(0, j) - deficient(3, j);
+  BasicMatrix<long> cofactors = deficient.CalcComplements();
+  ASSERT_NE(cofactors(8, 0), 0);
+  ASSERT_TRUE(deficient * cofactors.Transpose() == BasicMatrix<long>(9, 9));
+  Matrix expected = MatrixCast<double>(deficient).CalcComplements();
+  const double scale = fabs((double)cofactors(8, 0));
+  for (int i = 0; i < 9; i++)
+    for (int j = 0; j < 9; j++)
+      ASSERT_NEAR((double)cofactors(i, j), expected(i, j), 1e-9 * scale);
+  // Rank n - 2.
+  for (int j = 0; j < 9; j++) deficient(7, j) = 2 * deficient(6, j);
+  ASSERT_TRUE(deficient.CalcComplements() == BasicMatrix<long>(9, 9));
+}
+
+TEST(MatrixView, test1) {
+  Matrix a = SampleMatrix(7, 9, 30);
+  MatrixView block = MatrixView(a).Block(2, 3, 4, 5);
+  ASSERT_EQ(block.GetRows(), 4);
+  ASSERT_EQ(block(1, 2), a(3, 5));
+  block(0, 0) = 42;
+  ASSERT_EQ(a(2, 3), 42);
+  ASSERT_EQ(block.Row(3)(0, 4), a(5, 7));
+  ASSERT_EQ(block.Col(1)(2, 0), a(4, 4));
+  ASSERT_EQ(block.Transposed()(4, 1), a(3, 7));
+  MatrixView diagonal = MatrixView(a).Diagonal();
+  ASSERT_EQ(diagonal.GetRows(), 7);
+  ASSERT_EQ(diagonal(6, 0), a(6, 6));
+  // Copies out only the viewed elements.
+  Matrix copy(block.Transposed());
+  ASSERT_EQ(copy.GetRows(), 5);
+  ASSERT_EQ(copy(4, 3), a(5, 7));
+  diagonal = Matrix(7, 1);
+  ASSERT_EQ(a(3, 3), 0);
+  ASSERT_EQ(a(3, 4), SampleMatrix(7, 9, 30)(3, 4));
+  EXPECT_THROW(block(4, 0), std::out_of_range);
+  EXPECT_THROW(block.Block(1, 1, 4, 1), std::out_of_range);
+  EXPECT_THROW(block = Matrix(5, 4), std::invalid_argument);
+}
+
+TEST(MatrixView, test2) {
+  Matrix a = SampleMatrix(150, 130, 31), b = SampleMatrix(140, 160, 32);
+  Matrix c = SampleMatrix(200, 200, 33), expected(c);
+  MatrixView ab = MatrixView(a).Block(10, 20, 100, 70);
+  MatrixView bb = MatrixView(b).Block(5, 7, 70, 90);
+  MatrixView cb = MatrixView(c).Block(50, 60, 100, 90);
+  cb += ab * bb;
+  Matrix product = NaiveProduct(Matrix(ab), Matrix(bb));
+  for (int i = 0; i < 100; i++)
+    for (int j = 0; j < 90; j++) expected(50 + i, 60 + j) += product(i, j);
+  ASSERT_TRUE(c == expected);
+  // A transposed destination takes the transposed product.
+  Matrix d(90, 100);
+  MatrixView(d).Transposed() = ab * bb;
+  ASSERT_TRUE(d == product.Transpose());
+  // Expressions of views, and views of rows and columns in them.
+  Matrix e = ab - 2 * Matrix(ab);
+  ASSERT_TRUE(e == Matrix(ab) * -1);
+  MatrixView(a).Row(0) += MatrixView(a).Row(1) * 2;
+  ASSERT_DOUBLE_EQ(a(0, 5), SampleMatrix(150, 130, 31)(0, 5) + 2 * a(1, 5));
+  MatrixView(a).Col(3) *= 0.5;
+  ASSERT_DOUBLE_EQ(a(140, 3), SampleMatrix(150, 130, 31)(140, 3) / 2);
+}
+
+TEST(MatrixView, test3) {
+  // Overlapping operands go through a temporary.
+  Matrix a = SampleMatrix(6, 6, 34), expected(a);
+  MatrixView(a).Block(1, 1, 5, 5) = MatrixView(a).Block(0, 0, 5, 5);
+  for (int i = 0; i < 5; i++)
+    for (int j = 0; j < 5; j++) ASSERT_EQ(a(i + 1, j + 1), expected(i, j));
+  Matrix b = SampleMatrix(8, 8, 35), original(b);
+  MatrixView top = MatrixView(b).Block(0, 0, 4, 8);
+  MatrixView(b).Block(4, 0, 4, 8) = top * MatrixView(b).Block(0, 0, 8, 8);
+  Matrix product = NaiveProduct(Matrix(MatrixView(original).Block(0, 0, 4, 8)),
+                                original);
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 8; j++) ASSERT_NEAR(b(4 + i, j), product(i, j), 1e-12);
+  b = MatrixView(b).Block(2, 2, 3, 3);
+  ASSERT_EQ(b.GetRows(), 3);
+  ASSERT_EQ(b(0, 0), original(2, 2));
+  // Decompositions read blocks and products in place.
+  Matrix m = SampleMatrix(9, 9, 36);
+  for (int i = 0; i < 9; i++) m(i, i) += 10;
+  MatrixView inner = MatrixView(m).Block(1, 1, 6, 6);
+  Matrix x = LU(inner).Solve(MatrixView(m).Block(1, 7, 6, 2));
+  ASSERT_TRUE(Matrix(inner) * x == Matrix(MatrixView(m).Block(1, 7, 6, 2)));
+  ASSERT_TRUE(Solve(inner.Transposed(), Matrix(6, 1)) == Matrix(6, 1));
+}
+
+TEST(Strassen, test1) {
+  // Integer operands keep every sum exact, so the results must match the
+  // classical product exactly, padding included.
+  SetStrassenCrossover(16);
+  SetNumThreads(4);
+  ASSERT_TRUE(UseStrassen(16, 40, 16));
+  ASSERT_FALSE(UseStrassen(15, 40, 16));
+  for (int n : {16, 64, 67, 131}) {
+    Matrix a = IntegerSample<double>(n, n, n);
+    Matrix b = IntegerSample<double>(n, n, n + 1);
+    ASSERT_TRUE(Matrix(a * b) == NaiveProduct(a, b));
+  }
+  Matrix a = IntegerSample<double>(45, 100, 1);
+  Matrix b = IntegerSample<double>(77, 100, 2);
+  Matrix c = IntegerSample<double>(60, 90, 3), expected(c);
+  MatrixView block = MatrixView(c).Block(10, 5, 45, 77);
+  block -= a * Transposed(b);
+  Matrix product = NaiveProduct(a, b.Transpose());
+  for (int i = 0; i < 45; i++)
+    for (int j = 0; j < 77; j++) expected(10 + i, 5 + j) -= product(i, j);
+  ASSERT_TRUE(c == expected);
+  // The same on the serial schedule, which the first level takes too
+  // without threads for the seven products.
+  {
+    ThreadLimit serial(1);
+    Matrix d = IntegerSample<double>(90, 90, 4);
+    ASSERT_TRUE(d * d == NaiveProduct(d, d));
+  }
+  SetNumThreads(0);
+  SetStrassenCrossover(0);
+  ASSERT_FALSE(UseStrassen(1000, 1000, 1000));
+  Matrix e(4, 3);
+  EXPECT_THROW(StrassenGemm(e, e, Matrix(4, 3), 1.0, 2),
+               std::invalid_argument);
+}
+
+TEST(Strassen, test2) {
+  // Error against a long double reference, within the Winograd bound
+  // ((n / n0)^log2(18) (n0^2 + 6 n0) - 6n) u max|A| max|B| for leaves of
+  // order n0.
+  const int n = 300, crossover = 40;
+  Matrix a = SampleMatrix(n, n, 37), b = SampleMatrix(n, n, 38);
+  Matrix c(n, n);
+  StrassenGemm(a, b, c, 1.0, crossover);
+  Matrix classical = a * b;
+  double max_a = 0, max_b = 0, error = 0, classical_error = 0;
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) {
+      max_a = std::max(max_a, fabs(a(i, j)));
+      max_b = std::max(max_b, fabs(b(i, j)));
+      long double exact = 0;
+      for (int k = 0; k < n; k++) exact += (long double)a(i, k) * b(k, j);
+      error = std::max(error, (double)fabsl(c(i, j) - exact));
+      classical_error =
+          std::max(classical_error, (double)fabsl(classical(i, j) - exact));
+    }
+  // 300 halves three times to 38 after padding to 304.
+  const double n0 = 38, padded = 304;
+  const double bound = (pow(padded / n0, log2(18.0)) * (n0 * n0 + 6 * n0) -
+                        6 * padded) *
+                       DBL_EPSILON / 2 * max_a * max_b;
+  ASSERT_LT(error, bound);
+  ASSERT_LT(classical_error, n * DBL_EPSILON * max_a * max_b);
+  ASSERT_GT(error, 0);
+}
+
+TEST(Stats, test1) {
+  if (!StatsCompiled()) GTEST_SKIP() << "built with MATRIX_STATS=0";
+  ResetStats();
+  SetStatsEnabled(true);
+  Matrix a = SampleMatrix(40, 40, 39);
+  for (int i = 0; i < 40; i++) a(i, i) += 10;
+  Matrix b(a);
+  Matrix c = a * b;
+  c += a * b;
+  a.Determinant();
+  a.InverseMatrix();
+  SetStatsEnabled(false);
+  Matrix ignored(50, 50);
+  ignored = a * b;
+  const long bytes = 40 * Matrix::LeadingDimension(40) * sizeof(double);
+  OpStats mul = GetStats(StatsOp::kMulMatrix);
+  ASSERT_EQ(mul.calls, 2);
+  ASSERT_EQ(mul.sizes[5], 2);
+  ASSERT_EQ(mul.flops, 4.0 * 40 * 40 * 40);
+  ASSERT_EQ(mul.bytes_allocated, bytes);
+  ASSERT_GE(mul.seconds, 0);
+  // The LU and the inverse they allocate are charged to the outer call.
+  ASSERT_EQ(GetStats(StatsOp::kDeterminant).calls, 1);
+  ASSERT_GE(GetStats(StatsOp::kDeterminant).bytes_allocated, bytes);
+  ASSERT_EQ(GetStats(StatsOp::kInverseMatrix).calls, 1);
+  ASSERT_GE(GetStats(StatsOp::kInverseMatrix).bytes_allocated, 2 * bytes);
+  ASSERT_EQ(GetStats(StatsOp::kConstruct).calls, 1);
+  ASSERT_EQ(GetStats(StatsOp::kCopy).calls, 1);
+  ASSERT_EQ(GetStats(StatsOp::kCopy).bytes_allocated, bytes);
+  std::string json = StatsJson();
+  ASSERT_NE(json.find("\"MulMatrix\": {\"calls\": 2, "), std::string::npos);
+  ASSERT_NE(json.find("\"sizes\": {\"32\": 2}"), std::string::npos);
+  ASSERT_NE(json.find("\"enabled\": false"), std::string::npos);
+  ResetStats();
+  ASSERT_EQ(GetStats(StatsOp::kMulMatrix).calls, 0);
+  ASSERT_STREQ(StatsOpName(StatsOp::kOther), "Other");
+}
+
+// Largest element of |a - b|.
+static double MaxDifference(const Matrix& a, const Matrix& b) {
+  double result = 0;
+  for (int i = 0; i < a.GetRows(); i++)
+    for (int j = 0; j < a.GetCols(); j++)
+      result = std::max(result, fabs(a(i, j) - b(i, j)));
+  return result;
+}
+
+static Matrix Identity(int n) {
+  Matrix m(n, n);
+  for (int i = 0; i < n; i++) m(i, i) = 1;
+  return m;
+}
+
+TEST(SymmetricEigen, test1) {
+  for (int n : {1, 2, 3, 33, 150}) {
+    Matrix a = SampleMatrix(n, n, n);
+    Matrix sym = a + Transposed(a);
+    // Only the lower triangle is read.
+    Matrix lower(sym);
+    for (int i = 0; i < n; i++)
+      for (int j = i + 1; j < n; j++) lower(i, j) = NAN;
+    SymmetricEigen eigen(lower);
+    const std::vector<double>& values = eigen.GetValues();
+    const Matrix& v = eigen.GetVectors();
+    ASSERT_EQ(eigen.GetSize(), n);
+    ASSERT_TRUE(std::is_sorted(values.begin(), values.end()));
+    Matrix lambda(n, n);
+    for (int i = 0; i < n; i++) lambda(i, i) = values[i];
+    ASSERT_LT(MaxDifference(v * lambda * Transposed(v), sym), 1e-12 * n);
+    ASSERT_LT(MaxDifference(Transposed(v) * v, Identity(n)), 1e-13 * n);
+    std::vector<double> only = SymmetricEigen(sym, false).GetValues();
+    for (int i = 0; i < n; i++) ASSERT_NEAR(only[i], values[i], 1e-12 * n);
+    ASSERT_TRUE(SymmetricEigen(sym, false).GetVectors().GetRows() == 0);
+  }
+}
+
+TEST(SymmetricEigen, test2) {
+  // The second difference matrix has eigenvalues 2 - 2 cos(k pi / (n + 1)).
+  const int n = 100;
+  Matrix a(n, n);
+  for (int i = 0; i < n; i++) {
+    a(i, i) = 2;
+    if (i) a(i, i - 1) = a(i - 1, i) = -1;
+  }
+  std::vector<double> values = SymmetricEigen(a, false).GetValues();
+  for (int k = 1; k <= n; k++)
+    ASSERT_NEAR(values[k - 1], 2 - 2 * cos(k * M_PI / (n + 1)), 1e-13);
+  // Repeated eigenvalues still get an orthonormal basis.
+  SymmetricEigen identity(Identity(40) * 3);
+  for (double value : identity.GetValues()) ASSERT_DOUBLE_EQ(value, 3);
+  ASSERT_TRUE(Transposed(identity.GetVectors()) * identity.GetVectors() ==
+              Identity(40));
+  EXPECT_THROW(SymmetricEigen(Matrix(2, 3)), std::invalid_argument);
+  Matrix bad = Identity(3);
+  bad(2, 1) = INFINITY;
+  EXPECT_THROW(SymmetricEigen(bad, false), std::invalid_argument);
+}
+
+TEST(SVD, test1) {
+  for (auto [m, n] : {std::pair{1, 1}, {1, 5}, {5, 1}, {2, 2}, {40, 40},
+                      {130, 90}, {90, 130}}) {
+    Matrix a = SampleMatrix(m, n, m + n);
+    SVD svd(a);
+    const std::vector<double>& s = svd.GetValues();
+    const Matrix &u = svd.GetU(), &v = svd.GetV();
+    const int p = std::min(m, n);
+    ASSERT_EQ((int)s.size(), p);
+    ASSERT_EQ(u.GetRows(), m);
+    ASSERT_EQ(u.GetCols(), p);
+    ASSERT_EQ(v.GetRows(), n);
+    ASSERT_EQ(v.GetCols(), p);
+    ASSERT_TRUE(std::is_sorted(s.rbegin(), s.rend()));
+    ASSERT_GE(s.back(), 0);
+    Matrix sigma(p, p);
+    for (int i = 0; i < p; i++) sigma(i, i) = s[i];
+    ASSERT_LT(MaxDifference(u * sigma * Transposed(v), a), 1e-12 * (m + n));
+    ASSERT_LT(MaxDifference(Transposed(u) * u, Identity(p)), 1e-13 * (m + n));
+    ASSERT_LT(MaxDifference(Transposed(v) * v, Identity(p)), 1e-13 * (m + n));
+    // The squares of the singular values are the eigenvalues of A^T A.
+    std::vector<double> eigen = SymmetricEigen(Transposed(a) * a, false)
+                                    .GetValues();
+    for (int i = 0; i < p; i++)
+      ASSERT_NEAR(s[i] * s[i], eigen[n - 1 - i], 1e-11 * s[0] * s[0]);
+    std::vector<double> only = SVD(a, false).GetValues();
+    for (int i = 0; i < p; i++) ASSERT_NEAR(only[i], s[i], 1e-12 * s[0]);
+  }
+}
+
+TEST(SVD, test2) {
+  // Rank 2: the outer products of two vectors.
+  Matrix x = SampleMatrix(60, 2, 40), y = SampleMatrix(2, 45, 41);
+  SVD svd(x * y);
+  ASSERT_EQ(svd.Rank(), 2);
+  ASSERT_GT(svd.Condition(), 1e12);
+  Matrix sigma(45, 45);
+  for (int i = 0; i < 45; i++) sigma(i, i) = svd.GetValues()[i];
+  ASSERT_LT(MaxDifference(svd.GetU() * sigma * Transposed(svd.GetV()), x * y),
+            1e-12);
+  ASSERT_LT(MaxDifference(Transposed(svd.GetU()) * svd.GetU(), Identity(45)),
+            1e-12);
+  Matrix d(3, 3);
+  d(0, 0) = -4, d(1, 1) = 0.5, d(2, 2) = 2;
+  SVD diagonal(d);
+  ASSERT_DOUBLE_EQ(diagonal.GetValues()[0], 4);
+  ASSERT_DOUBLE_EQ(diagonal.GetValues()[2], 0.5);
+  ASSERT_DOUBLE_EQ(diagonal.Condition(), 8);
+  ASSERT_EQ(diagonal.Rank(), 3);
+  ASSERT_EQ(SVD(Matrix(4, 3)).Rank(), 0);
+  ASSERT_TRUE(std::isinf(SVD(Matrix(4, 3)).Condition()));
+}
+
+// SampleMatrix with everything outside the band zeroed.
+static Matrix BandSample(int n, Bandwidth band, int seed) {
+  Matrix m = SampleMatrix(n, n, seed);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++)
+      if (j - i > band.upper || i - j > band.lower) m(i, j) = 0;
+    m(i, i) += 4;
+  }
+  return m;
+}
+
+TEST(Structure, test1) {
+  const int n = 200;
+  Matrix tridiagonal = BandSample(n, {1, 1}, 1);
+  Bandwidth band = DetectBandwidth(tridiagonal);
+  ASSERT_EQ(band.lower, 1);
+  ASSERT_EQ(band.upper, 1);
+  ASSERT_TRUE(band.IsNarrow(n));
+  band = DetectBandwidth(MatrixView(BandSample(n, {0, n}, 2)).Transposed());
+  ASSERT_EQ(band.lower, n - 1);
+  ASSERT_EQ(band.upper, 0);
+  ASSERT_TRUE(DetectBandwidth(Matrix(3, 5)).IsDiagonal());
+  ASSERT_TRUE(IsSymmetric(SpdSample(40, 3)));
+  ASSERT_FALSE(IsSymmetric(SampleMatrix(40, 40, 3)));
+  ASSERT_FALSE(IsSymmetric(Matrix(2, 3)));
+  // Every fast path against the dense LU.
+  for (Bandwidth shape : {Bandwidth{0, 0}, Bandwidth{0, n}, Bandwidth{n, 0},
+                          Bandwidth{2, 5}, Bandwidth{7, 1}}) {
+    Matrix a = BandSample(n, shape, 4), b = SampleMatrix(n, 3, 5);
+    LU lu(a);
+    ASSERT_NEAR(a.Determinant() / lu.Determinant(), 1, 1e-9);
+    ASSERT_LT(MaxDifference(a.InverseMatrix(), lu.Inverse()), 1e-12);
+    BandLU band_lu(a);
+    ASSERT_EQ(band_lu.GetBandwidth().lower, std::min(shape.lower, n - 1));
+    ASSERT_LT(MaxDifference(band_lu.Solve(b), lu.Solve(b)), 1e-12);
+  }
+  Matrix spd = SpdSample(60, 6);
+  ASSERT_NEAR(spd.Determinant() / LU(spd).Determinant(), 1, 1e-9);
+  Matrix singular = BandSample(n, {1, 2}, 7);
+  for (int j = 0; j < n; j++) singular(5, j) = 0;
+  ASSERT_EQ(singular.Determinant(), 0);
+  ASSERT_TRUE(BandLU(singular).IsSingular());
+  EXPECT_THROW(singular.InverseMatrix(), std::invalid_argument);
+  Matrix upper = BandSample(50, {0, 50}, 8), rhs = SampleMatrix(50, 2, 9);
+  ASSERT_LT(MaxDifference(SolveTriangular(upper, rhs, Triangle::kUpper),
+                          LU(upper).Solve(rhs)),
+            1e-12);
+  // Only the named triangle is read.
+  Matrix lower = BandSample(50, {50, 0}, 10), full = lower;
+  for (int i = 0; i < 49; i++) full(i, i + 1) += 100;
+  ASSERT_LT(MaxDifference(SolveTriangular(full, rhs, Triangle::kLower),
+                          LU(lower).Solve(rhs)),
+            1e-12);
+  upper(3, 3) = 0;
+  EXPECT_THROW(SolveTriangular(upper, rhs, Triangle::kUpper),
+               std::invalid_argument);
+}
+
+TEST(Structure, test2) {
+  // Integer operands, so every path must agree with the naive product
+  // exactly.
+  const int n = 300;
+  Matrix a = IntegerSample<double>(n, 280, 1);
+  Matrix c = IntegerSample<double>(n, n, 2);
+  Matrix expected = c + NaiveProduct(a, a.Transpose());
+  c += a * Transposed(a);
+  ASSERT_TRUE(c == expected);
+  // Blocks of different heights of one matrix look like a and a^T but
+  // aren't.
+  Matrix square = IntegerSample<double>(n, n, 5);
+  MatrixView top = MatrixView(square).Block(0, 0, 150, n);
+  MatrixView taller = MatrixView(square).Block(0, 0, 180, n).Transposed();
+  ASSERT_TRUE(Matrix(top * taller) ==
+              NaiveProduct(Matrix(top), Matrix(taller)));
+  for (Bandwidth shape : {Bandwidth{0, 0}, Bandwidth{0, n}, Bandwidth{n, 0},
+                          Bandwidth{3, 2}}) {
+    Matrix band = BandSample(n, shape, 3);
+    Matrix dense = IntegerSample<double>(n, 70, 4);
+    for (int i = 0; i < n; i++) band(i, i) = i % 5 - 2;
+    ASSERT_TRUE(Matrix(band * dense) == NaiveProduct(band, dense));
+    Matrix left = dense.Transpose();
+    ASSERT_TRUE(Matrix(left * band) == NaiveProduct(left, band));
+    ASSERT_TRUE(Matrix(Transposed(band) * dense) ==
+                NaiveProduct(band.Transpose(), dense));
+  }
+}
+
+TEST(Structure, test3) {
+  const int n = 70;
+  Matrix spd = SpdSample(n, 11), b = SampleMatrix(n, 9, 12);
+  Matrix lower = BandSample(n, {n, 0}, 13), upper = BandSample(n, {0, n}, 14);
+  PackedMatrix packed[] = {PackedMatrix(spd, Packing::kSymmetric),
+                           PackedMatrix(lower, Packing::kLower),
+                           PackedMatrix(upper, Packing::kUpper)};
+  const Matrix* dense[] = {&spd, &lower, &upper};
+  for (int p = 0; p < 3; p++) {
+    ASSERT_EQ(packed[p].GetValues().size(), n * (n + 1) / 2);
+    ASSERT_TRUE(packed[p].ToDense() == *dense[p]);
+    ASSERT_LT(MaxDifference(packed[p] * b, *dense[p] * b), 1e-12);
+    ASSERT_LT(MaxDifference(packed[p].Solve(b), LU(*dense[p]).Solve(b)),
+              1e-12);
+    ASSERT_NEAR(packed[p].Determinant() / LU(*dense[p]).Determinant(), 1,
+                1e-9);
+  }
+  ASSERT_DOUBLE_EQ(packed[0](2, 9), spd(9, 2));
+  ASSERT_EQ(packed[1](2, 9), 0);
+  packed[0].At(2, 9) = 5;
+  ASSERT_EQ(packed[0](9, 2), 5);
+  EXPECT_THROW(packed[1].At(2, 9), std::out_of_range);
+  EXPECT_THROW(packed[2](0, n), std::out_of_range);
+  // Indefinite: solved dense.
+  Matrix indefinite = spd;
+  indefinite(0, 0) = -1;
+  PackedMatrix packed_indefinite(indefinite, Packing::kSymmetric);
+  ASSERT_LT(MaxDifference(packed_indefinite.Solve(b), LU(indefinite).Solve(b)),
+            1e-12);
+  EXPECT_THROW(PackedMatrix(Matrix(2, 3), Packing::kLower),
+               std::invalid_argument);
+  EXPECT_THROW(PackedMatrix(lower, Packing::kLower).MulMatrix(Matrix(3, 3)),
+               std::invalid_argument);
+}
+
+TEST(MixedPrecision, test1) {
+  for (int n : {1, 3, 70, 200}) {
+    Matrix a = BandSample(n, {n, n}, n), b = SampleMatrix(n, 5, n + 1);
+    FloatLU float_lu(MatrixCast<float>(a));
+    ASSERT_EQ(float_lu.GetSize(), n);
+    ASSERT_NEAR(float_lu.Determinant() / LU(a).Determinant(), 1, 1e-4);
+    BasicMatrix<float> float_x = float_lu.Solve(MatrixCast<float>(b));
+    ASSERT_LT(MaxDifference(MatrixCast<double>(float_x), LU(a).Solve(b)),
+              1e-4);
+    // Refined to double accuracy in a few steps, for one column and many.
+    for (int m : {1, 5}) {
+      Matrix rhs = MatrixView(b).Block(0, 0, n, m);
+      Refinement refinement;
+      Matrix x = Solve(a, rhs, Precision::kMixed, &refinement);
+      ASSERT_FALSE(refinement.fallback);
+      ASSERT_LE(refinement.iterations, 4);
+      ASSERT_LT(refinement.residual, 1e-15 * sqrt(n) + 1e-16);
+      ASSERT_LT(BackwardError(a, x, rhs), 1e-15 * sqrt(n) + 1e-16);
+      ASSERT_LT(MaxDifference(x, LU(a).Solve(rhs)), 1e-12);
+    }
+  }
+  Refinement refinement;
+  Matrix spd = SpdSample(30, 2), b = SampleMatrix(30, 2, 3);
+  Matrix x = Solve(spd, b, Precision::kDouble, &refinement);
+  ASSERT_TRUE(x == Solve(spd, b));
+  ASSERT_LT(refinement.residual, 1e-15);
+  ASSERT_EQ(refinement.iterations, 0);
+  EXPECT_THROW(Solve(Matrix(3, 2), Matrix(3, 1), Precision::kMixed),
+               std::invalid_argument);
+  EXPECT_THROW(MixedLU(Identity(3)).Solve(Matrix(2, 1)),
+               std::invalid_argument);
+}
+
+TEST(MixedPrecision, test2) {
+  const int n = 150;
+  Matrix a = BandSample(n, {n, n}, 4);
+  Refinement refinement;
+  Matrix inverse = a.InverseMatrix(Precision::kMixed, &refinement);
+  ASSERT_FALSE(refinement.fallback);
+  ASSERT_LT(MaxDifference(inverse, a.InverseMatrix()), 1e-12);
+  a.InverseMatrix(Precision::kDouble, &refinement);
+  ASSERT_LT(refinement.residual, 1e-15);
+  // Too badly conditioned for float: the Hilbert matrix, cond(A) ~ 1e16.
+  Matrix hilbert(12, 12);
+  for (int i = 0; i < 12; i++)
+    for (int j = 0; j < 12; j++) hilbert(i, j) = 1.0 / (i + j + 1);
+  Matrix b = SampleMatrix(12, 2, 5);
+  Matrix x = MixedLU(hilbert).Solve(b, &refinement);
+  ASSERT_TRUE(refinement.fallback);
+  ASSERT_TRUE(x == LU(hilbert).Solve(b));
+  // Out of float's range: the factors overflow.
+  Matrix huge = Identity(5) * 1e50, rhs = MatrixView(b).Block(0, 0, 5, 2);
+  MixedLU huge_lu(huge);
+  ASSERT_DOUBLE_EQ(huge_lu.Determinant(), pow(1e50, 5));
+  ASSERT_TRUE(huge_lu.Solve(rhs, &refinement) == LU(huge).Solve(rhs));
+  ASSERT_TRUE(refinement.fallback);
+  Matrix singular = SampleMatrix(4, 4, 6);
+  for (int j = 0; j < 4; j++) singular(2, j) = singular(1, j);
+  EXPECT_THROW(singular.InverseMatrix(Precision::kMixed),
+               std::invalid_argument);
+  EXPECT_THROW(Matrix(2, 3).InverseMatrix(Precision::kMixed),
+               std::invalid_argument);
+}
+
+TEST(MatrixAsync, test1) {
+  const int n = 90;
+  Matrix a = BandSample(n, {n, n}, 1), b = SampleMatrix(n, n, 2);
+  // Started together, finished in any order.
+  std::future<Matrix> product = MulMatrixAsync(a, b);
+  std::future<Matrix> inverse = InverseAsync(a);
+  std::future<Matrix> sum = SumMatrixAsync(a, b);
+  std::future<Matrix> difference = SubMatrixAsync(a, b);
+  std::future<Matrix> scaled = MulNumberAsync(a, 3);
+  std::future<Matrix> transposed = TransposeAsync(b);
+  std::future<double> determinant = DeterminantAsync(a);
+  std::future<Matrix> solution = SolveAsync(a, b);
+  ASSERT_TRUE(solution.get() == Solve(a, b));
+  ASSERT_DOUBLE_EQ(determinant.get(), a.Determinant());
+  ASSERT_TRUE(transposed.get() == b.Transpose());
+  ASSERT_TRUE(scaled.get() == a * 3);
+  ASSERT_TRUE(difference.get() == a - b);
+  ASSERT_TRUE(sum.get() == a + b);
+  ASSERT_TRUE(inverse.get() == a.InverseMatrix());
+  ASSERT_TRUE(product.get() == a * b);
+  EXPECT_THROW(InverseAsync(Matrix(2, 3)).get(), std::invalid_argument);
+  EXPECT_THROW(MulMatrixAsync(Matrix(2, 3), Matrix(2, 3)).get(),
+               std::invalid_argument);
+}
+
+// Resizing drops the pool while its workers still run products on it; the
+// last of them mustn't have to join itself.
+TEST(MatrixAsync, test2) {
+  Matrix a = SampleMatrix(120, 120, 3), expected = a * a;
+  long saved_threshold = GetParallelThreshold();
+  SetParallelThreshold(1);
+  for (int round = 0; round < 200; round++) {
+    SetNumThreads(4);
+    std::vector<std::future<Matrix>> products;
+    for (int i = 0; i < 4; i++) products.push_back(MulMatrixAsync(a, a));
+    SetNumThreads(3);
+    for (std::future<Matrix>& product : products)
+      ASSERT_TRUE(product.get() == expected);
+  }
+  SetParallelThreshold(saved_threshold);
+  SetNumThreads(0);
+}
+
+TEST(MatrixGraph, test1) {
+  const int n = 120;
+  Matrix a = BandSample(n, {n, n}, 3), b = SampleMatrix(n, n, 4);
+  Matrix c = SampleMatrix(n, n, 5);
+  MatrixGraph graph;
+  const int x = graph.Input(a), y = graph.Input(b), z = graph.Input(c);
+  // xy and yz are independent; both die once s is formed, and s once t is,
+  // so t and u get their buffers.
+  const int xy = graph.Mul(x, y), yz = graph.Mul(y, z);
+  const int s = graph.Sum(xy, yz), t = graph.Transpose(s);
+  const int u = graph.Sub(graph.MulNumber(t, 2), z);
+  const int v = graph.Solve(x, u), w = graph.Inverse(x);
+  graph.Keep(u);
+  graph.Run();
+  Matrix expected_u = Matrix(a * b + b * c).Transpose() * 2 - c;
+  ASSERT_TRUE(graph.Get(u) == expected_u);
+  ASSERT_TRUE(graph.Get(v) == Solve(a, expected_u));
+  ASSERT_TRUE(graph.Get(w) == a.InverseMatrix());
+  ASSERT_TRUE(graph.Get(x) == a);
+  ASSERT_GE(graph.GetReusedBuffers(), 2);
+  EXPECT_THROW(graph.Get(xy), std::out_of_range);
+  EXPECT_THROW(graph.Mul(s, x), std::invalid_argument);
+  // Kept results feed a second run.
+  const int uw = graph.Mul(w, u);
+  graph.Run();
+  ASSERT_TRUE(graph.Get(uw) == a.InverseMatrix() * expected_u);
+  ASSERT_EQ(graph.GetSize(), 12);
+}
+
+TEST(MatrixGraph, test2) {
+  MatrixGraph graph;
+  const int wide = graph.Input(Matrix(2, 3));
+  const int square = graph.Input(Matrix(3, 3));
+  EXPECT_THROW(graph.Mul(wide, wide), std::invalid_argument);
+  EXPECT_THROW(graph.Sum(wide, square), std::invalid_argument);
+  EXPECT_THROW(graph.Inverse(wide), std::invalid_argument);
+  EXPECT_THROW(graph.Solve(square, wide), std::invalid_argument);
+  EXPECT_THROW(graph.Transpose(7), std::out_of_range);
+  // A singular inverse fails the run; what depends on it never runs.
+  const int inverse = graph.Inverse(square);
+  const int product = graph.Mul(wide, inverse);
+  EXPECT_THROW(graph.Run(), std::invalid_argument);
+  EXPECT_THROW(graph.Get(product), std::out_of_range);
+  EXPECT_THROW(graph.Get(inverse), std::out_of_range);
+}
+
+TEST(Numa, test1) {
+  const int nodes = GetNumaNodes();
+  ASSERT_GE(nodes, 1);
+  for (int node = 0; node < nodes; node++) {
+    const std::vector<int>& cpus = GetNodeCpus(node);
+    ASSERT_TRUE(std::is_sorted(cpus.begin(), cpus.end()));
+  }
+  EXPECT_THROW(GetNodeCpus(nodes), std::invalid_argument);
+  EXPECT_THROW(NumaAllocator(NumaPolicy::kBind, -1), std::invalid_argument);
+  for (NumaPolicy policy : {NumaPolicy::kFirstTouch, NumaPolicy::kInterleave,
+                            NumaPolicy::kBind}) {
+    NumaAllocator numa(policy, nodes - 1);
+    ASSERT_EQ(numa.GetPolicy(), policy);
+    // Mapped blocks come back untouched.
+    void* block = numa.Allocate(NumaAllocator::kNumaMinBlock);
+    ASSERT_EQ((std::uintptr_t)block % kMatrixAlignment, 0u);
+    ASSERT_EQ(GetPageNode(block), -1);
+    numa.Deallocate(block, NumaAllocator::kNumaMinBlock);
+    {
+      AllocatorScope scope(&numa);
+      Matrix big = SampleMatrix(400, 400, 60), small = SampleMatrix(5, 6, 61);
+      Matrix zero(400, 400), copy(big);
+      ASSERT_TRUE(copy == big);
+      ASSERT_TRUE(big + zero == big);
+      ASSERT_DOUBLE_EQ(Matrix(small * 2.0)(4, 5), 2 * small(4, 5));
+      const int node = GetPageNode(big.GetData());
+      ASSERT_TRUE(node >= -1 && node < nodes);
+      if (policy == NumaPolicy::kBind && node >= 0) {
+        ASSERT_EQ(node, nodes - 1);
+      }
+    }
+  }
+}
+
+// Pinned workers and the parallel first touch of new matrices.
+TEST(Numa, test2) {
+  Matrix a = SampleMatrix(120, 130, 62), b = SampleMatrix(130, 110, 63);
+  Matrix expected;
+  {
+    ThreadLimit serial(1);
+    expected = a * b;
+  }
+  long saved_threshold = GetParallelThreshold();
+  SetThreadPinning(true);
+  SetNumThreads(3);
+  SetParallelThreshold(1);
+  ASSERT_TRUE(GetThreadPinning());
+  ASSERT_TRUE(a * b == expected);
+  Matrix copy(a), zero(300, 200);
+  ASSERT_TRUE(copy == a);
+  for (int i = 0; i < 300; i++) ASSERT_DOUBLE_EQ(zero(i, i % 200), 0);
+  Matrix narrow = a;
+  narrow.SetCols(3);
+  ASSERT_DOUBLE_EQ(narrow(119, 2), a(119, 2));
+  SetParallelThreshold(saved_threshold);
+  SetNumThreads(0);
+  SetThreadPinning(false);
+  ASSERT_FALSE(GetThreadPinning());
+}
+
 int main(int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();